@@ -16,20 +16,42 @@
  * =====================================================================================
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #if defined __SSE2__ || _M_IX86_FP == 2
 #include <emmintrin.h>
 #endif
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define LDGM_XOR_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
 #include <string.h>
+#include <thread>
 #include <time.h>
+#include <vector>
 
 #include "ldgm-session-cpu.h"
 #include "timer-util.h"
+#ifdef HAVE_CONFIG_H // built as a part of UltraGrid
+#include "utils/worker.h"
+#endif
+
+/// minimal amount of data XORed by one encoder worker
+#define MIN_ENCODE_BYTES_PER_WORKER (512 * 1024)
 
 using namespace std;
 
-#ifdef _WIN32
+#ifdef HAVE_CONFIG_H
+// aligned_malloc() and aligned_free() defined in UltraGrid config headers
+#elif defined _WIN32
 #define aligned_malloc _aligned_malloc
 #define aligned_free _aligned_free
 #else
@@ -53,6 +75,28 @@ static inline void *aligned_malloc(size_t size, size_t alignment)
 #endif
 
 
+/**
+ * Portable variant XORing 8 bytes at once (compilers are able to vectorize
+ * this loop, unlike the byte-per-byte one).
+ */
+static char*
+xor_using_words (char* source, char* dest, int packet_size)
+{
+    int i = 0;
+    for ( ; i + 8 <= packet_size; i += 8)
+    {
+        uint64_t s, d;
+        memcpy(&s, source + i, 8);
+        memcpy(&d, dest + i, 8);
+        d ^= s;
+        memcpy(dest + i, &d, 8);
+    }
+    for ( ; i < packet_size; i++)
+        dest[i] ^= source[i];
+
+    return dest;
+}
+
 static char*
 xor_using_sse (char* source, char* dest, int packet_size)
 {
@@ -76,8 +120,6 @@ xor_using_sse (char* source, char* dest, int packet_size)
     // }
     //First, do as many 128-bit XORs as possible
     int iter_bytes_16 = 0;
-    int iter_bytes_4 = 0;
-    int iter_bytes_1 = 0;
 #if defined __SSE2__ || _M_IX86_FP == 2
     iter_bytes_16 = (packet_size/16)*16;
 
@@ -106,32 +148,153 @@ xor_using_sse (char* source, char* dest, int packet_size)
     //Check, whether further XORing is necessary
     if ( iter_bytes_16 < packet_size )
     {
-        char *mark_source = source + iter_bytes_16;
-        char *mark_dest = dest + iter_bytes_16;
+        xor_using_words(source + iter_bytes_16, dest + iter_bytes_16,
+                packet_size - iter_bytes_16);
+    }
 
-        iter_bytes_4 = ((packet_size - iter_bytes_16)/4)*4;
+    return dest;
+}
 
-        for ( int i = 0; i < (packet_size - iter_bytes_16)/4; i++)
-        {
-            int *s = ((int*) mark_source) + i;
-            int *d = ((int*) mark_dest) + i;
-            *d ^= *s;
-        }
+#ifdef LDGM_XOR_X86_DISPATCH
+__attribute__((target("avx2")))
+static char*
+xor_using_avx2 (char* source, char* dest, int packet_size)
+{
+    int i = 0;
+    for ( ; i + 64 <= packet_size; i += 64)
+    {
+        __m256i s0 = _mm256_loadu_si256((const __m256i *) (source + i));
+        __m256i s1 = _mm256_loadu_si256((const __m256i *) (source + i + 32));
+        __m256i d0 = _mm256_loadu_si256((const __m256i *) (dest + i));
+        __m256i d1 = _mm256_loadu_si256((const __m256i *) (dest + i + 32));
+        _mm256_storeu_si256((__m256i *) (dest + i), _mm256_xor_si256(s0, d0));
+        _mm256_storeu_si256((__m256i *) (dest + i + 32), _mm256_xor_si256(s1, d1));
+    }
+    // avoid AVX-SSE transition penalty in the (non-VEX) tail
+    _mm256_zeroupper();
+    if (i < packet_size)
+        xor_using_words(source + i, dest + i, packet_size - i);
 
-        mark_source += iter_bytes_4;
-        mark_dest += iter_bytes_4;
+    return dest;
+}
 
-        iter_bytes_1 = packet_size - iter_bytes_16 - iter_bytes_4;
+#if __GNUC__ >= 5 || defined __clang__
+__attribute__((target("avx512f")))
+static char*
+xor_using_avx512 (char* source, char* dest, int packet_size)
+{
+    int i = 0;
+    for ( ; i + 128 <= packet_size; i += 128)
+    {
+        __m512i s0 = _mm512_loadu_si512(source + i);
+        __m512i s1 = _mm512_loadu_si512(source + i + 64);
+        __m512i d0 = _mm512_loadu_si512(dest + i);
+        __m512i d1 = _mm512_loadu_si512(dest + i + 64);
+        _mm512_storeu_si512(dest + i, _mm512_xor_si512(s0, d0));
+        _mm512_storeu_si512(dest + i + 64, _mm512_xor_si512(s1, d1));
+    }
+    _mm256_zeroupper();
+    if (i < packet_size)
+        xor_using_words(source + i, dest + i, packet_size - i);
 
-        for ( int i = 0; i < iter_bytes_1; i++)
-        {
-            *(mark_dest + i) ^= *(mark_source+i);
+    return dest;
+}
+#endif
+#endif // defined LDGM_XOR_X86_DISPATCH
+
+typedef char *(*xor_func_t)(char* source, char* dest, int packet_size);
+
+static xor_func_t select_xor_func()
+{
+#ifdef LDGM_XOR_X86_DISPATCH
+    __builtin_cpu_init();
+#if __GNUC__ >= 5 || defined __clang__
+    if (__builtin_cpu_supports("avx512f"))
+        return xor_using_avx512;
+#endif
+    if (__builtin_cpu_supports("avx2"))
+        return xor_using_avx2;
+#endif
+    return xor_using_sse;
+}
+
+/// XOR of source into dest using the best kernel for current CPU
+static const xor_func_t xor_packet = select_xor_func();
+
+namespace {
+struct ldgm_encode_data {
+    const int *pcm;
+    int pcm_row_len;
+    int param_k;
+    int packet_size;
+    char *data_ptr;
+    char *parity_ptr;
+    int m_start;        ///< first parity row computed by the worker
+    int m_end;          ///< one after last parity row
+    char *carry;        ///< XOR of all parity rows preceding m_start
+};
+}
+
+/**
+ * Computes parity rows [m_start, m_end). Because of the staircase, each parity
+ * packet is XOR of its row with the previous parity packet. This computes only
+ * the part of the chain starting at m_start, the rest is added by
+ * ldgm_encode_apply_carry.
+ */
+static void *ldgm_encode_rows(void *arg)
+{
+    struct ldgm_encode_data *d = (struct ldgm_encode_data *) arg;
+
+    for ( int m = d->m_start; m < d->m_end; ++m) {
+        char *parity_packet = d->parity_ptr + m * d->packet_size;
+        if (m == d->m_start) {
+            memset(parity_packet, 0, d->packet_size);
+        } else {
+            memcpy(parity_packet, parity_packet - d->packet_size, d->packet_size);
+        }
+
+        //Find out which packets to XOR
+        for ( int k = 0; k < d->pcm_row_len; ++k) {
+            int idx = d->pcm[m * d->pcm_row_len + k];
+            if (idx > -1 && idx < d->param_k) {
+                xor_packet(d->data_ptr + idx * d->packet_size, parity_packet, d->packet_size);
+            }
         }
     }
 
-//   printf ( "XORed: %d bytes using SSE, %d bytes as ints and %d bytes byte-per-byte.\n",iter_bytes_16, iter_bytes_4, iter_bytes_1);
+    return NULL;
+}
 
-    return dest;
+static void *ldgm_encode_apply_carry(void *arg)
+{
+    struct ldgm_encode_data *d = (struct ldgm_encode_data *) arg;
+
+    for ( int m = d->m_start; m < d->m_end; ++m) {
+        xor_packet(d->carry, d->parity_ptr + m * d->packet_size, d->packet_size);
+    }
+
+    return NULL;
+}
+
+/**
+ * Runs func for each of count items of data in parallel and waits for all of
+ * them. UltraGrid worker pool is used if available, otherwise the first item
+ * is processed in the calling thread and the others in new threads.
+ */
+static void run_parallel(void *(*func)(void *), struct ldgm_encode_data *data, int count)
+{
+#ifdef HAVE_CONFIG_H
+    task_run_parallel(func, count, data, sizeof data[0], NULL);
+#else
+    std::vector<std::thread> threads;
+    for ( int i = 1; i < count; ++i) {
+        threads.emplace_back(func, &data[i]);
+    }
+    func(&data[0]);
+    for (auto &t : threads) {
+        t.join();
+    }
+#endif
 }
 
 void *
@@ -150,41 +313,45 @@ LDGM_session_cpu::alloc_buf (int buf_size)
 void
 LDGM_session_cpu::encode ( char* data_ptr, char* parity_ptr )
 {
-//    start encoding
-   // printf ( "packet_size: %d\n", this->packet_size );
-
-    char *parity_packet;
-
-	parity_packet = (char *) aligned_malloc(packet_size, 16);
-	if (!parity_packet)
-	{
-		printf ( "Error while using posix_memalign\n" );
-		return;
-	}
-	memset(parity_packet, 0, packet_size);
-
-    for ( int m = 0; m < param_m; ++m) {
-//	printf ( "m: %d\n", m );
-
-//	printf ( "max w: %d\n", max_row_weight );
-        //Find out which packets to XOR
-        for ( int k = 0; k < max_row_weight+2; ++k) {
-            int idx = pcm[m*(max_row_weight+2) + k];
-//	    printf ( "adept: %d\n", idx );
-            if (idx > -1 && idx < param_k) {
-//		printf ( "xoring idx: %d\n", idx );
-                char *ptr = data_ptr + idx*packet_size;
-                parity_packet = xor_using_sse(ptr, parity_packet, packet_size);
-            }
-        }
+    int workers = std::min<long>(std::max(std::thread::hardware_concurrency(), 1u),
+            (long) param_k * packet_size / MIN_ENCODE_BYTES_PER_WORKER);
+    workers = std::max(std::min(workers, (int) param_m), 1);
+
+    std::vector<struct ldgm_encode_data> data(workers);
+    for ( int i = 0; i < workers; ++i) {
+        data[i].pcm = pcm;
+        data[i].pcm_row_len = max_row_weight + 2;
+        data[i].param_k = param_k;
+        data[i].packet_size = packet_size;
+        data[i].data_ptr = data_ptr;
+        data[i].parity_ptr = parity_ptr;
+        data[i].m_start = param_m * i / workers;
+        data[i].m_end = param_m * (i + 1) / workers;
+        data[i].carry = NULL;
+    }
 
-        //Add the new parity packet to overall parity
-        memcpy ( parity_ptr + m*packet_size, parity_packet, packet_size );
+    if (workers == 1) {
+        ldgm_encode_rows(&data[0]);
+        return;
     }
 
-	aligned_free(parity_packet);
+    run_parallel(ldgm_encode_rows, data.data(), workers);
 
-    return ;
+    // parity rows of each worker need to be XORed with the last parity packet
+    // of the previous worker - compute those (carry) for all workers
+    char *carry = (char *) alloc_buf(packet_size * workers);
+    if (!carry) {
+        return;
+    }
+    memset(carry, 0, packet_size);
+    for ( int i = 1; i < workers; ++i) {
+        char *c = carry + i * packet_size;
+        memcpy(c, c - packet_size, packet_size);
+        xor_packet(parity_ptr + (data[i - 1].m_end - 1) * packet_size, c, packet_size);
+        data[i].carry = c;
+    }
+    run_parallel(ldgm_encode_apply_carry, data.data() + 1, workers - 1);
+    aligned_free(carry);
 }		/* -----  end of method LDGM_session_cpu::encode  ----- */
 
 void
@@ -217,18 +384,14 @@ LDGM_session_cpu::encode_naive ( char* data_ptr, char* parity_ptr )
             int idx = pcm[m*(max_row_weight+2) + k];
             if (idx > -1 && idx < param_k) {
                 char *ptr = data_ptr + idx*packet_size;
-//		parity_packet = xor_using_sse(ptr, parity_packet, packet_size);
-                for ( int i = 0; i < packet_size; i++)
-                    parity_packet[i] ^= *(ptr+i);
+                xor_packet(ptr, parity_packet, packet_size);
             }
         }
 
         //Apply inverted staircase matrix
         if( m > 0) {
             char *prev_parity = parity_ptr + (m-1)*packet_size;
-//	    parity_packet = xor_using_sse(prev_parity, parity_packet, packet_size);
-            for ( int i = 0; i < packet_size; i++)
-                parity_packet[i] ^= *(prev_parity+i);
+            xor_packet(prev_parity, parity_packet, packet_size);
         }
 
 
@@ -484,7 +647,7 @@ LDGM_session_cpu::iterate ( Tanner_graph *graph )
 //		    printf ( "decode, packet_size: %d\n", packet_size );
                     char *g_data = (graph->nodes.find(*j))->second.getDataPtr();
                     //XOR
-                    xor_using_sse(g_data, r_data, packet_size);
+                    xor_packet(g_data, r_data, packet_size);
                     count++;
                 }
             }
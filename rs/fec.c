@@ -10,6 +10,11 @@
 #include <string.h>
 #include <assert.h>
 
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define GF_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
 /*
  * Primitive polynomials - see Lin & Costello, Appendix A,
  * and  Lee & Messerschmitt, p. 453.
@@ -166,7 +171,7 @@ generate_gf (void) {
  * calls are unfrequent in my typical apps so I did not bother.
  */
 #define addmul(dst, src, c, sz)                 \
-    if (c != 0) _addmul1(dst, src, c, sz)
+    if (c != 0) { if (sz < 16) _addmul1(dst, src, c, sz); else _addmul(dst, src, c, sz); }
 
 #define UNROLL 16               /* 1, 4, 8, 16 */
 static void
@@ -205,6 +210,78 @@ _addmul1(gf*restrict dst, const gf*restrict src, gf c, size_t sz) {
         GF_ADDMULC (*dst, *src);
 }
 
+#ifdef GF_SIMD_X86
+/*
+ * SIMD variants of _addmul1() - multiplication by a constant in GF(2^8) is
+ * linear so c * x = c * (x & 0xf) ^ c * (x & 0xf0). Both halves have only 16
+ * possible values that fit in a vector register and can be looked up with
+ * PSHUFB for 16 or 32 bytes at once.
+ */
+static gf gf_mul_lo[256][16] __attribute__((aligned(16))); /* c * i        */
+static gf gf_mul_hi[256][16] __attribute__((aligned(16))); /* c * (i << 4) */
+
+static void
+_init_mul_nibble_tables(void) {
+    int c, i;
+    for (c = 0; c < 256; c++) {
+        for (i = 0; i < 16; i++) {
+            gf_mul_lo[c][i] = gf_mul (c, i);
+            gf_mul_hi[c][i] = gf_mul (c, i << 4);
+        }
+    }
+}
+
+__attribute__((target("ssse3")))
+static void
+_addmul_ssse3(gf*restrict dst, const gf*restrict src, gf c, size_t sz) {
+    const __m128i lo_tbl = _mm_load_si128((const __m128i *) gf_mul_lo[c]);
+    const __m128i hi_tbl = _mm_load_si128((const __m128i *) gf_mul_hi[c]);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i lo = _mm_shuffle_epi8(lo_tbl, _mm_and_si128(x, mask));
+        __m128i hi = _mm_shuffle_epi8(hi_tbl, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+        __m128i d = _mm_loadu_si128((const __m128i *) (dst + i));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_xor_si128(d, _mm_xor_si128(lo, hi)));
+    }
+    if (i < sz)
+        _addmul1(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("avx2")))
+static void
+_addmul_avx2(gf*restrict dst, const gf*restrict src, gf c, size_t sz) {
+    const __m256i lo_tbl = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf_mul_lo[c]));
+    const __m256i hi_tbl = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) gf_mul_hi[c]));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 64 <= sz; i += 64) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *) (src + i + 32));
+        __m256i p0 = _mm256_xor_si256(
+                _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(x0, mask)),
+                _mm256_shuffle_epi8(hi_tbl, _mm256_and_si256(_mm256_srli_epi64(x0, 4), mask)));
+        __m256i p1 = _mm256_xor_si256(
+                _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(x1, mask)),
+                _mm256_shuffle_epi8(hi_tbl, _mm256_and_si256(_mm256_srli_epi64(x1, 4), mask)));
+        __m256i d0 = _mm256_loadu_si256((const __m256i *) (dst + i));
+        __m256i d1 = _mm256_loadu_si256((const __m256i *) (dst + i + 32));
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_xor_si256(d0, p0));
+        _mm256_storeu_si256((__m256i *) (dst + i + 32), _mm256_xor_si256(d1, p1));
+    }
+    /* avoid AVX-SSE transition penalty in the (non-VEX) SSSE3 tail */
+    _mm256_zeroupper();
+    if (i < sz)
+        _addmul_ssse3(dst + i, src + i, c, sz - i);
+}
+#endif /* GF_SIMD_X86 */
+
+typedef void (*addmul_func_t)(gf*restrict dst, const gf*restrict src, gf c, size_t sz);
+static addmul_func_t _addmul = _addmul1;
+
 /*
  * computes C = AB where A is n*k, B is k*m, C is n*m
  */
@@ -400,6 +477,14 @@ static void
 init_fec (void) {
     generate_gf();
     _init_mul_table();
+#ifdef GF_SIMD_X86
+    _init_mul_nibble_tables();
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        _addmul = _addmul_avx2;
+    else if (__builtin_cpu_supports("ssse3"))
+        _addmul = _addmul_ssse3;
+#endif
     fec_initialized = 1;
 }
 
@@ -512,10 +597,20 @@ build_decode_matrix_into_space(const fec_t*restrict const code, const unsigned*c
 void
 fec_decode(const fec_t* code, const gf*restrict const*restrict const inpkts, gf*restrict const*restrict const outpkts, const unsigned*restrict const index, size_t sz) {
     gf* m_dec = (gf*)alloca(code->k * code->k);
+    fec_build_decode_matrix(code, index, m_dec);
+    fec_decode_with_matrix(code, m_dec, inpkts, outpkts, index, sz);
+}
+
+void
+fec_build_decode_matrix(const fec_t* code, const unsigned*restrict const index, gf*restrict const matrix) {
+    build_decode_matrix_into_space(code, index, code->k, matrix);
+}
+
+void
+fec_decode_with_matrix(const fec_t* code, const gf*restrict const m_dec, const gf*restrict const*restrict const inpkts, gf*restrict const*restrict const outpkts, const unsigned*restrict const index, size_t sz) {
     unsigned char outix=0;
     unsigned char row=0;
     unsigned char col=0;
-    build_decode_matrix_into_space(code, index, code->k, m_dec);
 
     for (row=0; row<code->k; row++) {
         assert ((index[row] >= code->k) || (index[row] == row)); /* If the block whose number is i is present, then it is required to be in the i'th element. */
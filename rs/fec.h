@@ -42,6 +42,16 @@ void fec_encode(const fec_t* code, const gf*restrict const*restrict const src, g
  */
 void fec_decode(const fec_t* code, const gf*restrict const*restrict const inpkts, gf*restrict const*restrict const outpkts, const unsigned*restrict const index, size_t sz);
 
+/**
+ * The same as fec_decode() split into two steps - building (inverting) the
+ * decode matrix and the decoding itself. This allows decoding disjoint
+ * column ranges of the blocks in parallel with a single matrix.
+ *
+ * @param matrix k*k bytes long space for the decode matrix
+ */
+void fec_build_decode_matrix(const fec_t* code, const unsigned*restrict const index, gf*restrict const matrix);
+void fec_decode_with_matrix(const fec_t* code, const gf*restrict const matrix, const gf*restrict const*restrict const inpkts, gf*restrict const*restrict const outpkts, const unsigned*restrict const index, size_t sz);
+
 #if defined(_MSC_VER)
 #define alloca _alloca
 #else
@@ -1002,10 +1002,6 @@ static void *audio_sender_thread(void *arg)
                                                 supp_sample_rates);
                         }
                         if (resample_to != 0 && bf_n.get_sample_rate() != s->resample_to) {
-                                if (bf_n.get_bps() != 2) {
-                                        bf_n.change_bps(2);
-                                }
-
                                 bf_n.resample(resampler_state, resample_to);
                         }
                         // COMPRESS
@@ -45,8 +45,10 @@
 #include "audio/audio.h"
 #include "audio/utils.h"
 #include "debug.h"
+#include "host.h"
 #include <speex/speex_resampler.h>
 
+#include <cstring>
 #include <sstream>
 #include <stdexcept>
 
@@ -319,20 +321,34 @@ void  audio_frame2::change_bps(int new_bps)
         channels = move(new_channels);
 }
 
+ADD_TO_PARAM(resampler_quality, "resampler-quality", "* resampler-quality={0-10|voip|desktop|max}\n"
+                "  Audio resampler quality (default max). Lower values decrease latency and CPU usage.\n");
+static int get_resampler_quality()
+{
+        const char *val = get_commandline_param("resampler-quality");
+        if (val == nullptr || strcmp(val, "max") == 0) {
+                return SPEEX_RESAMPLER_QUALITY_MAX;
+        }
+        if (strcmp(val, "voip") == 0) {
+                return SPEEX_RESAMPLER_QUALITY_VOIP;
+        }
+        if (strcmp(val, "desktop") == 0) {
+                return SPEEX_RESAMPLER_QUALITY_DESKTOP;
+        }
+        int quality = atoi(val);
+        if (quality < SPEEX_RESAMPLER_QUALITY_MIN || quality > SPEEX_RESAMPLER_QUALITY_MAX) {
+                LOG(LOG_LEVEL_WARNING) << "Wrong resampler quality " << val << ", using max.\n";
+                return SPEEX_RESAMPLER_QUALITY_MAX;
+        }
+        return quality;
+}
+
 void audio_frame2::resample(audio_frame2_resampler & resampler_state, int new_sample_rate)
 {
         if (new_sample_rate == sample_rate) {
                 return;
         }
 
-        /// @todo
-        /// speex supports also floats so there could be possibility also to add support for more bps
-        if (bps != 2) {
-                throw logic_error("Only 16 bits per sample are currently for resampling supported!");
-        }
-
-        std::vector<channel> new_channels(channels.size());
-
         if (sample_rate != resampler_state.resample_from || new_sample_rate != resampler_state.resample_to || channels.size() != resampler_state.resample_ch_count) {
                 if (resampler_state.resampler) {
                         speex_resampler_destroy((SpeexResamplerState *) resampler_state.resampler);
@@ -340,11 +356,8 @@ void audio_frame2::resample(audio_frame2_resampler & resampler_state, int new_sa
                 resampler_state.resampler = nullptr;
 
                 int err;
-                /// @todo
-                /// Consider lower quality than 10 (max). This will improve both latency and
-                /// performance.
                 resampler_state.resampler = speex_resampler_init(channels.size(), sample_rate,
-                                new_sample_rate, 10, &err);
+                                new_sample_rate, get_resampler_quality(), &err);
                 if(err) {
                         abort();
                 }
@@ -353,33 +366,42 @@ void audio_frame2::resample(audio_frame2_resampler & resampler_state, int new_sa
                 resampler_state.resample_ch_count = channels.size();
         }
 
-        for (size_t i = 0; i < channels.size(); i++) {
-                // allocate new storage + 10 ms headroom
-                size_t new_size = channels[i].len * new_sample_rate / sample_rate + new_sample_rate * sizeof(int16_t) / 100;
-                new_channels[i] = {unique_ptr<char []>(new char[new_size]), new_size, new_size};
-        }
-
         /// @todo
         /// Consider doing this in parallel - complex resampling requires some milliseconds.
         /// Parallel resampling would reduce latency (and improve performance if there is not
         /// enough single-core power).
         for (size_t i = 0; i < channels.size(); i++) {
-                uint32_t in_frames = get_data_len(i) / sizeof(int16_t);
+                uint32_t in_frames = get_data_len(i) / bps;
                 uint32_t in_frames_orig = in_frames;
-                uint32_t write_frames = new_channels[i].len;
+                // 10 ms headroom
+                uint32_t write_frames = (uint64_t) in_frames * new_sample_rate / sample_rate + new_sample_rate / 100;
 
-                speex_resampler_process_int(
+                if (resampler_state.in_buf.size() < in_frames) {
+                        resampler_state.in_buf.resize(in_frames);
+                }
+                if (resampler_state.out_buf.size() < write_frames) {
+                        resampler_state.out_buf.resize(write_frames);
+                }
+
+                pcm_to_float(resampler_state.in_buf.data(), get_data(i), bps, in_frames);
+                speex_resampler_process_float(
                                 (SpeexResamplerState *) resampler_state.resampler,
                                 i,
-                                (const spx_int16_t *) get_data(i), &in_frames,
-                                (spx_int16_t *) new_channels[i].data.get(), &write_frames);
+                                resampler_state.in_buf.data(), &in_frames,
+                                resampler_state.out_buf.data(), &write_frames);
                 if (in_frames != in_frames_orig) {
                         LOG(LOG_LEVEL_WARNING) << "Audio frame resampler: not all samples resampled!\n";
                 }
-                new_channels[i].len = write_frames * sizeof(int16_t);
+
+                size_t new_len = write_frames * bps;
+                if (channels[i].max_len < new_len) { // input was already consumed, no need to keep it
+                        channels[i].data = unique_ptr<char []>(new char[new_len]);
+                        channels[i].max_len = new_len;
+                }
+                float_to_pcm(channels[i].data.get(), resampler_state.out_buf.data(), bps, write_frames);
+                channels[i].len = new_len;
         }
 
         sample_rate = new_sample_rate;
-        channels = move(new_channels);
 }
 
@@ -131,6 +131,8 @@ private:
         int resample_from;
         size_t resample_ch_count;
         int resample_to;
+        std::vector<float> in_buf;  ///< float conversion buffers reused across calls
+        std::vector<float> out_buf;
 
         friend class audio_frame2;
 };
@@ -170,8 +172,9 @@ public:
         static audio_frame2 copy_with_bps_change(audio_frame2 const &frame, int new_bps);
         void change_bps(int new_bps);
         /**
-         * @note
-         * bps of the frame needs to be 16 bits!
+         * Resamples all channels in float (regardless of bps) and stores the
+         * result back with the original bps. Channel storage is reused if
+         * large enough. Quality can be set with "resampler-quality" param.
          *
          * @param resampler_state opaque state that can holds resampler that dosn't need
          *                        to be reinitalized during calls on various audio frames.
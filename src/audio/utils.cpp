@@ -50,8 +50,13 @@
 #include <limits.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 
 #ifdef WORDS_BIGENDIAN
 #error "This code will not run with a big-endian machine. Please report a bug to " PACKAGE_BUGREPORT " if you reach here."
@@ -59,6 +64,45 @@
 
 using namespace std;
 
+namespace {
+/**
+ * Typed access to signed little-endian samples of given bps. Loads are
+ * sign-extended to int32_t, stores keep only low bps bytes (no clamping).
+ */
+template<int bps> struct sample_io;
+
+template<> struct sample_io<1> {
+        static inline int32_t load(const char *p) { return (int8_t) *p; }
+        static inline void store(char *p, int32_t val) { *p = (char) val; }
+};
+
+template<> struct sample_io<2> {
+        static inline int32_t load(const char *p) { int16_t val; memcpy(&val, p, sizeof val); return val; }
+        static inline void store(char *p, int32_t val) { int16_t s = val; memcpy(p, &s, sizeof s); }
+};
+
+template<> struct sample_io<3> {
+        static inline int32_t load(const char *p) {
+                const unsigned char *u = (const unsigned char *)(const void *) p;
+                return (int32_t) ((uint32_t) u[0] << 8 | (uint32_t) u[1] << 16 | (uint32_t) u[2] << 24) >> 8;
+        }
+        static inline void store(char *p, int32_t val) { p[0] = val; p[1] = val >> 8; p[2] = val >> 16; }
+};
+
+template<> struct sample_io<4> {
+        static inline int32_t load(const char *p) { int32_t val; memcpy(&val, p, sizeof val); return val; }
+        static inline void store(char *p, int32_t val) { memcpy(p, &val, sizeof val); }
+};
+
+/// clamps val to range representable with bps bytes and truncates it to integer
+template<int bps, typename T>
+inline int32_t saturate(T val) {
+        const int32_t max = (int32_t) ((INT64_C(1) << (bps * 8 - 1)) - 1);
+        const int32_t min = -max - 1;
+        return val >= (T) max ? max : val <= (T) min ? min : (int32_t) val;
+}
+} // end of anonymous namespace
+
 static double get_normalized(const int8_t *in, int bps) {
         int64_t sample = 0;
         bool negative = false;
@@ -137,30 +181,49 @@ struct audio_desc audio_desc_from_audio_channel(audio_channel *channel) {
         };
 }
 
-void change_bps(char *out, int out_bps, const char *in, int in_bps, int in_len /* bytes */)
+template<int in_bps, int out_bps>
+static void change_bps_typed(char *out, const char *in, int in_len)
 {
-        int i;
-
-        assert ((unsigned int) out_bps <= sizeof(int32_t));
+        constexpr int up = out_bps > in_bps ? (out_bps - in_bps) * 8 : 0;
+        constexpr int down = in_bps > out_bps ? (in_bps - out_bps) * 8 : 0;
+        int samples = in_len / in_bps;
+        int i = 0;
+
+#ifdef __SSE2__
+        if (in_bps == 2 && out_bps == 4) {
+                for ( ; i + 8 <= samples; i += 8) {
+                        __m128i val = _mm_loadu_si128((const __m128i *)(const void *) (in + i * 2));
+                        _mm_storeu_si128((__m128i *)(void *) (out + i * 4), _mm_unpacklo_epi16(_mm_setzero_si128(), val));
+                        _mm_storeu_si128((__m128i *)(void *) (out + i * 4 + 16), _mm_unpackhi_epi16(_mm_setzero_si128(), val));
+                }
+        } else if (in_bps == 4 && out_bps == 2) {
+                for ( ; i + 8 <= samples; i += 8) {
+                        __m128i lo = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(const void *) (in + i * 4)), 16);
+                        __m128i hi = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(const void *) (in + i * 4 + 16)), 16);
+                        _mm_storeu_si128((__m128i *)(void *) (out + i * 2), _mm_packs_epi32(lo, hi));
+                }
+        }
+#endif
 
-        for(i = 0; i < in_len / in_bps; i++) {
-                int32_t in_value = format_from_in_bps(in, in_bps);
+        for ( ; i < samples; ++i) {
+                int32_t val = sample_io<in_bps>::load(in + i * in_bps);
+                sample_io<out_bps>::store(out + i * out_bps, (int32_t) ((uint32_t) val << up) >> down);
+        }
+}
 
-                int32_t out_value;
+#define CHANGE_BPS_ROW(in_bps) { change_bps_typed<in_bps, 1>, change_bps_typed<in_bps, 2>, change_bps_typed<in_bps, 3>, change_bps_typed<in_bps, 4> }
 
-                if(in_bps > out_bps) {
-                        out_value = in_value >> (in_bps * 8 - out_bps * 8);
-                } else {
-                        out_value = in_value << (out_bps * 8 - in_bps * 8);
-                }
+void change_bps(char *out, int out_bps, const char *in, int in_bps, int in_len /* bytes */)
+{
+        static void (*const funcs[4][4])(char *, const char *, int) = {
+                CHANGE_BPS_ROW(1), CHANGE_BPS_ROW(2), CHANGE_BPS_ROW(3), CHANGE_BPS_ROW(4),
+        };
 
-                format_to_out_bps(out, out_bps, out_value);
+        assert (in_bps >= 1 && (unsigned int) in_bps <= sizeof(int32_t));
+        assert (out_bps >= 1 && (unsigned int) out_bps <= sizeof(int32_t));
 
-                in += in_bps;
-                out += out_bps;
-        }
+        funcs[in_bps - 1][out_bps - 1](out, in, in_len);
 }
-
 void copy_channel(char *out, const char *in, int bps, int in_len /* bytes */, int out_channel_count)
 {
         int samples = in_len / bps;
@@ -189,116 +252,300 @@ void audio_frame_multiply_channel(struct audio_frame *frame, int new_channel_cou
         copy_channel(frame->data, frame->data, frame->bps, frame->data_len, new_channel_count);
 }
 
-void demux_channel(char *out, char *in, int bps, int in_len, int in_stream_channels, int pos_in_stream)
-{
-        int samples = in_len / (in_stream_channels * bps);
-        int i;
+#define BPS_FUNCS(func) { func<1>, func<2>, func<3>, func<4> }
 
-        assert (bps <= 4);
+template<int bps>
+static void demux_channel_typed(char *out, const char *in, int samples, int in_stream_channels)
+{
+        for (int i = 0; i < samples; ++i) {
+                sample_io<bps>::store(out + i * bps, sample_io<bps>::load(in + i * in_stream_channels * bps));
+        }
+}
 
-        in += pos_in_stream * bps;
+void demux_channel(char *out, char *in, int bps, int in_len, int in_stream_channels, int pos_in_stream)
+{
+        static void (*const funcs[])(char *, const char *, int, int) = BPS_FUNCS(demux_channel_typed);
 
-        for (i = 0; i < samples; ++i) {
-                memcpy(out, in, bps);
+        assert (bps >= 1 && bps <= 4);
 
-                out += bps;
-                in += in_stream_channels * bps;
+        funcs[bps - 1](out, in + pos_in_stream * bps, in_len / (in_stream_channels * bps), in_stream_channels);
+}
 
+template<int bps>
+static void remux_channel_typed(char *out, const char *in, int samples, int in_stream_channels, int out_stream_channels)
+{
+        for (int i = 0; i < samples; ++i) {
+                sample_io<bps>::store(out + i * out_stream_channels * bps, sample_io<bps>::load(in + i * in_stream_channels * bps));
         }
 }
 
 void remux_channel(char *out, const char *in, int bps, int in_len, int in_stream_channels, int out_stream_channels, int pos_in_stream, int pos_out_stream)
 {
-        int samples = in_len / (in_stream_channels * bps);
-        int i;
+        static void (*const funcs[])(char *, const char *, int, int, int) = BPS_FUNCS(remux_channel_typed);
+
+        assert (bps >= 1 && bps <= 4);
 
-        assert (bps <= 4);
+        funcs[bps - 1](out + pos_out_stream * bps, in + pos_in_stream * bps,
+                        in_len / (in_stream_channels * bps), in_stream_channels, out_stream_channels);
+}
+
+template<int bps>
+static void mux_channel_typed(char *out, const char *in, int samples, int out_stream_channels, double scale)
+{
+        if (scale == 1.0) {
+                for (int i = 0; i < samples; ++i) {
+                        sample_io<bps>::store(out + i * out_stream_channels * bps, sample_io<bps>::load(in + i * bps));
+                }
+        } else {
+                for (int i = 0; i < samples; ++i) {
+                        sample_io<bps>::store(out + i * out_stream_channels * bps,
+                                        saturate<bps>(sample_io<bps>::load(in + i * bps) * scale));
+                }
+        }
+}
 
-        in += pos_in_stream * bps;
-        out += pos_out_stream * bps;
+void mux_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int pos_in_stream, double scale)
+{
+        static void (*const funcs[])(char *, const char *, int, int, double) = BPS_FUNCS(mux_channel_typed);
 
-        for (i = 0; i < samples; ++i) {
-                memcpy(out, in, bps);
+        assert (bps >= 1 && bps <= 4);
 
-                out += bps * out_stream_channels;
-                in += bps * in_stream_channels;
+        funcs[bps - 1](out + pos_in_stream * bps, in, in_len / bps, out_stream_channels, scale);
+}
 
+template<int bps>
+static void mux_and_mix_channel_typed(char *out, const char *in, int samples, int out_stream_channels, double scale)
+{
+        for (int i = 0; i < samples; ++i) {
+                char *o = out + i * out_stream_channels * bps;
+                sample_io<bps>::store(o, saturate<bps>(sample_io<bps>::load(in + i * bps) * scale + sample_io<bps>::load(o)));
         }
 }
 
-void mux_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int pos_in_stream, double scale)
+void mux_and_mix_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int pos_in_stream, double scale)
 {
-        int samples = in_len / bps;
-        int i;
-        
-        assert (bps <= 4);
+        static void (*const funcs[])(char *, const char *, int, int, double) = BPS_FUNCS(mux_and_mix_channel_typed);
+
+        assert (bps >= 1 && bps <= 4);
+
+        funcs[bps - 1](out + pos_in_stream * bps, in, in_len / bps, out_stream_channels, scale);
+}
 
-        out += pos_in_stream * bps;
+/*
+ * Fused mixing of non-interleaved channels into an interleaved stream.
+ *
+ * The output is processed in blocks of samples. For each block, routed
+ * channels are scaled and summed into per-output-channel accumulators
+ * (contiguous, thus vectorizable) and the accumulators are then saturated
+ * and interleaved into the output in a single pass.
+ */
+#define MIX_ACC_SIZE 4096 ///< accumulator samples (all output channels of a block)
 
-        if(scale == 1.0) {
-                for (i = 0; i < samples; ++i) {
-                        memcpy(out, in, bps);
+/// float mantissa holds up to 24-bit samples exactly, 32-bit ones need double
+template<int bps> struct mix_acc { typedef float type; };
+template<> struct mix_acc<4> { typedef double type; };
 
-                        in += bps;
-                        out += out_stream_channels * bps;
+template<int bps>
+static void mix_accumulate(typename mix_acc<bps>::type *acc, const char *in, int n, double scale)
+{
+        typedef typename mix_acc<bps>::type acc_t;
+        const acc_t s = scale;
+        for (int j = 0; j < n; ++j) {
+                acc[j] += (acc_t) sample_io<bps>::load(in + j * bps) * s;
+        }
+}
 
+template<int bps>
+static void mix_store_scalar(char *out, int out_stream_channels, const typename mix_acc<bps>::type *acc, int block, int start, int n)
+{
+        for (int j = start; j < n; ++j) {
+                for (int ch = 0; ch < out_stream_channels; ++ch) {
+                        sample_io<bps>::store(out + (j * out_stream_channels + ch) * bps, saturate<bps>(acc[ch * block + j]));
                 }
-        } else {
-                for (i = 0; i < samples; ++i) {
-                        int32_t in_value = format_from_in_bps(in, bps);
+        }
+}
+
+template<int bps>
+static void mix_store(char *out, int out_stream_channels, const typename mix_acc<bps>::type *acc, int block, int n)
+{
+        mix_store_scalar<bps>(out, out_stream_channels, acc, block, 0, n);
+}
 
-                        in_value *= scale;
+#ifdef __SSE2__
+template<>
+void mix_accumulate<2>(float *acc, const char *in, int n, double scale)
+{
+        const __m128 s = _mm_set1_ps(scale);
+        int j = 0;
+        for ( ; j + 8 <= n; j += 8) {
+                __m128i val = _mm_loadu_si128((const __m128i *)(const void *) (in + j * 2));
+                __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(val, val), 16));
+                __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(val, val), 16));
+                _mm_storeu_ps(acc + j, _mm_add_ps(_mm_loadu_ps(acc + j), _mm_mul_ps(lo, s)));
+                _mm_storeu_ps(acc + j + 4, _mm_add_ps(_mm_loadu_ps(acc + j + 4), _mm_mul_ps(hi, s)));
+        }
+        for ( ; j < n; ++j) {
+                acc[j] += (float) sample_io<2>::load(in + j * 2) * (float) scale;
+        }
+}
 
-                        format_to_out_bps(out, bps, in_value);
+template<>
+void mix_accumulate<4>(double *acc, const char *in, int n, double scale)
+{
+        const __m128d s = _mm_set1_pd(scale);
+        int j = 0;
+        for ( ; j + 4 <= n; j += 4) {
+                __m128i val = _mm_loadu_si128((const __m128i *)(const void *) (in + j * 4));
+                __m128d lo = _mm_cvtepi32_pd(val);
+                __m128d hi = _mm_cvtepi32_pd(_mm_srli_si128(val, 8));
+                _mm_storeu_pd(acc + j, _mm_add_pd(_mm_loadu_pd(acc + j), _mm_mul_pd(lo, s)));
+                _mm_storeu_pd(acc + j + 2, _mm_add_pd(_mm_loadu_pd(acc + j + 2), _mm_mul_pd(hi, s)));
+        }
+        for ( ; j < n; ++j) {
+                acc[j] += sample_io<4>::load(in + j * 4) * scale;
+        }
+}
+
+/// transposes 4x4 tiles of (channel, sample) accumulators into interleaved 16-bit output
+template<>
+void mix_store<2>(char *out, int out_stream_channels, const float *acc, int block, int n)
+{
+        if (out_stream_channels % 4 != 0) {
+                mix_store_scalar<2>(out, out_stream_channels, acc, block, 0, n);
+                return;
+        }
 
-                        in += bps;
-                        out += out_stream_channels * bps;
+        const __m128 max = _mm_set1_ps(INT16_MAX);
+        const __m128 min = _mm_set1_ps(INT16_MIN);
+        int j = 0;
+        for ( ; j + 4 <= n; j += 4) {
+                for (int ch = 0; ch < out_stream_channels; ch += 4) {
+                        __m128 r0 = _mm_loadu_ps(acc + ch * block + j);
+                        __m128 r1 = _mm_loadu_ps(acc + (ch + 1) * block + j);
+                        __m128 r2 = _mm_loadu_ps(acc + (ch + 2) * block + j);
+                        __m128 r3 = _mm_loadu_ps(acc + (ch + 3) * block + j);
+                        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                        __m128i s01 = _mm_packs_epi32(_mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(r0, min), max)),
+                                        _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(r1, min), max)));
+                        __m128i s23 = _mm_packs_epi32(_mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(r2, min), max)),
+                                        _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(r3, min), max)));
+                        char *o = out + (j * out_stream_channels + ch) * 2;
+                        _mm_storel_epi64((__m128i *)(void *) o, s01);
+                        _mm_storel_epi64((__m128i *)(void *) (o + out_stream_channels * 2), _mm_srli_si128(s01, 8));
+                        _mm_storel_epi64((__m128i *)(void *) (o + out_stream_channels * 4), s23);
+                        _mm_storel_epi64((__m128i *)(void *) (o + out_stream_channels * 6), _mm_srli_si128(s23, 8));
                 }
         }
+        mix_store_scalar<2>(out, out_stream_channels, acc, block, j, n);
 }
+#endif // defined __SSE2__
 
-void mux_and_mix_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int pos_in_stream, double scale)
+template<int bps>
+static void mix_channels_typed(char *out, int out_stream_channels, const struct audio_mix_route *routes, int route_count, int samples)
 {
-        int i;
+        typename mix_acc<bps>::type acc[MIX_ACC_SIZE];
+        int block = MIX_ACC_SIZE / out_stream_channels / 4 * 4;
+
+        if (block == 0) { // too many channels for the accumulator, mix one by one
+                memset(out, 0, (size_t) samples * out_stream_channels * bps);
+                for (int r = 0; r < route_count; ++r) {
+                        if (routes[r].out_channel < out_stream_channels) {
+                                mux_and_mix_channel_typed<bps>(out + routes[r].out_channel * bps, routes[r].in,
+                                                samples, out_stream_channels, routes[r].scale);
+                        }
+                }
+                return;
+        }
 
-        assert (bps <= 4);
+        for (int t = 0; t < samples; t += block) {
+                int n = min(block, samples - t);
+                memset(acc, 0, out_stream_channels * block * sizeof acc[0]);
+                for (int r = 0; r < route_count; ++r) {
+                        if (routes[r].out_channel < out_stream_channels) {
+                                mix_accumulate<bps>(acc + routes[r].out_channel * block, routes[r].in + t * bps, n, routes[r].scale);
+                        }
+                }
+                mix_store<bps>(out + t * out_stream_channels * bps, out_stream_channels, acc, block, n);
+        }
+}
 
-        out += pos_in_stream * bps;
+audio_mix_func_t get_audio_mix_func(int bps)
+{
+        static const audio_mix_func_t funcs[] = BPS_FUNCS(mix_channels_typed);
 
-        for(i = 0; i < in_len / bps; i++) {
-                int32_t in_value = format_from_in_bps(in, bps);
-                int32_t out_value = format_from_in_bps(out, bps);
+        assert (bps >= 1 && bps <= 4);
 
-                int32_t new_value = (double)in_value * scale + out_value;
+        return funcs[bps - 1];
+}
 
-                format_to_out_bps(out, bps, new_value);
+template<int bps>
+static double get_avg_volume_typed(const char *data, int samples, int stream_channels)
+{
+        int64_t sum = 0;
 
-                in += bps;
-                out += out_stream_channels * bps;
+        for (int i = 0; i < samples; ++i) {
+                int32_t val = sample_io<bps>::load(data + i * stream_channels * bps);
+                sum += val < 0 ? -(int64_t) val : val;
         }
+
+        return samples == 0 ? 0.0 : (double) sum / samples / ((INT64_C(1) << (bps * 8 - 1)) - 1);
 }
 
 double get_avg_volume(char *data, int bps, int in_len, int stream_channels, int pos_in_stream)
 {
-        float average_vol = 0;
-        int i;
+        static double (*const funcs[])(const char *, int, int) = BPS_FUNCS(get_avg_volume_typed);
+
+        assert (bps >= 1 && (unsigned int) bps <= sizeof(int32_t));
 
-        assert ((unsigned int) bps <= sizeof(int32_t));
+        return funcs[bps - 1](data + pos_in_stream * bps, in_len / bps, stream_channels);
+}
 
-        data += pos_in_stream * bps;
+template<int bps>
+static void pcm_to_float_typed(float *out, const char *in, int samples)
+{
+        int i = 0;
+#ifdef __SSE2__
+        if (bps == 2) {
+                for ( ; i + 8 <= samples; i += 8) {
+                        __m128i val = _mm_loadu_si128((const __m128i *)(const void *) (in + i * 2));
+                        _mm_storeu_ps(out + i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(val, val), 16)));
+                        _mm_storeu_ps(out + i + 4, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(val, val), 16)));
+                }
+        } else if (bps == 4) {
+                for ( ; i + 4 <= samples; i += 4) {
+                        _mm_storeu_ps(out + i, _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(const void *) (in + i * 4))));
+                }
+        }
+#endif
+        for ( ; i < samples; ++i) {
+                out[i] = sample_io<bps>::load(in + i * bps);
+        }
+}
 
-        for(i = 0; i < in_len / bps; i++) {
-                int32_t in_value = format_from_in_bps(data, bps);
+void pcm_to_float(float *out, const char *in, int bps, int samples)
+{
+        static void (*const funcs[])(float *, const char *, int) = BPS_FUNCS(pcm_to_float_typed);
 
-                //if(pos_in_stream) fprintf(stderr, "%d-%d ", pos_in_stream, data);
+        assert (bps >= 1 && bps <= 4);
 
-                average_vol = average_vol * (i / ((double) i + 1)) + 
-                        fabs(((double) in_value / ((1 << (bps * 8 - 1)) - 1)) / (i + 1));
+        funcs[bps - 1](out, in, samples);
+}
 
-                data += bps * stream_channels;
+template<int bps>
+static void float_to_pcm_typed(char *out, const float *in, int samples)
+{
+        for (int i = 0; i < samples; ++i) {
+                sample_io<bps>::store(out + i * bps, saturate<bps>(floor((double) in[i] + 0.5)));
         }
+}
+
+void float_to_pcm(char *out, const float *in, int bps, int samples)
+{
+        static void (*const funcs[])(char *, const float *, int) = BPS_FUNCS(float_to_pcm_typed);
+
+        assert (bps >= 1 && bps <= 4);
 
-        return average_vol;
+        funcs[bps - 1](out, in, samples);
 }
 
 void float2int(char *out, const char *in, int len)
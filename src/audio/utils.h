@@ -87,6 +87,42 @@ void interleaved2noninterleaved(char *out, const char *in, int bps, int in_len /
 void mux_and_mix_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int chan_pos_stream, double scale);
 double get_avg_volume(char *data, int bps, int in_len, int stream_channels, int chan_pos_stream);
 
+/**
+ * One non-interleaved input channel routed to an output channel
+ */
+struct audio_mix_route {
+        const char *in;   ///< input samples (same bps as output)
+        int out_channel;  ///< position in the interleaved output stream
+        double scale;
+};
+
+/**
+ * Mixes routed channels into interleaved output stream. Every route is scaled
+ * by its own scale, routes with the same out_channel are summed and the sum
+ * is saturated once per sample.
+ * The whole out is overwritten - channels without any route are zeroed and
+ * routes with out_channel >= out_stream_channels are ignored.
+ *
+ * @param samples number of samples of every input channel
+ */
+typedef void (*audio_mix_func_t)(char *out, int out_stream_channels, const struct audio_mix_route *routes, int route_count, int samples);
+
+/**
+ * Returns mixing kernel specialized for given bps, intended to be selected
+ * once per audio format.
+ */
+audio_mix_func_t get_audio_mix_func(int bps);
+
+/**
+ * Converts signed integer samples of given bps to float without normalization
+ * (values keep the integer range), eg. for processing with float DSP routines.
+ */
+void pcm_to_float(float *out, const char *in, int bps, int samples);
+/**
+ * Inverse to pcm_to_float(). Values are rounded to nearest and saturated.
+ */
+void float_to_pcm(char *out, const float *in, int bps, int samples);
+
 /**
  * This fuction converts from normalized float to int32_t representation
  * Input and output data may overlap.
@@ -43,26 +43,72 @@
 
 #include "capture_filter.h"
 #include "debug.h"
+#include "host.h"
 #include "lib_common.h"
 #include "module.h"
 #include "utils/list.h"
+#include "utils/synchronized_queue.h"
+#include "utils/thread.h"
 #include "video.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
+using namespace std::chrono;
 
-struct capture_filter {
-        struct module mod;
-        struct simple_linked_list *filters;
-};
+static constexpr int DEFAULT_PIPELINE_DEPTH = 2;
+static constexpr duration<double> STATS_INTERVAL(5.0);
+static constexpr milliseconds DRAIN_INTERVAL(10); ///< how often is output drained while waiting for the pipeline
+
+ADD_TO_PARAM(capture_filter_pipeline, "capture-filter-pipeline", "* capture-filter-pipeline[=<depth>]\n"
+                "  Run capture filters as a pipeline, each filter in its own thread (default depth 2).\n"
+                "  Filters may be grouped to one thread by separating groups with '|' instead of ','\n"
+                "  in the capture filter list, eg. \"logo:img.pam,resize:1/2|flip\".\n");
+
+typedef synchronized_queue<struct video_frame *, -1> frame_queue;
 
 struct capture_filter_instance {
         const struct capture_filter_info *functions;
         void *state;
+        string name;
+        int stage; ///< filters with the same stage number run in the same thread if pipelined
+
+        duration<double> time{};
+        int frames = 0;
+        steady_clock::time_point last_report = steady_clock::now();
+};
+
+struct capture_filter_stage {
+        struct capture_filter *parent;
+        vector<struct capture_filter_instance *> filters;
+        frame_queue *in;
+        frame_queue *out;
+        thread thr;
 };
 
-static int create_filter(struct capture_filter *s, char *cfg)
+struct capture_filter {
+        struct module mod;
+        struct simple_linked_list *filters;
+        int next_stage;
+
+        int pipeline_depth; ///< 0 if filters run in the caller thread
+        vector<unique_ptr<frame_queue>> queues;
+        vector<unique_ptr<capture_filter_stage>> stages;
+        struct video_frame *newest = nullptr; ///< newest frame drained from the pipeline output
+
+        mutex borrow_lock;
+        condition_variable borrow_cv;
+        bool borrow_done = false; ///< first stage has finished with the caller's frame
+        bool borrow_disposed = false; ///< caller's frame is no longer referenced
+};
+
+static int create_filter(struct capture_filter *s, char *cfg, int stage)
 {
         bool found = false;
         char *options = NULL;
@@ -75,16 +121,17 @@ static int create_filter(struct capture_filter *s, char *cfg)
         for (auto && item : capture_filters) {
                 auto capture_filter_info = static_cast<const struct capture_filter_info*>(item.second);
                 if(strcasecmp(item.first.c_str(), filter_name) == 0) {
-                        struct capture_filter_instance *instance = (struct capture_filter_instance *)
-                                malloc(sizeof(struct capture_filter_instance));
+                        struct capture_filter_instance *instance = new capture_filter_instance();
                         instance->functions = capture_filter_info;
+                        instance->name = item.first;
+                        instance->stage = stage;
                         int ret = capture_filter_info->init(&s->mod, options, &instance->state);
                         if(ret < 0) {
                                 fprintf(stderr, "Unable to initialize capture filter: %s\n",
                                                 filter_name);
                         }
                         if(ret != 0) {
-                                free(instance);
+                                delete instance;
                                 return ret;
                         }
                         simple_linked_list_append(s->filters, instance);
@@ -100,15 +147,200 @@ static int create_filter(struct capture_filter *s, char *cfg)
         return 0;
 }
 
+static void destroy_filter(struct capture_filter_instance *inst)
+{
+        inst->functions->done(inst->state);
+        delete inst;
+}
+
+static struct video_frame *run_filter(struct capture_filter_instance *inst, struct video_frame *frame)
+{
+        auto t0 = steady_clock::now();
+        frame = inst->functions->filter(inst->state, frame);
+        auto t1 = steady_clock::now();
+
+        inst->time += t1 - t0;
+        inst->frames += 1;
+        if (t1 - inst->last_report > STATS_INTERVAL) {
+                log_msg(LOG_LEVEL_VERBOSE, "[capture filter] %s: %d frames, %.2f ms per frame\n",
+                                inst->name.c_str(), inst->frames,
+                                duration_cast<duration<double, milli>>(inst->time).count() / inst->frames);
+                inst->time = {};
+                inst->frames = 0;
+                inst->last_report = t1;
+        }
+        return frame;
+}
+
+/**
+ * Caller's frame without dispose callback is valid only until the next call
+ * of the producer (grab), so it is not copied but passed to the first stage
+ * wrapped with this dispose and the caller waits until the stage has finished
+ * with it. Filters creating a new frame dispose the input so that the data
+ * are copied only if the stage output still references the caller's frame.
+ */
+static void borrowed_frame_dispose(struct video_frame *frame)
+{
+        auto s = (struct capture_filter *) frame->callbacks.dispose_udata;
+        unique_lock<mutex> l(s->borrow_lock);
+        s->borrow_disposed = true;
+        l.unlock();
+        vf_free(frame);
+}
+
+static struct video_frame *borrow_frame(struct capture_filter *s, struct video_frame *frame)
+{
+        struct video_frame *ref = vf_alloc_desc(video_desc_from_frame(frame));
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                ref->tiles[i].data = frame->tiles[i].data;
+                ref->tiles[i].data_len = frame->tiles[i].data_len;
+        }
+        char metadata[VF_METADATA_SIZE];
+        vf_store_metadata(frame, metadata);
+        vf_restore_metadata(ref, metadata);
+        ref->callbacks.dispose = borrowed_frame_dispose;
+        ref->callbacks.dispose_udata = s;
+        s->borrow_disposed = false;
+        return ref;
+}
+
+/**
+ * Frames passed between pipeline stages need to be owned by the receiver -
+ * frame without dispose callback (or referencing a borrowed one) is valid only
+ * until the next call of the producer so it needs to be copied.
+ */
+static struct video_frame *get_owned_frame(struct video_frame *frame, bool references_borrowed)
+{
+        if (frame->callbacks.dispose && !references_borrowed) {
+                return frame;
+        }
+        struct video_frame *copy = vf_get_copy(frame);
+        copy->callbacks.dispose = vf_free;
+        VIDEO_FRAME_DISPOSE(frame);
+        return copy;
+}
+
+static void capture_filter_stage_run(struct capture_filter_stage *stage)
+{
+        set_thread_name("capture_filter_stage");
+        while (struct video_frame *frame = stage->in->pop()) {
+                bool borrowed = frame->callbacks.dispose == borrowed_frame_dispose;
+                for (auto inst : stage->filters) {
+                        frame = run_filter(inst, frame);
+                        if (!frame) {
+                                break;
+                        }
+                }
+                if (frame) {
+                        bool references_borrowed = false;
+                        if (borrowed) {
+                                unique_lock<mutex> l(stage->parent->borrow_lock);
+                                references_borrowed = !stage->parent->borrow_disposed;
+                        }
+                        frame = get_owned_frame(frame, references_borrowed);
+                }
+                if (borrowed) {
+                        unique_lock<mutex> l(stage->parent->borrow_lock);
+                        stage->parent->borrow_done = true;
+                        l.unlock();
+                        stage->parent->borrow_cv.notify_one();
+                }
+                if (frame) {
+                        stage->out->push(frame);
+                }
+        }
+        stage->out->push(nullptr); // pass poison pill
+}
+
+/**
+ * Takes all frames ready at the pipeline output, only the newest one is kept.
+ * @retval false poison pill was received
+ */
+static bool pipeline_drain(struct capture_filter *s)
+{
+        while (s->queues.back()->size() > 0) {
+                struct video_frame *frame = s->queues.back()->pop();
+                if (!frame) {
+                        return false;
+                }
+                VIDEO_FRAME_DISPOSE(s->newest);
+                s->newest = frame;
+        }
+        return true;
+}
+
+/// pushes to the first stage, output is drained meanwhile so that the stages cannot block
+static void pipeline_push(struct capture_filter *s, struct video_frame *frame)
+{
+        while (!s->queues.front()->timed_push(frame, DRAIN_INTERVAL)) {
+                pipeline_drain(s);
+        }
+}
+
+static void pipeline_start(struct capture_filter *s)
+{
+        if (s->pipeline_depth == 0 || simple_linked_list_size(s->filters) == 0) {
+                return;
+        }
+
+        s->queues.emplace_back(new frame_queue(s->pipeline_depth));
+        for (void *it = simple_linked_list_it_init(s->filters); it != NULL; ) {
+                auto inst = (struct capture_filter_instance *) simple_linked_list_it_next(&it);
+                if (s->stages.empty() || s->stages.back()->filters.back()->stage != inst->stage) {
+                        s->stages.emplace_back(new capture_filter_stage());
+                        s->stages.back()->parent = s;
+                        s->stages.back()->in = s->queues.back().get();
+                        s->queues.emplace_back(new frame_queue(s->pipeline_depth));
+                        s->stages.back()->out = s->queues.back().get();
+                }
+                s->stages.back()->filters.push_back(inst);
+        }
+        for (auto && stage : s->stages) {
+                stage->thr = thread(capture_filter_stage_run, stage.get());
+        }
+        log_msg(LOG_LEVEL_VERBOSE, "[capture filter] Running %d filters in %d pipeline stages.\n",
+                        simple_linked_list_size(s->filters), (int) s->stages.size());
+}
+
+/// Stops the pipeline threads, frames being processed are dropped.
+static void pipeline_stop(struct capture_filter *s)
+{
+        if (s->stages.empty()) {
+                return;
+        }
+
+        pipeline_push(s, nullptr);
+        while (pipeline_drain(s)) {
+                this_thread::sleep_for(DRAIN_INTERVAL);
+        }
+        VIDEO_FRAME_DISPOSE(s->newest);
+        s->newest = nullptr;
+        for (auto && stage : s->stages) {
+                stage->thr.join();
+        }
+        s->stages.clear();
+        s->queues.clear();
+}
+
 int capture_filter_init(struct module *parent, const char *cfg, struct capture_filter **state)
 {
-        struct capture_filter *s = (struct capture_filter *) calloc(1, sizeof(struct capture_filter));
+        struct capture_filter *s = new struct capture_filter();
+        char *stage_item, *stage_save_ptr;
         char *item, *save_ptr;
-        assert(s);
         char *filter_list_str = NULL,
              *tmp = NULL;
 
         s->filters = simple_linked_list_init();
+        if (get_commandline_param("capture-filter-pipeline")) {
+                const char *depth = get_commandline_param("capture-filter-pipeline");
+                s->pipeline_depth = strlen(depth) > 0 ? atoi(depth) : DEFAULT_PIPELINE_DEPTH;
+                if (s->pipeline_depth <= 0) {
+                        log_msg(LOG_LEVEL_ERROR, "[capture filter] Wrong pipeline depth: %s\n", depth);
+                        simple_linked_list_destroy(s->filters);
+                        delete s;
+                        return -1;
+                }
+        }
 
         module_init_default(&s->mod);
         s->mod.cls = MODULE_CLASS_FILTER;
@@ -121,29 +353,43 @@ int capture_filter_init(struct module *parent, const char *cfg, struct capture_f
                         for (auto && item : capture_filters) {
                                 printf("\t%s\n", item.first.c_str());
                         }
+                        printf("\nFilters can be run as a pipeline, see \"--param help\" (capture-filter-pipeline).\n");
+                        simple_linked_list_destroy(s->filters);
                         module_done(&s->mod);
-                        free(s);
+                        delete s;
                         return 1;
                 }
                 filter_list_str = tmp = strdup(cfg);
 
-                while((item = strtok_r(filter_list_str, ",", &save_ptr))) {
-                        char filter_name[128];
-                        strncpy(filter_name, item, sizeof filter_name - 1);
+                // groups separated by '|' are pipeline stages, without them each filter is a stage
+                bool groups = strchr(cfg, '|') != NULL;
+                char *stage_str = filter_list_str;
+                while ((stage_item = strtok_r(stage_str, "|", &stage_save_ptr))) {
+                        char *filter_str = stage_item;
+                        while((item = strtok_r(filter_str, ",", &save_ptr))) {
+                                char filter_name[128] = "";
+                                strncpy(filter_name, item, sizeof filter_name - 1);
 
-                        int ret = create_filter(s, filter_name);
-                        if (ret != 0) {
-                                module_done(&s->mod);
-                                free(tmp);
-                                free(s);
-                                return ret;
+                                int ret = create_filter(s, filter_name, s->next_stage);
+                                if (!groups) {
+                                        s->next_stage += 1;
+                                }
+                                if (ret != 0) {
+                                        capture_filter_destroy(s);
+                                        free(tmp);
+                                        return ret;
+                                }
+                                filter_str = NULL;
                         }
-                        filter_list_str = NULL;
+                        s->next_stage += 1;
+                        stage_str = NULL;
                 }
         }
 
         free(tmp);
 
+        pipeline_start(s);
+
         *state = s;
 
         return 0;
@@ -153,17 +399,18 @@ void capture_filter_destroy(struct capture_filter *state)
 {
         struct capture_filter *s = state;
 
+        pipeline_stop(s);
+
         while(simple_linked_list_size(s->filters) > 0) {
                 struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_pop(s->filters);
-                inst->functions->done(inst->state);
-                free(inst);
+                destroy_filter(inst);
         }
 
         simple_linked_list_destroy(s->filters);
 
         module_done(&s->mod);
 
-        free(state);
+        delete s;
 }
 
 static struct response *process_message(struct capture_filter *s, struct msg_universal *msg)
@@ -178,14 +425,12 @@ static struct response *process_message(struct capture_filter *s, struct msg_uni
                         return new_response(RESPONSE_INT_SERV_ERR, NULL);
                 } else {
                         printf("Capture filter #%d removed successfully.\n", index);
-                        inst->functions->done(inst->state);
-                        free(inst);
+                        destroy_filter(inst);
                 }
         } else if (strcmp("flush", msg->text) == 0) {
                 while(simple_linked_list_size(s->filters) > 0) {
                         struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_pop(s->filters);
-                        inst->functions->done(inst->state);
-                        free(inst);
+                        destroy_filter(inst);
                 }
         } else if (strcmp("help", msg->text) == 0) {
                 printf("Capture filter control:\n"
@@ -194,7 +439,7 @@ static struct response *process_message(struct capture_filter *s, struct msg_uni
                                 "\t<filter>   - append a filter named <filter>\n");
         } else {
                 char *fmt = strdup(msg->text);
-                if (create_filter(s, fmt) != 0) {
+                if (create_filter(s, fmt, s->next_stage++) != 0) {
                         fprintf(stderr, "Cannot create capture filter: %s.\n",
                                         msg->text);
                         free(fmt);
@@ -209,23 +454,49 @@ static struct response *process_message(struct capture_filter *s, struct msg_uni
         return new_response(RESPONSE_OK, NULL);
 }
 
+/**
+ * If pipelined, the frame is passed to the first stage and the newest frame
+ * that has passed the whole pipeline is returned if there is any (NULL
+ * otherwise), older ones are dropped.
+ */
 struct video_frame *capture_filter(struct capture_filter *state, struct video_frame *frame) {
         struct capture_filter *s = state;
 
         struct message *msg;
         while ((msg = check_message(&s->mod))) {
+                // filters are modified, so they must not be running
+                pipeline_stop(s);
                 struct response *r = process_message(s, (struct msg_universal *) msg);
                 free_message(msg, r);
+                pipeline_start(s);
+        }
+
+        if (!s->stages.empty()) {
+                if (frame->callbacks.dispose) {
+                        pipeline_push(s, frame);
+                } else {
+                        s->borrow_done = false;
+                        pipeline_push(s, borrow_frame(s, frame));
+                        unique_lock<mutex> l(s->borrow_lock);
+                        while (!s->borrow_cv.wait_for(l, DRAIN_INTERVAL, [s]{ return s->borrow_done; })) {
+                                l.unlock();
+                                pipeline_drain(s);
+                                l.lock();
+                        }
+                }
+                pipeline_drain(s);
+                struct video_frame *out = s->newest;
+                s->newest = nullptr;
+                return out;
         }
 
         for(void *it = simple_linked_list_it_init(s->filters);
                         it != NULL;
            ) {
                 struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_it_next(&it);
-                frame = inst->functions->filter(inst->state, frame);
+                frame = run_filter(inst, frame);
                 if(!frame)
                         return NULL;
         }
         return frame;
 }
-
@@ -56,9 +56,15 @@
 
 #include "debug.h"
 
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_codec.h"
 
+#include <algorithm>
+#include <memory>
+
+using std::shared_ptr;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -89,10 +95,13 @@ struct resize_param {
     bool force_interlaced, force_progressive;
 };
 
+typedef video_frame_pool<aligned_data_allocator<>> resize_frame_pool;
+
 struct state_resize {
     struct resize_param param;
-    struct video_frame *frame;
+    shared_ptr<resize_frame_pool> pool{std::make_shared<resize_frame_pool>()};
     struct video_desc saved_desc;
+    struct video_desc out_desc;
 };
 
 static void usage() {
@@ -105,6 +114,7 @@ static void usage() {
                     "\tresize:1/2 - downscale input frame size by scale factor of 2\n"
                     "\tresize:1280x720 - scales input to 1280x720\n"
                     "\tresize:720x576i - scales input to PAL (overrides interlacing setting)\n");
+    printf("\nPixel format is kept, supported are UYVY, YUYV, v210, RGB, BGR, RGBA and I420.\n");
 }
 
 static int init(struct module * /* parent */, const char *cfg, void **state)
@@ -178,7 +188,7 @@ static int init(struct module * /* parent */, const char *cfg, void **state)
         return -1;
     }
 
-    struct state_resize *s = (state_resize*) calloc(1, sizeof(struct state_resize));
+    struct state_resize *s = new state_resize();
     s->param = param;
 
     *state = s;
@@ -189,18 +199,22 @@ static void done(void *state)
 {
     struct state_resize *s = (state_resize*) state;
 
-    vf_free(s->frame);
-    free(state);
+    delete s;
 }
 
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
     struct state_resize *s = (state_resize*) state;
-    unsigned int i;
     int res = 0;
 
+    if (!resize_supports_codec(in->color_spec)) {
+        log_msg(LOG_LEVEL_ERROR, "[RESIZE ERROR] Unsupported codec %s!\n", get_codec_name(in->color_spec));
+        VIDEO_FRAME_DISPOSE(in);
+        return NULL;
+    }
+
     if (!video_desc_eq(video_desc_from_frame(in), s->saved_desc)) {
-    	struct video_desc desc = video_desc_from_frame(in);
+        struct video_desc desc = video_desc_from_frame(in);
         if (s->param.mode == resize_param::resize_mode::USE_DIMENSIONS) {
             desc.width = s->param.target_width;
             desc.height = s->param.target_height;
@@ -208,34 +222,46 @@ static struct video_frame *filter(void *state, struct video_frame *in)
             desc.width = in->tiles[0].width * s->param.num / s->param.denom;
             desc.height = in->tiles[0].height * s->param.num / s->param.denom;
         }
-        desc.color_spec = RGB;
-    	s->frame = vf_alloc_desc_data(desc);
+        if (codec_is_a_rgb(desc.color_spec)) {
+            desc.width = std::max(desc.width, 1u);
+            desc.height = std::max(desc.height, 1u);
+        } else { // chroma subsampling
+            desc.width = std::max(desc.width & ~1u, 2u);
+            desc.height = std::max(desc.height & ~1u, 2u);
+        }
         if (s->param.force_interlaced) {
-                s->frame->interlacing = INTERLACED_MERGED;
+            desc.interlacing = INTERLACED_MERGED;
         } else if (s->param.force_progressive) {
-                s->frame->interlacing = PROGRESSIVE;
+            desc.interlacing = PROGRESSIVE;
         }
+        s->pool->reconfigure(desc, vc_get_datalen(desc.width, desc.height, desc.color_spec));
+        s->out_desc = desc;
         s->saved_desc = video_desc_from_frame(in);
-        printf("[resize filter] resizing from %dx%d to %dx%d\n", in->tiles[0].width, in->tiles[0].height, s->frame->tiles[0].width, s->frame->tiles[0].height);
+        printf("[resize filter] resizing from %dx%d to %dx%d\n", in->tiles[0].width, in->tiles[0].height, desc.width, desc.height);
     }
 
-    for(i=0; i<s->frame->tile_count;i++){
-        if (s->param.mode == resize_param::resize_mode::USE_DIMENSIONS) {
-            res = resize_frame(in->tiles[i].data, in->color_spec, s->frame->tiles[i].data, in->tiles[i].width, in->tiles[i].height, s->param.target_width, s->param.target_height);
-        } else {
-            res = resize_frame(in->tiles[i].data, in->color_spec, s->frame->tiles[i].data, in->tiles[i].width, in->tiles[i].height, (double)s->param.num/s->param.denom);
-        }
+    // frame from the pool so that the previous output may still be in use (eg. by async compression)
+    struct video_frame *out = video_frame_pool_get_disposable_frame(s->pool);
+    char metadata[VF_METADATA_SIZE];
+    vf_store_metadata(in, metadata);
+    vf_restore_metadata(out, metadata);
+
+    for (unsigned int i = 0; i < out->tile_count; i++) {
+        res = resize_frame(in->tiles[i].data, in->color_spec, out->tiles[i].data, in->tiles[i].width, in->tiles[i].height,
+                s->out_desc.width, s->out_desc.height, s->param.mode == resize_param::resize_mode::USE_DIMENSIONS);
 
         if(res!=0){
             error_msg("\n[RESIZE ERROR] Unable to resize with scale factor configured [%d/%d] in tile number %d\n", s->param.num, s->param.denom, i);
             error_msg("\t\t No scale factor applied at all. No frame returns...\n");
+            VIDEO_FRAME_DISPOSE(out);
+            VIDEO_FRAME_DISPOSE(in);
             return NULL;
         }
     }
 
     VIDEO_FRAME_DISPOSE(in);
 
-    return s->frame;
+    return out;
 }
 
 static struct capture_filter_info capture_filter_resize = {
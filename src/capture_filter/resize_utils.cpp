@@ -51,86 +51,582 @@
 #include "config_win32.h"
 #endif
 
-#include <opencv2/opencv.hpp>
-#include <opencv2/imgproc/types_c.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "capture_filter/resize_utils.h"
+#include "utils/worker.h"
+#include "video_codec.h"
+
+#define COEF_BITS 14   ///< filter coefficients are fixed-point with this precision
+#define INTERM_BITS 15 ///< precision of horizontally scaled (intermediate) samples
+
+static constexpr int MIN_LINES_PER_WORKER = 32;
+
+using namespace std;
+
+namespace {
+/**
+ * Polyphase filter - for every output position there are taps consecutive
+ * source samples starting at first (clamped indices are in index) and weights
+ * summing up to 1 << COEF_BITS.
+ */
+struct scale_filter {
+    scale_filter(int src_len, int dst_len, enum resize_filter kernel);
+    int taps;
+    vector<int> first;
+    vector<int> index;
+    vector<int16_t> coef;
+};
+
+/// single color component within picture lines
+struct plane {
+    int offset; ///< first sample index in line
+    int step;   ///< distance of horizontally neighbouring samples (in samples)
+    int width;
+    int black;
+};
+
+/**
+ * Lines of samples shared by one or more planes - packed formats have all
+ * components in one picture, planar formats have a picture per plane.
+ */
+struct picture {
+    unsigned char *data;
+    long pitch;    ///< bytes
+    int height;
+    int line_len;  ///< samples
+    int bits;      ///< 8 for uint8_t samples, uint16_t samples otherwise
+    vector<plane> planes;
+};
+
+struct scale_task {
+    const picture *in;
+    const picture *out;
+    const scale_filter *vf;
+    const vector<scale_filter> *hf; ///< per plane
+    int y_start;
+    int y_end;
+};
+
+struct v210_task {
+    unsigned char *packed; ///< v210 data
+    long packed_pitch;
+    vector<picture> *pictures;
+    int y_start;
+    int y_end;
+};
+} // end of anonymous namespace
+
+/// @returns kernel radius (in source samples when not downscaling)
+static double get_kernel_radius(enum resize_filter kernel)
+{
+    return kernel == RESIZE_BILINEAR ? 1.0 : 2.0;
+}
+
+static double get_kernel_weight(enum resize_filter kernel, double x)
+{
+    x = fabs(x);
+    switch (kernel) {
+    case RESIZE_BILINEAR:
+        return max(0.0, 1.0 - x);
+    case RESIZE_TRIANGULAR:
+        return max(0.0, 1.0 - x / 2.0);
+    case RESIZE_CATMULL_ROM:
+        if (x < 1.0) {
+            return 1.5 * x * x * x - 2.5 * x * x + 1.0;
+        }
+        return x < 2.0 ? -0.5 * x * x * x + 2.5 * x * x - 4.0 * x + 2.0 : 0.0;
+    case RESIZE_BSPLINE:
+        if (x < 1.0) {
+            return 2.0 / 3.0 + 0.5 * x * x * x - x * x;
+        }
+        return x < 2.0 ? (2.0 - x) * (2.0 - x) * (2.0 - x) / 6.0 : 0.0;
+    }
+    return 0.0;
+}
+
+/**
+ * The kernel is widened when downscaling so that all source samples
+ * contribute to the output.
+ */
+scale_filter::scale_filter(int src_len, int dst_len, enum resize_filter kernel)
+{
+    double scale = (double) src_len / dst_len;
+    double stretch = max(scale, 1.0);
+    double support = stretch * get_kernel_radius(kernel);
+    taps = (int) ceil(2.0 * support);
+    first.resize(dst_len);
+    index.resize(dst_len * taps);
+    coef.resize(dst_len * taps);
+    vector<double> weights(taps);
+
+    for (int x = 0; x < dst_len; ++x) {
+        double center = (x + 0.5) * scale - 0.5;
+        first[x] = (int) floor(center - support) + 1;
+        double sum = 0.0;
+        for (int k = 0; k < taps; ++k) {
+            weights[k] = get_kernel_weight(kernel, (first[x] + k - center) / stretch);
+            sum += weights[k];
+        }
+        int isum = 0;
+        int max_k = 0;
+        for (int k = 0; k < taps; ++k) {
+            int16_t c = lround(weights[k] / sum * (1 << COEF_BITS));
+            coef[x * taps + k] = c;
+            index[x * taps + k] = min(max(first[x] + k, 0), src_len - 1);
+            isum += c;
+            if (c > coef[x * taps + max_k]) {
+                max_k = k;
+            }
+        }
+        coef[x * taps + max_k] += (1 << COEF_BITS) - isum;
+    }
+}
+
+#ifdef __SSE2__
+template<typename T> static inline __m128i load_8_samples(const T *src);
+template<> inline __m128i load_8_samples<uint8_t>(const uint8_t *src) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) src), _mm_setzero_si128());
+}
+template<> inline __m128i load_8_samples<uint16_t>(const uint16_t *src) {
+    return _mm_loadu_si128((const __m128i *) src);
+}
+#endif
 
-using namespace cv;
+/**
+ * Vertical pass - computes one intermediate line (with INTERM_BITS precision)
+ * from taps source lines. Samples of all planes in the line are processed at once.
+ */
+template<typename T>
+static void scale_vertical(const T *const *lines, const int16_t *coef, int taps, int16_t *out, int len, int shift)
+{
+    const int out_shift = COEF_BITS - shift;
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i round = _mm_set1_epi32(1 << (out_shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(out_shift);
+    for ( ; x + 8 <= len; x += 8) {
+        __m128i acc_lo = round;
+        __m128i acc_hi = round;
+        for (int k = 0; k < taps; ++k) {
+            __m128i c = _mm_set1_epi16(coef[k]);
+            __m128i val = load_8_samples<T>(lines[k] + x);
+            __m128i lo = _mm_mullo_epi16(val, c);
+            __m128i hi = _mm_mulhi_epi16(val, c);
+            acc_lo = _mm_add_epi32(acc_lo, _mm_unpacklo_epi16(lo, hi));
+            acc_hi = _mm_add_epi32(acc_hi, _mm_unpackhi_epi16(lo, hi));
+        }
+        __m128i res = _mm_packs_epi32(_mm_sra_epi32(acc_lo, count), _mm_sra_epi32(acc_hi, count));
+        _mm_storeu_si128((__m128i *) (out + x), res);
+    }
+#endif
+    for ( ; x < len; ++x) {
+        int acc = 1 << (out_shift - 1);
+        for (int k = 0; k < taps; ++k) {
+            acc += coef[k] * lines[k][x];
+        }
+        out[x] = min(max(acc >> out_shift, INT16_MIN), INT16_MAX);
+    }
+}
 
-static Mat ug_to_rgb_mat(codec_t codec, int width, int height, char *indata) {
-    Mat yuv;
-    Mat rgb;
-    int pix_fmt = CV_8UC2;
-    int cv_color;
-    int num = 1, den = 1;
+/**
+ * Horizontal pass - scales one plane of the intermediate line and stores the
+ * result to the output line. Input samples are contiguous and padded by
+ * replicated edge samples (at least taps on each side). TAPS is a compile-time
+ * taps count for common filters (0 - use the filter value).
+ */
+template<typename T, int TAPS>
+static void scale_horizontal(const int16_t *src, const scale_filter &hf,
+        T *out, const plane &out_plane, int shift, int max_val)
+{
+    const int taps = TAPS > 0 ? TAPS : hf.taps;
+    const int total_shift = COEF_BITS + shift;
+    const int16_t *c = hf.coef.data();
+    T *dst = out + out_plane.offset;
+    for (int x = 0; x < out_plane.width; ++x) {
+        const int16_t *s = src + hf.first[x];
+        int acc = 1 << (total_shift - 1);
+        for (int k = 0; k < taps; ++k) {
+            acc += c[k] * s[k];
+        }
+        dst[x * out_plane.step] = min(max(acc >> total_shift, 0), max_val);
+        c += taps;
+    }
+}
+
+template<typename T>
+static void scale_horizontal(const int16_t *in, const plane &in_plane, const scale_filter &hf,
+        int16_t *buf, T *out, const plane &out_plane, int shift, int max_val)
+{
+    // gather plane samples to a contiguous buffer with replicated edges
+    const int pad = hf.taps;
+    for (int i = 0; i < pad; ++i) {
+        buf[i] = in[in_plane.offset];
+        buf[pad + in_plane.width + i] = in[in_plane.offset + (in_plane.width - 1) * in_plane.step];
+    }
+    for (int i = 0; i < in_plane.width; ++i) {
+        buf[pad + i] = in[in_plane.offset + i * in_plane.step];
+    }
+    const int16_t *src = buf + pad;
+
+    switch (hf.taps) {
+    case 2:
+        return scale_horizontal<T, 2>(src, hf, out, out_plane, shift, max_val);
+    case 3:
+        return scale_horizontal<T, 3>(src, hf, out, out_plane, shift, max_val);
+    case 4:
+        return scale_horizontal<T, 4>(src, hf, out, out_plane, shift, max_val);
+    default:
+        return scale_horizontal<T, 0>(src, hf, out, out_plane, shift, max_val);
+    }
+}
+
+/**
+ * Scales output lines [y_start, y_end) of a picture. Downscaling vertically
+ * first keeps the (gathering) horizontal pass to output lines only.
+ */
+template<typename T>
+static void scale_picture_lines(const scale_task &t)
+{
+    const picture &in = *t.in;
+    const picture &out = *t.out;
+    const int shift = INTERM_BITS - in.bits;
+    const int max_val = (1 << in.bits) - 1;
+
+    vector<int16_t> interm(in.line_len);
+    size_t buf_len = 0;
+    for (unsigned int i = 0; i < in.planes.size(); ++i) {
+        buf_len = max<size_t>(buf_len, in.planes[i].width + 2 * (*t.hf)[i].taps);
+    }
+    vector<int16_t> buf(buf_len);
+    vector<const T *> lines(t.vf->taps);
+    for (int y = t.y_start; y < t.y_end; ++y) {
+        for (int k = 0; k < t.vf->taps; ++k) {
+            lines[k] = (const T *) (in.data + t.vf->index[y * t.vf->taps + k] * in.pitch);
+        }
+        scale_vertical<T>(lines.data(), &t.vf->coef[y * t.vf->taps], t.vf->taps, interm.data(), in.line_len, shift);
+        T *dst = (T *) (out.data + y * out.pitch);
+        for (unsigned int i = 0; i < in.planes.size(); ++i) {
+            scale_horizontal<T>(interm.data(), in.planes[i], (*t.hf)[i], buf.data(), dst, out.planes[i], shift, max_val);
+        }
+    }
+}
+
+static void *scale_picture_worker(void *arg)
+{
+    auto t = (scale_task *) arg;
+    if (t->in->bits == 8) {
+        scale_picture_lines<uint8_t>(*t);
+    } else {
+        scale_picture_lines<uint16_t>(*t);
+    }
+    return NULL;
+}
+
+static int get_worker_count(int lines)
+{
+    return min<int>(max(lines / MIN_LINES_PER_WORKER, 1), max(thread::hardware_concurrency(), 1u));
+}
+
+/**
+ * Returns pictures of the frame in a codec with 8-bit components (or in the
+ * planar 16-bit 4:2:2 representation used for v210).
+ */
+static vector<picture> get_pictures(codec_t codec, unsigned char *data, int width, int height)
+{
+    auto packed = [&](int pixel_len, const int *offsets, const int *h_sub, const int *black) {
+        picture ret{data, vc_get_linesize(width, codec), height, width * pixel_len, 8, {}};
+        for (int i = 0; offsets[i] >= 0; ++i) {
+            ret.planes.push_back({offsets[i], pixel_len * h_sub[i], (width + h_sub[i] - 1) / h_sub[i], black[i]});
+        }
+        return vector<picture>{ret};
+    };
+    static const int no_sub[] = { 1, 1, 1, 1 };
+    static const int rgb_black[] = { 0, 0, 0, 255 };
+    static const int uyvy_black[] = { 16, 128, 128 };
+    static const int uyvy_sub[] = { 1, 2, 2 };
 
     switch (codec) {
-    case RGB:
-        rgb.create(height, width, CV_8UC3);
-        rgb.data = (uchar*)indata;
-        return rgb;
-    case I420:
-        pix_fmt = CV_8U;
-        num = 3;
-        den = 2;
-        cv_color = CV_YUV2RGB_I420;
-        break;
     case UYVY:
-        cv_color = CV_YUV2RGB_UYVY;
-        break;
+    {
+        static const int offsets[] = { 1, 0, 2, -1 };
+        return packed(2, offsets, uyvy_sub, uyvy_black);
+    }
     case YUYV:
-        cv_color = CV_YUV2RGB_YUYV;
-        break;
+    {
+        static const int offsets[] = { 0, 1, 3, -1 };
+        return packed(2, offsets, uyvy_sub, uyvy_black);
+    }
+    case RGB:
+    case BGR:
+    {
+        static const int offsets[] = { 0, 1, 2, -1 };
+        return packed(3, offsets, no_sub, rgb_black);
+    }
+    case RGBA:
+    {
+        static const int offsets[] = { 0, 1, 2, 3, -1 };
+        return packed(4, offsets, no_sub, rgb_black);
+    }
+    case v210:
+    {
+        // unpacked to 16-bit planes
+        vector<picture> ret;
+        int chroma_width = (width + 1) / 2;
+        ret.push_back({data, 2L * width, height, width, 10, {{0, 1, width, 64}}});
+        data += 2L * width * height;
+        for (int i = 0; i < 2; ++i) {
+            ret.push_back({data, 2L * chroma_width, height, chroma_width, 10, {{0, 1, chroma_width, 512}}});
+            data += 2L * chroma_width * height;
+        }
+        return ret;
+    }
     default:
-        assert(0 && "Unsupported codec!");
+        assert(codec_is_planar(codec));
+        int sub[8];
+        codec_get_planes_subsampling(codec, sub);
+        vector<picture> ret;
+        for (int i = 0; i < 4 && sub[2 * i] != 0; ++i) {
+            int plane_width = (width + sub[2 * i] - 1) / sub[2 * i];
+            int plane_height = (height + sub[2 * i + 1] - 1) / sub[2 * i + 1];
+            ret.push_back({data, plane_width, plane_height, plane_width, 8,
+                    {{0, 1, plane_width, i == 0 ? 16 : 128}}});
+            data += (long) plane_width * plane_height;
+        }
+        return ret;
     }
-    yuv.create(height * num / den, width, pix_fmt);
-    yuv.data = (uchar*)indata;
-    cvtColor(yuv, rgb, cv_color);
+}
 
-    return rgb;
+static size_t get_v210_planar_size(int width, int height)
+{
+    return 2L * (width + 2 * ((width + 1) / 2)) * height;
 }
 
-int resize_frame(char *indata, codec_t in_color, char *outdata, unsigned int width, unsigned int height, double scale_factor){
-    Mat rgb, out(height * scale_factor, width * scale_factor, CV_8UC3, outdata);
+static void *v210_unpack_worker(void *arg)
+{
+    auto t = (v210_task *) arg;
+    vector<picture> &p = *t->pictures;
+    const int width = p[0].line_len;
+    const int chroma_width = p[1].line_len;
+    for (int y = t->y_start; y < t->y_end; ++y) {
+        const uint32_t *in = (const uint32_t *) (t->packed + y * t->packed_pitch);
+        uint16_t *y_line = (uint16_t *) (p[0].data + y * p[0].pitch);
+        uint16_t *cb_line = (uint16_t *) (p[1].data + y * p[1].pitch);
+        uint16_t *cr_line = (uint16_t *) (p[2].data + y * p[2].pitch);
+        uint16_t ys[6], cbs[3], crs[3];
+        for (int x = 0; x < width; x += 6) {
+            cbs[0] = in[0] & 0x3ff; ys[0] = (in[0] >> 10) & 0x3ff; crs[0] = (in[0] >> 20) & 0x3ff;
+            ys[1] = in[1] & 0x3ff; cbs[1] = (in[1] >> 10) & 0x3ff; ys[2] = (in[1] >> 20) & 0x3ff;
+            crs[1] = in[2] & 0x3ff; ys[3] = (in[2] >> 10) & 0x3ff; cbs[2] = (in[2] >> 20) & 0x3ff;
+            ys[4] = in[3] & 0x3ff; crs[2] = (in[3] >> 10) & 0x3ff; ys[5] = (in[3] >> 20) & 0x3ff;
+            in += 4;
+            for (int i = 0; i < 6 && x + i < width; ++i) {
+                y_line[x + i] = ys[i];
+            }
+            for (int i = 0; i < 3 && x / 2 + i < chroma_width; ++i) {
+                cb_line[x / 2 + i] = cbs[i];
+                cr_line[x / 2 + i] = crs[i];
+            }
+        }
+    }
+    return NULL;
+}
 
-    if (indata == NULL || outdata == NULL) {
-        return 1;
+static void *v210_pack_worker(void *arg)
+{
+    auto t = (v210_task *) arg;
+    vector<picture> &p = *t->pictures;
+    const int width = p[0].line_len;
+    const int chroma_width = p[1].line_len;
+    for (int y = t->y_start; y < t->y_end; ++y) {
+        uint32_t *out = (uint32_t *) (t->packed + y * t->packed_pitch);
+        const uint16_t *y_line = (const uint16_t *) (p[0].data + y * p[0].pitch);
+        const uint16_t *cb_line = (const uint16_t *) (p[1].data + y * p[1].pitch);
+        const uint16_t *cr_line = (const uint16_t *) (p[2].data + y * p[2].pitch);
+        uint32_t ys[6], cbs[3], crs[3];
+        for (int x = 0; x < width; x += 6) {
+            for (int i = 0; i < 6; ++i) {
+                ys[i] = x + i < width ? y_line[x + i] : 64;
+            }
+            for (int i = 0; i < 3; ++i) {
+                cbs[i] = x / 2 + i < chroma_width ? cb_line[x / 2 + i] : 512;
+                crs[i] = x / 2 + i < chroma_width ? cr_line[x / 2 + i] : 512;
+            }
+            *out++ = cbs[0] | ys[0] << 10 | crs[0] << 20;
+            *out++ = ys[1] | cbs[1] << 10 | ys[2] << 20;
+            *out++ = crs[1] | ys[3] << 10 | cbs[2] << 20;
+            *out++ = ys[4] | crs[2] << 10 | ys[5] << 20;
+        }
+        memset(out, 0, t->packed + (y + 1) * t->packed_pitch - (unsigned char *) out);
     }
+    return NULL;
+}
 
-    rgb = ug_to_rgb_mat(in_color, width, height, indata);
-    resize(rgb, out, Size(0,0), scale_factor, scale_factor, INTER_LINEAR);
+static void run_v210_workers(runnable_t worker, unsigned char *packed, int width, vector<picture> &pictures)
+{
+    int height = pictures[0].height;
+    int workers = get_worker_count(height);
+    vector<v210_task> tasks(workers);
+    for (int i = 0; i < workers; ++i) {
+        tasks[i] = { packed, vc_get_linesize(width, v210), &pictures,
+            height * i / workers, height * (i + 1) / workers };
+    }
+    task_run_parallel(worker, workers, tasks.data(), sizeof tasks[0], NULL);
+}
 
-    return 0;
+static void fill_black(const picture &p)
+{
+    for (int y = 0; y < p.height; ++y) {
+        unsigned char *line = p.data + y * p.pitch;
+        for (auto const &pl : p.planes) {
+            for (int x = 0; x < pl.width; ++x) {
+                int pos = pl.offset + x * pl.step;
+                if (p.bits == 8) {
+                    line[pos] = pl.black;
+                } else {
+                    ((uint16_t *) line)[pos] = pl.black;
+                }
+            }
+        }
+    }
 }
 
-int resize_frame(char *indata, codec_t in_color, char *outdata, unsigned int width, unsigned int height, unsigned int target_width, unsigned int target_height) {
-    Mat rgb, out = cv::Mat::zeros(target_height, target_width, CV_8UC3);
+bool resize_supports_codec(codec_t codec)
+{
+    switch (codec) {
+    case UYVY:
+    case YUYV:
+    case RGB:
+    case BGR:
+    case RGBA:
+    case v210:
+        return true;
+    default:
+        return codec_is_planar(codec) && get_bits_per_component(codec) == 8;
+    }
+}
 
-    if (indata == NULL || outdata == NULL) {
+/**
+ * Scales the input pictures to the area (x, y, w, h) of the output pictures,
+ * coordinates are in pixels of the whole (target_width x target_height) frame.
+ */
+static void scale_to_area(const vector<picture> &in_pics, const vector<picture> &out_pics,
+        unsigned int target_width, unsigned int target_height,
+        unsigned int x, unsigned int y, unsigned int w, unsigned int h,
+        enum resize_filter filter, bool letterbox)
+{
+    vector<picture> out_areas;
+    vector<scale_filter> v_filters;
+    vector<vector<scale_filter>> h_filters(in_pics.size());
+    v_filters.reserve(in_pics.size());
+    for (unsigned int i = 0; i < in_pics.size(); ++i) {
+        const picture &full = out_pics[i];
+        if (letterbox) {
+            fill_black(full);
+        }
+        // picture area scaled to the picture (and plane) subsampling
+        int sy = (target_height + full.height - 1) / full.height;
+        picture area = full;
+        area.data += (y / sy) * full.pitch;
+        area.height = (h + sy - 1) / sy;
+        for (auto &pl : area.planes) {
+            int sx = (target_width + pl.width - 1) / pl.width;
+            pl.offset += (x / sx) * pl.step;
+            pl.width = (w + sx - 1) / sx;
+        }
+        out_areas.push_back(area);
+        v_filters.emplace_back(in_pics[i].height, area.height, filter);
+        for (unsigned int j = 0; j < area.planes.size(); ++j) {
+            h_filters[i].emplace_back(in_pics[i].planes[j].width, area.planes[j].width, filter);
+        }
+    }
+
+    vector<scale_task> tasks;
+    for (unsigned int i = 0; i < in_pics.size(); ++i) {
+        int workers = get_worker_count(out_areas[i].height);
+        for (int j = 0; j < workers; ++j) {
+            tasks.push_back({ &in_pics[i], &out_areas[i], &v_filters[i], &h_filters[i],
+                    out_areas[i].height * j / workers, out_areas[i].height * (j + 1) / workers });
+        }
+    }
+    task_run_parallel(scale_picture_worker, tasks.size(), tasks.data(), sizeof tasks[0], NULL);
+}
+
+int resize_frame(char *indata, codec_t codec, char *outdata, unsigned int width, unsigned int height,
+        unsigned int target_width, unsigned int target_height, bool keep_aspect)
+{
+    if (indata == NULL || outdata == NULL || !resize_supports_codec(codec)) {
         return 1;
     }
 
-    rgb = ug_to_rgb_mat(in_color, width, height, indata);
+    // picture area within the output, dimensions are kept even because of chroma subsampling
+    unsigned int x = 0, y = 0, w = target_width, h = target_height;
+    if (keep_aspect) {
+        double in_aspect = (double) width / height;
+        double out_aspect = (double) target_width / target_height;
+        if (in_aspect > out_aspect) {
+            h = min<unsigned int>(target_width / in_aspect + 1, target_height) & ~1u;
+            y = (target_height - h) / 2 & ~1u;
+        } else {
+            w = min<unsigned int>(target_height * in_aspect + 1, target_width) & ~1u;
+            x = (target_width - w) / 2 & ~1u;
+        }
+    }
+    bool letterbox = w != target_width || h != target_height;
 
-    double in_aspect = (double) width / height;
-    double out_aspect = (double) target_width / target_height;
-    Rect r;
-    if (in_aspect > out_aspect) {
-        r.x = 0;
-        r.width = target_width;
-        r.height = target_width / in_aspect;
-        r.y = (target_height - r.height) / 2;
-    } else {
-        r.y = 0;
-        r.height = target_height;
-        r.width = target_height * in_aspect;
-        r.x = (target_width - r.width) / 2;
+    vector<unsigned char> in_unpacked, out_unpacked;
+    unsigned char *in_ptr = (unsigned char *) indata;
+    unsigned char *out_ptr = (unsigned char *) outdata;
+    if (codec == v210) {
+        in_unpacked.resize(get_v210_planar_size(width, height));
+        out_unpacked.resize(get_v210_planar_size(target_width, target_height));
+        in_ptr = in_unpacked.data();
+        out_ptr = out_unpacked.data();
+    }
+    vector<picture> in_pics = get_pictures(codec, in_ptr, width, height);
+    vector<picture> out_pics = get_pictures(codec, out_ptr, target_width, target_height);
+    if (codec == v210) {
+        run_v210_workers(v210_unpack_worker, (unsigned char *) indata, width, in_pics);
+    }
+
+    scale_to_area(in_pics, out_pics, target_width, target_height, x, y, w, h, RESIZE_BILINEAR, letterbox);
+
+    if (codec == v210) {
+        run_v210_workers(v210_pack_worker, (unsigned char *) outdata, target_width, out_pics);
+    }
+
+    return 0;
+}
+
+int resize_frame_to_rect(const char *indata, codec_t codec, unsigned int width, unsigned int height,
+        char *outdata, unsigned int target_width, unsigned int target_height,
+        unsigned int x, unsigned int y, unsigned int w, unsigned int h, enum resize_filter filter)
+{
+    if (indata == NULL || outdata == NULL || codec == v210 || !resize_supports_codec(codec)) {
+        return 1;
+    }
+    if (w == 0 || h == 0 || x + w > target_width || y + h > target_height) {
+        return 1;
+    }
+    if (codec == UYVY || codec == YUYV || codec_is_planar(codec)) {
+        // keep the area aligned to (possibly subsampled) chroma samples
+        x &= ~1u;
+        y &= ~1u;
     }
 
-    out.data = (uchar *) outdata;
-    resize(rgb, out(r), r.size());
+    // input pictures are only read
+    vector<picture> in_pics = get_pictures(codec, (unsigned char *) const_cast<char *>(indata), width, height);
+    vector<picture> out_pics = get_pictures(codec, (unsigned char *) outdata, target_width, target_height);
+    scale_to_area(in_pics, out_pics, target_width, target_height, x, y, w, h, filter, false);
 
     return 0;
 }
@@ -47,7 +47,32 @@
 
 #include "types.h"
 
-int resize_frame(char *indata, codec_t in_color, char *outdata, unsigned int width, unsigned int height, double scale_factor);
-int resize_frame(char *indata, codec_t in_color, char *outdata, unsigned int width, unsigned int height, unsigned int target_width, unsigned int target_height);
+enum resize_filter {
+    RESIZE_BILINEAR,
+    RESIZE_TRIANGULAR,  ///< linear with twice the radius (softer than bilinear)
+    RESIZE_CATMULL_ROM, ///< sharp bicubic
+    RESIZE_BSPLINE,     ///< smooth bicubic
+};
+
+bool resize_supports_codec(codec_t codec);
+/**
+ * Scales the picture keeping its pixel format. The work is split among
+ * available CPU cores.
+ *
+ * @param keep_aspect if true, the picture is letterboxed to keep its aspect ratio
+ * @retval 0 on success
+ */
+int resize_frame(char *indata, codec_t codec, char *outdata, unsigned int width, unsigned int height,
+        unsigned int target_width, unsigned int target_height, bool keep_aspect);
+/**
+ * Scales the picture to the area (x, y, w, h) of a target_width x target_height
+ * output picture of the same pixel format, rest of the output is left untouched.
+ * The area must lie within the output. v210 is not supported.
+ *
+ * @retval 0 on success
+ */
+int resize_frame_to_rect(const char *indata, codec_t codec, unsigned int width, unsigned int height,
+        char *outdata, unsigned int target_width, unsigned int target_height,
+        unsigned int x, unsigned int y, unsigned int w, unsigned int h, enum resize_filter filter);
 
 #endif// RESIZE_UTILS_H_
@@ -49,46 +49,70 @@
 #include "debug.h"
 #include "lib_common.h"
 
+#include <mutex>
 #include <string.h>
 #include <openssl/aes.h>
+#include <openssl/evp.h>
 
 struct openssl_decrypt {
         AES_KEY key;
+        unsigned char key_bytes[16];
 
         unsigned char ivec[AES_BLOCK_SIZE];
         unsigned char ecount[AES_BLOCK_SIZE];
         unsigned int num;
+
+        EVP_CIPHER_CTX *ctx; ///< AEAD context used by openssl_decrypt()
+        std::mutex lock; ///< serializes non-AEAD modes in openssl_decrypt_batch
 };
 
+static EVP_CIPHER_CTX *create_gcm_ctx(const unsigned char *key)
+{
+        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+        if (ctx == NULL) {
+                return NULL;
+        }
+        if (EVP_DecryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, key, NULL) != 1) {
+                EVP_CIPHER_CTX_free(ctx);
+                return NULL;
+        }
+        return ctx;
+}
+
+static void openssl_decrypt_destroy(struct openssl_decrypt *s)
+{
+        if(!s)
+                return;
+        if (s->ctx) {
+                EVP_CIPHER_CTX_free(s->ctx);
+        }
+        delete s;
+}
+
 static int openssl_decrypt_init(struct openssl_decrypt **state,
                                 const char *passphrase)
 {
-        struct openssl_decrypt *s =
-                (struct openssl_decrypt *)
-                calloc(1, sizeof(struct openssl_decrypt));
+        struct openssl_decrypt *s = new openssl_decrypt();
 
         MD5_CTX context;
-        unsigned char hash[16];
 
         MD5Init(&context);
         MD5Update(&context, (const unsigned char *) passphrase,
                         strlen(passphrase));
-        MD5Final(hash, &context);
+        MD5Final(s->key_bytes, &context);
 
-        AES_set_encrypt_key(hash, 128, &s->key);
+        AES_set_encrypt_key(s->key_bytes, 128, &s->key);
         // for ECB it should be AES_set_decrypt_key(hash, 128, &s->key);
 
+        if ((s->ctx = create_gcm_ctx(s->key_bytes)) == NULL) {
+                openssl_decrypt_destroy(s);
+                return -1;
+        }
+
         *state = s;
         return 0;
 }
 
-static void openssl_decrypt_destroy(struct openssl_decrypt *s)
-{
-        if(!s)
-                return;
-        free(s);
-}
-
 static void openssl_decrypt_block(struct openssl_decrypt *s,
                 const unsigned char *ciphertext, unsigned char *plaintext, const char *ivec_or_nonce_and_counter,
                 int len, enum openssl_mode mode)
@@ -127,14 +151,55 @@ static void openssl_decrypt_block(struct openssl_decrypt *s,
         }
 }
 
+/**
+ * @see openssl_encrypt_gcm for the format
+ * @retval 0 if authentication fails
+ */
+static int openssl_decrypt_gcm(EVP_CIPHER_CTX *ctx,
+                const char *ciphertext, int ciphertext_len,
+                const char *aad, int aad_len, char *plaintext)
+{
+        uint32_t data_len;
+        memcpy(&data_len, ciphertext, sizeof(uint32_t));
+        if (ciphertext_len < (int) (sizeof(uint32_t) + GCM_IV_LEN + GCM_TAG_LEN) ||
+                        data_len > ciphertext_len - sizeof(uint32_t) - GCM_IV_LEN - GCM_TAG_LEN) {
+                return 0;
+        }
+        const unsigned char *iv = (const unsigned char *) ciphertext + sizeof(uint32_t);
+        ciphertext += sizeof(uint32_t) + GCM_IV_LEN;
+        unsigned char tag[GCM_TAG_LEN];
+        memcpy(tag, ciphertext + data_len, GCM_TAG_LEN);
+
+        int len = 0;
+        int final_len = 0;
+        if (EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv) != 1 ||
+                        (aad_len > 0 && EVP_DecryptUpdate(ctx, NULL, &len,
+                                (const unsigned char *) aad, aad_len) != 1) ||
+                        EVP_DecryptUpdate(ctx, (unsigned char *) plaintext, &len,
+                                (const unsigned char *) ciphertext, data_len) != 1 ||
+                        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_LEN, tag) != 1 ||
+                        EVP_DecryptFinal_ex(ctx, (unsigned char *) plaintext + len, &final_len) != 1) {
+                return 0;
+        }
+        return data_len;
+}
+
 static int openssl_decrypt(struct openssl_decrypt *decrypt,
                 const char *ciphertext, int ciphertext_len,
                 const char *aad, int aad_len,
                 char *plaintext, enum openssl_mode mode)
 {
-        UNUSED(ciphertext_len);
+        if (mode == MODE_AES128_GCM) {
+                return openssl_decrypt_gcm(decrypt->ctx, ciphertext, ciphertext_len,
+                                aad, aad_len, plaintext);
+        }
+
         uint32_t data_len;
         memcpy(&data_len, ciphertext, sizeof(uint32_t));
+        if (ciphertext_len < (int) (2 * sizeof(uint32_t) + 16) ||
+                        data_len > ciphertext_len - 2 * sizeof(uint32_t) - 16) {
+                return 0;
+        }
         ciphertext += sizeof(uint32_t);
 
         const char *nonce_and_counter = ciphertext;
@@ -164,10 +229,36 @@ static int openssl_decrypt(struct openssl_decrypt *decrypt,
         return data_len;
 }
 
+static void openssl_decrypt_batch(struct openssl_decrypt *s,
+                struct openssl_decrypt_packet *packets, int count)
+{
+        EVP_CIPHER_CTX *ctx = NULL;
+        for (int i = 0; i < count; ++i) {
+                struct openssl_decrypt_packet *p = &packets[i];
+                if (p->mode != MODE_AES128_GCM) {
+                        std::lock_guard<std::mutex> lk(s->lock);
+                        p->plaintext_len = openssl_decrypt(s, p->ciphertext, p->ciphertext_len,
+                                        p->aad, p->aad_len, p->plaintext, p->mode);
+                        continue;
+                }
+                // own context so that batches can be processed concurrently
+                if (ctx == NULL && (ctx = create_gcm_ctx(s->key_bytes)) == NULL) {
+                        p->plaintext_len = 0;
+                        continue;
+                }
+                p->plaintext_len = openssl_decrypt_gcm(ctx, p->ciphertext, p->ciphertext_len,
+                                p->aad, p->aad_len, p->plaintext);
+        }
+        if (ctx) {
+                EVP_CIPHER_CTX_free(ctx);
+        }
+}
+
 static const struct openssl_decrypt_info functions = {
         openssl_decrypt_init,
         openssl_decrypt_destroy,
         openssl_decrypt,
+        openssl_decrypt_batch,
 };
 
 REGISTER_MODULE(openssl_decrypt, &functions, LIBRARY_CLASS_UNDEFINED, OPENSSL_DECRYPT_ABI_VERSION);
@@ -41,10 +41,23 @@
 #ifdef __cplusplus
 #include "crypto/openssl_encrypt.h" // enum openssl_mode
 
-#define OPENSSL_DECRYPT_ABI_VERSION 1
+#define OPENSSL_DECRYPT_ABI_VERSION 2
 
 struct openssl_decrypt;
 
+/**
+ * Packet for openssl_decrypt_info::decrypt_batch
+ */
+struct openssl_decrypt_packet {
+        const char *ciphertext;
+        int ciphertext_len;
+        const char *aad;
+        int aad_len;
+        enum openssl_mode mode;
+        char *plaintext;    ///< output buffer of at least ciphertext_len bytes
+        int plaintext_len;  ///< [out] length of plaintext, 0 if checksum doesn't match
+};
+
 struct openssl_decrypt_info {
         /**
          * Creates decryption state
@@ -78,6 +91,14 @@ struct openssl_decrypt_info {
                         const char *ciphertext, int ciphertext_len,
                         const char *aad, int aad_len,
                         char *plaintext, enum openssl_mode mode);
+        /**
+         * Decrypts multiple packets, each one as with decrypt().
+         *
+         * Unlike decrypt(), this function may be called concurrently from
+         * multiple threads (AEAD packets are then processed in parallel).
+         */
+        void (*decrypt_batch)(struct openssl_decrypt *decrypt,
+                        struct openssl_decrypt_packet *packets, int count);
 };
 
 #endif // __cplusplus
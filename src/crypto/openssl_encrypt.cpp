@@ -47,41 +47,80 @@
 #include "debug.h"
 #include "lib_common.h"
 
+#include <atomic>
+#include <mutex>
 #include <string.h>
 #include <openssl/aes.h>
+#include <openssl/evp.h>
 #include <openssl/rand.h>
 
 struct openssl_encrypt {
         AES_KEY key;
+        unsigned char key_bytes[16];
 
         enum openssl_mode mode;
 
         unsigned char ivec[16];
         unsigned int num;
         unsigned char ecount[16];
+
+        EVP_CIPHER_CTX *ctx; ///< AEAD context used by openssl_encrypt()
+        unsigned char gcm_salt[4];
+        std::atomic<uint64_t> gcm_counter; ///< invocation part of GCM IV
+        std::mutex lock; ///< serializes non-AEAD modes in openssl_encrypt_batch (chained IV)
 };
 
+static EVP_CIPHER_CTX *create_gcm_ctx(const unsigned char *key)
+{
+        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+        if (ctx == NULL) {
+                return NULL;
+        }
+        if (EVP_EncryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, key, NULL) != 1) {
+                EVP_CIPHER_CTX_free(ctx);
+                return NULL;
+        }
+        return ctx;
+}
+
+static void openssl_encrypt_destroy(struct openssl_encrypt *s)
+{
+        if (s->ctx) {
+                EVP_CIPHER_CTX_free(s->ctx);
+        }
+        delete s;
+}
+
 static int openssl_encrypt_init(struct openssl_encrypt **state, const char *passphrase,
                 enum openssl_mode mode)
 {
-        struct openssl_encrypt *s = (struct openssl_encrypt *)
-                calloc(1, sizeof(struct openssl_encrypt));
+        struct openssl_encrypt *s = new openssl_encrypt();
 
         MD5_CTX context;
-        unsigned char hash[16];
 
         MD5Init(&context);
         MD5Update(&context, (const unsigned char *) passphrase,
                         strlen(passphrase));
-        MD5Final(hash, &context);
+        MD5Final(s->key_bytes, &context);
 
-        AES_set_encrypt_key(hash, 128, &s->key);
+        AES_set_encrypt_key(s->key_bytes, 128, &s->key);
         if (!RAND_bytes(s->ivec, 8)) {
-                free(s);
+                openssl_encrypt_destroy(s);
                 return -1;
         }
         s->mode = mode;
-        assert(s->mode == MODE_AES128_CFB || MODE_AES128_CTR); // only functional by now
+        assert(s->mode == MODE_AES128_CFB || s->mode == MODE_AES128_CTR || s->mode == MODE_AES128_GCM); // only functional by now
+
+        if (s->mode == MODE_AES128_GCM) {
+                uint64_t counter;
+                if (!RAND_bytes(s->gcm_salt, sizeof s->gcm_salt) ||
+                                !RAND_bytes((unsigned char *) &counter, sizeof counter) ||
+                                (s->ctx = create_gcm_ctx(s->key_bytes)) == NULL) {
+                        openssl_encrypt_destroy(s);
+                        return -1;
+                }
+                s->gcm_counter = counter;
+        }
 
         *state = s;
         return 0;
@@ -127,17 +166,51 @@ static void openssl_encrypt_block(struct openssl_encrypt *s, unsigned char *plai
                         AES_ecb_encrypt(plaintext, ciphertext,
                                         &s->key, AES_ENCRYPT);
                         break;
+                case MODE_AES128_GCM:
+                        abort(); // whole packets only
         }
 }
 
-static void openssl_encrypt_destroy(struct openssl_encrypt *s)
+/**
+ * Encrypts the packet in one pass with AES-GCM, the tag authenticates
+ * both the ciphertext and AAD.
+ *
+ * Output: data_len (4 B), IV (12 B), ciphertext, tag (16 B)
+ */
+static int openssl_encrypt_gcm(struct openssl_encrypt *s, EVP_CIPHER_CTX *ctx,
+                const char *plaintext, int data_len, const char *aad, int aad_len, char *ciphertext)
 {
-        free(s);
+        memcpy(ciphertext, &data_len, sizeof(uint32_t));
+        ciphertext += sizeof(uint32_t);
+        unsigned char *iv = (unsigned char *) ciphertext;
+        uint64_t counter = s->gcm_counter++;
+        memcpy(iv, s->gcm_salt, sizeof s->gcm_salt);
+        memcpy(iv + sizeof s->gcm_salt, &counter, sizeof counter);
+        ciphertext += GCM_IV_LEN;
+
+        int len = 0;
+        int final_len = 0;
+        if (EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) != 1 ||
+                        (aad_len > 0 && EVP_EncryptUpdate(ctx, NULL, &len,
+                                (const unsigned char *) aad, aad_len) != 1) ||
+                        EVP_EncryptUpdate(ctx, (unsigned char *) ciphertext, &len,
+                                (const unsigned char *) plaintext, data_len) != 1 ||
+                        EVP_EncryptFinal_ex(ctx, (unsigned char *) ciphertext + len, &final_len) != 1 ||
+                        EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_LEN, ciphertext + data_len) != 1) {
+                log_msg(LOG_LEVEL_ERROR, "AES-GCM encryption failed!\n");
+                return 0;
+        }
+        return sizeof(uint32_t) + GCM_IV_LEN + data_len + GCM_TAG_LEN;
 }
 
 static int openssl_encrypt(struct openssl_encrypt *encryption,
                 char *plaintext, int data_len, char *aad, int aad_len, char *ciphertext)
 {
+        if (encryption->mode == MODE_AES128_GCM) {
+                return openssl_encrypt_gcm(encryption, encryption->ctx, plaintext, data_len,
+                                aad, aad_len, ciphertext);
+        }
+
         uint32_t crc = 0xffffffff;
         memcpy(ciphertext, &data_len, sizeof(uint32_t));
         ciphertext += sizeof(uint32_t);
@@ -167,6 +240,32 @@ static int openssl_encrypt(struct openssl_encrypt *encryption,
         return data_len + sizeof(crc) + 16 + sizeof(uint32_t);
 }
 
+static void openssl_encrypt_batch(struct openssl_encrypt *s,
+                struct openssl_encrypt_packet *packets, int count)
+{
+        if (s->mode != MODE_AES128_GCM) {
+                std::lock_guard<std::mutex> lk(s->lock);
+                for (int i = 0; i < count; ++i) {
+                        packets[i].ciphertext_len = openssl_encrypt(s,
+                                        packets[i].plaintext, packets[i].plaintext_len,
+                                        packets[i].aad, packets[i].aad_len,
+                                        packets[i].ciphertext);
+                }
+                return;
+        }
+
+        // own context so that batches can be processed concurrently
+        EVP_CIPHER_CTX *ctx = create_gcm_ctx(s->key_bytes);
+        for (int i = 0; i < count; ++i) {
+                packets[i].ciphertext_len = ctx == NULL ? 0 :
+                        openssl_encrypt_gcm(s, ctx, packets[i].plaintext, packets[i].plaintext_len,
+                                        packets[i].aad, packets[i].aad_len, packets[i].ciphertext);
+        }
+        if (ctx) {
+                EVP_CIPHER_CTX_free(ctx);
+        }
+}
+
 static int openssl_get_overhead(struct openssl_encrypt *s)
 {
         switch(s->mode) {
@@ -174,6 +273,9 @@ static int openssl_get_overhead(struct openssl_encrypt *s)
                 case MODE_AES128_CTR:
                         return sizeof(uint32_t) /* data_len */ +
                                 16 /* nonce + counter */ + sizeof(uint32_t) /* crc */;
+                case MODE_AES128_GCM:
+                        return sizeof(uint32_t) /* data_len */ +
+                                GCM_IV_LEN + GCM_TAG_LEN;
                 default:
                         abort();
         }
@@ -184,6 +286,7 @@ static const struct openssl_encrypt_info functions = {
         openssl_encrypt_destroy,
         openssl_encrypt,
         openssl_get_overhead,
+        openssl_encrypt_batch,
 };
 
 REGISTER_MODULE(openssl_encrypt, &functions, LIBRARY_CLASS_UNDEFINED, OPENSSL_ENCRYPT_ABI_VERSION);
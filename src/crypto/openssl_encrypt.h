@@ -46,16 +46,31 @@ enum openssl_mode {
         MODE_AES128_NONE = 0,
         MODE_AES128_CTR = 1, // no autenticity, only integrity (CRC)
         MODE_AES128_CFB = 2,
-        MODE_AES128_MAX = MODE_AES128_CFB,
+        MODE_AES128_GCM = 3, // authenticated encryption
+        MODE_AES128_MAX = MODE_AES128_GCM,
         MODE_AES128_ECB = -1, // do not use
 };
 
+#define GCM_IV_LEN 12
+#define GCM_TAG_LEN 16
 
-#define MAX_CRYPTO_EXTRA_DATA 24 // == maximal overhead of available encryptions
+#define MAX_CRYPTO_EXTRA_DATA 32 // == maximal overhead of available encryptions
 #define MAX_CRYPTO_PAD 0 // CTR does not need padding
 #define MAX_CRYPTO_EXCEED (MAX_CRYPTO_EXTRA_DATA + MAX_CRYPTO_PAD)
 
-#define OPENSSL_ENCRYPT_ABI_VERSION 1
+#define OPENSSL_ENCRYPT_ABI_VERSION 2
+
+/**
+ * Packet for openssl_encrypt_info::encrypt_batch
+ */
+struct openssl_encrypt_packet {
+        char *plaintext;
+        int plaintext_len;
+        char *aad;
+        int aad_len;
+        char *ciphertext;   ///< output buffer of at least plaintext_len + get_overhead() bytes
+        int ciphertext_len; ///< [out] size of written ciphertext, 0 on error
+};
 
 struct openssl_encrypt_info {
         /**
@@ -96,6 +111,15 @@ struct openssl_encrypt_info {
          * @returns max overhead (must be <= MAX_CRYPTO_EXCEED)
          */
         int (*get_overhead)(struct openssl_encrypt *encryption);
+        /**
+         * Encrypts multiple packets, each one as with encrypt().
+         *
+         * Unlike encrypt(), this function may be called concurrently from
+         * multiple threads. Only AEAD mode (MODE_AES128_GCM) is processed
+         * in parallel, other modes chain the IV so the calls are serialized.
+         */
+        void (*encrypt_batch)(struct openssl_encrypt *encryption,
+                        struct openssl_encrypt_packet *packets, int count);
 };
 
 #endif // __cplusplus
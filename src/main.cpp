@@ -88,9 +88,11 @@
 #include "rtsp/rtsp_utils.h"
 #include "ug_runtime_error.h"
 #include "utils/color_out.h"
+#include "utils/metrics.h"
 #include "utils/misc.h"
 #include "utils/net.h"
 #include "utils/thread.h"
+#include "utils/video_frame_pool.h"
 #include "utils/wait_obj.h"
 #include "video.h"
 #include "video_capture.h"
@@ -424,6 +426,65 @@ static void print_fps(bool should_print, steady_clock::time_point &t0, int &fram
         }
 }
 
+static constexpr unsigned int DEFAULT_CAPTURE_POOL_FRAMES = 3;
+
+ADD_TO_PARAM(capture_pool_frames, "capture-pool-frames", "* capture-pool-frames=<n>\n"
+                "  Number of buffered frames for capturers that reuse their buffer. Captured\n"
+                "  frame is copied so that next one can be grabbed while it is being sent\n"
+                "  (default 3, 0 - wait until frame is sent).\n");
+
+ADD_TO_PARAM(metrics_port, "metrics-port", "* metrics-port=<port>\n"
+                "  Serve runtime metrics (packets, frames, latencies) in Prometheus text\n"
+                "  format at http://localhost:<port>/metrics.\n");
+ADD_TO_PARAM(metrics_public, "metrics-public", "* metrics-public\n"
+                "  Serve metrics (see metrics-port) on all addresses, not only on loopback.\n");
+
+typedef video_frame_pool<default_data_allocator> capture_frame_pool;
+
+/**
+ * Returns the pooled frame to the pool. Holds also the pool because the capture
+ * thread may exit while some frames are still being processed.
+ */
+struct capture_pool_frame_deleter {
+        shared_ptr<capture_frame_pool> pool;
+        shared_ptr<video_frame> frame;
+        void operator()(struct video_frame *) {
+                frame.reset();
+                pool.reset();
+        }
+};
+
+/**
+ * Copies frame whose buffer will be reused by the capturer with next grab to a
+ * pooled frame. The pool blocks if all frames are still being processed.
+ */
+static shared_ptr<video_frame> get_pooled_copy(shared_ptr<capture_frame_pool> const &pool,
+                struct video_desc *pool_desc, size_t *pool_data_len, struct video_frame *in)
+{
+        size_t data_len = 0;
+        for (unsigned int i = 0; i < in->tile_count; ++i) {
+                data_len = max<size_t>(data_len, in->tiles[i].data_len);
+        }
+        struct video_desc desc = video_desc_from_frame(in);
+        if (!video_desc_eq(desc, *pool_desc) || data_len > *pool_data_len) {
+                *pool_desc = desc;
+                *pool_data_len = data_len;
+                pool->reconfigure(desc, data_len);
+        }
+
+        shared_ptr<video_frame> out = pool->get_frame();
+        char metadata[VF_METADATA_SIZE];
+        vf_store_metadata(in, metadata);
+        vf_restore_metadata(out.get(), metadata);
+        out->frame_type = in->frame_type;
+        for (unsigned int i = 0; i < in->tile_count; ++i) {
+                memcpy(out->tiles[i].data, in->tiles[i].data, in->tiles[i].data_len);
+                out->tiles[i].data_len = in->tiles[i].data_len;
+        }
+
+        return shared_ptr<video_frame>(out.get(), capture_pool_frame_deleter{pool, out});
+}
+
 /**
  * This function captures video and possibly compresses it.
  * It then delegates sending to another thread.
@@ -440,6 +501,13 @@ static void *capture_thread(void *arg)
         steady_clock::time_point t0 = steady_clock::now();
         int frames = 0;
         bool should_print_fps = vidcap_generic_fps(uv->capture_device);
+        unsigned int pool_frames = DEFAULT_CAPTURE_POOL_FRAMES;
+        if (get_commandline_param("capture-pool-frames")) {
+                pool_frames = atoi(get_commandline_param("capture-pool-frames"));
+        }
+        auto pool = make_shared<capture_frame_pool>(pool_frames);
+        struct video_desc pool_desc{};
+        size_t pool_data_len = 0;
 
         while (!should_exit) {
                 /* Capture and transmit video... */
@@ -456,7 +524,11 @@ static void *capture_thread(void *arg)
                         //tx_frame = vf_get_copy(tx_frame);
                         bool wait_for_cur_uncompressed_frame;
                         shared_ptr<video_frame> frame;
-                        if (!tx_frame->callbacks.dispose) {
+                        if (!tx_frame->callbacks.dispose && pool_frames > 0) {
+                                // capturer reuses the buffer, copy it so that we can grab next frame
+                                wait_for_cur_uncompressed_frame = false;
+                                frame = get_pooled_copy(pool, &pool_desc, &pool_data_len, tx_frame);
+                        } else if (!tx_frame->callbacks.dispose) {
                                 wait_obj_reset(wait_obj);
                                 wait_for_cur_uncompressed_frame = true;
                                 frame = shared_ptr<video_frame>(tx_frame, [wait_obj](struct video_frame *) {
@@ -1219,6 +1291,13 @@ int main(int argc, char *argv[])
                 EXIT(EXIT_FAIL_CONTROL_SOCK);
         }
 
+        if (get_commandline_param("metrics-port") != nullptr &&
+                        !metrics_http_start(atoi(get_commandline_param("metrics-port")), force_ip_version == 6 ? 6 : 4,
+                                get_commandline_param("metrics-public") != nullptr)) {
+                LOG(LOG_LEVEL_FATAL) << "Error: Unable to start metrics HTTP server!\n";
+                EXIT(EXIT_FAILURE);
+        }
+
         uv.audio = audio_cfg_init (&uv.root_module, audio_host, audio_rx_port,
                         audio_tx_port, audio_send, audio_recv,
                         audio_protocol, audio_protocol_opts,
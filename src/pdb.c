@@ -13,13 +13,11 @@
  * Copyright (c)      2004 University of Glasgow
  * Copyright (c) 2002-2003 University of Southern California
  * Copyright (c) 1999-2000 University College London
- * Copyright (c) 2005-2016 CESNET z.s.p.o.
+ * Copyright (c) 2005-2026 CESNET z.s.p.o.
  *
- * Largely based on common/src/btree.c revision 1.7 from the UCL 
- * Robust-Audio Tool v4.2.25. Code is based on the algorithm in:
- *  
- *   Introduction to Algorithms by Corman, Leisserson, and Rivest,
- *   MIT Press / McGraw Hill, 1990.
+ * Originally based on common/src/btree.c revision 1.7 from the UCL
+ * Robust-Audio Tool v4.2.25. The unbalanced tree has since been replaced
+ * by an open-addressing hash table (see below).
  *
  * Redistribution and use in source and binary forms, with or without
  * modification, is permitted provided that the following conditions
@@ -69,174 +67,186 @@
 #include "tfrc.h"
 #include "pdb.h"
 
+/*
+ * The database is a compact open-addressing hash table (in the manner of
+ * CPython dicts). Participants are stored in insertion order in a dense
+ * array of items, the hash index holds only packed (ssrc, item index)
+ * pairs and is probed linearly. This gives:
+ *
+ *  - pdb_get() touching a single cache line of the index in common case
+ *    instead of chasing pointers through the (unbalanced) tree,
+ *  - stable iteration order (order of insertion) that is not affected by
+ *    removing entries, even the one currently being iterated over. Note that
+ *    the former tree was iterated in order of SSRCs.
+ *
+ * As before, all operations must be serialized by caller (in practice they
+ * are all done by the RTP receiving thread), so that lookups are plain reads
+ * without any synchronization. When the table needs to grow or be compacted,
+ * a new one is built and the old one freed, iterators detect it by the
+ * database generation.
+ */
+
 #define PDB_MAGIC	0x10101010
-#define PDB_NODE_MAGIC	0x01010101
-
-typedef struct s_pdb_node {
-        uint32_t key;
-        void *data;
-        struct s_pdb_node *parent;
-        struct s_pdb_node *left;
-        struct s_pdb_node *right;
-        uint32_t magic;
-} pdb_node_t;
+
+#define PDB_MIN_INDEX_SIZE      16
+/// index is at most half full (including removed entries)
+#define PDB_MAX_LOAD_SHIFT      1
+
+/// slot value of an unused index slot
+#define PDB_SLOT_EMPTY          UINT64_MAX
+/// item index signalizing removed entry (ssrc part of slot is irrelevant)
+#define PDB_IDX_REMOVED         UINT32_MAX
+
+#define PDB_SLOT(ssrc, idx)     (((uint64_t) (ssrc) << 32) | (uint32_t) (idx))
+#define PDB_SLOT_SSRC(slot)     ((uint32_t) ((slot) >> 32))
+#define PDB_SLOT_IDX(slot)      ((uint32_t) ((slot) & 0xFFFFFFFFu))
+
+struct pdb_item {
+        struct pdb_e *e;        ///< NULL if removed
+        uint64_t serial;        ///< insertion serial number, increasing with index
+};
+
+struct pdb_table {
+        uint32_t mask;          ///< index size - 1
+        uint32_t shift;         ///< 32 - log2(index size)
+        uint32_t capacity;      ///< number of item slots
+        uint32_t used;          ///< used item slots including the removed ones
+        struct pdb_item *items;
+        uint64_t index[];
+};
 
 struct pdb {
-        pdb_node_t *root;
+        struct pdb_table *table;
+        uint32_t generation;            ///< incremented when the table is rebuilt
         uint32_t magic;
         int count;
+        uint64_t next_serial;
         volatile int *delay_ms;
 };
 
 /*****************************************************************************/
-/* Debugging functions...                                                    */
+/* Utility functions                                                         */
 /*****************************************************************************/
 
-#define BTREE_MAGIC      0x10101010
-#define BTREE_NODE_MAGIC 0x01010101
-
-#ifdef DEBUG
-static
-#ifndef HAVE_MACOSX
-__thread
-#endif
-int pdb_count;
-
-static void pdb_validate_node(pdb_node_t * node, pdb_node_t * parent)
+static inline uint32_t pdb_hash(struct pdb_table *t, uint32_t ssrc)
 {
-        assert(node->magic == BTREE_NODE_MAGIC);
-        assert(node->parent == parent);
-        pdb_count++;
-        if (node->left != NULL) {
-                pdb_validate_node(node->left, node);
-        }
-        if (node->right != NULL) {
-                pdb_validate_node(node->right, node);
-        }
+        /* Fibonacci hashing - SSRCs should be random but there is no
+         * guarantee that remote senders really choose them that way */
+        return (uint32_t) (ssrc * 2654435769u) >> t->shift;
 }
-#endif
 
-static void pdb_validate(struct pdb *t)
+static void pdb_validate(struct pdb *db)
 {
-        assert(t->magic == BTREE_MAGIC);
+        assert(db->magic == PDB_MAGIC);
 #ifdef DEBUG
-        pdb_count = 0;
-        if (t->root != NULL) {
-                pdb_validate_node(t->root, NULL);
+        struct pdb_table *t = db->table;
+        int count = 0;
+        for (uint32_t i = 0; i < t->used; ++i) {
+                if (t->items[i].e != NULL) {
+                        count++;
+                }
+                assert(i == 0 || t->items[i - 1].serial < t->items[i].serial);
         }
-        assert(pdb_count == t->count);
+        assert(count == db->count);
 #endif
 }
 
-/*****************************************************************************/
-/* Utility functions                                                         */
-/*****************************************************************************/
-
-static pdb_node_t *pdb_min(pdb_node_t * x)
+static struct pdb_table *pdb_table_alloc(uint32_t index_size)
 {
-        if (x == NULL) {
+        struct pdb_table *t = malloc(sizeof(struct pdb_table) + index_size * sizeof(uint64_t));
+        if (t == NULL) {
                 return NULL;
         }
-        while (x->left) {
-                x = x->left;
+        t->mask = index_size - 1;
+        t->shift = 32;
+        while (index_size >>= 1) {
+                t->shift--;
         }
-        return x;
+        t->capacity = (t->mask + 1) >> PDB_MAX_LOAD_SHIFT;
+        t->used = 0;
+        t->items = calloc(t->capacity, sizeof(struct pdb_item));
+        if (t->items == NULL) {
+                free(t);
+                return NULL;
+        }
+        memset(t->index, 0xFF, (t->mask + 1) * sizeof(uint64_t));
+        return t;
 }
 
-static pdb_node_t *pdb_successor(pdb_node_t * x)
+static void pdb_table_free(struct pdb_table *t)
 {
-        pdb_node_t *y;
-
-        if (x->right != NULL) {
-                return pdb_min(x->right);
-        }
-
-        y = x->parent;
-        while (y != NULL && x == y->right) {
-                x = y;
-                y = y->parent;
+        if (t) {
+                free(t->items);
+                free(t);
         }
-
-        return y;
 }
 
-static pdb_node_t *pdb_search(pdb_node_t * x, uint32_t key)
+/**
+ * Finds index slot of ssrc.
+ * @param[out] slot  content of the found slot
+ * @returns slot position or -1 if not found
+ */
+static int64_t pdb_table_find(struct pdb_table *t, uint32_t ssrc, uint64_t *slot)
 {
-        while (x != NULL && key != x->key) {
-                if (key < x->key) {
-                        x = x->left;
-                } else {
-                        x = x->right;
+        uint32_t pos = pdb_hash(t, ssrc);
+        while (1) {
+                *slot = t->index[pos];
+                if (*slot == PDB_SLOT_EMPTY) {
+                        return -1;
                 }
+                if (PDB_SLOT_SSRC(*slot) == ssrc && PDB_SLOT_IDX(*slot) != PDB_IDX_REMOVED) {
+                        return pos;
+                }
+                pos = (pos + 1) & t->mask;
         }
-        return x;
 }
 
-static void pdb_insert_node(struct pdb *tree, pdb_node_t * z)
+/// appends item to the table, caller must ensure that there is a free item slot
+static void pdb_table_append(struct pdb_table *t, struct pdb_e *e, uint64_t serial)
 {
-        pdb_node_t *x, *y;
-
-        pdb_validate(tree);
-        y = NULL;
-        x = tree->root;
-        while (x != NULL) {
-                y = x;
-                assert(z->key != x->key);
-                if (z->key < x->key) {
-                        x = x->left;
-                } else {
-                        x = x->right;
-                }
-        }
+        uint32_t idx = t->used++;
+        uint32_t pos = pdb_hash(t, e->ssrc);
+
+        assert(idx < t->capacity);
+        t->items[idx].serial = serial;
+        t->items[idx].e = e;
 
-        z->parent = y;
-        if (y == NULL) {
-                tree->root = z;
-        } else if (z->key < y->key) {
-                y->left = z;
-        } else {
-                y->right = z;
+        /* removed slots are not reused - they are needed to continue probing
+         * for items that were inserted after them, compaction drops them */
+        while (t->index[pos] != PDB_SLOT_EMPTY) {
+                pos = (pos + 1) & t->mask;
         }
-        tree->count++;
-        pdb_validate(tree);
+        t->index[pos] = PDB_SLOT(e->ssrc, idx);
 }
 
-static pdb_node_t *pdb_delete_node(struct pdb *tree, pdb_node_t * z)
+/**
+ * Replaces current table with a new one (compacted and possibly enlarged)
+ * able to hold at least one more item.
+ */
+static int pdb_rebuild(struct pdb *db)
 {
-        pdb_node_t *x, *y;
-
-        pdb_validate(tree);
-        if (z->left == NULL || z->right == NULL) {
-                y = z;
-        } else {
-                y = pdb_successor(z);
+        struct pdb_table *old = db->table;
+        uint32_t index_size = PDB_MIN_INDEX_SIZE;
+        while ((index_size >> PDB_MAX_LOAD_SHIFT) < (uint32_t) db->count * 2 + 1) {
+                index_size <<= 1;
         }
 
-        if (y->left != NULL) {
-                x = y->left;
-        } else {
-                x = y->right;
+        struct pdb_table *t = pdb_table_alloc(index_size);
+        if (t == NULL) {
+                return -1;
         }
-
-        if (x != NULL) {
-                x->parent = y->parent;
-        }
-
-        if (y->parent == NULL) {
-                tree->root = x;
-        } else if (y == y->parent->left) {
-                y->parent->left = x;
-        } else {
-                y->parent->right = x;
+        for (uint32_t i = 0; i < old->used; ++i) {
+                if (old->items[i].e != NULL) {
+                        pdb_table_append(t, old->items[i].e, old->items[i].serial);
+                }
         }
 
-        z->key = y->key;
-        z->data = y->data;
-
-        tree->count--;
+        db->table = t;
+        db->generation++;
+        pdb_table_free(old);
 
-        pdb_validate(tree);
-        return y;
+        debug_msg("Participant database rebuilt - index size %" PRIu32 "\n", index_size);
+        return 0;
 }
 
 /*****************************************************************************/
@@ -247,8 +257,14 @@ struct pdb *pdb_init(volatile int *delay_ms)
         if (db != NULL) {
                 db->magic = PDB_MAGIC;
                 db->count = 0;
-                db->root = NULL;
+                db->next_serial = 0;
+                db->generation = 0;
                 db->delay_ms = delay_ms;
+                db->table = pdb_table_alloc(PDB_MIN_INDEX_SIZE);
+                if (db->table == NULL) {
+                        free(db);
+                        return NULL;
+                }
         }
         return db;
 }
@@ -258,18 +274,17 @@ void pdb_destroy(struct pdb **db_p)
         struct pdb *db = *db_p;
 
         pdb_validate(db);
-        if (db->root != NULL) {
-                pdb_iter_t it;
-                struct pdb_e *cp = pdb_iter_init(db, &it);
-                while (cp != NULL) {
-                        struct pdb_e *item = NULL;
-                        pdb_remove(db, cp->ssrc, &item);
-                        cp = pdb_iter_next(&it);
-                        pdb_destroy_item(item);
-                }
-                pdb_iter_done(&it);
+        pdb_iter_t it;
+        struct pdb_e *cp = pdb_iter_init(db, &it);
+        while (cp != NULL) {
+                struct pdb_e *item = NULL;
+                pdb_remove(db, cp->ssrc, &item);
+                cp = pdb_iter_next(&it);
+                pdb_destroy_item(item);
         }
+        pdb_iter_done(&it);
 
+        pdb_table_free(db->table);
         free(db);
         *db_p = NULL;
 }
@@ -301,30 +316,29 @@ int pdb_add(struct pdb *db, uint32_t ssrc)
         /* Add an item to the participant database, indexed by ssrc. */
         /* Returns 0 on success, 1 if the participant is already in  */
         /* the database, 2 for other failures.                       */
-        pdb_node_t *x;
         struct pdb_e *i;
+        uint64_t slot;
 
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
-        if (x != NULL) {
+        if (pdb_table_find(db->table, ssrc, &slot) != -1) {
                 debug_msg("Item already exists - ssrc %x\n", ssrc);
                 return 1;
         }
 
+        if (db->table->used == db->table->capacity && pdb_rebuild(db) != 0) {
+                debug_msg("Unable to grow database - ssrc %x\n", ssrc);
+                return 2;
+        }
+
         i = pdb_create_item(ssrc, db->delay_ms);
         if (i == NULL) {
                 debug_msg("Unable to create database entry - ssrc %x\n", ssrc);
                 return 2;
         }
 
-        x = (pdb_node_t *) malloc(sizeof(pdb_node_t));
-        x->key = ssrc;
-        x->data = i;
-        x->parent = NULL;
-        x->left = NULL;
-        x->right = NULL;
-        x->magic = BTREE_NODE_MAGIC;
-        pdb_insert_node(db, x);
+        pdb_table_append(db->table, i, db->next_serial++);
+        db->count++;
+        pdb_validate(db);
         debug_msg("Added participant %x\n", ssrc);
         return 0;
 }
@@ -333,37 +347,34 @@ struct pdb_e *pdb_get(struct pdb *db, uint32_t ssrc)
 {
         /* Return a pointer to the item indexed by ssrc, or NULL if   */
         /* the item is not present in the database.                   */
-        pdb_node_t *x;
+        uint64_t slot;
 
-        pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
-        if (x != NULL) {
-                return x->data;
+        if (pdb_table_find(db->table, ssrc, &slot) == -1) {
+                return NULL;
         }
-        return NULL;
+        return db->table->items[PDB_SLOT_IDX(slot)].e;
 }
 
 int pdb_remove(struct pdb *db, uint32_t ssrc, struct pdb_e **item)
 {
         /* Remove the item indexed by ssrc. Return zero on success.   */
-        pdb_node_t *x;
+        struct pdb_table *t = db->table;
+        uint64_t slot;
 
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
-        if (x == NULL) {
-                debug_msg("Item not on tree - ssrc %ul\n", ssrc);
+        int64_t pos = pdb_table_find(t, ssrc, &slot);
+        if (pos == -1) {
+                debug_msg("Item not in database - ssrc %" PRIx32 "\n", ssrc);
                 *item = NULL;
                 return 1;
         }
 
-        /* Note value that gets freed is not necessarily the the same as node
-         * that gets removed from tree since there is an optimization to avoid
-         * pointer updates in tree which means sometimes we just copy key and
-         * data from one node to another.  
-         */
-        *item = x->data;
-        x = pdb_delete_node(db, x);
-        free(x);
+        uint32_t idx = PDB_SLOT_IDX(slot);
+        *item = t->items[idx].e;
+        t->index[pos] = PDB_SLOT(ssrc, PDB_IDX_REMOVED);
+        t->items[idx].e = NULL;
+        db->count--;
+        pdb_validate(db);
         return 0;
 }
 
@@ -390,27 +401,59 @@ void pdb_destroy_item(struct pdb_e *item)
  * Iterator functions 
  */
 
-struct pdb_e *pdb_iter_init(struct pdb *db, pdb_iter_t *it)
+/**
+ * Returns first present item starting at it->pos, relocating the iterator
+ * if the table has been rebuilt since the last call.
+ */
+static struct pdb_e *pdb_iter_current(pdb_iter_t *it)
 {
-        if (db->root == NULL) {
-                return NULL;    /* The database is empty */
+        struct pdb_table *t = it->db->table;
+
+        if (it->generation != it->db->generation) {
+                /* items are kept ordered by serial, find first one that
+                 * hasn't been visited yet */
+                uint32_t lo = 0, hi = t->used;
+                while (lo < hi) {
+                        uint32_t mid = lo + (hi - lo) / 2;
+                        if (t->items[mid].serial < it->serial) {
+                                lo = mid + 1;
+                        } else {
+                                hi = mid;
+                        }
+                }
+                it->generation = it->db->generation;
+                it->pos = lo;
+        }
+
+        while (it->pos < t->used) {
+                struct pdb_e *e = t->items[it->pos].e;
+                if (e != NULL) {
+                        it->serial = t->items[it->pos].serial;
+                        return e;
+                }
+                it->pos++;
         }
-        *it = (pdb_node_t *) pdb_min(db->root);
-        return ((pdb_node_t *) *it)->data;
+        return NULL;
+}
+
+struct pdb_e *pdb_iter_init(struct pdb *db, pdb_iter_t *it)
+{
+        it->db = db;
+        it->generation = db->generation;
+        it->pos = 0;
+        it->serial = 0;
+        return pdb_iter_current(it);
 }
 
 struct pdb_e *pdb_iter_next(pdb_iter_t *it)
 {
-        assert(*it != NULL);
-        *it = (pdb_node_t *)pdb_successor((pdb_node_t *)*it);
-        if (*it == NULL) {
-                return NULL;
-        }
-        return ((pdb_node_t *) *it)->data;
+        assert(it->db != NULL);
+        it->pos++;
+        it->serial++;
+        return pdb_iter_current(it);
 }
 
 void pdb_iter_done(pdb_iter_t *it)
 {
-        *it = NULL;
+        it->db = NULL;
 }
-
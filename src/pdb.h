@@ -93,6 +93,11 @@ struct pdb;	/* The participant database */
 struct pdb          *pdb_init(volatile int *delay_ms);
 void                 pdb_destroy(struct pdb **db);
 int                  pdb_add(struct pdb *db, uint32_t ssrc);
+/**
+ * Returns participant with given ssrc or NULL if not present.
+ *
+ * As all other database operations, lookups must be serialized by caller.
+ */
 struct pdb_e        *pdb_get(struct pdb *db, uint32_t ssrc);
 
 /* Remove the entry indexed by "ssrc" from the database, returning a
@@ -101,10 +106,19 @@ struct pdb_e        *pdb_get(struct pdb *db, uint32_t ssrc);
 int                  pdb_remove(struct pdb *db, uint32_t ssrc, struct pdb_e **item);
 void                 pdb_destroy_item(struct pdb_e *item);
 
-typedef void *pdb_iter_t;
 /*
- * Iterator for the database.
- */ 
+ * Iterator for the database. Items are iterated in order of their insertion
+ * (not ordered by SSRC as with the former tree-based database). It is safe
+ * to remove the current item (and any other one) while iterating, items
+ * added during the iteration are visited as well.
+ */
+typedef struct {
+        struct pdb       *db;
+        uint32_t          generation;
+        uint32_t          pos;
+        uint64_t          serial;
+} pdb_iter_t;
+
 struct pdb_e        *pdb_iter_init(struct pdb *db, pdb_iter_t *it);
 struct pdb_e        *pdb_iter_next(pdb_iter_t *it);
 void                 pdb_iter_done(pdb_iter_t *it);
@@ -62,15 +62,20 @@
 #include "crypto/crc.h"
 #include "crypto/openssl_decrypt.h"
 #include "rang.hpp"
+#include "utils/metrics.h"
 #include "utils/packet_counter.h"
 #include "utils/worker.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
 #include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
+#include <string>
+#include <vector>
 
 using rang::fg;
 using rang::style;
@@ -108,6 +113,10 @@ struct state_audio_decoder {
         struct scale_data *scale; ///< contains scaling metadata if we want to perform audio scaling
         bool fixed_scale;
 
+        audio_mix_func_t mix_func; ///< selected for output bps on reconfiguration
+        std::vector<struct audio_mix_route> mix_routes;
+        std::vector<char> interleaved; ///< received data of AUDIO_HDR_INTERLEAVED frames
+
         struct audio_codec_state *audio_decompress;
 
         struct audio_desc saved_desc; // from network
@@ -126,6 +135,12 @@ struct state_audio_decoder {
         void *audio_playback_state;
 
         struct control_state *control;
+
+        struct metric *decoded_frames;
+        struct metric *failed_frames;
+        struct metric *received_bytes;
+        struct metric *expected_bytes;
+        struct metric *decompress_time;
 };
 
 static int validate_mapping(struct channel_map *map);
@@ -196,6 +211,14 @@ void *audio_decoder_init(char *audio_channel_map, const char *audio_scale, const
         gettimeofday(&s->t0, NULL);
         s->packet_counter = NULL;
 
+        static std::atomic<int> decoder_idx{0};
+        std::string labels = "decoder=\"" + std::to_string(decoder_idx++) + "\"";
+        s->decoded_frames = metric_register_counter("ug_audio_rx_frames_total", "Decoded audio frames", labels.c_str());
+        s->failed_frames = metric_register_counter("ug_audio_rx_failed_frames_total", "Received audio frames that failed to decompress", labels.c_str());
+        s->received_bytes = metric_register_counter("ug_audio_rx_received_bytes_total", "Received audio payload bytes", labels.c_str());
+        s->expected_bytes = metric_register_counter("ug_audio_rx_expected_bytes_total", "Audio payload bytes that should have been received", labels.c_str());
+        s->decompress_time = metric_register_histogram("ug_audio_rx_decompress_seconds", "Audio frame decompression time", labels.c_str(), nullptr, 0);
+
         s->audio_decompress = NULL;
 
         s->control = (struct control_state *) get_module(get_root_module(parent), "control");
@@ -340,6 +363,10 @@ void audio_decoder_destroy(void *state)
                 s->dec_funcs->destroy(s->decrypt);
         }
 
+        for (auto *m : { s->decoded_frames, s->failed_frames, s->received_bytes, s->expected_bytes, s->decompress_time }) {
+                metric_unregister(m);
+        }
+
         delete s;
 }
 
@@ -382,6 +409,31 @@ static void *adec_compute_and_print_stats(void *arg) {
 }
 
 
+/// @returns number of bytes of channel ch in first len bytes of interleaved data
+static unsigned int interleaved_channel_bytes(unsigned int len, int ch, int ch_count, int bps)
+{
+        unsigned int stride = ch_count * bps;
+        unsigned int rem = len % stride;
+        unsigned int ch_start = ch * bps;
+        return len / stride * bps + (rem > ch_start ? std::min<unsigned int>(rem - ch_start, bps) : 0);
+}
+
+/**
+ * Registers interleaved packet to packet counter as the parts of the
+ * individual channels it carries (offsets relative to the channel data).
+ */
+static void register_interleaved_packet(struct packet_counter *counter, int bufnum, unsigned int offset,
+                unsigned int length, int ch_count, int bps)
+{
+        for (int ch = 0; ch < ch_count; ++ch) {
+                unsigned int start = interleaved_channel_bytes(offset, ch, ch_count, bps);
+                unsigned int end = interleaved_channel_bytes(offset + length, ch, ch_count, bps);
+                if (end > start) {
+                        packet_counter_register_packet(counter, ch, bufnum, start, end - start);
+                }
+        }
+}
+
 int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_stats *)
 {
         struct pbuf_audio_data *s = (struct pbuf_audio_data *) pbuf_data;
@@ -391,6 +443,7 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
         int output_channels = 0;
         int bps, sample_rate, channel;
         bool first = true;
+        size_t interleaved_len = 0;
 
         if(!cdata) {
                 return FALSE;
@@ -460,9 +513,10 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                         data = plaintext;
                 }
 
+                const bool interleaved = ntohl(audio_hdr[3]) & AUDIO_HDR_INTERLEAVED;
                 /* we receive last channel first (with m bit, last packet) */
-                /* thus can be set only with m-bit packet */
-                if(cdata->data->m) {
+                /* thus can be set only with m-bit packet (or any interleaved) */
+                if(cdata->data->m || interleaved) {
                         input_channels = ((ntohl(audio_hdr[0]) >> 22) & 0x3ff) + 1;
                 }
 
@@ -501,6 +555,7 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                         s->buffer.bps = device_desc.bps;
                         s->buffer.ch_count = device_desc.ch_count;
                         s->buffer.sample_rate = device_desc.sample_rate;
+                        decoder->mix_func = get_audio_mix_func(s->buffer.bps);
 
                         if(!decoder->fixed_scale) {
                                 free(decoder->scale);
@@ -542,6 +597,23 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                         first = false;
                 }
 
+                if (interleaved) {
+                        if (bps == 0 || buffer_len % (input_channels * bps) != 0 || offset + length > buffer_len) {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Invalid interleaved packet (offset %u, length %u, total %u)!\n",
+                                                offset, length, buffer_len);
+                                cdata = cdata->nxt;
+                                continue;
+                        }
+                        if (decoder->interleaved.size() < buffer_len) {
+                                decoder->interleaved.resize(buffer_len);
+                        }
+                        memcpy(decoder->interleaved.data() + offset, data, length);
+                        interleaved_len = buffer_len;
+                        register_interleaved_packet(decoder->packet_counter, bufnum, offset, length, input_channels, bps);
+                        cdata = cdata->nxt;
+                        continue;
+                }
+
                 received_frame.replace(channel, offset, data, length);
 
                 packet_counter_register_packet(decoder->packet_counter, channel, bufnum, offset, length);
@@ -554,33 +626,41 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 cdata = cdata->nxt;
         }
 
+        if (interleaved_len > 0) {
+                for (int i = 0; i < input_channels; ++i) {
+                        received_frame.resize(i, interleaved_len / input_channels);
+                        demux_channel(received_frame.get_data(i), decoder->interleaved.data(), bps,
+                                        interleaved_len, input_channels, i);
+                }
+        }
+
         s->frame_size = received_frame.get_data_len();
+        auto t_decompress = std::chrono::steady_clock::now();
         audio_frame2 decompressed = audio_codec_decompress(decoder->audio_decompress, &received_frame);
         if (!decompressed) {
+                metric_inc(decoder->failed_frames);
                 return FALSE;
         }
-
-        if (s->buffer.sample_rate != decompressed.get_sample_rate()) {
-                if (decompressed.get_bps() != 2) {
-                        decompressed.change_bps(2);
-                }
-                decompressed.resample(decoder->resampler, s->buffer.sample_rate);
-        }
+        metric_observe(decoder->decompress_time, std::chrono::duration<double>(std::chrono::steady_clock::now() - t_decompress).count());
+        metric_inc(decoder->decoded_frames);
 
         if (decompressed.get_bps() != s->buffer.bps) {
                 decompressed.change_bps(s->buffer.bps);
         }
 
+        if (s->buffer.sample_rate != decompressed.get_sample_rate()) {
+                decompressed.resample(decoder->resampler, s->buffer.sample_rate);
+        }
+
         size_t new_data_len = s->buffer.data_len + decompressed.get_data_len(0) * s->buffer.ch_count;
         if ((size_t) s->buffer.max_size < new_data_len) {
                 s->buffer.max_size = new_data_len;
                 s->buffer.data = (char *) realloc(s->buffer.data, new_data_len);
         }
 
-        memset(s->buffer.data + s->buffer.data_len, 0, new_data_len - s->buffer.data_len);
-
         if (!decoder->muted) {
                 // there is a mapping for channel
+                decoder->mix_routes.clear();
                 for(int channel = 0; channel < decompressed.get_channel_count(); ++channel) {
                         if(decoder->channel_remapping) {
                                 if(channel < decoder->channel_map.size) {
@@ -588,22 +668,22 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                                                 int new_position = decoder->channel_map.map[channel][i];
                                                 if (new_position >= s->buffer.ch_count)
                                                         continue;
-                                                mux_and_mix_channel(s->buffer.data + s->buffer.data_len,
-                                                                decompressed.get_data(channel),
-                                                                decompressed.get_bps(), decompressed.get_data_len(channel),
-                                                                s->buffer.ch_count, new_position,
-                                                                decoder->scale[decoder->fixed_scale ? 0 : new_position].scale);
+                                                decoder->mix_routes.push_back({decompressed.get_data(channel), new_position,
+                                                                decoder->scale[decoder->fixed_scale ? 0 : new_position].scale});
                                         }
                                 }
                         } else {
                                 if (channel >= s->buffer.ch_count)
                                         continue;
-                                mux_and_mix_channel(s->buffer.data + s->buffer.data_len, decompressed.get_data(channel),
-                                                decompressed.get_bps(),
-                                                decompressed.get_data_len(channel), s->buffer.ch_count, channel,
-                                                decoder->scale[decoder->fixed_scale ? 0 : input_channels].scale);
+                                decoder->mix_routes.push_back({decompressed.get_data(channel), channel,
+                                                decoder->scale[decoder->fixed_scale ? 0 : channel].scale});
                         }
                 }
+                decoder->mix_func(s->buffer.data + s->buffer.data_len, s->buffer.ch_count,
+                                decoder->mix_routes.data(), decoder->mix_routes.size(),
+                                decompressed.get_data_len(0) / decompressed.get_bps());
+        } else {
+                memset(s->buffer.data + s->buffer.data_len, 0, new_data_len - s->buffer.data_len);
         }
         s->buffer.data_len = new_data_len;
 
@@ -643,6 +723,8 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 d->seconds = seconds;
                 d->bytes_received = packet_counter_get_total_bytes(decoder->packet_counter);
                 d->bytes_expected = packet_counter_get_all_bytes(decoder->packet_counter);
+                metric_add(decoder->received_bytes, d->bytes_received);
+                metric_add(decoder->expected_bytes, d->bytes_expected);
 
                 task_run_async_detached(adec_compute_and_print_stats, d);
 
@@ -43,6 +43,7 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
 #include <string>
 
 #include "rtp/fec.h"
@@ -135,3 +136,35 @@ int fec_pt_from_fec_type(enum fec_type type, bool encrypted)
         return fec::pt_from_fec_type(type, encrypted);
 }
 
+fec_decode_progress::fec_decode_progress(struct fec_desc desc, int buffer_len)
+        : m_k(desc.k), m_symbol_size(0), m_complete_symbols(0), m_recoverable(false)
+{
+        int n = desc.k + desc.m;
+        if (desc.type == FEC_RS && n > 0 && buffer_len >= n) {
+                m_symbol_size = buffer_len / n;
+                m_symbol_bytes.resize(n);
+        }
+}
+
+bool fec_decode_progress::add(int offset, int len)
+{
+        if (m_recoverable || m_symbol_size == 0 || offset < 0) {
+                return m_recoverable;
+        }
+
+        int symbol = offset / m_symbol_size;
+        int pos = offset % m_symbol_size;
+        while (len > 0 && symbol < (int) m_symbol_bytes.size()) {
+                int l = min(len, m_symbol_size - pos);
+                m_symbol_bytes[symbol] += l;
+                if (m_symbol_bytes[symbol] == m_symbol_size) {
+                        m_complete_symbols += 1;
+                }
+                len -= l;
+                pos = 0;
+                symbol += 1;
+        }
+
+        m_recoverable = m_complete_symbols >= m_k;
+        return m_recoverable;
+}
@@ -43,9 +43,40 @@
 #ifdef __cplusplus
 #include <map>
 #include <memory>
+#include <vector>
 
 struct video_frame;
 
+/**
+ * Incremental decoding state of one FEC-protected buffer (tile).
+ *
+ * Received packets are accounted to the symbols as they arrive, so that the
+ * buffer can be passed to fec::decode() as soon as it is recoverable instead
+ * of waiting for its last (parity) packet.
+ *
+ * Only RS is supported - RS buffer is recoverable once any k symbols are
+ * complete. Whether an LDGM buffer is recoverable depends on which symbols
+ * arrived (it needs the parity matrix and peeling as in the decoder itself),
+ * so LDGM (and other schemes) are never reported recoverable early and are
+ * decoded once the whole frame was received, as before.
+ */
+struct fec_decode_progress {
+        fec_decode_progress(struct fec_desc desc, int buffer_len);
+        /**
+         * Accounts packet carrying bytes [offset, offset + len) of the buffer.
+         * @retval true if the buffer is recoverable (now or already before)
+         */
+        bool add(int offset, int len);
+        bool recoverable() const { return m_recoverable; }
+
+private:
+        int m_k;
+        int m_symbol_size;
+        std::vector<int> m_symbol_bytes; ///< received bytes of each symbol
+        int m_complete_symbols;
+        bool m_recoverable;
+};
+
 struct fec {
         virtual std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame>) = 0;
         /**
@@ -1199,6 +1199,39 @@ int udp_recv_data(socket_udp * s, char **buffer)
         return ret;
 }
 
+/**
+ * Receives multiple datagrams from multithreaded socket at once.
+ *
+ * Does not block - pops at most max_count datagrams that are currently
+ * queued (use udp_not_empty() to wait for data) while holding the queue
+ * lock only once.
+ *
+ * @param[in]  s         UDP socket state
+ * @param[out] buffers   received datagrams, each must be freed by caller!
+ * @param[out] lens      lengths of the received datagrams
+ * @param[in]  max_count capacity of buffers and lens arrays
+ * @returns              number of received datagrams
+ */
+int udp_recv_data_batch(socket_udp * s, char **buffers, int *lens, int max_count)
+{
+        assert(s->local->multithreaded);
+        int count = 0;
+        unique_lock<mutex> lk(s->local->lock);
+
+        while (count < max_count && !s->local->packets.empty()) {
+                auto it = s->local->packets.front();
+                buffers[count] = (char *) it.buf;
+                lens[count] = it.size;
+                s->local->packets.pop();
+                count++;
+        }
+
+        lk.unlock();
+        s->local->reader_cv.notify_one();
+
+        return count;
+}
+
 #ifndef WIN32
 int udp_recvv(socket_udp * s, struct msghdr *m)
 {
@@ -96,6 +96,7 @@ void        udp_fd_set_r(socket_udp *s, struct udp_fd_r *);
 int         udp_fd_isset_r(socket_udp *s, struct udp_fd_r *);
 
 int         udp_recv_data(socket_udp * s, char **buffer);
+int         udp_recv_data_batch(socket_udp * s, char **buffers, int *lens, int max_count);
 bool        udp_not_empty(socket_udp *s, struct timeval *timeout);
 int         udp_port_pair_is_free(const char *addr, int force_ip_version, int even_port);
 bool        udp_is_ipv6(socket_udp *s);
@@ -63,6 +63,7 @@
 #include "rtp/rtp_callback.h"
 #include "rtp/ptime.h"
 #include "rtp/pbuf.h"
+#include "utils/metrics.h"
 
 #include <algorithm>
 #include <climits>
@@ -72,6 +73,9 @@
 #define PBUF_MAGIC	0xcafebabe
 
 #define STATS_INTERVAL 128
+/// packets up to this number of frames older than the last removed one are
+/// considered late, older ones are taken as a new stream (eg. sender restart)
+#define LATE_PKT_WINDOW_FRAMES 8
 static_assert(STATS_INTERVAL % (sizeof(unsigned long long) * CHAR_BIT) == 0,
                 "STATS_INTERVAL must be divisible by (sizeof(ull) * CHAR_BIT)");
 
@@ -94,6 +98,8 @@ struct pbuf_node {
         int mbit;               /* determines if mbit of frame had been seen */
         uint32_t magic;         /* For debugging                         */
         bool completed;
+        bool ready;             ///< frame is decodable before its last packet arrived
+        void *frame_state;      ///< state of pbuf::frame_ready callback
 };
 
 struct pbuf {
@@ -112,10 +118,38 @@ struct pbuf {
         int longest_gap; // longest loss
         bool out_of_order_pkts;
         bool dups; // duplicite packets
+        const struct pbuf_metrics *metrics;
+
+        pbuf_frame_ready_t *frame_ready;
+        pbuf_frame_state_free_t *frame_state_free;
+        void *frame_ready_udata;
+        bool removed_any;       ///< last_removed_* is valid
+        uint32_t last_removed_ts;
+        uint32_t last_removed_ssrc;
+        uint32_t removed_ts_delta; ///< RTP timestamp difference of last removed frames (frame duration in stream clock)
 };
 
+/// process-wide metrics shared by all playout buffers
+struct pbuf_metrics {
+        struct metric *received_pkts;
+        struct metric *expected_pkts;
+        struct metric *duplicate_pkts;
+        struct metric *late_pkts;
+};
+
+static const struct pbuf_metrics *get_pbuf_metrics() {
+        static const struct pbuf_metrics metrics = {
+                metric_register_counter("ug_rtp_rx_received_packets_total", "RTP packets received by playout buffers", nullptr),
+                metric_register_counter("ug_rtp_rx_expected_packets_total", "RTP packets expected by playout buffers (according to sequence numbers)", nullptr),
+                metric_register_counter("ug_rtp_rx_duplicate_packets_total", "Duplicate RTP packets", nullptr),
+                metric_register_counter("ug_rtp_rx_late_packets_total", "RTP packets arriving after their frame was removed from playout buffer", nullptr),
+        };
+        return &metrics;
+}
+
 static void free_cdata(struct coded_data *head);
 static int frame_complete(struct pbuf_node *frame);
+static void free_pnode(struct pbuf *playout_buf, struct pbuf_node *node);
 
 /*********************************************************************************/
 
@@ -186,6 +220,7 @@ struct pbuf *pbuf_init(volatile int *delay_ms)
                 playout_buf->offset_ms = delay_ms;
                 playout_buf->playout_delay_us = 0.032 * 1000 * 1000;
                 playout_buf->last_report_seq = -1;
+                playout_buf->metrics = get_pbuf_metrics();
         } else {
                 debug_msg("Failed to allocate memory for playout buffer\n");
         }
@@ -220,8 +255,7 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                         if (curr->prv != NULL) {
                                 curr->prv->nxt = curr->nxt;
                         }
-                        free_cdata(curr->cdata);
-                        delete curr;
+                        free_pnode(playout_buf, curr);
                         curr = temp;
                 }
                 free(playout_buf);
@@ -232,8 +266,10 @@ void pbuf_destroy(struct pbuf *playout_buf) {
  * previously been created, and has some coded data already...
  *
  * New arrivals are filed to the list in descending sequence number order
+ *
+ * @retval false if the packet was dropped (and freed)
  */
-static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
+static bool add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
 {
         struct coded_data *tmp, *curr, *prv;
 
@@ -244,7 +280,7 @@ static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
         if (tmp == NULL) {
                 /* this is bad, out of memory, drop the packet... */
                 free(pkt);
-                return;
+                return false;
         }
 
         tmp->seqno = pkt->seq;
@@ -274,8 +310,23 @@ static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
                         /* this is bad, something went terribly wrong... */
                         free(pkt);
                         free(tmp);
+                        return false;
                 }
         }
+        return true;
+}
+
+/**
+ * Asks the frame_ready callback whether the frame can be decoded before all
+ * its packets arrive.
+ */
+static void check_frame_ready(struct pbuf *playout_buf, struct pbuf_node *node, rtp_packet *pkt)
+{
+        if (playout_buf->frame_ready == NULL || node->ready || node->decoded) {
+                return;
+        }
+        node->ready = playout_buf->frame_ready(playout_buf->frame_ready_udata,
+                        &node->frame_state, pkt);
 }
 
 static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_delay_us)
@@ -354,17 +405,24 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
         }
         if (playout_buf->packets[pkt->seq / number_word_bits] & current_bit) {
                 playout_buf->dups = true;
+                metric_inc(playout_buf->metrics->duplicate_pkts);
         }
         playout_buf->packets[pkt->seq / number_word_bits] |= current_bit;
         if ((uint16_t) (pkt->seq - playout_buf->last_report_seq) >= STATS_INTERVAL * 2) {
                 uint16_t report_seq_until = (uint16_t) ((pkt->seq / STATS_INTERVAL * STATS_INTERVAL) - STATS_INTERVAL); // sum up only up to current-STATS_INTERVAL to be able to catch out-of-order packets
+                int received = 0;
+                int expected = 0;
                 for (uint16_t i = playout_buf->last_report_seq;
                                 i != report_seq_until; i += number_word_bits) {
-                        playout_buf->expected_pkts += number_word_bits;
-                        playout_buf->received_pkts += __builtin_popcountll(playout_buf->packets[i / number_word_bits]);
+                        expected += number_word_bits;
+                        received += __builtin_popcountll(playout_buf->packets[i / number_word_bits]);
                         compute_longest_gap(&playout_buf->longest_gap, playout_buf->packets[i / number_word_bits]);
                         playout_buf->packets[i / number_word_bits] = 0;
                 }
+                playout_buf->expected_pkts += expected;
+                playout_buf->received_pkts += received;
+                metric_add(playout_buf->metrics->expected_pkts, expected);
+                metric_add(playout_buf->metrics->received_pkts, received);
 
                 playout_buf->received_pkts_cum += playout_buf->received_pkts;
                 playout_buf->expected_pkts_cum += playout_buf->expected_pkts;
@@ -395,25 +453,49 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                 playout_buf->dups = false;
         }
 
+        if (playout_buf->removed_any) {
+                int32_t ts_diff = pkt->ts - playout_buf->last_removed_ts;
+                int64_t window = (int64_t) LATE_PKT_WINDOW_FRAMES * max<uint32_t>(playout_buf->removed_ts_delta, 1);
+                if (pkt->ssrc != playout_buf->last_removed_ssrc || ts_diff < -window) {
+                        /* a new stream - do not compare with the old one */
+                        playout_buf->removed_any = false;
+                        playout_buf->removed_ts_delta = 0;
+                } else if (ts_diff <= 0) {
+                        /* late packet (eg. FEC parity) of an already removed frame */
+                        metric_inc(playout_buf->metrics->late_pkts);
+                        free(pkt);
+                        return;
+                }
+        }
+
         if (playout_buf->frst == NULL && playout_buf->last == NULL) {
                 /* playout buffer is empty - add new frame */
                 playout_buf->frst = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
                 playout_buf->last = playout_buf->frst;
+                if (playout_buf->frst) {
+                        check_frame_ready(playout_buf, playout_buf->frst, pkt);
+                }
                 return;
         }
 
         if (playout_buf->last->rtp_timestamp == pkt->ts) {
                 /* Packet belongs to last frame in playout_buf this is the */
                 /* most likely scenario - although...                      */
-                add_coded_unit(playout_buf->last, pkt);
+                if (add_coded_unit(playout_buf->last, pkt)) {
+                        check_frame_ready(playout_buf, playout_buf->last, pkt);
+                }
         } else {
                 if (playout_buf->last->rtp_timestamp < pkt->ts) {
                         /* Packet belongs to a new frame... */
                         tmp = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                        if (tmp == NULL) {
+                                return;
+                        }
                         playout_buf->last->nxt = tmp;
                         playout_buf->last->completed = true;
                         tmp->prv = playout_buf->last;
                         playout_buf->last = tmp;
+                        check_frame_ready(playout_buf, tmp, pkt);
                 } else {
                         bool discard_pkt = false;
                         /* Packet belongs to a previous frame... */
@@ -429,7 +511,9 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                                 }
                                 if (curr->rtp_timestamp == pkt->ts) {
                                         /* Packet belongs to a previous existing frame... */
-                                        add_coded_unit(curr, pkt);
+                                        if (add_coded_unit(curr, pkt)) {
+                                                check_frame_ready(playout_buf, curr, pkt);
+                                        }
                                 } else {
                                         /* Packet belongs to a frame that is not present */
                                         discard_pkt = true;
@@ -485,8 +569,15 @@ void pbuf_remove(struct pbuf *playout_buf, std::chrono::high_resolution_clock::t
                         if (curr->prv != NULL) {
                                 curr->prv->nxt = curr->nxt;
                         }
-                        free_cdata(curr->cdata);
-                        delete curr;
+                        uint32_t ssrc = curr->cdata ? curr->cdata->data->ssrc : 0;
+                        if (playout_buf->removed_any && ssrc == playout_buf->last_removed_ssrc &&
+                                        (int32_t) (curr->rtp_timestamp - playout_buf->last_removed_ts) > 0) {
+                                playout_buf->removed_ts_delta = curr->rtp_timestamp - playout_buf->last_removed_ts;
+                        }
+                        playout_buf->removed_any = true;
+                        playout_buf->last_removed_ts = curr->rtp_timestamp;
+                        playout_buf->last_removed_ssrc = ssrc;
+                        free_pnode(playout_buf, curr);
                 } else {
                         /* The playout buffer is stored in order, so once  */
                         /* we see one packet that has not yet reached it's */
@@ -501,6 +592,15 @@ void pbuf_remove(struct pbuf *playout_buf, std::chrono::high_resolution_clock::t
         return;
 }
 
+static void free_pnode(struct pbuf *playout_buf, struct pbuf_node *node)
+{
+        if (node->frame_state && playout_buf->frame_state_free) {
+                playout_buf->frame_state_free(node->frame_state);
+        }
+        free_cdata(node->cdata);
+        delete node;
+}
+
 static int frame_complete(struct pbuf_node *frame)
 {
         /* Return non-zero if the list of coded_data represents a    */
@@ -535,10 +635,13 @@ pbuf_decode(struct pbuf *playout_buf, std::chrono::high_resolution_clock::time_p
 
         curr = playout_buf->frst;
         while (curr != NULL) {
-                if (!curr->decoded 
-                                && curr_time > curr->playout_time
+                // frame that is already recoverable is decoded immediately
+                // unless some of preceding frames is still pending
+                bool ready_early = curr->ready && (curr->prv == NULL || curr->prv->decoded);
+                if (!curr->decoded
+                                && (curr_time > curr->playout_time || ready_early)
                    ) {
-                        if (frame_complete(curr)) {
+                        if (frame_complete(curr) || curr->ready) {
                                 struct pbuf_stats stats = { playout_buf->received_pkts_cum,
                                         playout_buf->expected_pkts_cum };
                                 int ret = decode_func(curr->cdata, data, &stats);
@@ -560,3 +663,10 @@ void pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay)
         playout_buf->playout_delay_us = playout_delay * 1000 * 1000;
 }
 
+void pbuf_set_frame_ready_cb(struct pbuf *playout_buf, pbuf_frame_ready_t *frame_ready,
+                pbuf_frame_state_free_t *state_free, void *udata)
+{
+        playout_buf->frame_ready = frame_ready;
+        playout_buf->frame_state_free = state_free;
+        playout_buf->frame_ready_udata = udata;
+}
@@ -108,12 +108,26 @@ struct pbuf_audio_data {
  */
 typedef int decode_frame_t(struct coded_data *cdata, void *decode_data, struct pbuf_stats *stats);
 
+/**
+ * Callback allowing a frame to be decoded before all its packets are received
+ * (eg. when FEC-protected frame has already enough symbols). It is called
+ * for each packet inserted to the frame until it returns true.
+ *
+ * @param frame_state  per-frame state of the callback, NULL for the first call,
+ *                     freed by pbuf_frame_state_free_t when the frame is removed
+ * @retval true        frame can be decoded now
+ */
+typedef bool pbuf_frame_ready_t(void *udata, void **frame_state, rtp_packet *pkt);
+typedef void pbuf_frame_state_free_t(void *frame_state);
+
 /* 
  * External C interface: 
  */
 struct pbuf	*pbuf_init(volatile int *delay_ms);
 void             pbuf_destroy(struct pbuf *);
 void		 pbuf_insert(struct pbuf *playout_buf, rtp_packet *r);
+void             pbuf_set_frame_ready_cb(struct pbuf *playout_buf, pbuf_frame_ready_t *frame_ready,
+                                 pbuf_frame_state_free_t *state_free, void *udata);
 
 #ifdef __cplusplus
 }
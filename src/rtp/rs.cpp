@@ -41,11 +41,15 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
 #include <bitset>
 #include <stdlib.h>
+#include <thread>
+#include <vector>
 #include "rtp/rs.h"
 #include "rtp/rtp_callback.h"
 #include "transmit.h"
+#include "utils/worker.h"
 #include "video.h"
 
 #define DEFAULT_K 200
@@ -54,6 +58,11 @@
 #define MAX_K 255
 #define MAX_N 255
 
+/// minimal column stripe (part of symbol) processed by one worker
+#define MIN_STRIPE_LEN 4096
+/// columns of all k symbols processed at once, k * STRIPE_CHUNK should fit in L2
+#define STRIPE_CHUNK 2048
+
 extern "C" {
 #include "rs/fec.h"
 }
@@ -62,6 +71,107 @@ static void usage();
 
 using namespace std;
 
+namespace {
+/**
+ * Part of the symbols (column range [offset, offset + len)) processed by
+ * one worker.
+ */
+struct rs_stripe_data {
+        const fec_t *state;
+        unsigned int k, m;
+        size_t ss;
+        size_t offset, len;
+
+        // encode
+        char *out;              ///< output buffer - k data symbols followed by m parity
+        const char *prefix;     ///< length and video header prepended to the data
+        size_t prefix_len;
+        const char *in;         ///< input tile data
+        size_t in_len;
+
+        // decode
+        const gf *matrix;
+        const gf *const *in_pkts;
+        gf *const *out_pkts;
+        const unsigned int *index;
+};
+}
+
+/**
+ * Returns number of workers and (64B aligned) per-worker column stripe length
+ * for symbol size ss.
+ */
+static int rs_get_stripes(size_t ss, size_t *stripe_len)
+{
+        int workers = min<size_t>(max<size_t>(ss / MIN_STRIPE_LEN, 1),
+                        max(thread::hardware_concurrency(), 1u));
+        *stripe_len = ((ss + workers - 1) / workers + 63) / 64 * 64;
+        return (ss + *stripe_len - 1) / *stripe_len;
+}
+
+/**
+ * Copies len bytes starting at position pos of virtual stream consisting of
+ * prefix, input data and zero padding.
+ */
+static void rs_copy_virtual(char *dst, size_t pos, size_t len, const rs_stripe_data *d)
+{
+        if (pos < d->prefix_len) {
+                size_t l = min(len, d->prefix_len - pos);
+                memcpy(dst, d->prefix + pos, l);
+                dst += l; pos += l; len -= l;
+        }
+        pos -= d->prefix_len;
+        if (len > 0 && pos < d->in_len) {
+                size_t l = min(len, d->in_len - pos);
+                memcpy(dst, d->in + pos, l);
+                dst += l; pos += l; len -= l;
+        }
+        memset(dst, 0, len);
+}
+
+/**
+ * Fills data symbols (copying the input) and computes parity for the column
+ * stripe. Data of the chunk are still in cache when the parity is computed.
+ */
+static void *rs_encode_stripe(void *arg)
+{
+        auto d = (rs_stripe_data *) arg;
+        const gf *src[MAX_K];
+        gf *dst[MAX_N];
+        unsigned int dst_idx[MAX_N];
+
+        for (size_t off = d->offset; off < d->offset + d->len; off += STRIPE_CHUNK) {
+                size_t len = min<size_t>(STRIPE_CHUNK, d->offset + d->len - off);
+                for (unsigned int k = 0; k < d->k; ++k) {
+                        char *sym = d->out + d->ss * k + off;
+                        rs_copy_virtual(sym, d->ss * k + off, len, d);
+                        src[k] = (const gf *) sym;
+                }
+                for (unsigned int m = 0; m < d->m; ++m) {
+                        dst[m] = (gf *) d->out + d->ss * (d->k + m) + off;
+                        dst_idx[m] = d->k + m;
+                }
+                fec_encode(d->state, src, dst, dst_idx, d->m, len);
+        }
+
+        return NULL;
+}
+
+static void *rs_decode_stripe(void *arg)
+{
+        auto d = (rs_stripe_data *) arg;
+        const gf *src[MAX_K];
+        gf *dst[MAX_K];
+
+        for (unsigned int i = 0; i < d->k; ++i) {
+                src[i] = d->in_pkts[i] + d->offset;
+                dst[i] = d->out_pkts[i] ? d->out_pkts[i] + d->offset : NULL;
+        }
+        fec_decode_with_matrix(d->state, d->matrix, src, dst, d->index, d->len);
+
+        return NULL;
+}
+
 rs::rs(unsigned int k, unsigned int n)
         : m_k(k), m_n(n)
 {
@@ -121,36 +231,33 @@ shared_ptr<video_frame> rs::encode(shared_ptr<video_frame> in)
         char *out_data;
         out_data = out->tiles[0].data = (char *) malloc(buffer_len);
         uint32_t len32 = len + hdr_len;
-        memcpy(out_data, &len32, sizeof(len32));
-        memcpy(out_data + sizeof(len32), hdr, hdr_len);
-        memcpy(out_data + sizeof(len32) + hdr_len, data, len);
-        memset(out_data + sizeof(len32) + hdr_len + len, 0, ss * m_k - (sizeof(len32) + hdr_len + len));
-
-#if 0
-        void *src[m_k];
-        for (int k = 0; k < m_k; ++k) {
-                src[k] = *out + ss * k;
-        }
-
-        for (int m = 0; m < m_n - m_k; ++m) {
-                fec_encode(state, src, *out + ss * (m_k + m), m, ss);
+        char prefix[sizeof(len32) + sizeof(video_payload_hdr_t)];
+        memcpy(prefix, &len32, sizeof(len32));
+        memcpy(prefix + sizeof(len32), hdr, hdr_len);
+
+        // the copy of the data symbols is fused with the parity computation
+        size_t stripe_len;
+        int workers = rs_get_stripes(ss, &stripe_len);
+        vector<rs_stripe_data> stripes(workers);
+        for (int i = 0; i < workers; ++i) {
+                stripes[i].state = (const fec_t *) state;
+                stripes[i].k = m_k;
+                stripes[i].m = m_n - m_k;
+                stripes[i].ss = ss;
+                stripes[i].offset = i * stripe_len;
+                stripes[i].len = min<size_t>(stripe_len, ss - i * stripe_len);
+                stripes[i].out = out_data;
+                stripes[i].prefix = prefix;
+                stripes[i].prefix_len = sizeof(len32) + hdr_len;
+                stripes[i].in = data;
+                stripes[i].in_len = len;
         }
-#else
-        void *src[m_k];
-        for (unsigned int k = 0; k < m_k; ++k) {
-                src[k] = out_data + ss * k;
-        }
-        void *dst[m_n-m_k];
-        unsigned int dst_idx[m_n-m_k];
-        for (unsigned int m = 0; m < m_n-m_k; ++m) {
-                dst[m] = out_data + ss * (m_k + m);
-                dst_idx[m] = m_k + m;
+        if (workers == 1) {
+                rs_encode_stripe(&stripes[0]);
+        } else {
+                task_run_parallel(rs_encode_stripe, workers, stripes.data(), sizeof stripes[0], NULL);
         }
 
-        fec_encode((const fec_t *)state, (gf **) src,
-                        (gf **) dst, dst_idx, m_n-m_k, ss);
-#endif
-
         out->tiles[0].data_len = buffer_len;
         out->fec_params = fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss);
 
@@ -277,26 +384,40 @@ bool rs::decode(char *in, int in_len, char **out, int *len,
                 return false;
         }
 
-        char **output = (char **) malloc(m_k * sizeof(char *));
-        for (unsigned int i = 0; i < m_k; ++i) {
-                output[i] = (char *) malloc(ss);
+        // recovered symbols are written directly to their place in the buffer
+        gf *output[MAX_K];
+        for (unsigned int j = 0; j < m_k; ++j) {
+                output[j] = NULL;
         }
-
-        fec_decode((const fec_t *) state, (const gf *const *) pkt,
-                        (gf *const *) output, index, ss);
-
         i = 0;
         for (unsigned int j = 0; j < m_k; ++j) {
                 if (repaired_slots.test(j)) {
-                        memcpy((void *) (in + j * ss), output[i], ss);
-                        i++;
+                        output[i++] = (gf *) in + j * ss;
                 }
         }
 
-        for (unsigned int i = 0; i < m_k; ++i) {
-                free(output[i]);
+        vector<gf> matrix(m_k * m_k);
+        fec_build_decode_matrix((const fec_t *) state, index, matrix.data());
+
+        size_t stripe_len;
+        int workers = rs_get_stripes(ss, &stripe_len);
+        vector<rs_stripe_data> stripes(workers);
+        for (int w = 0; w < workers; ++w) {
+                stripes[w].state = (const fec_t *) state;
+                stripes[w].k = m_k;
+                stripes[w].ss = ss;
+                stripes[w].offset = w * stripe_len;
+                stripes[w].len = min<size_t>(stripe_len, ss - w * stripe_len);
+                stripes[w].matrix = matrix.data();
+                stripes[w].in_pkts = (const gf *const *) pkt;
+                stripes[w].out_pkts = output;
+                stripes[w].index = index;
+        }
+        if (workers == 1) {
+                rs_decode_stripe(&stripes[0]);
+        } else {
+                task_run_parallel(rs_decode_stripe, workers, stripes.data(), sizeof stripes[0], NULL);
         }
-        free(output);
 
         uint32_t out_sz;
         memcpy(&out_sz, in, sizeof(out_sz));
@@ -113,6 +113,9 @@ static int des_encrypt(struct rtp *session, unsigned char *data,
 static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                uint8_t *buffer, rtp_packet *packet, int buflen);
 
+/* maximal number of packets fetched from receiving thread at once */
+#define RTP_RECV_BATCH_SIZE 64
+
 #define MAX_DROPOUT    3000
 #define MAX_MISORDER   100
 #define MIN_SEQUENTIAL 2
@@ -1559,10 +1562,19 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
         uint8_t *buffer = NULL;
 
         if (session->mt_recv) {
-                buflen =
-                        udp_recv_data(session->rtp_socket, (char **) &packet);
+                /* take all packets that the reader thread has queued so far
+                 * and process them at once */
+                rtp_packet *packets[RTP_RECV_BATCH_SIZE];
+                int lens[RTP_RECV_BATCH_SIZE];
+                int count = udp_recv_data_batch(session->rtp_socket, (char **) packets, lens, RTP_RECV_BATCH_SIZE);
+
+                buflen = 0;
+                for (int i = 0; i < count; ++i) {
+                        buflen += lens[i];
+                }
+                rtp_process_data_batch(session, curr_rtp_ts, packets, lens, count);
 
-                buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
+                return buflen;
         } else {
                 if (!session->opt->reuse_bufs || (packet == NULL)) {
                         packet = (rtp_packet *) malloc(RTP_MAX_PACKET_LEN + (session->opt->record_source ? sizeof(struct sockaddr_storage) : 0));
@@ -1590,110 +1602,200 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
         return buflen;
 }
 
-static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
-               uint8_t *buffer, rtp_packet *packet, int buflen)
+/**
+ * Decrypts packet (if needed), converts header to host byte order, sets up
+ * internal pointers and validates the header.
+ *
+ * @returns TRUE if packet is valid
+ */
+static int rtp_parse_packet(struct rtp *session, uint8_t *buffer, rtp_packet *packet, int buflen)
 {
-        /* This routine preprocesses an incoming RTP packet, deciding whether to process it. */
         uint8_t *buffer_vlen = NULL;
         int vlen = 12;          /* vlen = 12 | 16 | 20 */
-        source *s;
 
-        if (buflen > 0) {
-                if (session->encryption_enabled) {
-                        uint8_t initVec[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
-                        (session->decrypt_func) (session, buffer, buflen,
-                                                 initVec);
-                }
+        if (session->encryption_enabled) {
+                uint8_t initVec[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+                (session->decrypt_func) (session, buffer, buflen,
+                                         initVec);
+        }
 
-                /* figure out header lenght based on tfrc_on */
-                /* might as well extract rtt and send_ts     */
-                vlen = 12;
-                if (session->tfrc_on) {
-                        vlen += 4;
-                        packet->send_ts = ntohl(packet->send_ts);
+        /* figure out header lenght based on tfrc_on */
+        /* might as well extract rtt and send_ts     */
+        if (session->tfrc_on) {
+                vlen += 4;
+                packet->send_ts = ntohl(packet->send_ts);
+                /* rtt is present in RTP packet - XXX */
+                if (packet->pt & 64) {
                         /* rtt is present in RTP packet - XXX */
-                        if (packet->pt & 64) {
-                                /* rtt is present in RTP packet - XXX */
-                                vlen += 4;
-                                packet->rtt = ntohl(packet->rtt);
-                                //printf ("\n%8d %8d %8d", packet->send_ts, ntohl(packet->ts), packet->rtt );
-                        }
+                        vlen += 4;
+                        packet->rtt = ntohl(packet->rtt);
+                        //printf ("\n%8d %8d %8d", packet->send_ts, ntohl(packet->ts), packet->rtt );
                 }
-                buffer_vlen = buffer + vlen;
+        }
+        buffer_vlen = buffer + vlen;
 
-                /* Convert header fields to host byte order... */
-                packet->seq = ntohs(packet->seq);
-                packet->ts = ntohl(packet->ts);
-                packet->ssrc = ntohl(packet->ssrc);
-                /* Setup internal pointers, etc... */
-                if (packet->cc) {
-                        int i;
-                        packet->csrc = (uint32_t *) (buffer_vlen);
-                        for (i = 0; i < packet->cc; i++) {
-                                packet->csrc[i] = ntohl(packet->csrc[i]);
-                        }
-                } else {
-                        packet->csrc = NULL;
+        /* Convert header fields to host byte order... */
+        packet->seq = ntohs(packet->seq);
+        packet->ts = ntohl(packet->ts);
+        packet->ssrc = ntohl(packet->ssrc);
+        /* Setup internal pointers, etc... */
+        if (packet->cc) {
+                int i;
+                packet->csrc = (uint32_t *) (buffer_vlen);
+                for (i = 0; i < packet->cc; i++) {
+                        packet->csrc[i] = ntohl(packet->csrc[i]);
                 }
-                if (packet->x) {
-                        packet->extn = buffer_vlen + (packet->cc * 4);
-                        packet->extn_len =
-                            (packet->extn[2] << 8) | packet->extn[3];
-                        packet->extn_type =
-                            (packet->extn[0] << 8) | packet->extn[1];
-                } else {
-                        packet->extn = NULL;
-                        packet->extn_len = 0;
-                        packet->extn_type = 0;
-                }
-                packet->data = (char *)(buffer_vlen + (packet->cc * 4));
-                packet->data_len = buflen - (packet->cc * 4) - vlen;
-                if (packet->extn != NULL) {
-                        packet->data += ((packet->extn_len + 1) * 4);
-                        packet->data_len -= ((packet->extn_len + 1) * 4);
-                }
-                if (validate_rtp(session, packet, buflen, vlen)) {
-                        if (session->opt->wait_for_rtcp) {
-                                s = create_source(session, packet->ssrc, TRUE);
-                        } else {
-                                s = get_source(session, packet->ssrc);
-                        }
-                        if (session->opt->promiscuous_mode) {
-                                if (s == NULL) {
-                                        create_source(session, packet->ssrc,
-                                                      FALSE);
-                                        s = get_source(session, packet->ssrc);
-                                }
-                                update_seq(s, packet->seq);
-                                process_rtp(session, curr_rtp_ts, packet, s);
-                                return; /* We don't free "packet", that's done by the callback function... */
-                        }
-                        if (s != NULL) {
-                                if (s->probation == -1) {
-                                        s->probation = MIN_SEQUENTIAL;
-                                        s->max_seq = packet->seq - 1;
-                                }
-                                if (update_seq(s, packet->seq)) {
-                                        process_rtp(session, curr_rtp_ts,
-                                                    packet, s);
-                                        return; /* we don't free "packet", that's done by the callback function... */
-                                } else {
-                                        /* This source is still on probation... */
-                                        debug_msg
-                                            ("RTP packet from probationary source ignored...\n");
-                                }
-                        } else {
-                                /* debug_msg("RTP packet from unknown source ignored\n"); */
-                        }
+        } else {
+                packet->csrc = NULL;
+        }
+        if (packet->x) {
+                packet->extn = buffer_vlen + (packet->cc * 4);
+                packet->extn_len =
+                    (packet->extn[2] << 8) | packet->extn[3];
+                packet->extn_type =
+                    (packet->extn[0] << 8) | packet->extn[1];
+        } else {
+                packet->extn = NULL;
+                packet->extn_len = 0;
+                packet->extn_type = 0;
+        }
+        packet->data = (char *)(buffer_vlen + (packet->cc * 4));
+        packet->data_len = buflen - (packet->cc * 4) - vlen;
+        if (packet->extn != NULL) {
+                packet->data += ((packet->extn_len + 1) * 4);
+                packet->data_len -= ((packet->extn_len + 1) * 4);
+        }
+        return validate_rtp(session, packet, buflen, vlen);
+}
+
+/**
+ * Looks up (or creates, depending on session options) source of a packet.
+ * Equivalent of create_source() in the strict validation case except that
+ * the last activity timestamp is passed by caller.
+ */
+static inline source *rtp_lookup_packet_source(struct rtp *session, uint32_t ssrc,
+                struct timeval *now)
+{
+        source *s = get_source(session, ssrc);
+
+        if (session->opt->wait_for_rtcp) {
+                if (s == NULL) {
+                        s = really_create_source(session, ssrc, TRUE, s);
                 } else {
+                        s->last_active = *now;
+                }
+        }
+        if (session->opt->promiscuous_mode && s == NULL) {
+                s = create_source(session, ssrc, FALSE);
+        }
+        return s;
+}
+
+static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
+               uint8_t *buffer, rtp_packet *packet, int buflen)
+{
+        assert(buffer == (uint8_t *) packet + RTP_PACKET_HEADER_SIZE);
+        UNUSED(buffer);
+        rtp_process_data_batch(session, curr_rtp_ts, &packet, &buflen, 1);
+}
+
+/**
+ * @brief Processes a batch of received RTP packets.
+ *
+ * This is equivalent to processing the packets one by one but amortizes the
+ * per-packet work - source database is checked once per batch, the source
+ * is looked up only once per run of packets with the same SSRC, its
+ * activity timestamp is updated once per batch and next packet header is
+ * prefetched while processing current one.
+ *
+ * Packets must be laid out as if received by rtp_recv_r(), ie. RTP header
+ * starting RTP_PACKET_HEADER_SIZE bytes after the beginning of the
+ * allocated rtp_packet. Ownership of the packets is passed to this
+ * function (and subsequently to the application callback).
+ *
+ * @param session     RTP session
+ * @param curr_rtp_ts current time expressed in units of the media timestamp
+ * @param packets     received packets
+ * @param lens        lengths of the packets (without RTP_PACKET_HEADER_SIZE)
+ * @param count       number of packets
+ */
+void rtp_process_data_batch(struct rtp *session, uint32_t curr_rtp_ts,
+                rtp_packet **packets, const int *lens, int count)
+{
+        source *s = NULL;
+        uint32_t last_ssrc = 0;
+        struct timeval now;
+
+        if (count <= 0) {
+                return;
+        }
+
+        check_database(session);
+        if (session->opt->wait_for_rtcp) {
+                gettimeofday(&now, NULL);
+        }
+
+        for (int i = 0; i < count; ++i) {
+                rtp_packet *packet = packets[i];
+                uint8_t *buffer = (uint8_t *) packet + RTP_PACKET_HEADER_SIZE;
+                int buflen = lens[i];
+
+                if (i + 1 < count) {
+                        __builtin_prefetch((uint8_t *) packets[i + 1] + RTP_PACKET_HEADER_SIZE, 1);
+                }
+
+                if (buflen <= 0) {
+                        free(packet);
+                        continue;
+                }
+
+                if (!rtp_parse_packet(session, buffer, packet, buflen)) {
                         session->invalid_rtp_count++;
                         debug_msg("Invalid RTP packet discarded\n");
+                        if (!session->opt->reuse_bufs) {
+                                free(packet);
+                        }
+                        continue;
                 }
 
+                /* Sources are never removed as a result of processing a
+                 * packet so it is safe to reuse the last looked up one. */
+                if (s == NULL || packet->ssrc != last_ssrc) {
+                        s = rtp_lookup_packet_source(session, packet->ssrc, &now);
+                        last_ssrc = packet->ssrc;
+                }
+
+                if (s == NULL) {
+                        /* debug_msg("RTP packet from unknown source ignored\n"); */
+                        if (!session->opt->reuse_bufs) {
+                                free(packet);
+                        }
+                        continue;
+                }
+
+                if (session->opt->promiscuous_mode) {
+                        update_seq(s, packet->seq);
+                        process_rtp(session, curr_rtp_ts, packet, s);
+                        continue; /* We don't free "packet", that's done by the callback function... */
+                }
+                if (s->probation == -1) {
+                        s->probation = MIN_SEQUENTIAL;
+                        s->max_seq = packet->seq - 1;
+                }
+                if (update_seq(s, packet->seq)) {
+                        process_rtp(session, curr_rtp_ts,
+                                    packet, s);
+                        continue; /* we don't free "packet", that's done by the callback function... */
+                }
+                /* This source is still on probation... */
+                debug_msg
+                    ("RTP packet from probationary source ignored...\n");
                 if (!session->opt->reuse_bufs) {
                         free(packet);
                 }
         }
+
+        check_database(session);
 }
 
 static int validate_rtcp(uint8_t * packet, int len)
@@ -249,6 +249,8 @@ int 		 rtcp_recv_r(struct rtp *session,
 			  struct timeval *timeout, uint32_t curr_rtp_ts);
 int 		 rtp_recv_poll_r(struct rtp **sessions, 
 			  struct timeval *timeout, uint32_t curr_rtp_ts);
+void		 rtp_process_data_batch(struct rtp *session, uint32_t curr_rtp_ts,
+			  rtp_packet **packets, const int *lens, int count);
 int 		 rtp_send_raw_rtp_data(struct rtp *session, char *buffer, int buffer_len);
 
 int 		 rtp_send_data(struct rtp *session, 
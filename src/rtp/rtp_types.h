@@ -108,12 +108,18 @@ typedef uint32_t video_payload_hdr_t[6];
  *
  * 4rd word
  * bits 0-5 audio quantization
- * bits 6-31 audio sample rate
+ * bit 6 channels interleaved (see below)
+ * bits 7-31 audio sample rate
  *
  * 5th word
  * bits 0 - 31 AudioTag
+ *
+ * If the interleaved bit is set, all channels of the buffer are sent as one
+ * interleaved packet series - substream is then channel count - 1 in every
+ * packet, offset and length are related to the interleaved data.
  */
 typedef uint32_t audio_payload_hdr_t[5];
+#define AUDIO_HDR_INTERLEAVED (1u << 25) ///< flag in the 4th word of audio_payload_hdr_t
 
 /*
  * FEC video payload
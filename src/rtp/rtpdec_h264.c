@@ -54,249 +54,355 @@
 #include "utils/bs.h"
 #include "video_frame.h"
 
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_SIZE 2 ///< frame buffers rotated by decode_frame_h264()
+
 static const uint8_t start_sequence[] = { 0, 0, 0, 1 };
 
-int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data, int data_len);
+struct rtpdec_h264_state {
+    unsigned char *pool[POOL_SIZE]; ///< Annex-B frame buffers, grow-only
+    size_t pool_size[POOL_SIZE];
+    int pool_idx;
+
+    struct rtpdec_h264_fragment *fragments;
+    int fragments_alloc;
+    uint8_t *fu_headers; ///< reconstructed FU-A NAL headers referenced from fragments
+    int fu_headers_alloc;
+
+    sps_t sps;
+    uint8_t *rbsp_buf;
+    int rbsp_alloc;
+    uint8_t *last_sps; ///< last parsed SPS NAL, parsing is skipped if it repeats
+    int last_sps_len;
+    int last_sps_alloc;
+};
+
+struct rtpdec_h264_state *rtpdec_h264_init(size_t initial_size) {
+    struct rtpdec_h264_state *s = (struct rtpdec_h264_state *) calloc(1, sizeof(struct rtpdec_h264_state));
+    if (!s) {
+        return NULL;
+    }
+    for (int i = 0; i < POOL_SIZE; ++i) {
+        if (initial_size > 0 && (s->pool[i] = (unsigned char *) malloc(initial_size)) != NULL) {
+            s->pool_size[i] = initial_size;
+        }
+    }
+    return s;
+}
 
-int decode_frame_h264(struct coded_data *cdata, void *decode_data) {
+void rtpdec_h264_destroy(struct rtpdec_h264_state *s) {
+    if (!s) {
+        return;
+    }
+    for (int i = 0; i < POOL_SIZE; ++i) {
+        free(s->pool[i]);
+    }
+    free(s->fragments);
+    free(s->fu_headers);
+    free(s->rbsp_buf);
+    free(s->last_sps);
+    free(s);
+}
+
+static bool ensure_capacity(void **buf, int *alloc, int count, size_t item_size) {
+    if (count <= *alloc) {
+        return true;
+    }
+    int new_alloc = *alloc * 2 > count ? *alloc * 2 : count;
+    void *tmp = realloc(*buf, new_alloc * item_size);
+    if (!tmp) {
+        return false;
+    }
+    *buf = tmp;
+    *alloc = new_alloc;
+    return true;
+}
+
+static bool add_fragment(struct rtpdec_h264_state *s, int *count, const void *data, int len) {
+    if (!ensure_capacity((void **) &s->fragments, &s->fragments_alloc, *count + 1, sizeof s->fragments[0])) {
+        return false;
+    }
+    s->fragments[*count].data = (const unsigned char *) data;
+    s->fragments[*count].len = len;
+    *count += 1;
+    return true;
+}
+
+static int parse_sps(sps_t *sps, uint8_t *rbsp_buf, const unsigned char *data, int data_len,
+        uint32_t *width, uint32_t *height) {
+    int rbsp_len = data_len;
+    if (nal_to_rbsp(data, &data_len, rbsp_buf, &rbsp_len) < 0){
+        return -1;
+    }
+    bs_t b;
+    bs_init(&b, rbsp_buf, rbsp_len);
+    if(read_seq_parameter_set_rbsp(sps, &b) < 0){
+        return -1;
+    }
+    *width = (sps->pic_width_in_mbs_minus1 + 1) * 16;
+    *height = (2 - sps->frame_mbs_only_flag) * (sps->pic_height_in_map_units_minus1 + 1) * 16;
+    //NOTE: frame_mbs_only_flag = 1 --> only progressive frames
+    //      frame_mbs_only_flag = 0 --> some type of interlacing (there are 3 types contemplated in the standard)
+    if (sps->frame_cropping_flag){
+        *width -= (sps->frame_crop_left_offset*2 + sps->frame_crop_right_offset*2);
+        *height -= (sps->frame_crop_top_offset*2 + sps->frame_crop_bottom_offset*2);
+    }
+    return 0;
+}
+
+/**
+ * Updates frame dimensions from SPS. The parse state and RBSP buffer are kept
+ * in the depacketizer state and an SPS identical to the previous one (which
+ * is the case for every keyframe of a stream) is not parsed at all.
+ */
+static int fill_coded_frame_from_sps(struct rtpdec_h264_state *s, struct video_frame *rx_data, const unsigned char *data, int data_len){
+    if (data_len == s->last_sps_len && memcmp(data, s->last_sps, data_len) == 0) {
+        return 0;
+    }
+    if (!ensure_capacity((void **) &s->rbsp_buf, &s->rbsp_alloc, data_len, 1) ||
+            !ensure_capacity((void **) &s->last_sps, &s->last_sps_alloc, data_len, 1)) {
+        return -1;
+    }
+
+    uint32_t width, height;
+    if (parse_sps(&s->sps, s->rbsp_buf, data, data_len, &width, &height) < 0) {
+        s->last_sps_len = 0;
+        return -1;
+    }
+    memcpy(s->last_sps, data, data_len);
+    s->last_sps_len = data_len;
+
+    if((width != rx_data->tiles[0].width) || (height != rx_data->tiles[0].height)) {
+        vf_get_tile(rx_data, 0)->width = width;
+        vf_get_tile(rx_data, 0)->height = height;
+    }
+
+    return 0;
+}
+
+static void update_frame_type(struct video_frame *frame, uint8_t nal_type, uint8_t nri) {
+    if(frame->frame_type != INTRA && (nal_type == 5 || nal_type == 6)) {
+        frame->frame_type = INTRA;
+    } else if (frame->frame_type == BFRAME && nri != 0){
+        frame->frame_type = OTHER;
+    }
+}
+
+/**
+ * Adds fragments of STAP-A payload (without the STAP-A NAL header).
+ *
+ * @returns   length of the Annex-B data, -1 if the payload is malformed
+ */
+static int decode_stap_a(struct rtpdec_h264_state *s, struct video_frame *frame,
+        const uint8_t *src, int src_len, int *count) {
+    int total_length = 0;
+    while (src_len > 2) {
+        uint16_t nal_size = src[0] << 8 | src[1];
+        src += 2;
+        src_len -= 2;
+
+        if (nal_size > src_len) {
+            error_msg("NAL size exceeds length: %u %d\n", nal_size, src_len);
+            return -1;
+        }
+        if (nal_size > 0) {
+            uint8_t nal_type = src[0] & 0x1f;
+            if (nal_type == 7) {
+                fill_coded_frame_from_sps(s, frame, src, nal_size);
+            }
+            update_frame_type(frame, nal_type, src[0] & 0x60);
+        }
+        if (!add_fragment(s, count, start_sequence, sizeof(start_sequence)) ||
+                !add_fragment(s, count, src, nal_size)) {
+            return -1;
+        }
+        total_length += sizeof(start_sequence) + nal_size;
+        src += nal_size;
+        src_len -= nal_size;
+    }
+    return total_length;
+}
+
+int rtpdec_h264_get_fragments(struct rtpdec_h264_state *s, struct coded_data *cdata,
+        struct video_frame *frame, const struct rtpdec_h264_fragment **fragments,
+        int *count, int *total_len) {
     rtp_packet *pckt = NULL;
-    struct coded_data *orig = cdata;
 
     uint8_t nal;
     uint8_t type;
     uint8_t nri;
 
-    int pass;
-    int total_length = 0;
-
-    unsigned char *dst = NULL;
     int src_len;
+    int packet_count = 0;
+    int fu_count = 0;
 
-    struct decode_data_h264 *data = (struct decode_data_h264 *) decode_data;
-    struct video_frame *frame = data->frame;
+    *count = 0;
+    *total_len = 0;
     frame->frame_type = BFRAME;
 
-    for (pass = 0; pass < 2; pass++) {
+    // the list is stored from the newest packet, walk it backwards
+    while (cdata != NULL && cdata->nxt != NULL) {
+        cdata = cdata->nxt;
+        packet_count++;
+    }
+    // preallocated so that the fragments may point to it
+    if (!ensure_capacity((void **) &s->fu_headers, &s->fu_headers_alloc, packet_count + 1, 1)) {
+        return FALSE;
+    }
 
-        if (pass > 0) {
-            cdata = orig;
-            if(frame->frame_type == INTRA){
-                total_length+=data->offset_len;
-            }
-            frame->tiles[0].data_len = total_length;
-            dst = (unsigned char *) frame->tiles[0].data + total_length;
+    for ( ; cdata != NULL; cdata = cdata->prv) {
+        pckt = cdata->data;
+
+        if (pckt->pt != PT_H264) {
+            error_msg("Wrong Payload type: %u\n", pckt->pt);
+            return FALSE;
         }
 
-        while (cdata != NULL) {
-            pckt = cdata->data;
+        nal = (uint8_t) pckt->data[0];
+        type = nal & 0x1f;
+        nri = nal & 0x60;
 
-            if (pckt->pt != PT_H264) {
-                error_msg("Wrong Payload type: %u\n", pckt->pt);
-                return FALSE;
-            }
+        if (type == 7){
+            fill_coded_frame_from_sps(s, frame, (unsigned char*) pckt->data, pckt->data_len);
+        }
 
-            nal = (uint8_t) pckt->data[0];
-            type = nal & 0x1f;
-            nri = nal & 0x60;
+        if (type >= 1 && type <= 23) {
+            update_frame_type(frame, type, nri);
+            type = 1;
+        }
 
-            if (type == 7){
-                fill_coded_frame_from_sps(frame, (unsigned char*) pckt->data, pckt->data_len);
-            }
+        const uint8_t *src = NULL;
 
-            if (type >= 1 && type <= 23) {
-                if(frame->frame_type != INTRA && (type == 5 || type == 6)) {
-                    frame->frame_type = INTRA;
-                } else if (frame->frame_type == BFRAME && nri != 0){
-                    frame->frame_type = OTHER;
+        switch (type) {
+            case 0:
+            case 1:
+                debug_msg("NAL type 1\n");
+                if (!add_fragment(s, count, start_sequence, sizeof(start_sequence)) ||
+                        !add_fragment(s, count, pckt->data, pckt->data_len)) {
+                    return FALSE;
                 }
-
-                type = 1;
-            }
-
-            const uint8_t *src = NULL;
-
-            switch (type) {
-                case 0:
-                case 1:
-                    if (pass == 0) {
-                        debug_msg("NAL type 1\n");
-                        total_length += sizeof(start_sequence) + pckt->data_len;
-                    } else {
-                        dst -= pckt->data_len + sizeof(start_sequence);
-                        memcpy(dst, start_sequence, sizeof(start_sequence));
-                        memcpy(dst + sizeof(start_sequence), pckt->data, pckt->data_len);
+                *total_len += sizeof(start_sequence) + pckt->data_len;
+                break;
+            case 24:
+                src = (const uint8_t *) pckt->data + 1;
+                src_len = pckt->data_len - 1;
+                {
+                    int stap_len = decode_stap_a(s, frame, src, src_len, count);
+                    if (stap_len < 0) {
+                        return FALSE;
                     }
-                    break;
-                case 24:
-                    src = (const uint8_t *) pckt->data;
-                    src_len = pckt->data_len;
+                    *total_len += stap_len;
+                }
+                break;
 
-                    src++;
-                    src_len--;
+            case 25:
+            case 26:
+            case 27:
+            case 29:
+                error_msg("Unhandled NAL type\n");
+                return FALSE;
+            case 28:
+                src = (const uint8_t *) pckt->data;
+                src_len = pckt->data_len;
 
-                    while (src_len > 2) {
-                        //TODO: Not properly tested
-                        //TODO: bframes and iframes detection
-                        uint16_t nal_size;
-                        memcpy(&nal_size, src, sizeof(uint16_t));
-
-                        src += 2;
-                        src_len -= 2;
-
-                        if (nal_size <= src_len) {
-                            if (pass == 0) {
-                                total_length += sizeof(start_sequence) + nal_size;
-                            } else {
-                                dst -= nal_size + sizeof(start_sequence);
-                                memcpy(dst, start_sequence, sizeof(start_sequence));
-                                memcpy(dst + sizeof(start_sequence), src, nal_size);
-                            }
-                        } else {
-                            error_msg("NAL size exceeds length: %u %d\n", nal_size, src_len);
-                            return FALSE;
-                        }
-                        src += nal_size;
-                        src_len -= nal_size;
+                src++;
+                src_len--;
 
-                        if (src_len < 0) {
-                            error_msg("Consumed more bytes than we got! (%d)\n", src_len);
-                            return FALSE;
-                        }
-                    }
-                    break;
+                if (src_len > 1) {
+                    uint8_t fu_header = *src;
+                    uint8_t start_bit = fu_header >> 7;
+                    //uint8_t end_bit       = (fu_header & 0x40) >> 6;
+                    uint8_t nal_type = fu_header & 0x1f;
 
-                case 25:
-                case 26:
-                case 27:
-                case 29:
-                    error_msg("Unhandled NAL type\n");
-                    return FALSE;
-                case 28:
-                    src = (const uint8_t *) pckt->data;
-                    src_len = pckt->data_len;
+                    update_frame_type(frame, nal_type, nri);
 
+                    // skip the fu_header
                     src++;
                     src_len--;
 
-                    if (src_len > 1) {
-                        uint8_t fu_header = *src;
-                        uint8_t start_bit = fu_header >> 7;
-                        //uint8_t end_bit       = (fu_header & 0x40) >> 6;
-                        uint8_t nal_type = fu_header & 0x1f;
-                        uint8_t reconstructed_nal;
-
-                        if(frame->frame_type != INTRA && (nal_type == 5 || nal_type == 6)){
-                            frame->frame_type = INTRA;
-                        } else if (frame->frame_type == BFRAME && nri != 0){
-                            frame->frame_type = OTHER;
-                        }
-
+                    if (start_bit) {
                         // Reconstruct this packet's true nal; only the data follows.
                         /* The original nal forbidden bit and NRI are stored in this
                          * packet's nal. */
-                        reconstructed_nal = nal & 0xe0;
-                        reconstructed_nal |= nal_type;
-
-                        // skip the fu_header
-                        src++;
-                        src_len--;
-
-                        if (pass == 0) {
-                            if (start_bit) {
-                                total_length += sizeof(start_sequence) + sizeof(reconstructed_nal) + src_len;
-                            } else {
-                                total_length += src_len;
-                            }
-                        } else {
-                            if (start_bit) {
-                                dst -= sizeof(start_sequence) + sizeof(reconstructed_nal) + src_len;
-                                memcpy(dst, start_sequence, sizeof(start_sequence));
-                                memcpy(dst + sizeof(start_sequence), &reconstructed_nal, sizeof(reconstructed_nal));
-                                memcpy(dst + sizeof(start_sequence) + sizeof(reconstructed_nal), src, src_len);
-                            } else {
-                                dst -= src_len;
-                                memcpy(dst, src, src_len);
-                            }
+                        uint8_t *reconstructed_nal = &s->fu_headers[fu_count++];
+                        *reconstructed_nal = (nal & 0xe0) | nal_type;
+                        if (!add_fragment(s, count, start_sequence, sizeof(start_sequence)) ||
+                                !add_fragment(s, count, reconstructed_nal, sizeof(*reconstructed_nal))) {
+                            return FALSE;
                         }
-                    } else {
-                        error_msg("Too short data for FU-A H264 RTP packet\n");
+                        *total_len += sizeof(start_sequence) + sizeof(*reconstructed_nal);
+                    }
+                    if (!add_fragment(s, count, src, src_len)) {
                         return FALSE;
                     }
-                    break;
-                default:
-                    error_msg("Unknown NAL type\n");
+                    *total_len += src_len;
+                } else {
+                    error_msg("Too short data for FU-A H264 RTP packet\n");
                     return FALSE;
-            }
-            cdata = cdata->nxt;
+                }
+                break;
+            default:
+                error_msg("Unknown NAL type\n");
+                return FALSE;
         }
     }
 
+    *fragments = s->fragments;
     return TRUE;
 }
 
-int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data, int data_len){
-    uint32_t width, height;
-    sps_t* sps = (sps_t*)malloc(sizeof(sps_t));
-    uint8_t* rbsp_buf = (uint8_t*)malloc(data_len);
-    if (nal_to_rbsp(data, &data_len, rbsp_buf, &data_len) < 0){
-        free(rbsp_buf);
-        free(sps);
-        return -1;
-    }
-    bs_t* b = bs_new(rbsp_buf, data_len);
-    if(read_seq_parameter_set_rbsp(sps,b) < 0){
-        bs_free(b);
-        free(rbsp_buf);
-        free(sps);
-        return -1;
+int decode_frame_h264(struct coded_data *cdata, void *decode_data) {
+    struct decode_data_h264 *data = (struct decode_data_h264 *) decode_data;
+    struct rtpdec_h264_state *s = data->state;
+    struct video_frame *frame = data->frame;
+    const struct rtpdec_h264_fragment *fragments;
+    int count;
+    int total_length;
+
+    if (!rtpdec_h264_get_fragments(s, cdata, frame, &fragments, &count, &total_length)) {
+        return FALSE;
     }
-    width = (sps->pic_width_in_mbs_minus1 + 1) * 16;
-    height = (2 - sps->frame_mbs_only_flag) * (sps->pic_height_in_map_units_minus1 + 1) * 16;
-    //NOTE: frame_mbs_only_flag = 1 --> only progressive frames
-    //      frame_mbs_only_flag = 0 --> some type of interlacing (there are 3 types contemplated in the standard)
-    if (sps->frame_cropping_flag){
-        width -= (sps->frame_crop_left_offset*2 + sps->frame_crop_right_offset*2);
-        height -= (sps->frame_crop_top_offset*2 + sps->frame_crop_bottom_offset*2);
+
+    // the caller fills SPS/PPS from SDP to the beginning of an intra frame
+    if(frame->frame_type == INTRA){
+        total_length += data->offset_len;
     }
 
-    if((width != rx_data->tiles[0].width) || (height != rx_data->tiles[0].height)) {
-        vf_get_tile(rx_data, 0)->width = width;
-        vf_get_tile(rx_data, 0)->height = height;
-//        free(rx_data->tiles[0].data);
-//        rx_data->tiles[0].data = calloc(1, rx_data->h264_width * rx_data->h264_height);
+    s->pool_idx = (s->pool_idx + 1) % POOL_SIZE;
+    if (s->pool_size[s->pool_idx] < (size_t) total_length) {
+        size_t new_size = total_length + total_length / 2;
+        unsigned char *tmp = (unsigned char *) realloc(s->pool[s->pool_idx], new_size);
+        if (!tmp) {
+            error_msg("Cannot allocate %zu B for H.264 frame!\n", new_size);
+            return FALSE;
+        }
+        s->pool[s->pool_idx] = tmp;
+        s->pool_size[s->pool_idx] = new_size;
     }
 
-    bs_free(b);
-    free(rbsp_buf);
-    free(sps);
+    frame->tiles[0].data = (char *) s->pool[s->pool_idx];
+    frame->tiles[0].data_len = total_length;
+    unsigned char *dst = s->pool[s->pool_idx] + (frame->frame_type == INTRA ? data->offset_len : 0);
+    for (int i = 0; i < count; ++i) {
+        memcpy(dst, fragments[i].data, fragments[i].len);
+        dst += fragments[i].len;
+    }
 
-    return 0;
+    return TRUE;
 }
 
 int width_height_from_SDP(int *widthOut, int *heightOut , unsigned char *data, int data_len){
     uint32_t width, height;
     sps_t* sps = (sps_t*)malloc(sizeof(sps_t));
     uint8_t* rbsp_buf = (uint8_t*)malloc(data_len);
-    if (nal_to_rbsp(data, &data_len, rbsp_buf, &data_len) < 0){
+    if (parse_sps(sps, rbsp_buf, data, data_len, &width, &height) < 0) {
         free(rbsp_buf);
         free(sps);
         return -1;
     }
-    bs_t* b = bs_new(rbsp_buf, data_len);
-    if(read_seq_parameter_set_rbsp(sps,b) < 0){
-        bs_free(b);
-        free(rbsp_buf);
-        free(sps);
-        return -1;
-    }
-    width = (sps->pic_width_in_mbs_minus1 + 1) * 16;
-    height = (2 - sps->frame_mbs_only_flag) * (sps->pic_height_in_map_units_minus1 + 1) * 16;
-    //NOTE: frame_mbs_only_flag = 1 --> only progressive frames
-    //      frame_mbs_only_flag = 0 --> some type of interlacing (there are 3 types contemplated in the standard)
-    if (sps->frame_cropping_flag){
-        width -= (sps->frame_crop_left_offset*2 + sps->frame_crop_right_offset*2);
-        height -= (sps->frame_crop_top_offset*2 + sps->frame_crop_bottom_offset*2);
-    }
 
     debug_msg("\n\n[width_height_from_SDP] width: %d   height: %d\n\n",width,height);
 
@@ -308,7 +414,6 @@ int width_height_from_SDP(int *widthOut, int *heightOut , unsigned char *data, i
         *heightOut = height;
     }
 
-    bs_free(b);
     free(rbsp_buf);
     free(sps);
 
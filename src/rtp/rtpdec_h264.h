@@ -44,17 +44,51 @@
 #ifndef _RTP_DEC_H264_H
 #define _RTP_DEC_H264_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct coded_data;
+struct rtpdec_h264_state;
 struct video_frame;
 
 struct decode_data_h264 {
         struct video_frame *frame;
         int offset_len;
+        struct rtpdec_h264_state *state;
+};
+
+/**
+ * Piece of an Annex-B stream, points either to packet data or to the
+ * depacketizer state.
+ */
+struct rtpdec_h264_fragment {
+        const unsigned char *data;
+        int len;
 };
 
+/**
+ * @param initial_size size of preallocated frame buffers
+ */
+struct rtpdec_h264_state *rtpdec_h264_init(size_t initial_size);
+void rtpdec_h264_destroy(struct rtpdec_h264_state *state);
+/**
+ * Depacketizes frame without copying the data - the concatenation of the
+ * fragments is an Annex-B stream. Also sets frame type and updates frame
+ * dimensions if SPS is present.
+ *
+ * Fragments are valid until next call and while the packets are held.
+ */
+int rtpdec_h264_get_fragments(struct rtpdec_h264_state *state, struct coded_data *cdata,
+                struct video_frame *frame, const struct rtpdec_h264_fragment **fragments,
+                int *count, int *total_len);
+/**
+ * Depacketizes frame to a buffer owned by decode_data_h264::state and sets
+ * frame->tiles[0].data to it. Intra frames have decode_data_h264::offset_len
+ * bytes reserved at the beginning.
+ */
 int decode_frame_h264(struct coded_data *cdata, void *decode_data);
 int width_height_from_SDP(int *widthOut, int *heightOut , unsigned char *data, int data_len);
 
@@ -45,152 +45,176 @@
 #include "config_unix.h"
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "debug.h"
-#include "perf.h"
-#include "transmit.h"
-#include "module.h"
-#include "tv.h"
-#include "rtp/rtp.h"
-#include "rtp/rtp_callback.h"
-#include "rtp/pbuf.h"
 #include "rtp/rtpenc_h264.h"
-#include "video.h"
-#include "video_codec.h"
-#include "compat/platform_spin.h"
-#include "video_frame.h"
-
-//UTILS DECLARATIONS
-uint32_t test4Bytes(struct rtpenc_h264_state *rtpench264state);
-unsigned char* startOfFrame(struct rtpenc_h264_state *rtpench264state);
-unsigned char* nextToParse(struct rtpenc_h264_state *rtpench264state);
-void checkEndOfFrame(struct rtpenc_h264_state *rtpench264state,
-		unsigned numBytesNeeded);
-uint8_t get1Byte(struct rtpenc_h264_state *rtpench264state);
-void setFromState(struct rtpenc_h264_state *rtpench264state);
-void setToState(struct rtpenc_h264_state *rtpench264state);
-void skipBytes(struct rtpenc_h264_state *rtpench264state, unsigned numBytes);
-bool haveSeenEOF(struct rtpenc_h264_state *rtpench264state); //EndOfFrame
-unsigned curNALSize(struct rtpenc_h264_state *rtpench264state);
 
-struct rtpenc_h264_state * rtpenc_h264_init_state() {
-	struct rtpenc_h264_state *rtpench264state;
+#define NAL_TYPE_STAP_A 24
+#define NAL_TYPE_FU_A 28
 
-	rtpench264state = calloc(1, sizeof(struct rtpenc_h264_state));
-	rtpench264state->curParserIndex = 0;
-	rtpench264state->curParserIndexOffset = 0;
-	rtpench264state->haveSeenFirstStartCode = false;
-	rtpench264state->inputFrameSize = 0;
-	rtpench264state->haveSeenEOF = false;
+struct rtpenc_h264_nal {
+	const unsigned char *data;
+	int len;
+};
 
-	return rtpench264state;
+struct rtpenc_h264_state {
+	struct rtpenc_h264_nal *nals;
+	int nals_alloc;
+	struct rtpenc_h264_packet *packets;
+	int packets_alloc;
+	unsigned char *stap_buf; ///< backing storage of STAP-A payloads
+	size_t stap_buf_alloc;
+};
+
+struct rtpenc_h264_state * rtpenc_h264_init_state() {
+	return calloc(1, sizeof(struct rtpenc_h264_state));
 }
 
-unsigned rtpenc_h264_frame_parse(struct rtpenc_h264_state *rtpench264state,	uint8_t *buf_in, int size) {
-
-	uint32_t next4Bytes = 0l;
-
-	if (!rtpench264state->haveSeenFirstStartCode) {
-		//reset pointers and params of interest for this new frame to parse and send
-		rtpench264state->startOfFrame = rtpench264state->from = rtpench264state->to = buf_in;
-		rtpench264state->curParserIndex = 0;
-		rtpench264state->inputFrameSize = size;
-		rtpench264state->curParserIndexOffset = 0;
-		// The frame must start with a 0x00000001:
-		// Skip over any input bytes that precede the first 0x00000001 and assert it
-		while (test4Bytes(rtpench264state) != 0x00000001) {
-			get1Byte(rtpench264state);
-			if(haveSeenEOF(rtpench264state)){
-				error_msg("No NAL found!\n");
-				return 0; //this shouldn't happen -> this would mean that we got new frame but no start code was found inside....
-			}
-		}
-		skipBytes(rtpench264state, 4); // skip this initial code
-		setFromState(rtpench264state); //set 'from' pointer of curr input frame
-		rtpench264state->haveSeenFirstStartCode = true;
-
-	} else {
-		//CONTINUE WITH THE SAME FRAME
-		// Assert: next4Bytes starts with 0x00000001 or 0x000001, and we've saved and sent all previous bytes (forming a complete NAL unit).
-		// Skip over these remaining bytes
-		if (test4Bytes(rtpench264state) == 0x00000001) {
-			skipBytes(rtpench264state, 4);
-		} else {
-			skipBytes(rtpench264state, 3);
+void rtpenc_h264_destroy_state(struct rtpenc_h264_state *state) {
+	if (!state) {
+		return;
+	}
+	free(state->nals);
+	free(state->packets);
+	free(state->stap_buf);
+	free(state);
+}
+
+const unsigned char *rtpenc_h264_find_startcode(const unsigned char *start, const unsigned char *end) {
+	// search for the 0x01 byte with memchr (vectorized by libc) and check the
+	// preceding zeros - if they do not match, the next start code can begin
+	// at earliest 3 bytes further
+	const unsigned char *p = start + 2;
+	while (p < end) {
+		p = memchr(p, 1, end - p);
+		if (p == NULL) {
+			return end;
 		}
-		if(haveSeenEOF(rtpench264state)){
-			error_msg("No NAL found!\n");
-			return 0; //this shouldn't happen -> this would mean that we got more to parse but we run out of space....
+		if (p[-1] == 0 && p[-2] == 0) {
+			return p - 2;
 		}
+		p += 3;
+	}
+	return end;
+}
 
-		setFromState(rtpench264state); //re-set 'from' pointer of current input data
+static struct rtpenc_h264_packet *add_packet(struct rtpenc_h264_state *state, int *count) {
+	if (*count == state->packets_alloc) {
+		state->packets_alloc = state->packets_alloc ? state->packets_alloc * 2 : 64;
+		state->packets = realloc(state->packets, state->packets_alloc * sizeof state->packets[0]);
 	}
+	struct rtpenc_h264_packet *pkt = &state->packets[(*count)++];
+	pkt->hdr_len = 0;
+	return pkt;
+}
 
-	// Then save everything up until the next 0x00000001 (4 bytes) or 0x000001 (3 bytes), or we hit EOF.
-	// Also make note of the first byte, because it contains the "nal_unit_type":
-	next4Bytes = test4Bytes(rtpench264state);
-	rtpench264state->firstByteOfNALUnit = next4Bytes >> 24;
-
-	while (next4Bytes != 0x00000001 && (next4Bytes & 0xFFFFFF00) != 0x00000100 && !haveSeenEOF(rtpench264state)) {
-		// We save at least some of "next4Bytes".
-		if ((unsigned) (next4Bytes & 0xFF) > 1) {
-			// Common case: 0x00000001 or 0x000001 definitely doesn't begin anywhere in "next4Bytes", so we save all of it:
-			skipBytes(rtpench264state, 4);
-		} else {
-			// Save the first byte, and continue testing the rest:
-			skipBytes(rtpench264state, 1);
+/// @returns number of NAL units found (not including start codes and trailing zeros)
+static int split_nals(struct rtpenc_h264_state *state, const unsigned char *buf, int size) {
+	const unsigned char *end = buf + size;
+	const unsigned char *sc = rtpenc_h264_find_startcode(buf, end);
+	int count = 0;
+
+	while (sc < end) {
+		const unsigned char *nal_start = sc + 3;
+		const unsigned char *next = rtpenc_h264_find_startcode(nal_start, end);
+		const unsigned char *nal_end = next;
+		// strip trailing_zero_8bits (and leading zero of a 4-byte start code)
+		while (nal_end > nal_start && nal_end[-1] == 0) {
+			nal_end--;
+		}
+		if (nal_end > nal_start) {
+			if (count == state->nals_alloc) {
+				state->nals_alloc = state->nals_alloc ? state->nals_alloc * 2 : 16;
+				state->nals = realloc(state->nals, state->nals_alloc * sizeof state->nals[0]);
+			}
+			state->nals[count].data = nal_start;
+			state->nals[count].len = nal_end - nal_start;
+			count++;
 		}
-		next4Bytes = test4Bytes(rtpench264state);
+		sc = next;
 	}
-	setToState(rtpench264state);
 
-	return curNALSize(rtpench264state);
+	return count;
 }
 
-//UTILS
-uint32_t test4Bytes(struct rtpenc_h264_state *rtpench264state) {
-	checkEndOfFrame(rtpench264state, 4);
+int rtpenc_h264_packetize(struct rtpenc_h264_state *state, const unsigned char *buf_in, int size,
+		int max_payload_size, const struct rtpenc_h264_packet **packets) {
+	assert(max_payload_size > 3);
+	int nal_count = split_nals(state, buf_in, size);
+	if (nal_count == 0) {
+		error_msg("No NAL found!\n");
+		return 0;
+	}
 
-	unsigned char const* ptr = nextToParse(rtpench264state);
-	return (ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3];
-}
-unsigned char* startOfFrame(struct rtpenc_h264_state *rtpench264state) {
-	return rtpench264state->startOfFrame;
-}
-unsigned char* nextToParse(struct rtpenc_h264_state *rtpench264state) {
-	return &startOfFrame(rtpench264state)[rtpench264state->curParserIndex];
-}
-void checkEndOfFrame(struct rtpenc_h264_state *rtpench264state,
-		unsigned numBytesNeeded) {
-	// assure EOF check
-	if (rtpench264state->curParserIndex + numBytesNeeded
-			>= rtpench264state->inputFrameSize){
-		rtpench264state->haveSeenEOF = true;
+	// STAP-A payloads are copied to a buffer allocated in advance so that
+	// packets can point to it - its size cannot exceed the frame size + STAP-A
+	// header and NAL size fields
+	size_t stap_buf_needed = size + 3 * nal_count;
+	if (state->stap_buf_alloc < stap_buf_needed) {
+		free(state->stap_buf);
+		state->stap_buf = malloc(stap_buf_needed);
+		state->stap_buf_alloc = stap_buf_needed;
 	}
-}
-uint8_t get1Byte(struct rtpenc_h264_state *rtpench264state) { // byte-aligned
-	checkEndOfFrame(rtpench264state, 1);
-	return startOfFrame(rtpench264state)[rtpench264state->curParserIndex++];
-}
-void setFromState(struct rtpenc_h264_state *rtpench264state) {
-	rtpench264state->from = rtpench264state->startOfFrame
-			+ rtpench264state->curParserIndex;
-	rtpench264state->curParserIndexOffset = rtpench264state->curParserIndex;
-}
-void setToState(struct rtpenc_h264_state *rtpench264state) {
-	if(haveSeenEOF(rtpench264state)) {
-		rtpench264state->to = rtpench264state->startOfFrame + rtpench264state->inputFrameSize;
-	} else {
-		rtpench264state->to = rtpench264state->from
-			+ (rtpench264state->curParserIndex - rtpench264state->curParserIndexOffset);
+	unsigned char *stap_pos = state->stap_buf;
+
+	int count = 0;
+	for (int i = 0; i < nal_count; ) {
+		const struct rtpenc_h264_nal *nal = &state->nals[i];
+		if (nal->len > max_payload_size) {
+			unsigned char nal_hdr = nal->data[0];
+			const unsigned char *data = nal->data + 1;
+			int remaining = nal->len - 1;
+			bool first = true;
+			while (remaining > 0) {
+				struct rtpenc_h264_packet *pkt = add_packet(state, &count);
+				int len = MIN(remaining, max_payload_size - 2);
+				pkt->hdr[0] = (nal_hdr & 0xE0) | NAL_TYPE_FU_A;
+				pkt->hdr[1] = (first ? 0x80 : 0) | (len == remaining ? 0x40 : 0) | (nal_hdr & 0x1F);
+				pkt->hdr_len = 2;
+				pkt->data = data;
+				pkt->data_len = len;
+				data += len;
+				remaining -= len;
+				first = false;
+			}
+			i += 1;
+			continue;
+		}
+
+		int stap_len = 1;
+		int j = i;
+		while (j < nal_count && stap_len + 2 + state->nals[j].len <= max_payload_size) {
+			stap_len += 2 + state->nals[j].len;
+			j++;
+		}
+		struct rtpenc_h264_packet *pkt = add_packet(state, &count);
+		if (j - i < 2) { // single NAL unit packet
+			pkt->data = nal->data;
+			pkt->data_len = nal->len;
+			i += 1;
+			continue;
+		}
+		unsigned char *stap_hdr = stap_pos++;
+		unsigned char f = 0, nri = 0;
+		pkt->data = stap_hdr;
+		pkt->data_len = stap_len;
+		for ( ; i < j; ++i) {
+			nal = &state->nals[i];
+			f |= nal->data[0] & 0x80;
+			nri = MAX(nri, nal->data[0] & 0x60);
+			*stap_pos++ = nal->len >> 8;
+			*stap_pos++ = nal->len & 0xFF;
+			memcpy(stap_pos, nal->data, nal->len);
+			stap_pos += nal->len;
+		}
+		*stap_hdr = f | nri | NAL_TYPE_STAP_A;
 	}
-}
-void skipBytes(struct rtpenc_h264_state *rtpench264state, unsigned numBytes) {
-	checkEndOfFrame(rtpench264state, numBytes);
-	rtpench264state->curParserIndex += numBytes;
-}
-bool haveSeenEOF(struct rtpenc_h264_state *rtpench264state) {
-	return rtpench264state->haveSeenEOF;
-}
-unsigned curNALSize(struct rtpenc_h264_state *rtpench264state) {
-	return (rtpench264state->to - rtpench264state->from);
+
+	*packets = state->packets;
+	return count;
 }
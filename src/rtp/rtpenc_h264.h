@@ -50,23 +50,39 @@ extern "C" {
 
 #define RTPENC_H264_PT 96
 
-struct rtpenc_h264_state {
-	bool haveSeenFirstStartCode;
-	uint8_t firstByteOfNALUnit;
-	unsigned char* startOfFrame;
-	unsigned char* to;
-	unsigned char* from;
-	unsigned maxPacketSize;
-	unsigned curNALOffset;
-	bool lastNALUnitFragment;
-	unsigned curParserIndex; // <= inputFrameSize
-	unsigned curParserIndexOffset;
-	unsigned inputFrameSize;
-	bool haveSeenEOF;
+/**
+ * RTP payload (RFC 6184, non-interleaved mode) - either a single NAL unit,
+ * STAP-A aggregating multiple small NAL units or a FU-A fragment.
+ */
+struct rtpenc_h264_packet {
+	unsigned char hdr[2];        ///< FU indicator and FU header (FU-A only)
+	int hdr_len;                 ///< 2 for FU-A, 0 otherwise
+	const unsigned char *data;   ///< payload (pointing either to input frame or to STAP-A buffer)
+	int data_len;
 };
 
+struct rtpenc_h264_state;
+
 struct rtpenc_h264_state * rtpenc_h264_init_state(void);
-unsigned rtpenc_h264_frame_parse(struct rtpenc_h264_state *rtpench264state, uint8_t *buf_in, int size);
+void rtpenc_h264_destroy_state(struct rtpenc_h264_state *state);
+
+/**
+ * Finds next Annex-B start code (0x000001).
+ *
+ * @returns pointer to the first byte of the start code or end if not found
+ */
+const unsigned char *rtpenc_h264_find_startcode(const unsigned char *start, const unsigned char *end);
+
+/**
+ * Splits Annex-B H.264 frame into RTP payloads. NAL units not fitting into
+ * max_payload_size are fragmented to FU-A packets, consecutive small NAL units
+ * (eg. SPS, PPS, SEI) are aggregated into STAP-A packets.
+ *
+ * @param[out] packets list of packets (valid until next call, referencing buf_in)
+ * @returns            number of packets, 0 if no NAL unit was found
+ */
+int rtpenc_h264_packetize(struct rtpenc_h264_state *state, const unsigned char *buf_in, int size,
+		int max_payload_size, const struct rtpenc_h264_packet **packets);
 
 #ifdef __cplusplus
 }
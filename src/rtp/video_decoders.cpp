@@ -58,7 +58,9 @@
  * Data is saved to decompress buffer. The decompression itself is done by decompress_thread().
  *
  * ### video with FEC ###
- * Data is saved to FEC buffer. Decoded with fec_thread().
+ * Data is saved to FEC buffer. Decoded with fec_thread(). Symbols are counted
+ * already as the packets arrive (video_decoder_frame_ready()) so that the frame
+ * is passed on as soon as it is recoverable, not after its last parity packet.
  *
  * ### Encrypted video (without FEC) ###
  * Prior to decoding, packet is decompressed.
@@ -114,6 +116,7 @@
 #include "rtp/rtp_callback.h"
 #include "rtp/pbuf.h"
 #include "rtp/video_decoders.h"
+#include "utils/metrics.h"
 #include "utils/synchronized_queue.h"
 #include "utils/thread.h"
 #include "utils/timed_message.h"
@@ -122,6 +125,7 @@
 #include "video_decompress.h"
 #include "video_display.h"
 
+#include <atomic>
 #include <condition_variable>
 #ifdef RECONFIGURE_IN_FUTURE_THREAD
 #include <future>
@@ -133,6 +137,7 @@
 #include <queue>
 #include <set>
 #include <sstream>
+#include <string>
 #include <thread>
 
 #ifdef HAVE_LIBAVCODEC_AVCODEC_H
@@ -214,6 +219,36 @@ struct reported_statistics_cumul {
         unsigned long long int     nano_per_frame_error_correction = 0;
         unsigned long long int     nano_per_frame_expected = 0;
         unsigned long int     reported_frames = 0;
+
+        struct metric *frames_displayed, *frames_dropped, *frames_corrupted, *frames_missing;
+        struct metric *received_bytes, *expected_bytes;
+        struct metric *fec_ok_frames, *fec_corrected_frames, *fec_nok_frames;
+        struct metric *decompress_time, *error_correction_time;
+
+        reported_statistics_cumul() {
+                static atomic<int> decoder_idx{0};
+                string idx = "decoder=\"" + to_string(decoder_idx++) + "\"";
+                const char *frames_help = "Received video frames by outcome";
+                frames_displayed = metric_register_counter("ug_video_rx_frames_total", frames_help, (idx + ",state=\"displayed\"").c_str());
+                frames_dropped = metric_register_counter("ug_video_rx_frames_total", frames_help, (idx + ",state=\"dropped\"").c_str());
+                frames_corrupted = metric_register_counter("ug_video_rx_frames_total", frames_help, (idx + ",state=\"corrupted\"").c_str());
+                frames_missing = metric_register_counter("ug_video_rx_frames_total", frames_help, (idx + ",state=\"missing\"").c_str());
+                received_bytes = metric_register_counter("ug_video_rx_received_bytes_total", "Received video payload bytes", idx.c_str());
+                expected_bytes = metric_register_counter("ug_video_rx_expected_bytes_total", "Video payload bytes that should have been received", idx.c_str());
+                const char *fec_help = "Received video frames with FEC by decoding result";
+                fec_ok_frames = metric_register_counter("ug_video_rx_fec_frames_total", fec_help, (idx + ",result=\"ok\"").c_str());
+                fec_corrected_frames = metric_register_counter("ug_video_rx_fec_frames_total", fec_help, (idx + ",result=\"corrected\"").c_str());
+                fec_nok_frames = metric_register_counter("ug_video_rx_fec_frames_total", fec_help, (idx + ",result=\"failed\"").c_str());
+                decompress_time = metric_register_histogram("ug_video_rx_decompress_seconds", "Video frame decompression time", idx.c_str(), nullptr, 0);
+                error_correction_time = metric_register_histogram("ug_video_rx_error_correction_seconds", "Video frame FEC decoding time", idx.c_str(), nullptr, 0);
+        }
+        ~reported_statistics_cumul() {
+                for (auto *m : { frames_displayed, frames_dropped, frames_corrupted, frames_missing,
+                                received_bytes, expected_bytes, fec_ok_frames, fec_corrected_frames,
+                                fec_nok_frames, decompress_time, error_correction_time }) {
+                        metric_unregister(m);
+                }
+        }
         void print() {
                 ostringstream fec;
                 if (fec_ok + fec_nok + fec_corrected > 0) {
@@ -256,13 +291,26 @@ struct frame_msg {
                         if (recv_frame->fec_params.type != FEC_NONE) {
                                 if (is_corrupted) {
                                         stats.fec_nok += 1;
+                                        metric_inc(stats.fec_nok_frames);
                                 } else {
                                         if (received_bytes == expected_bytes) {
                                                 stats.fec_ok += 1;
+                                                metric_inc(stats.fec_ok_frames);
                                         } else {
                                                 stats.fec_corrected += 1;
+                                                metric_inc(stats.fec_corrected_frames);
                                         }
                                 }
+                                metric_observe(stats.error_correction_time, nanoPerFrameErrorCorrection / 1e9);
+                        }
+                        metric_add(stats.received_bytes, received_bytes);
+                        metric_add(stats.expected_bytes, expected_bytes);
+                        metric_inc(is_displayed ? stats.frames_displayed : stats.frames_dropped);
+                        if (is_corrupted) {
+                                metric_inc(stats.frames_corrupted);
+                        }
+                        if (nanoPerFrameDecompress > 0) {
+                                metric_observe(stats.decompress_time, nanoPerFrameDecompress / 1e9);
                         }
                         ostringstream oss;
                         oss << "RECV " << "bufferId " << buffer_num[0] << " expectedPackets " <<
@@ -384,6 +432,9 @@ struct state_video_decoder
 
         const struct openssl_decrypt_info *dec_funcs = NULL; ///< decrypt state
         struct openssl_decrypt      *decrypt = NULL; ///< decrypt state
+        vector<char> decrypt_buffer; ///< plaintext of packets decrypted in advance
+        vector<struct openssl_decrypt_packet> decrypt_packets;
+        vector<int> decrypt_index; ///< packet order in frame -> index to decrypt_packets (-1 if not decrypted)
 
 #ifdef RECONFIGURE_IN_FUTURE_THREAD
         std::future<bool> reconfiguration_future;
@@ -1484,6 +1535,149 @@ static int check_for_mode_change(struct state_video_decoder *decoder,
         return reconfigure_if_needed(decoder, network_desc);
 }
 
+namespace {
+/**
+ * Incremental FEC decoding state of a frame in playout buffer.
+ */
+struct fec_frame_progress {
+        vector<unique_ptr<fec_decode_progress>> tiles;
+        unsigned int recoverable_tiles = 0;
+};
+}
+
+static void video_decoder_free_frame_state(void *frame_state)
+{
+        delete (struct fec_frame_progress *) frame_state;
+}
+
+/**
+ * Accounts packet of a FEC-protected frame.
+ * @retval true if all tiles of the frame can be already reconstructed and the
+ *              frame can be decoded without waiting for the rest of packets
+ */
+static bool video_decoder_frame_ready(void *decoder_data, void **frame_state, rtp_packet *pckt)
+{
+        struct vcodec_state *pbuf_data = (struct vcodec_state *) decoder_data;
+        struct state_video_decoder *decoder = pbuf_data->decoder;
+
+        // encrypted packets are accounted after decryption (payload length differs)
+        if (!PT_VIDEO_HAS_FEC(pckt->pt) || PT_VIDEO_IS_ENCRYPTED(pckt->pt) ||
+                        decoder->max_substreams == 0 ||
+                        pckt->data_len < (int) sizeof(fec_video_payload_hdr_t)) {
+                return false;
+        }
+
+        uint32_t *hdr = (uint32_t *)(void *) pckt->data;
+        unsigned int substream = ntohl(hdr[0]) >> 22;
+        int data_pos = ntohl(hdr[1]);
+        int buffer_length = ntohl(hdr[2]);
+        uint32_t tmp = ntohl(hdr[3]);
+        struct fec_desc desc(fec::fec_type_from_pt(pckt->pt), tmp >> 19, 0x1fff & (tmp >> 6), 0x3f & tmp);
+        // only RS can tell recoverability from the count of symbols, see fec_decode_progress
+        if (desc.type != FEC_RS || substream >= decoder->max_substreams) {
+                return false;
+        }
+
+        auto progress = (struct fec_frame_progress *) *frame_state;
+        if (!progress) {
+                progress = new fec_frame_progress;
+                progress->tiles.resize(decoder->max_substreams);
+                *frame_state = progress;
+        }
+        if (progress->tiles.size() != decoder->max_substreams) {
+                return false;
+        }
+        auto &tile = progress->tiles[substream];
+        if (!tile) {
+                tile = unique_ptr<fec_decode_progress>(new fec_decode_progress(desc, buffer_length));
+        }
+        if (tile->recoverable()) {
+                return progress->recoverable_tiles == progress->tiles.size();
+        }
+        if (tile->add(data_pos, pckt->data_len - sizeof(fec_video_payload_hdr_t))) {
+                progress->recoverable_tiles += 1;
+        }
+        return progress->recoverable_tiles == progress->tiles.size();
+}
+
+void video_decoder_attach_playout_buffer(struct pbuf *playout_buf, void *decoder_data)
+{
+        pbuf_set_frame_ready_cb(playout_buf, video_decoder_frame_ready,
+                        video_decoder_free_frame_state, decoder_data);
+}
+
+#define MIN_PACKETS_PER_DECRYPT_STRIPE 32
+
+struct decrypt_stripe {
+        struct state_video_decoder *decoder;
+        struct openssl_decrypt_packet *packets;
+        int count;
+};
+
+static void *decrypt_stripe_worker(void *arg)
+{
+        struct decrypt_stripe *stripe = (struct decrypt_stripe *) arg;
+        stripe->decoder->dec_funcs->decrypt_batch(stripe->decoder->decrypt, stripe->packets, stripe->count);
+        return NULL;
+}
+
+/**
+ * Decrypts all encrypted packets of the frame in parallel stripes so that
+ * decode_video_frame() doesn't need to do it on the receiving thread.
+ * Packets that are not encrypted or have unknown cipher are left out, they
+ * are reported by decode_video_frame().
+ */
+static void decrypt_frame_packets(struct state_video_decoder *decoder, struct coded_data *cdata)
+{
+        size_t total_len = 0;
+        int packet_count = 0;
+        for (struct coded_data *it = cdata; it != NULL; it = it->nxt) {
+                total_len += it->data->data_len;
+                packet_count += 1;
+        }
+        if (decoder->decrypt_buffer.size() < total_len) {
+                decoder->decrypt_buffer.resize(total_len);
+        }
+        decoder->decrypt_packets.clear();
+        decoder->decrypt_index.assign(packet_count, -1);
+
+        char *plaintext = decoder->decrypt_buffer.data();
+        int idx = 0;
+        for (struct coded_data *it = cdata; it != NULL; it = it->nxt, ++idx) {
+                rtp_packet *pckt = it->data;
+                if (!PT_VIDEO_IS_ENCRYPTED(pckt->pt)) {
+                        continue;
+                }
+                int media_hdr_len = pckt->pt == PT_ENCRYPT_VIDEO ? sizeof(video_payload_hdr_t) : sizeof(fec_video_payload_hdr_t);
+                int ciphertext_len = pckt->data_len - media_hdr_len - sizeof(crypto_payload_hdr_t);
+                if (ciphertext_len < 0) {
+                        continue;
+                }
+                uint32_t crypto_hdr = ntohl(*(uint32_t *)(void *)(pckt->data + media_hdr_len));
+                enum openssl_mode crypto_mode = (enum openssl_mode) (crypto_hdr >> 24);
+                if (crypto_mode == MODE_AES128_NONE || crypto_mode > MODE_AES128_MAX) {
+                        continue;
+                }
+                decoder->decrypt_index[idx] = decoder->decrypt_packets.size();
+                decoder->decrypt_packets.push_back({ pckt->data + media_hdr_len + sizeof(crypto_payload_hdr_t),
+                                ciphertext_len, pckt->data, media_hdr_len, crypto_mode, plaintext, 0 });
+                plaintext += ciphertext_len;
+        }
+
+        int count = decoder->decrypt_packets.size();
+        if (count == 0) {
+                return;
+        }
+        int workers = min<int>(std::max(count / MIN_PACKETS_PER_DECRYPT_STRIPE, 1),
+                        std::max(thread::hardware_concurrency(), 1u));
+        vector<struct decrypt_stripe> stripes(workers);
+        for (int i = 0; i < workers; ++i) {
+                int start = count * i / workers;
+                stripes[i] = { decoder, decoder->decrypt_packets.data() + start, count * (i + 1) / workers - start };
+        }
+        task_run_parallel(decrypt_stripe_worker, workers, stripes.data(), sizeof stripes[0], NULL);
+}
+
 #define ERROR_GOTO_CLEANUP ret = FALSE; goto cleanup;
 #define max(a, b)       (((a) > (b))? (a): (b))
 
@@ -1566,7 +1760,13 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                 delete msg_reconf;
         }
 
+        if (decoder->decrypt) {
+                decrypt_frame_packets(decoder, cdata);
+        }
+        int packet_idx = -1;
+
         while (cdata != NULL) {
+                packet_idx += 1;
                 uint32_t tmp;
                 uint32_t *hdr;
                 int len;
@@ -1661,20 +1861,14 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                         goto cleanup;
                 }
 
-                char plaintext[len]; // will be actually shorter
                 if (PT_VIDEO_IS_ENCRYPTED(pt)) {
-                        int data_len;
-
-                        if((data_len = decoder->dec_funcs->decrypt(decoder->decrypt,
-                                        data, len,
-                                        (char *) hdr, pt == PT_ENCRYPT_VIDEO ?
-                                        sizeof(video_payload_hdr_t) : sizeof(fec_video_payload_hdr_t),
-                                        plaintext, crypto_mode)) == 0) {
+                        int decrypted = decoder->decrypt_index[packet_idx];
+                        if (decrypted == -1 || decoder->decrypt_packets[decrypted].plaintext_len == 0) {
                                 log_msg(LOG_LEVEL_VERBOSE, "Warning: Packet dropped AES - wrong CRC!\n");
                                 goto next_packet;
                         }
-                        data = (char *) plaintext;
-                        len = data_len;
+                        data = decoder->decrypt_packets[decrypted].plaintext;
+                        len = decoder->decrypt_packets[decrypted].plaintext_len;
                 }
 
                 if (!PT_VIDEO_HAS_FEC(pt))
@@ -1879,8 +2073,10 @@ cleanup:
                 lock_guard<mutex> lk(decoder->stats.lock);
                 if (missing < 0x3fffff / 2) {
                         decoder->stats.missing += missing;
+                        metric_add(decoder->stats.frames_missing, missing);
                 } else { // frames may have been reordered, add arbitrary 1
                         decoder->stats.missing += 1;
+                        metric_inc(decoder->stats.frames_missing);
                 }
         }
         decoder->last_buffer_number = buffer_number;
@@ -56,6 +56,7 @@
 struct coded_data;
 struct display;
 struct module;
+struct pbuf;
 struct state_video_decoder;
 struct video_desc;
 struct video_frame;
@@ -67,6 +68,11 @@ extern "C" {
 #endif // __cplusplus
 
 int decode_video_frame(struct coded_data *received_data, void *decoder_data, struct pbuf_stats *stats);
+/**
+ * Lets the playout buffer hand over RS-protected frames to decode_video_frame()
+ * as soon as they are recoverable, without waiting for the remaining parity.
+ */
+void video_decoder_attach_playout_buffer(struct pbuf *playout_buf, void *decoder_data);
 
 struct state_video_decoder *video_decoder_init(struct module *parent, enum video_mode,
                 struct display *display, const char *encryption);
@@ -80,10 +80,16 @@
 #include "tv.h"
 #include "transmit.h"
 #include "utils/jpeg_reader.h"
+#include "utils/metrics.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_codec.h"
 
 #include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define TRANSMIT_MAGIC	0xe80ab15f
 
@@ -104,6 +110,7 @@
 #endif
 
 #define DEFAULT_CIPHER_MODE MODE_AES128_CFB
+#define MIN_PACKETS_PER_ENCRYPT_STRIPE 32
 
 static void tx_update(struct tx *tx, struct video_frame *frame, int substream);
 static void tx_done(struct module *tx);
@@ -142,12 +149,31 @@ struct tx {
 
         const struct openssl_encrypt_info *enc_funcs;
         struct openssl_encrypt *encryption;
+        enum openssl_mode encryption_mode;
         long long int bitrate;
 		
         struct rtpenc_h264_state *rtpenc_h264_state;
         char tmp_packet[RTP_MAX_MTU];
+
+        char *enc_buffer; ///< tile packets encrypted in advance, grow-only
+        size_t enc_buffer_len;
+        struct openssl_encrypt_packet *enc_packets;
+        int enc_packets_count;
+
+        bool audio_interleaved; ///< send PCM channels interleaved in common packets
+        char *interleave_buffer; ///< grow-only
+        size_t interleave_buffer_len;
+
+        struct metric *sent_packets;
+        struct metric *sent_bytes;
 };
 
+static void tx_account_packet(struct tx *tx, int len)
+{
+        metric_inc(tx->sent_packets);
+        metric_add(tx->sent_bytes, len);
+}
+
 static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
 {
         if(!frame) {
@@ -183,6 +209,32 @@ static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
         }
 }
 
+ADD_TO_PARAM(encryption_mode, "encryption-mode", "* encryption-mode=cfb|gcm|ctr\n"
+                "  Cipher mode used with --encryption (default cfb). AES-GCM (gcm) is faster\n"
+                "  and authenticated but the receivers need to support it as well.\n");
+static enum openssl_mode get_encryption_mode()
+{
+        const char *mode = get_commandline_param("encryption-mode");
+        if (mode == NULL) {
+                return DEFAULT_CIPHER_MODE;
+        }
+        if (strcasecmp(mode, "gcm") == 0) {
+                return MODE_AES128_GCM;
+        }
+        if (strcasecmp(mode, "cfb") == 0) {
+                return MODE_AES128_CFB;
+        }
+        if (strcasecmp(mode, "ctr") == 0) {
+                return MODE_AES128_CTR;
+        }
+        log_msg(LOG_LEVEL_ERROR, "Unknown encryption mode: %s\n", mode);
+        return MODE_AES128_NONE;
+}
+
+ADD_TO_PARAM(audio_tx_interleaved, "audio-tx-interleaved", "* audio-tx-interleaved\n"
+                "  Send PCM audio channels interleaved in common packets instead of packet\n"
+                "  series per channel. Reduces packet rate for many channels, requires\n"
+                "  a receiver supporting it.\n");
 struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media_type,
                 const char *fec, const char *encryption, long long int bitrate)
 {
@@ -224,8 +276,13 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
                                 module_done(&tx->mod);
                                 return NULL;
                         }
+                        tx->encryption_mode = get_encryption_mode();
+                        if (tx->encryption_mode == MODE_AES128_NONE) {
+                                module_done(&tx->mod);
+                                return NULL;
+                        }
                         if (tx->enc_funcs->init(&tx->encryption,
-                                                encryption, DEFAULT_CIPHER_MODE) != 0) {
+                                                encryption, tx->encryption_mode) != 0) {
                                 fprintf(stderr, "Unable to initialize encryption\n");
                                 module_done(&tx->mod);
                                 return NULL;
@@ -234,6 +291,14 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
 
                 tx->bitrate = bitrate;
                 tx->rtpenc_h264_state = rtpenc_h264_init_state();
+                tx->audio_interleaved = media_type == TX_MEDIA_AUDIO &&
+                        get_commandline_param("audio-tx-interleaved") != NULL;
+
+                static std::atomic<int> tx_idx{0};
+                std::string labels = "tx=\"" + std::to_string(tx_idx++) + "\",media=\"" +
+                        (media_type == TX_MEDIA_AUDIO ? "audio" : "video") + "\"";
+                tx->sent_packets = metric_register_counter("ug_tx_packets_total", "Sent RTP packets", labels.c_str());
+                tx->sent_bytes = metric_register_counter("ug_tx_bytes_total", "Sent RTP payload bytes (including payload headers)", labels.c_str());
         }
 		return tx;
 }
@@ -335,7 +400,12 @@ static void tx_done(struct module *mod)
 {
         struct tx *tx = (struct tx *) mod->priv_data;
         assert(tx->magic == TRANSMIT_MAGIC);
-        free(tx->rtpenc_h264_state);
+        metric_unregister(tx->sent_packets);
+        metric_unregister(tx->sent_bytes);
+        rtpenc_h264_destroy_state(tx->rtpenc_h264_state);
+        free(tx->enc_buffer);
+        free(tx->enc_packets);
+        free(tx->interleave_buffer);
         free(tx);
 }
 
@@ -468,6 +538,104 @@ static inline int get_data_len(bool with_fec, int mtu, int hdrs_len,
         return data_len;
 }
 
+/**
+ * @returns interval between packets (in nanoseconds) for the traffic shaper,
+ *          0 if packets should be sent as fast as possible
+ */
+static long get_packet_rate(struct tx *tx, struct video_frame *frame, int data_len, int packet_count)
+{
+        if (tx->bitrate == RATE_UNLIMITED) {
+                return 0;
+        }
+        double time_for_frame = 1.0 / frame->fps / frame->tile_count;
+        double interval_between_pkts = time_for_frame / tx->mult_count / packet_count;
+        // use only 75% of the time - we less likely overshot the frame time and
+        // can minimize risk of swapping packets between 2 frames (out-of-order ones)
+        interval_between_pkts = interval_between_pkts * 0.75;
+        // prevent bitrate to be "too low", here 1 Mbps at minimum
+        interval_between_pkts = std::min<double>(interval_between_pkts, tx->mtu / 1000000.0);
+        long long packet_rate_auto = interval_between_pkts * 1000ll * 1000 * 1000;
+
+        if (tx->bitrate == RATE_AUTO) { // adaptive (spread packets to 75% frame time)
+                return packet_rate_auto;
+        }
+        // bitrate given manually
+        long long int bitrate = tx->bitrate | RATE_FLAG_FIXED_RATE;
+        int avg_packet_size = data_len / packet_count;
+        long long packet_rate = 1000ll * 1000 * 1000 * avg_packet_size * 8 / bitrate; // fixed rate
+        if ((tx->bitrate & RATE_FLAG_FIXED_RATE) == 0) { // adaptive capped rate
+                packet_rate = std::max<long long>(packet_rate, packet_rate_auto);
+        }
+        return packet_rate;
+}
+
+struct encrypt_stripe {
+        struct tx *tx;
+        struct openssl_encrypt_packet *packets;
+        int count;
+};
+
+static void *encrypt_stripe_worker(void *arg)
+{
+        struct encrypt_stripe *stripe = (struct encrypt_stripe *) arg;
+        stripe->tx->enc_funcs->encrypt_batch(stripe->tx->encryption, stripe->packets, stripe->count);
+        return NULL;
+}
+
+/**
+ * Encrypts all packets of the tile to tx->enc_packets in parallel stripes.
+ * Packet boundaries are computed the same way as in tx_send_base(), also
+ * the offsets are set in the (per-packet) headers because they are part
+ * of the AAD.
+ */
+static bool tx_encrypt_tile(struct tx *tx, struct video_frame *frame, struct tile *tile,
+                uint32_t *rtp_headers, int rtp_hdr_len, int hdrs_len, int fragment_offset,
+                int packet_count)
+{
+        size_t slot_len = tx->mtu + MAX_CRYPTO_EXCEED;
+        if (tx->enc_buffer_len < packet_count * slot_len) {
+                free(tx->enc_buffer);
+                tx->enc_buffer_len = packet_count * slot_len;
+                tx->enc_buffer = (char *) malloc(tx->enc_buffer_len);
+        }
+        if (tx->enc_packets_count < packet_count) {
+                free(tx->enc_packets);
+                tx->enc_packets_count = packet_count;
+                tx->enc_packets = (struct openssl_encrypt_packet *) malloc(packet_count * sizeof tx->enc_packets[0]);
+        }
+        if (tx->enc_buffer == NULL || tx->enc_packets == NULL) {
+                tx->enc_buffer_len = tx->enc_packets_count = 0;
+                return false;
+        }
+
+        int aad_len = frame->fec_params.type != FEC_NONE ? sizeof(fec_video_payload_hdr_t) : sizeof(video_payload_hdr_t);
+        unsigned int pos = 0;
+        int fec_symbol_offset = 0;
+        for (int i = 0; i < packet_count; ++i) {
+                uint32_t *hdr = rtp_headers + i * (rtp_hdr_len / sizeof(uint32_t));
+                hdr[1] = htonl(pos + fragment_offset);
+                int data_len = get_data_len(frame->fec_params.type != FEC_NONE, tx->mtu, hdrs_len,
+                                frame->fec_params.symbol_size, &fec_symbol_offset,
+                                get_pf_block_size(frame->color_spec));
+                if (pos + data_len >= (unsigned int) tile->data_len) {
+                        data_len = tile->data_len - pos;
+                }
+                tx->enc_packets[i] = { tile->data + pos, data_len, (char *) hdr, aad_len,
+                        tx->enc_buffer + i * slot_len, 0 };
+                pos += data_len;
+        }
+
+        int workers = std::min<int>(std::max(packet_count / MIN_PACKETS_PER_ENCRYPT_STRIPE, 1),
+                        std::max(std::thread::hardware_concurrency(), 1u));
+        std::vector<struct encrypt_stripe> stripes(workers);
+        for (int i = 0; i < workers; ++i) {
+                int start = packet_count * i / workers;
+                stripes[i] = { tx, tx->enc_packets + start, packet_count * (i + 1) / workers - start };
+        }
+        task_run_parallel(encrypt_stripe_worker, workers, stripes.data(), sizeof stripes[0], NULL);
+        return true;
+}
+
 static void
 tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 uint32_t ts, int send_m,
@@ -539,7 +707,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                         hdrs_len += (sizeof(video_payload_hdr_t));
                 }
 
-                encryption_hdr[0] = htonl(DEFAULT_CIPHER_MODE << 24);
+                encryption_hdr[0] = htonl(tx->encryption_mode << 24);
                 hdrs_len += sizeof(crypto_payload_hdr_t) + tx->enc_funcs->get_overhead(tx->encryption);
         } else {
                 if (frame->fec_params.type != FEC_NONE) {
@@ -602,30 +770,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         pos = 0;
         fec_symbol_offset = 0;
 
-        long packet_rate;
-        if (tx->bitrate == RATE_UNLIMITED) {
-                packet_rate = 0;
-        } else {
-                double time_for_frame = 1.0 / frame->fps / frame->tile_count;
-                double interval_between_pkts = time_for_frame / tx->mult_count / packet_count;
-                // use only 75% of the time - we less likely overshot the frame time and
-                // can minimize risk of swapping packets between 2 frames (out-of-order ones)
-                interval_between_pkts = interval_between_pkts * 0.75;
-                // prevent bitrate to be "too low", here 1 Mbps at minimum
-                interval_between_pkts = std::min<double>(interval_between_pkts, tx->mtu / 1000000.0);
-                long long packet_rate_auto = interval_between_pkts * 1000ll * 1000 * 1000;
-
-                if (tx->bitrate == RATE_AUTO) { // adaptive (spread packets to 75% frame time)
-                        packet_rate = packet_rate_auto;
-                } else { // bitrate given manually
-                        long long int bitrate = tx->bitrate | RATE_FLAG_FIXED_RATE;
-                        int avg_packet_size = tile->data_len / packet_count;
-                        packet_rate = 1000ll * 1000 * 1000 * avg_packet_size * 8 / bitrate; // fixed rate
-                        if ((tx->bitrate & RATE_FLAG_FIXED_RATE) == 0) { // adaptive capped rate
-                                packet_rate = std::max<long long>(packet_rate, packet_rate_auto);
-                        }
-                }
-        }
+        long packet_rate = get_packet_rate(tx, frame, tile->data_len, packet_count);
 
         // initialize header array with values (except offset which is different among
         // different packts)
@@ -637,7 +782,15 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         }
         rtp_hdr_packet = (uint32_t *) rtp_headers;
 
-        if (!tx->encryption) {
+        // FEC_MULT sends the packets interleaved, encrypt them one by one
+        bool preencrypted = tx->encryption && tx->fec_scheme != FEC_MULT &&
+                tx_encrypt_tile(tx, frame, tile, rtp_hdr_packet, rtp_hdr_len, hdrs_len,
+                                fragment_offset, packet_count);
+        int packet_idx = 0;
+        // for packets not encrypted by tx_encrypt_tile(), MTU is capped in tx_init()
+        char encrypted_data[RTP_MAX_MTU + MAX_CRYPTO_EXCEED];
+
+        if (!tx->encryption || preencrypted) {
                 rtp_async_start(rtp_session, packet_count);
         }
 
@@ -663,9 +816,10 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 }
                 pos += data_len;
                 if(data_len) { /* check needed for FEC_MULT */
-                        char encrypted_data[data_len + MAX_CRYPTO_EXCEED];
-
-                        if (tx->encryption) {
+                        if (preencrypted) {
+                                data = tx->enc_packets[packet_idx].ciphertext;
+                                data_len = tx->enc_packets[packet_idx].ciphertext_len;
+                        } else if (tx->encryption) {
                                 data_len = tx->enc_funcs->encrypt(tx->encryption,
                                                 data, data_len,
                                                 (char *) rtp_hdr_packet,
@@ -678,6 +832,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                         rtp_send_data_hdr(rtp_session, ts, pt, m, 0, 0,
                                   (char *) rtp_hdr_packet, rtp_hdr_len,
                                   data, data_len, 0, 0, 0);
+                        tx_account_packet(tx, rtp_hdr_len + data_len);
                 }
 
                 if(tx->fec_scheme == FEC_MULT) {
@@ -692,6 +847,7 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                         pos = mult_pos[tx->mult_count - 1];
                 }
                 rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
+                packet_idx += 1;
 
                 // TRAFFIC SHAPER
                 if (pos < (unsigned int) tile->data_len) { // wait for all but last packet
@@ -704,12 +860,91 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 }
         } while (pos < (unsigned int) tile->data_len);
 
-        if (!tx->encryption) {
+        if (!tx->encryption || preencrypted) {
                 rtp_async_wait(rtp_session);
         }
         free(rtp_headers);
 }
 
+/**
+ * Sends all channels of a PCM frame interleaved as one packet series. The
+ * header has AUDIO_HDR_INTERLEAVED set, substream is channel count - 1 in
+ * every packet and offset/length refer to the interleaved data.
+ */
+static void audio_tx_send_interleaved(struct tx* tx, struct rtp *rtp_session, const audio_frame2 * buffer)
+{
+        const int ch_count = buffer->get_channel_count();
+        const int bps = buffer->get_bps();
+        const size_t chan_len = buffer->get_data_len(0);
+        const size_t len = chan_len * ch_count;
+        uint32_t hdr_data[100];
+        uint32_t *audio_hdr = hdr_data;
+        uint32_t *crypto_hdr = audio_hdr + sizeof(audio_payload_hdr_t) / sizeof(uint32_t);
+        int pt = tx->encryption ? PT_ENCRYPT_AUDIO : PT_AUDIO;
+        int rtp_hdr_len = sizeof(audio_payload_hdr_t) + (tx->encryption ? sizeof(crypto_payload_hdr_t) : 0);
+        int hdrs_len = (rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12 + rtp_hdr_len;
+
+        if (tx->interleave_buffer_len < len) {
+                free(tx->interleave_buffer);
+                tx->interleave_buffer = (char *) malloc(len);
+                tx->interleave_buffer_len = len;
+        }
+        for (int ch = 0; ch < ch_count; ++ch) {
+                remux_channel(tx->interleave_buffer, buffer->get_data(ch), bps, chan_len, 1, ch_count, 0, ch);
+        }
+
+        uint32_t timestamp = get_local_mediatime();
+        perf_record(UVP_SEND, timestamp);
+
+        audio_hdr[0] = htonl((ch_count - 1) << 22 | tx->buffer);
+        audio_hdr[2] = htonl(len);
+        audio_hdr[3] = htonl((bps * 8) << 26 | AUDIO_HDR_INTERLEAVED | buffer->get_sample_rate());
+        audio_hdr[4] = htonl(get_audio_tag(buffer->get_codec()));
+        if (tx->encryption) {
+                crypto_hdr[0] = htonl(tx->encryption_mode << 24);
+        }
+
+        char encrypted_data[RTP_MAX_MTU + MAX_CRYPTO_EXCEED]; // data_len < MTU <= RTP_MAX_MTU
+        size_t pos = 0;
+        do {
+                const char *data = tx->interleave_buffer + pos;
+                int data_len = std::min<size_t>(tx->mtu - hdrs_len, len - pos);
+                int m = pos + data_len == len;
+                audio_hdr[1] = htonl(pos);
+                pos += data_len;
+
+                if (tx->encryption) {
+                        data_len = tx->enc_funcs->encrypt(tx->encryption,
+                                        const_cast<char *>(data), data_len,
+                                        (char *) audio_hdr, sizeof(audio_payload_hdr_t),
+                                        encrypted_data);
+                        data = encrypted_data;
+                }
+
+                rtp_send_data_hdr(rtp_session, timestamp, pt, m, 0, 0,
+                                (char *) audio_hdr, rtp_hdr_len,
+                                const_cast<char *>(data), data_len,
+                                0, 0, 0);
+                tx_account_packet(tx, rtp_hdr_len + data_len);
+        } while (pos < len);
+
+        tx->buffer ++;
+}
+
+static bool audio_tx_can_interleave(struct tx *tx, const audio_frame2 *buffer)
+{
+        if (!tx->audio_interleaved || tx->fec_scheme == FEC_MULT ||
+                        buffer->get_codec() != AC_PCM || buffer->get_data_len(0) == 0) {
+                return false;
+        }
+        for (int i = 1; i < buffer->get_channel_count(); ++i) {
+                if (buffer->get_data_len(i) != buffer->get_data_len(0)) {
+                        return false;
+                }
+        }
+        return true;
+}
+
 /* 
  * This multiplication scheme relies upon the fact, that our RTP/pbuf implementation is
  * not sensitive to packet duplication. Otherwise, we can get into serious problems.
@@ -743,6 +978,11 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
 
         fec_check_messages(tx);
 
+        if (audio_tx_can_interleave(tx, buffer)) {
+                audio_tx_send_interleaved(tx, rtp_session, buffer);
+                return;
+        }
+
         timestamp = get_local_mediatime();
         perf_record(UVP_SEND, timestamp);
 
@@ -837,7 +1077,7 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
                         if(data_len) { /* check needed for FEC_MULT */
                                 char encrypted_data[data_len + MAX_CRYPTO_EXCEED];
                                 if(tx->encryption) {
-                                        crypto_hdr[0] = htonl(DEFAULT_CIPHER_MODE << 24);
+                                        crypto_hdr[0] = htonl(tx->encryption_mode << 24);
                                         data_len = tx->enc_funcs->encrypt(tx->encryption,
                                                         const_cast<char *>(data), data_len,
                                                         (char *) audio_hdr, sizeof(audio_payload_hdr_t),
@@ -850,6 +1090,7 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
                                       (char *) audio_hdr, rtp_hdr_len,
                                       const_cast<char *>(data), data_len,
                                       0, 0, 0);
+                                tx_account_packet(tx, rtp_hdr_len + data_len);
                         }
 
                         if(tx->fec_scheme == FEC_MULT) {
@@ -954,6 +1195,7 @@ void audio_tx_send_standard(struct tx* tx, struct rtp *rtp_session,
                 rtp_send_data(rtp_session, ts, pt, 0, 0, /* contributing sources 		*/
                                 0, 												/* contributing sources length 	*/
                                 tx->tmp_packet, pkt_len, 0, 0, 0);
+                tx_account_packet(tx, pkt_len);
                 pos += pkt_len;
 	} while (pos < data_len);
 }
@@ -968,107 +1210,48 @@ void tx_send_h264(struct tx *tx, struct video_frame *frame,
         assert(!frame->fragment || frame->tile_count); // multiple tiles are not currently supported for fragmented send
         uint32_t ts = get_std_video_local_mediatime();
         struct tile *tile = &frame->tiles[0];
+        char pt = RTPENC_H264_PT;
+#ifdef HAVE_LINUX
+        struct timespec start, stop;
+#elif defined HAVE_MACOSX
+        struct timeval start, stop;
+#else // Windows
+	LARGE_INTEGER start, stop, freq;
+#endif
+        long delta, overslept = 0;
 
-	char pt = RTPENC_H264_PT;
-	unsigned char hdr[2];
-	int cc = 0;
-	uint32_t csrc = 0;
-	int m = 0;
-	char *extn = 0;
-	uint16_t extn_len = 0;
-	uint16_t extn_type = 0;
-	unsigned nalsize = 0;
-	uint8_t *data = (uint8_t *) tile->data;
-	int data_len = tile->data_len;
-	tx->rtpenc_h264_state->maxPacketSize = tx->mtu - 40;
-	tx->rtpenc_h264_state->haveSeenEOF = false;
-	tx->rtpenc_h264_state->haveSeenFirstStartCode = false;
-
-	while ((nalsize = rtpenc_h264_frame_parse(tx->rtpenc_h264_state, data, data_len)) > 0) {
-
-		tx->rtpenc_h264_state->curNALOffset = 0;
-		tx->rtpenc_h264_state->lastNALUnitFragment = false; // by default
-
-		while(!tx->rtpenc_h264_state->lastNALUnitFragment){
-			// We have NAL unit data in the buffer.  There are three cases to consider:
-			// 1. There is a new NAL unit in the buffer, and it's small enough to deliver
-			//    to the RTP sink (as is).
-			// 2. There is a new NAL unit in the buffer, but it's too large to deliver to
-			//    the RTP sink in its entirety.  Deliver the first fragment of this data,
-			//    as a FU packet, with one extra preceding header byte (for the "FU header").
-			// 3. There is a NAL unit in the buffer, and we've already delivered some
-			//    fragment(s) of this.  Deliver the next fragment of this data,
-			//    as a FU packet, with two (H.264) extra preceding header bytes
-			//    (for the "NAL header" and the "FU header").
-			if (tx->rtpenc_h264_state->curNALOffset == 0) { // case 1 or 2
-				if (nalsize	<= tx->rtpenc_h264_state->maxPacketSize) { // case 1
-
-					if (tx->rtpenc_h264_state->haveSeenEOF) m = 1;
-					if (rtp_send_data(rtp_session, ts, pt, m, cc, &csrc,
-							(char *) tx->rtpenc_h264_state->from, nalsize,
-							extn, extn_len, extn_type) < 0) {
-						error_msg("There was a problem sending the RTP packet\n");
-					}
-					tx->rtpenc_h264_state->lastNALUnitFragment = true;
-				} else { // case 2
-					// We need to send the NAL unit data as FU packets.  Deliver the first
-					// packet now.  Note that we add "NAL header" and "FU header" bytes to the front
-					// of the packet (overwriting the existing "NAL header").
-					hdr[0] = (tx->rtpenc_h264_state->firstByteOfNALUnit & 0xE0) | 28; //FU indicator
-					hdr[1] = 0x80 | (tx->rtpenc_h264_state->firstByteOfNALUnit & 0x1F); // FU header (with S bit)
-
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									(char *) tx->rtpenc_h264_state->from + 1, tx->rtpenc_h264_state->maxPacketSize - 2,
-									extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
-					tx->rtpenc_h264_state->curNALOffset += tx->rtpenc_h264_state->maxPacketSize - 1;
-					tx->rtpenc_h264_state->lastNALUnitFragment = false;
-					nalsize -= tx->rtpenc_h264_state->maxPacketSize - 1;
-				}
-			} else { // case 3
-				// We are sending this NAL unit data as FU packets.  We've already sent the
-				// first packet (fragment).  Now, send the next fragment.  Note that we add
-				// "NAL header" and "FU header" bytes to the front.  (We reuse these bytes that
-				// we already sent for the first fragment, but clear the S bit, and add the E
-				// bit if this is the last fragment.)
-				hdr[1] = hdr[1] & ~0x80;// FU header (no S bit)
-
-				if (nalsize + 1 > tx->rtpenc_h264_state->maxPacketSize) {
-					// We can't send all of the remaining data this time:
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-							(char *) hdr, 2,
-							(char *) tx->rtpenc_h264_state->from + tx->rtpenc_h264_state->curNALOffset,
-							tx->rtpenc_h264_state->maxPacketSize - 2, extn, extn_len,
-							extn_type) < 0) {
-								error_msg("There was a problem sending the RTP packet\n");
-					}
-					tx->rtpenc_h264_state->curNALOffset += tx->rtpenc_h264_state->maxPacketSize - 2;
-					tx->rtpenc_h264_state->lastNALUnitFragment = false;
-					nalsize -= tx->rtpenc_h264_state->maxPacketSize - 2;
-
-				} else {
-					// This is the last fragment:
-					if (tx->rtpenc_h264_state->haveSeenEOF) m = 1;
-
-					hdr[1] |= 0x40;// set the E bit in the FU header
-
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									(char *) tx->rtpenc_h264_state->from + tx->rtpenc_h264_state->curNALOffset,
-									nalsize, extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
-					tx->rtpenc_h264_state->lastNALUnitFragment = true;
-				}
-			}
-		}
-
-		if (tx->rtpenc_h264_state->haveSeenEOF){
-			return;
-		}
-	}
+        const struct rtpenc_h264_packet *packets;
+        int packet_count = rtpenc_h264_packetize(tx->rtpenc_h264_state,
+                        (unsigned char *) tile->data, tile->data_len,
+                        tx->mtu - 40, &packets);
+        if (packet_count == 0) {
+                return;
+        }
+        long packet_rate = get_packet_rate(tx, frame, tile->data_len, packet_count);
+
+        // packet headers and payloads stay valid until rtp_async_wait()
+        rtp_async_start(rtp_session, packet_count);
+        for (int i = 0; i < packet_count; ++i) {
+                GET_STARTTIME;
+                const struct rtpenc_h264_packet *pkt = &packets[i];
+                int m = i == packet_count - 1;
+                if (rtp_send_data_hdr(rtp_session, ts, pt, m, 0, 0,
+                                        pkt->hdr_len > 0 ? const_cast<char *>(reinterpret_cast<const char *>(pkt->hdr)) : NULL, pkt->hdr_len,
+                                        const_cast<char *>(reinterpret_cast<const char *>(pkt->data)), pkt->data_len, 0, 0, 0) < 0) {
+                        error_msg("There was a problem sending the RTP packet\n");
+                }
+                tx_account_packet(tx, pkt->hdr_len + pkt->data_len);
+
+                // TRAFFIC SHAPER
+                if (!m) { // wait for all but last packet
+                        do {
+                                GET_STOPTIME;
+                                GET_DELTA;
+                        } while (packet_rate - delta - overslept > 0);
+                        overslept = -(packet_rate - delta - overslept);
+                }
+        }
+        rtp_async_wait(rtp_session);
 }
 
 void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
@@ -1137,6 +1320,7 @@ void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
                 if (ret < 0) {
                         log_msg(LOG_LEVEL_ERROR, "Error sending RTP/JPEG packet!\n");
                 }
+                tx_account_packet(tx, hdr_len + data_len);
                 data += data_len;
                 bytes_left -= data_len;
                 fragment_offset += data_len;
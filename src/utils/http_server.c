@@ -0,0 +1,155 @@
+/**
+ * @file   utils/http_server.c
+ * @brief  wrapper around EmbeddableWebServer allowing multiple modules to serve content
+ *
+ * EmbeddableWebServer is a header-only library that requires the user to
+ * define createResponseForRequest() globally, so it is implemented in this
+ * compilation unit only and the request is dispatched to the handler stored
+ * in the server tag.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @todo
+ * * exit correctly HTTP thread (but it is a bit tricky because it waits on accept())
+ * * at least some Windows compatibility functions should be perhaps deleted from
+ *   EmbeddableWebServer, eg. pthread_* which we have from winpthreads, either.
+ *   This can also be potentially dangerous.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+// config_win32.h must not be included if using EWS because EWS has
+// some incomatible implementations of POSIX functions
+#endif
+
+#ifdef WIN32
+#define _WIN32_WINNT 0x0600
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "debug.h"
+#include "utils/http_server.h"
+
+#ifdef SDP_HTTP
+#define EWS_DISABLE_SNPRINTF_COMPAT
+#include "EmbeddableWebServer.h"
+
+#define MOD_NAME "[HTTP] "
+
+struct http_server {
+    struct Server server;
+    uint16_t port;
+    int ip_version;
+    bool loopback_only;
+    http_server_handler_t handler;
+    void *udata;
+};
+
+struct Response* createResponseForRequest(const struct Request* request, struct Connection* connection) {
+    struct http_server *s = connection->server->tag;
+    const char *content_type = "text/plain";
+    size_t len = 0;
+    char *body = s->handler(s->udata, request->pathDecoded, &content_type, &len);
+    if (body == NULL) {
+        return responseAlloc404NotFoundHTML(request->pathDecoded);
+    }
+    struct Response *response = responseAlloc(200, "OK", content_type, 0);
+    if (len > 0) { // response takes the ownership of the body
+        response->body.contents = body;
+        response->body.length = response->body.capacity = len;
+    } else {
+        free(body);
+    }
+    return response;
+}
+
+static THREAD_RETURN_TYPE STDCALL_ON_WIN32 acceptConnectionsThread(void* param) {
+    struct http_server *s = param;
+    struct sockaddr_storage ss = { 0 };
+    ss.ss_family = s->ip_version == 4 ? AF_INET : AF_INET6;
+    size_t sa_len = s->ip_version == 6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    if (s->ip_version == 4) {
+        struct sockaddr_in *sin = (struct sockaddr_in *) &ss;
+        sin->sin_addr.s_addr = htonl(s->loopback_only ? INADDR_LOOPBACK : INADDR_ANY);
+        sin->sin_port = htons(s->port);
+    } else {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) &ss;
+        sin6->sin6_addr = s->loopback_only ? in6addr_loopback : in6addr_any;
+        sin6->sin6_port = htons(s->port);
+    }
+    acceptConnectionsUntilStopped(&s->server, (struct sockaddr *) &ss, sa_len);
+    log_msg(LOG_LEVEL_WARNING, MOD_NAME "Warning: HTTP thread on port %d has exited.\n", (int) s->port);
+    return (THREAD_RETURN_TYPE) 0;
+}
+
+bool http_server_start(int port, int ip_version, bool loopback_only, http_server_handler_t handler, void *udata)
+{
+    assert(port >= 0 && port < 65536);
+    assert(ip_version == 4 || ip_version == 6);
+    struct http_server *s = calloc(1, sizeof(struct http_server));
+    s->port = port;
+    s->ip_version = ip_version;
+    s->loopback_only = loopback_only;
+    s->handler = handler;
+    s->udata = udata;
+    serverInit(&s->server);
+    s->server.tag = s;
+    pthread_t http_server_thr;
+    if (pthread_create(&http_server_thr, NULL, &acceptConnectionsThread, s) != 0) {
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create server thread!\n");
+        serverDeInit(&s->server);
+        free(s);
+        return false;
+    }
+    pthread_detach(http_server_thr);
+    // some resource will definitely leak but it shouldn't be a problem
+    return true;
+}
+#else
+bool http_server_start(int port, int ip_version, bool loopback_only, http_server_handler_t handler, void *udata)
+{
+    UNUSED(port), UNUSED(ip_version), UNUSED(loopback_only), UNUSED(handler), UNUSED(udata);
+    log_msg(LOG_LEVEL_ERROR, "HTTP server support was not compiled in!\n");
+    return false;
+}
+#endif // SDP_HTTP
+
+/* vim: set expandtab sw=4 : */
@@ -0,0 +1,80 @@
+/**
+ * @file   utils/http_server.h
+ * @brief  minimal HTTP server for serving generated content (SDP, metrics)
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_HTTP_SERVER_H_
+#define UTILS_HTTP_SERVER_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stddef.h>
+#else
+#include <cstddef>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Request handler called from the server thread for every GET request.
+ *
+ * @param udata             user data passed to http_server_start()
+ * @param path              decoded request path (including leading '/')
+ * @param[out] content_type MIME type of the returned body (static string)
+ * @param[out] len          length of the returned body
+ * @returns                 body allocated with malloc() that is freed by the
+ *                          server, NULL if the path is not served (404)
+ */
+typedef char *(*http_server_handler_t)(void *udata, const char *path, const char **content_type, size_t *len);
+
+/**
+ * Starts HTTP server in a detached thread.
+ *
+ * @param ip_version    4 or 6
+ * @param loopback_only listen on loopback address only, otherwise on all
+ *                      addresses
+ * @returns          true if server thread was started; false if unsupported
+ *                   (compiled without SDP_HTTP) or on failure
+ */
+bool http_server_start(int port, int ip_version, bool loopback_only, http_server_handler_t handler, void *udata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_HTTP_SERVER_H_
+
@@ -0,0 +1,348 @@
+/**
+ * @file   utils/metrics.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "utils/http_server.h"
+#include "utils/metrics.h"
+
+#define MOD_NAME "[metrics] "
+
+using std::atomic;
+using std::lock_guard;
+using std::map;
+using std::mutex;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+enum metric_type {
+        METRIC_COUNTER,
+        METRIC_GAUGE,
+        METRIC_HISTOGRAM,
+};
+
+static const char *metric_type_name[] = { "counter", "gauge", "histogram" };
+
+struct metric {
+        metric(const char *n, metric_type t, const char *l) : name(n), type(t), labels(l ? l : "") {}
+        string name;
+        enum metric_type type;
+        string labels;
+
+        atomic<uint64_t> count{0}; ///< counter value or histogram observation count
+        atomic<double> value{0.0}; ///< gauge value or histogram sum
+
+        vector<double> bounds;
+        unique_ptr<atomic<uint64_t>[]> buckets; ///< non-cumulative, last is +Inf
+};
+
+struct metric_family {
+        enum metric_type type;
+        string help;
+        vector<metric *> metrics;
+};
+
+struct metrics_registry {
+        mutex lock; ///< guards registration and export only, not updates
+        map<string, metric_family> families;
+};
+
+static metrics_registry &get_registry() {
+        static metrics_registry registry;
+        return registry;
+}
+
+/**
+ * Adds fully constructed metric to the registry (so that the exporter never
+ * sees it partially initialized). Deletes the metric on failure.
+ */
+static struct metric *metric_register(struct metric *m, const char *help)
+{
+        assert(help != nullptr);
+        auto &reg = get_registry();
+        lock_guard<mutex> lk(reg.lock);
+        auto it = reg.families.find(m->name);
+        if (it == reg.families.end()) {
+                it = reg.families.emplace(m->name, metric_family{m->type, help, {}}).first;
+        } else if (it->second.type != m->type) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Metric %s already registered as %s!\n",
+                                m->name.c_str(), metric_type_name[it->second.type]);
+                delete m;
+                return nullptr;
+        }
+        it->second.metrics.push_back(m);
+        return m;
+}
+
+struct metric *metric_register_counter(const char *name, const char *help, const char *labels)
+{
+        return metric_register(new metric(name, METRIC_COUNTER, labels), help);
+}
+
+struct metric *metric_register_gauge(const char *name, const char *help, const char *labels)
+{
+        return metric_register(new metric(name, METRIC_GAUGE, labels), help);
+}
+
+struct metric *metric_register_histogram(const char *name, const char *help, const char *labels,
+                const double *bounds, int bound_count)
+{
+        static const double default_bounds[] = { METRIC_LATENCY_BUCKETS };
+        if (bounds == nullptr) {
+                bounds = default_bounds;
+                bound_count = sizeof default_bounds / sizeof default_bounds[0];
+        }
+        for (int i = 1; i < bound_count; ++i) {
+                assert(bounds[i - 1] < bounds[i]);
+        }
+        auto *m = new metric(name, METRIC_HISTOGRAM, labels);
+        m->bounds.assign(bounds, bounds + bound_count);
+        m->buckets.reset(new atomic<uint64_t>[bound_count + 1]);
+        for (int i = 0; i <= bound_count; ++i) {
+                m->buckets[i] = 0;
+        }
+        return metric_register(m, help);
+}
+
+void metric_unregister(struct metric *m)
+{
+        if (m == nullptr) {
+                return;
+        }
+        auto &reg = get_registry();
+        {
+                lock_guard<mutex> lk(reg.lock);
+                auto it = reg.families.find(m->name);
+                assert(it != reg.families.end());
+                auto &metrics = it->second.metrics;
+                for (auto i = metrics.begin(); i != metrics.end(); ++i) {
+                        if (*i == m) {
+                                metrics.erase(i);
+                                break;
+                        }
+                }
+                if (metrics.empty()) {
+                        reg.families.erase(it);
+                }
+        }
+        delete m;
+}
+
+void metric_inc(struct metric *counter)
+{
+        metric_add(counter, 1);
+}
+
+void metric_add(struct metric *counter, uint64_t val)
+{
+        if (counter == nullptr) {
+                return;
+        }
+        assert(counter->type == METRIC_COUNTER);
+        counter->count.fetch_add(val, std::memory_order_relaxed);
+}
+
+void metric_set(struct metric *gauge, double val)
+{
+        if (gauge == nullptr) {
+                return;
+        }
+        assert(gauge->type == METRIC_GAUGE);
+        gauge->value.store(val, std::memory_order_relaxed);
+}
+
+void metric_observe(struct metric *histogram, double val)
+{
+        if (histogram == nullptr) {
+                return;
+        }
+        assert(histogram->type == METRIC_HISTOGRAM);
+        size_t idx = 0;
+        while (idx < histogram->bounds.size() && val > histogram->bounds[idx]) {
+                idx++;
+        }
+        histogram->buckets[idx].fetch_add(1, std::memory_order_relaxed);
+        double sum = histogram->value.load(std::memory_order_relaxed);
+        while (!histogram->value.compare_exchange_weak(sum, sum + val, std::memory_order_relaxed)) {
+        }
+        histogram->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void append_double(string &out, double val)
+{
+        if (std::isnan(val)) {
+                out += "NaN";
+        } else if (std::isinf(val)) {
+                out += val > 0 ? "+Inf" : "-Inf";
+        } else {
+                // shortest representation that parses back to the same value
+                char buf[32];
+                snprintf(buf, sizeof buf, "%.15g", val);
+                if (strtod(buf, nullptr) != val) {
+                        snprintf(buf, sizeof buf, "%.17g", val);
+                }
+                out += buf;
+        }
+}
+
+static void append_sample(string &out, const string &name, const char *suffix, const string &labels,
+                const string &extra_label)
+{
+        out += name;
+        out += suffix;
+        if (!labels.empty() || !extra_label.empty()) {
+                out += "{";
+                out += labels;
+                if (!labels.empty() && !extra_label.empty()) {
+                        out += ",";
+                }
+                out += extra_label;
+                out += "}";
+        }
+        out += " ";
+}
+
+static void append_help(string &out, const string &help)
+{
+        for (char c : help) {
+                if (c == '\\') {
+                        out += "\\\\";
+                } else if (c == '\n') {
+                        out += "\\n";
+                } else {
+                        out += c;
+                }
+        }
+}
+
+char *metrics_export(void)
+{
+        string out;
+        auto &reg = get_registry();
+        lock_guard<mutex> lk(reg.lock);
+        for (auto &f : reg.families) {
+                const string &name = f.first;
+                out += "# HELP " + name + " ";
+                append_help(out, f.second.help);
+                out += "\n# TYPE " + name + " " + metric_type_name[f.second.type] + "\n";
+                for (auto *m : f.second.metrics) {
+                        switch (m->type) {
+                        case METRIC_COUNTER:
+                                append_sample(out, name, "", m->labels, {});
+                                out += std::to_string(m->count.load(std::memory_order_relaxed)) + "\n";
+                                break;
+                        case METRIC_GAUGE:
+                                append_sample(out, name, "", m->labels, {});
+                                append_double(out, m->value.load(std::memory_order_relaxed));
+                                out += "\n";
+                                break;
+                        case METRIC_HISTOGRAM:
+                        {
+                                // the snapshot is not atomic as a whole, so derive
+                                // the count from the buckets to keep it consistent
+                                uint64_t cumulative = 0;
+                                for (size_t i = 0; i <= m->bounds.size(); ++i) {
+                                        cumulative += m->buckets[i].load(std::memory_order_relaxed);
+                                        string le = "le=\"";
+                                        if (i < m->bounds.size()) {
+                                                append_double(le, m->bounds[i]);
+                                        } else {
+                                                le += "+Inf";
+                                        }
+                                        le += "\"";
+                                        append_sample(out, name, "_bucket", m->labels, le);
+                                        out += std::to_string(cumulative) + "\n";
+                                }
+                                append_sample(out, name, "_sum", m->labels, {});
+                                append_double(out, m->value.load(std::memory_order_relaxed));
+                                out += "\n";
+                                append_sample(out, name, "_count", m->labels, {});
+                                out += std::to_string(cumulative) + "\n";
+                                break;
+                        }
+                        }
+                }
+        }
+        return strdup(out.c_str());
+}
+
+static char *metrics_http_handler(void *udata, const char *path, const char **content_type, size_t *len)
+{
+        UNUSED(udata);
+        if (strcmp(path, "/metrics") != 0) {
+                return nullptr;
+        }
+        char *body = metrics_export();
+        *content_type = "text/plain; version=0.0.4; charset=utf-8";
+        *len = strlen(body);
+        return body;
+}
+
+bool metrics_http_start(int port, int ip_version, bool public_access)
+{
+        if (port < 0 || port > 65535) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Invalid port %d!\n", port);
+                return false;
+        }
+        if (!http_server_start(port, ip_version, !public_access, metrics_http_handler, nullptr)) {
+                return false;
+        }
+        if (public_access) {
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Serving metrics at http://<host>:%d/metrics\n", port);
+        } else {
+                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Serving metrics at http://localhost:%d/metrics\n", port);
+        }
+        return true;
+}
+
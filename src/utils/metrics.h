@@ -0,0 +1,115 @@
+/**
+ * @file   utils/metrics.h
+ * @brief  registry of typed runtime metrics (counters, gauges, histograms)
+ *
+ * Modules register their metrics once (eg. on init) and update them from the
+ * data path. Updates are lock-free (atomic operations only) so that they can
+ * be safely called per packet or per frame. The registry can be exported in
+ * Prometheus/OpenMetrics text exposition format, either with metrics_export()
+ * or served over HTTP (see metrics_http_start()).
+ *
+ * All update functions accept NULL metric as a no-op.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_METRICS_H_
+#define UTILS_METRICS_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct metric;
+
+/**
+ * Registers a monotonically increasing counter.
+ *
+ * Multiple metrics may share a name (eg. multiple instances of a module) as
+ * long as they have the same type and help and differ in labels.
+ *
+ * @param name   metric name, eg. "ug_video_rx_frames_total"
+ * @param help   one-line description
+ * @param labels comma-separated label pairs without braces (eg. "stream=\"0\""),
+ *               may be NULL
+ * @returns      metric handle, NULL if registration failed (type mismatch)
+ */
+struct metric *metric_register_counter(const char *name, const char *help, const char *labels);
+/// Registers a gauge (value that can go up and down), see metric_register_counter()
+struct metric *metric_register_gauge(const char *name, const char *help, const char *labels);
+/**
+ * Registers a histogram, see metric_register_counter().
+ *
+ * @param bounds      ascending upper bounds of the buckets (+Inf bucket is
+ *                    implicit); if NULL, METRIC_LATENCY_BUCKETS is used
+ * @param bound_count number of items in bounds
+ */
+struct metric *metric_register_histogram(const char *name, const char *help, const char *labels,
+                const double *bounds, int bound_count);
+/// Removes the metric from registry and frees it, accepts NULL
+void metric_unregister(struct metric *m);
+
+/// default latency histogram bucket upper bounds (in seconds), 100 us - 1 s
+#define METRIC_LATENCY_BUCKETS 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0
+
+void metric_inc(struct metric *counter);
+void metric_add(struct metric *counter, uint64_t val);
+void metric_set(struct metric *gauge, double val);
+void metric_observe(struct metric *histogram, double val);
+
+/**
+ * @returns all registered metrics in Prometheus text exposition format
+ *          (version 0.0.4), caller is responsible for freeing the string
+ */
+char *metrics_export(void);
+
+/**
+ * Starts serving metrics_export() output at "/metrics" on given port.
+ *
+ * @param public_access listen on all addresses, otherwise on loopback only
+ */
+bool metrics_http_start(int port, int ip_version, bool public_access);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_METRICS_H_
+
@@ -42,42 +42,29 @@
 /**
  * @file
  * @todo
- * * exit correctly HTTP thread (but it is a bit tricky because it waits on accept())
- * * createResponseForRequest() should be probably static (in case that other
- *   modules want also to use EmbeddableWebServer)
  * * HTTP server should work even if the SDP file cannot be written
- * * at least some Windows compatibility functions should be perhaps deleted from
- *   EmbeddableWebServer, eg. pthread_* which we have from winpthreads, either.
- *   This can also be potentially dangerous.
  */
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #include "config_unix.h"
-// config_win32.h must not be included if using EWS because EWS has
-// some incomatible implementations of POSIX functions
+#include "config_win32.h"
 #endif
 
-#ifdef WIN32
-#define _WIN32_WINNT 0x0600
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#endif
+#include <stdlib.h>
+#include <string.h>
 
 #include "audio/types.h"
 #include "debug.h"
 #include "rtp/rtp_types.h"
 #include "types.h"
 #include "utils/fs.h"
+#include "utils/http_server.h"
 #include "utils/net.h"
 #include "utils/sdp.h"
-#ifdef SDP_HTTP
-#define EWS_DISABLE_SNPRINTF_COMPAT
-#include "EmbeddableWebServer.h"
-#endif // SDP_HTTP
 
 #define SDP_FILE "ug.sdp"
 
@@ -270,44 +257,37 @@ void clean_sdp(struct sdp *sdp){
 // HTTP server stuff
 // --------------------------------------------------------------------
 #ifdef SDP_HTTP
-// this is needed for HTTP server
-static struct sdp *sdp_global;
-
-struct Response* createResponseForRequest(const struct Request* request, struct Connection* connection) {
-    UNUSED(connection);
-    if (strlen(request->pathDecoded) > 1 && request->pathDecoded[0] == '/' && strcmp(request->pathDecoded + 1, SDP_FILE) == 0) {
-        char *sdp_file_name = alloca(strlen(SDP_FILE) + strlen(get_temp_dir()) + 1);
-        strcpy(sdp_file_name, get_temp_dir());
-        strcat(sdp_file_name, SDP_FILE);
-	return responseAllocWithFile(sdp_file_name, "application/sdp");
+static char *sdp_http_handler(void *udata, const char *path, const char **content_type, size_t *len) {
+    UNUSED(udata);
+    if (path[0] != '/' || strcmp(path + 1, SDP_FILE) != 0) {
+        return NULL;
     }
-    return responseAlloc404NotFoundHTML(request->pathDecoded);
-}
-
-static uint16_t portInHostOrder;
-
-static THREAD_RETURN_TYPE STDCALL_ON_WIN32 acceptConnectionsThread(void* param) {
-    struct sockaddr_storage ss = { 0 };
-    ss.ss_family = sdp_global->ip_version == 4 ? AF_INET : AF_INET6;
-    size_t sa_len = sdp_global->ip_version == 6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
-    if (sdp_global->ip_version == 4) {
-        struct sockaddr_in *sin = (struct sockaddr_in *) &ss;
-        sin->sin_addr.s_addr = htonl(INADDR_ANY);
-        sin->sin_port = htons(portInHostOrder);
-    } else {
-        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) &ss;
-        sin6->sin6_addr = in6addr_any;
-        sin6->sin6_port = htons(portInHostOrder);
+    char *sdp_file_name = alloca(strlen(SDP_FILE) + strlen(get_temp_dir()) + 1);
+    strcpy(sdp_file_name, get_temp_dir());
+    strcat(sdp_file_name, SDP_FILE);
+    FILE *f = fopen(sdp_file_name, "rb");
+    if (f == NULL) {
+        return NULL;
     }
-    acceptConnectionsUntilStopped(param, (struct sockaddr *) &ss, sa_len);
-    log_msg(LOG_LEVEL_WARNING, "Warning: HTTP/SDP thread has exited.\n");
-    return (THREAD_RETURN_TYPE) 0;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *body = size > 0 ? malloc(size) : NULL;
+    if (body == NULL || fread(body, size, 1, f) != 1) {
+        free(body);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *content_type = "application/sdp";
+    *len = size;
+    return body;
 }
 
-static void print_http_path() {
+static void print_http_path(int ip_version, int port) {
     struct sockaddr_storage addrs[20];
     size_t len = sizeof addrs;
-    if (get_local_addresses(addrs, &len, sdp_global->ip_version)) {
+    if (get_local_addresses(addrs, &len, ip_version)) {
         bool found_public_ip = false;
         for (size_t i = 0; i < len / sizeof addrs[0]; ++i) {
             if (!is_addr_loopback((struct sockaddr *) &addrs[i]) && !is_addr_linklocal((struct sockaddr *) &addrs[i])) {
@@ -320,7 +300,7 @@ static void print_http_path() {
                 bool ipv6 = addrs[i].ss_family == AF_INET6;
                 size_t sa_len = ipv6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
                 getnameinfo((struct sockaddr *) &addrs[i], sa_len, hostname, sizeof(hostname), NULL, 0, NI_NUMERICHOST);
-                log_msg(LOG_LEVEL_NOTICE, "Receiver can play SDP with URL http://%s%s%s:%u/%s\n", ipv6 ? "[" : "", hostname, ipv6 ? "]" : "", portInHostOrder, SDP_FILE);
+                log_msg(LOG_LEVEL_NOTICE, "Receiver can play SDP with URL http://%s%s%s:%d/%s\n", ipv6 ? "[" : "", hostname, ipv6 ? "]" : "", port, SDP_FILE);
             }
         }
     }
@@ -329,15 +309,10 @@ static void print_http_path() {
 bool sdp_run_http_server(struct sdp *sdp, int port)
 {
     assert(port >= 0 && port < 65536);
-    portInHostOrder = port;
-    struct Server *http_server = calloc(1, sizeof(struct Server));
-    sdp_global = sdp;
-    serverInit(http_server);
-    pthread_t http_server_thr;
-    pthread_create(&http_server_thr, NULL, &acceptConnectionsThread, http_server);
-    pthread_detach(http_server_thr);
-    // some resource will definitely leak but it shouldn't be a problem
-    print_http_path();
+    if (!http_server_start(port, sdp->ip_version, false, sdp_http_handler, sdp)) {
+        return false;
+    }
+    print_http_path(sdp->ip_version, port);
     return true;
 }
 #endif // SDP_HTTP
@@ -38,6 +38,7 @@
 #ifndef SYNCHRONIZED_QUEUE_H_
 #define SYNCHRONIZED_QUEUE_H_
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <queue>
@@ -56,11 +57,14 @@ struct msg_quit : public msg {};
  * if there is no element in the queue.
  *
  * @tparam T type to be stored
- * @tparam max_len maximal length of the queue until it bloks (-1 means unlimited)
+ * @tparam max_len maximal length of the queue until it bloks (-1 means unlimited),
+ *                 may be overriden in constructor
  */
 template<typename T = struct msg *, int max_len = 1>
 class synchronized_queue {
 public:
+        explicit synchronized_queue(int len = max_len) : m_max_len(len) {}
+
         int size()
         {
                 std::unique_lock<std::mutex> l(m_lock);
@@ -70,8 +74,8 @@ public:
         void push(T const & message)
         {
                 std::unique_lock<std::mutex> l(m_lock);
-                if (max_len != -1) {
-                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) max_len;});
+                if (m_max_len != -1) {
+                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) m_max_len;});
                 }
                 m_queue.push(message);
                 l.unlock();
@@ -81,14 +85,32 @@ public:
         void push(T && message)
         {
                 std::unique_lock<std::mutex> l(m_lock);
-                if (max_len != -1) {
-                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) max_len;});
+                if (m_max_len != -1) {
+                        m_queue_decremented.wait(l, [this]{return m_queue.size() < (unsigned int) m_max_len;});
                 }
                 m_queue.push(std::move(message));
                 l.unlock();
                 m_queue_incremented.notify_one();
         }
 
+        /**
+         * Like push() but gives up after timeout if the queue is still full.
+         * @retval false message was not pushed
+         */
+        template<class Rep, class Period>
+        bool timed_push(T const & message, std::chrono::duration<Rep, Period> const & timeout)
+        {
+                std::unique_lock<std::mutex> l(m_lock);
+                if (m_max_len != -1 && !m_queue_decremented.wait_for(l, timeout,
+                                        [this]{return m_queue.size() < (unsigned int) m_max_len;})) {
+                        return false;
+                }
+                m_queue.push(message);
+                l.unlock();
+                m_queue_incremented.notify_one();
+                return true;
+        }
+
         T pop(bool nonblocking = false)
         {
                 std::unique_lock<std::mutex> l(m_lock);
@@ -107,6 +129,7 @@ public:
 
 
 private:
+        int                     m_max_len;
         std::queue<T>           m_queue;
         std::mutex              m_lock;
         std::condition_variable m_queue_decremented;
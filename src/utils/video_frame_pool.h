@@ -45,6 +45,7 @@
 #ifdef __cplusplus
 
 #include <cassert>
+#include <cstdlib>
 #include <condition_variable>
 #include <functional>
 #include <iostream>
@@ -62,6 +63,37 @@ struct default_data_allocator {
         }
 };
 
+/**
+ * Allocates buffers aligned to @p alignment (cache line by default) so that
+ * aligned SIMD loads and stores can be used on frame data.
+ *
+ * Buffers of at least the huge page size are aligned to it and, on Linux,
+ * advised to be backed by transparent huge pages. The memory is not touched
+ * here so that its pages get allocated on the NUMA node of the thread that
+ * first writes the frame (the decoder).
+ */
+template <size_t alignment = 64>
+struct aligned_data_allocator {
+        static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+        void *allocate(size_t size) {
+                if (size >= HUGE_PAGE_SIZE && alignment < HUGE_PAGE_SIZE) {
+                        size_t rounded_size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+                        void *ptr = aligned_malloc(rounded_size, HUGE_PAGE_SIZE);
+#ifdef MADV_HUGEPAGE
+                        if (ptr != nullptr) {
+                                madvise(ptr, rounded_size, MADV_HUGEPAGE);
+                        }
+#endif
+                        return ptr;
+                }
+                return aligned_malloc(size, alignment);
+        }
+        void deallocate(void *ptr) {
+                aligned_free(ptr);
+        }
+};
+
 template <typename allocator>
 struct video_frame_pool {
         public:
@@ -99,14 +131,15 @@ struct video_frame_pool {
                         assert(m_generation != 0);
                         struct video_frame *ret = NULL;
                         std::unique_lock<std::mutex> lk(m_lock);
-                        if (!m_free_frames.empty()) {
-                                ret = m_free_frames.front();
-                                m_free_frames.pop();
-                        } else if (m_max_used_frames > 0 && m_max_used_frames == m_unreturned_frames) {
+                        if (m_max_used_frames > 0) {
+                                // returned frame may have been freed (older generation) so it
+                                // needn't be in m_free_frames - a new one is allocated then
                                 m_frame_returned.wait(lk, [this] {return m_unreturned_frames < m_max_used_frames;});
-                                assert(!m_free_frames.empty());
+                        }
+                        if (!m_free_frames.empty()) {
                                 ret = m_free_frames.front();
                                 m_free_frames.pop();
+                                reset_data_len(ret);
                         } else {
                                 try {
                                         ret = vf_alloc_desc(m_desc);
@@ -130,7 +163,7 @@ struct video_frame_pool {
 
                                         assert(m_unreturned_frames > 0);
                                         m_unreturned_frames -= 1;
-                                        m_frame_returned.notify_one();
+                                        m_frame_returned.notify_all();
 
                                         if (this->m_generation != generation) {
                                                 this->deallocate_frame(frame);
@@ -145,6 +178,12 @@ struct video_frame_pool {
                 }
 
         private:
+                void reset_data_len(struct video_frame *frame) {
+                        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                                frame->tiles[i].data_len = m_max_data_len;
+                        }
+                }
+
                 void remove_free_frames() {
                         while (!m_free_frames.empty()) {
                                 struct video_frame *frame = m_free_frames.front();
@@ -172,6 +211,32 @@ struct video_frame_pool {
                 allocator         m_allocator;
                 unsigned int      m_max_used_frames;
 };
+
+template <typename allocator>
+struct video_frame_pool_disposable_frame {
+        // members are destroyed in reverse order, so the frame is returned first
+        std::shared_ptr<video_frame_pool<allocator>> pool; ///< keeps the pool alive until the frame returns
+        std::shared_ptr<video_frame> frame;
+
+        static void dispose(struct video_frame *frame) {
+                delete static_cast<video_frame_pool_disposable_frame *>(frame->callbacks.dispose_udata);
+        }
+};
+
+/**
+ * Returns a frame from the pool to be passed on as a plain struct video_frame
+ * (eg. from display_get_frame() or to a frame_recv_delegate). The frame is
+ * returned to the pool by VIDEO_FRAME_DISPOSE(), which may happen after the
+ * pool owner is destroyed.
+ */
+template <typename allocator>
+struct video_frame *video_frame_pool_get_disposable_frame(std::shared_ptr<video_frame_pool<allocator>> const & pool) {
+        auto holder = new video_frame_pool_disposable_frame<allocator>{pool, pool->get_frame()};
+        struct video_frame *out = holder->frame.get();
+        out->callbacks.dispose = video_frame_pool_disposable_frame<allocator>::dispose;
+        out->callbacks.dispose_udata = holder;
+        return out;
+}
 #endif //  __cplusplus
 
 #endif // VIDEO_FRAME_POOL_H_
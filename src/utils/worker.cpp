@@ -47,6 +47,7 @@
 #include <algorithm>
 #include <queue>
 #include <set>
+#include <vector>
 
 using namespace std;
 
@@ -278,3 +279,17 @@ void *wait_task(task_result_handle_t handle)
         return instance.wait_task(handle);
 }
 
+void task_run_parallel(runnable_t task, int worker_count, void *data, size_t data_len, void **res)
+{
+        vector<task_result_handle_t> handles(worker_count);
+        for (int i = 0; i < worker_count; ++i) {
+                handles[i] = task_run_async(task, (char *) data + i * data_len);
+        }
+        for (int i = 0; i < worker_count; ++i) {
+                void *ret = wait_task(handles[i]);
+                if (res) {
+                        res[i] = ret;
+                }
+        }
+}
+
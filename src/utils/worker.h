@@ -44,6 +44,12 @@
 #ifndef WORKER_H_
 #define WORKER_H
 
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stddef.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -57,6 +63,14 @@ task_result_handle_t task_run_async(runnable_t task, void *data);
  */
 void task_run_async_detached(runnable_t task, void *data);
 void *wait_task(task_result_handle_t handle);
+/**
+ * Runs task on worker_count workers in parallel and waits for all of them.
+ *
+ * @param data     array of worker_count items, each data_len bytes long,
+ *                 i-th item is passed to i-th worker
+ * @param res      array of worker_count results (may be NULL)
+ */
+void task_run_parallel(runnable_t task, int worker_count, void *data, size_t data_len, void **res);
 
 
 #ifdef __cplusplus
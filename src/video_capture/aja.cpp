@@ -127,15 +127,6 @@ volatile bool *aja_should_exit = &should_exit;
 
 using namespace std;
 
-struct aligned_data_allocator {
-        void *allocate(size_t size) {
-                return aligned_malloc(size, AJA_PAGE_SIZE);
-        }
-        void deallocate(void *ptr) {
-                aligned_free(ptr);
-        }
-};
-
 static const ULWord app = AJA_FOURCC ('U','L','G','R');
 
 class vidcap_state_aja {
@@ -161,7 +152,7 @@ class vidcap_state_aja {
                 uint32_t               mVideoBufferSize{};            ///     My video buffer size, in bytes
                 uint32_t               mAudioBufferSize{};            ///     My audio buffer size, in bytes
                 thread                 mProducerThread;               ///     My producer thread object -- does the frame capturing
-                video_frame_pool<aligned_data_allocator> mPool;
+                video_frame_pool<aligned_data_allocator<AJA_PAGE_SIZE>> mPool;
                 shared_ptr<video_frame> mOutputFrame;
                 shared_ptr<uint32_t>   mOutputAudioFrame;
                 size_t                 mOutputAudioFrameSize{};
@@ -41,6 +41,18 @@
  */
 /**
  * @file
+ * Processing is split into pipeline stages, each running in its own thread
+ * and connected with bounded queues:
+ * 1. demuxer (+ audio decoding) reading packets ahead
+ * 2. video decoder (with libavcodec frame/slice threading)
+ * 3. conversion to UG pixel format, in parallel horizontal stripes, to
+ *    pooled output frames
+ *
+ * Decoded audio is kept aside tagged with its timestamp and attached to the
+ * video frame it belongs to when the frame is grabbed, so that it doesn't run
+ * ahead of the video by the depth of the pipeline. Timestamps of a looped
+ * file are offset so that they grow monotonically.
+ *
  * @todo
  * - selectable pixel format
  * - audio-only input
@@ -56,6 +68,8 @@
 #include <assert.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/avutil.h>
+#include <libavutil/cpu.h>
+#include <libavutil/pixdesc.h>
 #include <libavformat/avformat.h>
 #include <libswscale/swscale.h>
 #include <inttypes.h>
@@ -75,39 +89,109 @@
 #include "utils/misc.h"
 #include "utils/time.h"
 #include "utils/thread.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_capture.h"
 
 #define MAGIC to_fourcc('u', 'g', 'l', 'f')
 #define MOD_NAME "[File cap.] "
 
+#define QUEUE_MAX 64
+#define DEFAULT_READAHEAD 32 ///< packets
+#define DEFAULT_QUEUE_LEN 4  ///< decoded and converted frames
+#define CONV_THREADS_MAX 16
+#define CONV_STRIPE_ALIGN 16 ///< stripe height alignment (enough for any chroma subsampling)
+#define FRAME_POOL_MAX 16
+#define AUDIO_PENDING_MAX_SEC 5 ///< max decoded audio waiting for video
+
+/**
+ * Bounded FIFO connecting pipeline stages, protected by vidcap_state_lavf_decoder::lock
+ */
+struct item_queue {
+        void *items[QUEUE_MAX];
+        unsigned generation[QUEUE_MAX]; ///< see vidcap_state_lavf_decoder::generation
+        int64_t pts[QUEUE_MAX]; ///< video stream time base, used by frames queue only
+        int head;
+        int count;
+        int max_len;
+};
+
+/**
+ * Pool of output frames. Frames may be returned after the capture has been
+ * closed, so the pool is destroyed when both the capture and all frames are gone.
+ */
+struct frame_pool {
+        pthread_mutex_t lock;
+        struct video_desc desc;
+        struct video_frame *free_frames[FRAME_POOL_MAX];
+        int free_count;
+        int lent;
+        bool released;
+};
+
+/**
+ * Decoded (interleaved) audio waiting for the corresponding video frame.
+ */
+struct audio_chunk {
+        int64_t pts; ///< in video stream time base, AV_NOPTS_VALUE if unknown
+        int data_len;
+        struct audio_chunk *next;
+        char data[];
+};
+
+struct conv_stripe {
+        struct SwsContext *sws_ctx;
+        const AVFrame *in;
+        int planes;
+        int log2_chroma_h;
+        int y;
+        int height;
+        char *out;
+        int out_linesize;
+};
+
 struct vidcap_state_lavf_decoder {
         struct module mod;
         char *src_filename;
         AVFormatContext *fmt_ctx;
         AVCodecContext *aud_ctx, *vid_ctx;
-        struct SwsContext *sws_ctx;
+        struct conv_stripe conv[CONV_THREADS_MAX];
+        int conv_threads;
+        enum AVPixelFormat conv_src_fmt;
+        struct frame_pool *pool;
         bool failed;
         bool loop;
         bool new_msg;
         bool no_decode;
         bool paused;
+        bool eof;
         bool use_audio;
 
         int video_stream_idx, audio_stream_idx;
         int64_t last_vid_pts;
+        int64_t vid_frame_duration; ///< in video stream time base
+        int64_t loop_offset; ///< added to timestamps of the looped file (video stream time base)
+        int64_t vid_end_pts; ///< end of the last video packet read (including loop_offset)
 
         struct video_desc video_desc;
 
-        struct video_frame *video_frame;
-        struct audio_frame audio_frame;
+        struct item_queue packets; ///< demuxer -> decoder (AVPacket, NULL to drain the decoder)
+        struct item_queue decoded; ///< decoder -> converter (AVFrame)
+        struct item_queue frames;  ///< converter (or demuxer with nodecode) -> grab (struct video_frame)
+        /// incremented on seek, queued items with older generation are dropped
+        unsigned generation;
+
+        struct audio_frame audio_frame; ///< audio format only, data are in audio_chunks
+        struct audio_chunk *audio_chunks; ///< FIFO, protected by audio_frame_lock
+        struct audio_chunk **audio_chunks_tail;
+        int audio_pending_len;
         pthread_mutex_t audio_frame_lock;
 
         pthread_t thread_id;
+        pthread_t dec_thread_id;
+        pthread_t conv_thread_id;
         pthread_mutex_t lock;
-        pthread_cond_t new_frame_ready;
-        pthread_cond_t frame_consumed;
-        pthread_cond_t paused_cv;
+        pthread_cond_t state_changed; ///< any queue, pause state or exit; broadcasted
         struct timeval last_frame;
 
         bool should_exit;
@@ -116,17 +200,146 @@ struct vidcap_state_lavf_decoder {
 static void vidcap_file_show_help() {
         color_out(0, "Usage:\n");
         color_out(COLOR_OUT_BOLD | COLOR_OUT_RED, "\t-t file:<name>");
-        color_out(COLOR_OUT_BOLD, "[:loop][:nodecode]\n");
+        color_out(COLOR_OUT_BOLD, "[:loop][:nodecode][:readahead=<pkts>][:queue=<frames>][:threads=<n>]\n");
         color_out(0, "\t\twhere\n");
         color_out(COLOR_OUT_BOLD, "\tloop\n");
         color_out(0, "\t\tloop the playback\n");
         color_out(COLOR_OUT_BOLD, "\tnodecode\n");
         color_out(0, "\t\tdon't decompress the video (may not work because required data for correct decompess are in container or UG doesn't recognize the codec)\n");
+        color_out(COLOR_OUT_BOLD, "\treadahead\n");
+        color_out(0, "\t\tnumber of packets read ahead of the decoder (default %d, max %d)\n", DEFAULT_READAHEAD, QUEUE_MAX - 1);
+        color_out(COLOR_OUT_BOLD, "\tqueue\n");
+        color_out(0, "\t\tnumber of decoded frames buffered between stages (default %d, max %d)\n", DEFAULT_QUEUE_LEN, QUEUE_MAX - 1);
+        color_out(COLOR_OUT_BOLD, "\tthreads\n");
+        color_out(0, "\t\tnumber of pixel format conversion threads (default number of CPUs, max %d)\n", CONV_THREADS_MAX);
+}
+
+static void queue_push(struct item_queue *q, void *item, unsigned generation, int64_t pts) {
+        assert(q->count < QUEUE_MAX);
+        int idx = (q->head + q->count) % QUEUE_MAX;
+        q->items[idx] = item;
+        q->generation[idx] = generation;
+        q->pts[idx] = pts;
+        q->count += 1;
+}
+
+static void *queue_pop(struct item_queue *q, unsigned *generation, int64_t *pts) {
+        assert(q->count > 0);
+        void *item = q->items[q->head];
+        if (generation) {
+                *generation = q->generation[q->head];
+        }
+        if (pts) {
+                *pts = q->pts[q->head];
+        }
+        q->head = (q->head + 1) % QUEUE_MAX;
+        q->count -= 1;
+        return item;
+}
+
+static bool queue_full(struct item_queue *q) {
+        return q->count >= q->max_len;
+}
+
+/// removes all items, must be called with s->lock held
+static void vidcap_file_clear_queues(struct vidcap_state_lavf_decoder *s) {
+        while (s->packets.count > 0) {
+                AVPacket *pkt = queue_pop(&s->packets, NULL, NULL);
+                av_packet_free(&pkt);
+        }
+        while (s->decoded.count > 0) {
+                AVFrame *frame = queue_pop(&s->decoded, NULL, NULL);
+                av_frame_free(&frame);
+        }
+        while (s->frames.count > 0) {
+                struct video_frame *f = queue_pop(&s->frames, NULL, NULL);
+                VIDEO_FRAME_DISPOSE(f);
+        }
+}
+
+static void vidcap_file_clear_audio(struct vidcap_state_lavf_decoder *s) {
+        pthread_mutex_lock(&s->audio_frame_lock);
+        while (s->audio_chunks) {
+                struct audio_chunk *next = s->audio_chunks->next;
+                free(s->audio_chunks);
+                s->audio_chunks = next;
+        }
+        s->audio_chunks_tail = &s->audio_chunks;
+        s->audio_pending_len = 0;
+        pthread_mutex_unlock(&s->audio_frame_lock);
+}
+
+static void frame_pool_destroy(struct frame_pool *pool) {
+        for (int i = 0; i < pool->free_count; ++i) {
+                vf_free(pool->free_frames[i]);
+        }
+        pthread_mutex_destroy(&pool->lock);
+        free(pool);
+}
+
+static void frame_pool_put(struct video_frame *f) {
+        struct frame_pool *pool = f->callbacks.dispose_udata;
+        pthread_mutex_lock(&pool->lock);
+        pool->lent -= 1;
+        if (!pool->released && pool->free_count < FRAME_POOL_MAX) {
+                pool->free_frames[pool->free_count++] = f;
+                f = NULL;
+        }
+        bool destroy = pool->released && pool->lent == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (f) {
+                vf_free(f);
+        }
+        if (destroy) {
+                frame_pool_destroy(pool);
+        }
+}
+
+static struct video_frame *frame_pool_get(struct frame_pool *pool) {
+        struct video_frame *f = NULL;
+        pthread_mutex_lock(&pool->lock);
+        if (pool->free_count > 0) {
+                f = pool->free_frames[--pool->free_count];
+        }
+        pool->lent += 1;
+        pthread_mutex_unlock(&pool->lock);
+        if (!f) {
+                f = vf_alloc_desc_data(pool->desc);
+        }
+        f->callbacks.dispose = frame_pool_put;
+        f->callbacks.dispose_udata = pool;
+        return f;
+}
+
+static struct frame_pool *frame_pool_create(struct video_desc desc) {
+        struct frame_pool *pool = calloc(1, sizeof *pool);
+        pthread_mutex_init(&pool->lock, NULL);
+        pool->desc = desc;
+        return pool;
+}
+
+/// frames still in use are freed once returned
+static void frame_pool_release(struct frame_pool *pool) {
+        if (!pool) {
+                return;
+        }
+        pthread_mutex_lock(&pool->lock);
+        pool->released = true;
+        bool destroy = pool->lent == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (destroy) {
+                frame_pool_destroy(pool);
+        }
 }
 
 static void vidcap_file_common_cleanup(struct vidcap_state_lavf_decoder *s) {
-        if (s->sws_ctx) {
-                sws_freeContext(s->sws_ctx);
+        vidcap_file_clear_queues(s);
+        vidcap_file_clear_audio(s);
+        frame_pool_release(s->pool);
+        for (int i = 0; i < CONV_THREADS_MAX; ++i) {
+                if (s->conv[i].sws_ctx) {
+                        sws_freeContext(s->conv[i].sws_ctx);
+                }
         }
         if (s->vid_ctx) {
                 avcodec_free_context(&s->vid_ctx);
@@ -138,14 +351,9 @@ static void vidcap_file_common_cleanup(struct vidcap_state_lavf_decoder *s) {
                 avformat_close_input(&s->fmt_ctx);
         }
 
-        free(s->audio_frame.data);
-        VIDEO_FRAME_DISPOSE(s->video_frame);
-
         pthread_mutex_destroy(&s->audio_frame_lock);
         pthread_mutex_destroy(&s->lock);
-        pthread_cond_destroy(&s->frame_consumed);
-        pthread_cond_destroy(&s->new_frame_ready);
-        pthread_cond_destroy(&s->paused_cv);
+        pthread_cond_destroy(&s->state_changed);
         free(s->src_filename);
         module_done(&s->mod);
         free(s);
@@ -153,36 +361,95 @@ static void vidcap_file_common_cleanup(struct vidcap_state_lavf_decoder *s) {
 
 static void vidcap_file_write_audio(struct vidcap_state_lavf_decoder *s, AVFrame * frame) {
         int plane_count = av_sample_fmt_is_planar(s->aud_ctx->sample_fmt) ? s->aud_ctx->channels : 1;
+        int bps = av_get_bytes_per_sample(s->aud_ctx->sample_fmt);
         // transform from floats
         if (av_get_alt_sample_fmt(s->aud_ctx->sample_fmt, 0) == AV_SAMPLE_FMT_FLT) {
                 for (int i = 0; i < plane_count; ++i) {
-                        float2int((char *) frame->data[i], (char *) frame->data[i], s->aud_ctx->frame_size * 4);
+                        float2int((char *) frame->data[i], (char *) frame->data[i],
+                                        frame->nb_samples * 4 * (s->aud_ctx->channels / plane_count));
                 }
         } else if (av_get_alt_sample_fmt(s->aud_ctx->sample_fmt, 0) == AV_SAMPLE_FMT_DBL) {
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Doubles not supported!\n");
                 return;
         }
 
-        pthread_mutex_lock(&s->audio_frame_lock);
+        int data_len = frame->nb_samples * bps * s->audio_frame.ch_count;
+        struct audio_chunk *c = malloc(sizeof *c + data_len);
+        c->data_len = data_len;
+        c->next = NULL;
         if (av_sample_fmt_is_planar(s->aud_ctx->sample_fmt)) {
-                int bps = av_get_bytes_per_sample(s->aud_ctx->sample_fmt);
-                if (s->audio_frame.data_len + plane_count * bps * s->aud_ctx->frame_size > s->audio_frame.max_size) {
-                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Audio buffer overflow!\n");
-                        pthread_mutex_unlock(&s->audio_frame_lock);
-                        return;
-                }
                 for (int i = 0; i < plane_count; ++i) {
-                        mux_channel(s->audio_frame.data + s->audio_frame.data_len, (char *) frame->data[i], bps, s->aud_ctx->frame_size * bps, plane_count, i, 1.0);
+                        mux_channel(c->data, (char *) frame->data[i], bps, frame->nb_samples * bps, plane_count, i, 1.0);
                 }
-                s->audio_frame.data_len += plane_count * bps * s->aud_ctx->frame_size;
         } else {
-                int data_size = av_samples_get_buffer_size(NULL, s->audio_frame.ch_count,
-                                s->aud_ctx->frame_size,
-                                s->aud_ctx->sample_fmt, 1);
-                append_audio_frame(&s->audio_frame, (char *) frame->data[0],
-                                data_size);
+                memcpy(c->data, frame->data[0], data_len);
+        }
+        c->pts = frame->best_effort_timestamp;
+        if (c->pts != AV_NOPTS_VALUE) {
+                c->pts = av_rescale_q(c->pts, s->fmt_ctx->streams[s->audio_stream_idx]->time_base,
+                                s->fmt_ctx->streams[s->video_stream_idx]->time_base);
+        }
+
+        pthread_mutex_lock(&s->audio_frame_lock);
+        if (s->audio_pending_len + data_len > s->audio_frame.max_size) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Audio too far ahead of video, dropping!\n");
+                pthread_mutex_unlock(&s->audio_frame_lock);
+                free(c);
+                return;
+        }
+        *s->audio_chunks_tail = c;
+        s->audio_chunks_tail = &c->next;
+        s->audio_pending_len += data_len;
+        pthread_mutex_unlock(&s->audio_frame_lock);
+}
+
+/**
+ * Returns audio belonging to video frame with given pts (everything up to
+ * the start of the next frame), NULL if there is none.
+ */
+static struct audio_frame *vidcap_file_get_audio(struct vidcap_state_lavf_decoder *s, int64_t pts) {
+        int64_t end = pts == AV_NOPTS_VALUE ? INT64_MAX : pts + s->vid_frame_duration;
+        pthread_mutex_lock(&s->audio_frame_lock);
+        int data_len = 0;
+        for (struct audio_chunk *c = s->audio_chunks; c && (c->pts == AV_NOPTS_VALUE || c->pts < end); c = c->next) {
+                data_len += c->data_len;
+        }
+        if (data_len == 0) {
+                pthread_mutex_unlock(&s->audio_frame_lock);
+                return NULL;
+        }
+        struct audio_frame *ret = malloc(sizeof *ret);
+        memcpy(ret, &s->audio_frame, sizeof *ret);
+        ret->data = malloc(data_len);
+        ret->data_len = ret->max_size = data_len;
+        for (int off = 0; off < data_len; ) {
+                struct audio_chunk *c = s->audio_chunks;
+                memcpy(ret->data + off, c->data, c->data_len);
+                off += c->data_len;
+                s->audio_chunks = c->next;
+                free(c);
         }
+        if (s->audio_chunks == NULL) {
+                s->audio_chunks_tail = &s->audio_chunks;
+        }
+        s->audio_pending_len -= data_len;
         pthread_mutex_unlock(&s->audio_frame_lock);
+        return ret;
+}
+
+/// adds loop offset to packet timestamps (see vidcap_state_lavf_decoder::loop_offset)
+static void vidcap_file_adjust_pts(struct vidcap_state_lavf_decoder *s, AVPacket *pkt) {
+        if (s->loop_offset == 0) {
+                return;
+        }
+        int64_t offset = av_rescale_q(s->loop_offset, s->fmt_ctx->streams[s->video_stream_idx]->time_base,
+                        s->fmt_ctx->streams[pkt->stream_index]->time_base);
+        if (pkt->pts != AV_NOPTS_VALUE) {
+                pkt->pts += offset;
+        }
+        if (pkt->dts != AV_NOPTS_VALUE) {
+                pkt->dts += offset;
+        }
 }
 
 #define CHECK_FF(cmd, action_failed) do { int rc = cmd; if (rc < 0) { char buf[1024]; av_strerror(rc, buf, 1024); log_msg(LOG_LEVEL_ERROR, MOD_NAME #cmd ": %s\n", buf); action_failed} } while(0)
@@ -200,6 +467,14 @@ static void vidcap_file_process_messages(struct vidcap_state_lavf_decoder *s) {
                         format_time_ms(s->last_vid_pts * tb.num * 1000 / tb.den  + sec * 1000, position);
                         format_time_ms(st->duration * tb.num * 1000 / tb.den, duration);
                         log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Seeking to %s / %s\n", position, duration);
+                        // drop everything read ahead from the old position
+                        s->generation += 1;
+                        vidcap_file_clear_queues(s);
+                        vidcap_file_clear_audio(s);
+                        if (s->aud_ctx) {
+                                avcodec_flush_buffers(s->aud_ctx);
+                        }
+                        s->eof = false;
                 } else if (strcmp(msg->text, "pause") == 0) {
                         s->paused = !s->paused;
                         log_msg(LOG_LEVEL_NOTICE, MOD_NAME "%s\n", s->paused ? "paused" : "unpaused");
@@ -215,134 +490,295 @@ static void vidcap_file_process_messages(struct vidcap_state_lavf_decoder *s) {
         }
 }
 
-#define FAIL_WORKER { pthread_mutex_lock(&s->lock); s->failed = true; pthread_mutex_unlock(&s->lock); pthread_cond_signal(&s->new_frame_ready); return NULL; }
+
+static void vidcap_file_decode_audio(struct vidcap_state_lavf_decoder *s, AVPacket *pkt) {
+        int ret = avcodec_send_packet(s->aud_ctx, pkt);
+        if (ret < 0) {
+                print_decoder_error(MOD_NAME, ret);
+        }
+        AVFrame * frame = av_frame_alloc();
+        while (ret >= 0) {
+                ret = avcodec_receive_frame(s->aud_ctx, frame);
+                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                        break;
+                } else if (ret < 0) {
+                        print_decoder_error(MOD_NAME, ret);
+                        break;
+                }
+                /* if a frame has been decoded, output it */
+                vidcap_file_write_audio(s, frame);
+        }
+        av_frame_free(&frame);
+}
+
+#define FAIL_WORKER { pthread_mutex_lock(&s->lock); s->failed = true; pthread_mutex_unlock(&s->lock); pthread_cond_broadcast(&s->state_changed); return NULL; }
+/**
+ * Demuxer - reads packets ahead (up to readahead) and decodes audio
+ */
 static void *vidcap_file_worker(void *state) {
         set_thread_name(__func__);
         struct vidcap_state_lavf_decoder *s = (struct vidcap_state_lavf_decoder *) state;
-        AVPacket pkt;
-        av_init_packet(&pkt);
-        pkt.size = 0;
-        pkt.data = 0;
-        while (!s->should_exit) {
+        struct item_queue *video_queue = s->no_decode ? &s->frames : &s->packets;
+        while (true) {
                 pthread_mutex_lock(&s->lock);
+                while (!s->should_exit && !s->new_msg && (s->paused || s->eof || queue_full(video_queue))) {
+                        pthread_cond_wait(&s->state_changed, &s->lock);
+                }
+                if (s->should_exit) {
+                        pthread_mutex_unlock(&s->lock);
+                        break;
+                }
                 if (s->new_msg) {
                         vidcap_file_process_messages(s);
                         s->new_msg = false;
-                }
-                if (s->paused) {
-                        while (!s->should_exit && !s->new_msg) {
-                                pthread_cond_wait(&s->paused_cv, &s->lock);
-                        }
                         pthread_mutex_unlock(&s->lock);
-                        if (s->should_exit) {
-                                break;
-                        } else { // new_msg -> process in next iteration
-                                continue;
-                        }
+                        pthread_cond_broadcast(&s->state_changed);
+                        continue;
                 }
                 pthread_mutex_unlock(&s->lock);
 
-                int ret = av_read_frame(s->fmt_ctx, &pkt);
+                AVPacket *pkt = av_packet_alloc();
+                int ret = av_read_frame(s->fmt_ctx, pkt);
                 if (ret == AVERROR_EOF) {
+                        av_packet_free(&pkt);
                         if (s->loop) {
                                 CHECK_FF(avformat_seek_file(s->fmt_ctx, -1, INT64_MIN, s->fmt_ctx->start_time, INT64_MAX, 0), FAIL_WORKER);
-                                continue;
-                        } else {
-                                s->paused = true;
-                                continue;
+                                // next loop continues where this one ended
+                                int64_t start = s->fmt_ctx->streams[s->video_stream_idx]->start_time;
+                                s->loop_offset = s->vid_end_pts - (start == AV_NOPTS_VALUE ? 0 : start);
+                        }
+                        pthread_mutex_lock(&s->lock);
+                        if (!s->no_decode) { // get frames buffered in the decoder
+                                queue_push(&s->packets, NULL, s->generation, AV_NOPTS_VALUE);
                         }
+                        s->eof = !s->loop;
+                        pthread_mutex_unlock(&s->lock);
+                        pthread_cond_broadcast(&s->state_changed);
+                        continue;
                 }
-                CHECK_FF(ret, FAIL_WORKER); // check the retval of av_read_frame for error other than EOF
+                CHECK_FF(ret, { av_packet_free(&pkt); FAIL_WORKER }); // check the retval of av_read_frame for error other than EOF
 
                 log_msg(LOG_LEVEL_DEBUG, MOD_NAME "received %s packet, ID %d, pos %" PRId64" , size %d\n",
                                 av_get_media_type_string(
-                                        s->fmt_ctx->streams[pkt.stream_index]->codecpar->codec_type),
-                                pkt.stream_index, pkt.pos, pkt.size);
+                                        s->fmt_ctx->streams[pkt->stream_index]->codecpar->codec_type),
+                                pkt->stream_index, pkt->pos, pkt->size);
 
-                if (pkt.stream_index == s->audio_stream_idx) {
-                        ret = avcodec_send_packet(s->aud_ctx, &pkt);
-                        if (ret < 0) {
-                                print_decoder_error(MOD_NAME, ret);
+                if (pkt->stream_index == s->audio_stream_idx) {
+                        vidcap_file_adjust_pts(s, pkt);
+                        vidcap_file_decode_audio(s, pkt);
+                        av_packet_free(&pkt);
+                } else if (pkt->stream_index == s->video_stream_idx) {
+                        s->last_vid_pts = pkt->pts;
+                        vidcap_file_adjust_pts(s, pkt);
+                        if (pkt->pts != AV_NOPTS_VALUE) {
+                                s->vid_end_pts = MAX(s->vid_end_pts, pkt->pts + MAX(pkt->duration, s->vid_frame_duration));
                         }
-                        AVFrame * frame = av_frame_alloc();
-                        while (ret >= 0) {
-                                ret = avcodec_receive_frame(s->aud_ctx, frame);
-				if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-					av_frame_free(&frame);
-					break; // inner loop
-                                } else if (ret < 0) {
-					print_decoder_error(MOD_NAME, ret);
-					av_frame_free(&frame);
-					break; // inner loop
-				}
-				/* if a frame has been decoded, output it */
-                                vidcap_file_write_audio(s, frame);
-                        }
-                        av_frame_free(&frame);
-                } else if (pkt.stream_index == s->video_stream_idx) {
-                        s->last_vid_pts = pkt.pts;
-                        struct video_frame *out;
+                        int64_t pts = pkt->pts;
+                        void *item = pkt;
                         if (s->no_decode) {
-                                out = vf_alloc_desc(s->video_desc);
+                                struct video_frame *out = vf_alloc_desc(s->video_desc);
                                 out->callbacks.data_deleter = vf_data_deleter;
                                 out->callbacks.dispose = vf_free;
-                                out->tiles[0].data_len = pkt.size;
-                                out->tiles[0].data = malloc(pkt.size);
-                                memcpy(out->tiles[0].data, pkt.data, pkt.size);
-                        } else {
-                                AVFrame * frame = av_frame_alloc();
-                                int got_frame = 0;
-                                ret = avcodec_send_packet(s->vid_ctx, &pkt);
-                                if (ret == 0 || ret == AVERROR(EAGAIN)) {
-                                        ret = avcodec_receive_frame(s->vid_ctx, frame);
-                                        if (ret == 0) {
-                                                got_frame = 1;
-                                        }
-                                }
-                                if (ret != 0) {
-                                        print_decoder_error(MOD_NAME, ret);
-                                }
+                                out->tiles[0].data_len = pkt->size;
+                                out->tiles[0].data = malloc(pkt->size);
+                                memcpy(out->tiles[0].data, pkt->data, pkt->size);
+                                av_packet_free(&pkt);
+                                item = out;
+                        }
+                        pthread_mutex_lock(&s->lock);
+                        queue_push(video_queue, item, s->generation, pts);
+                        pthread_mutex_unlock(&s->lock);
+                        pthread_cond_broadcast(&s->state_changed);
+                } else {
+                        av_packet_free(&pkt);
+                }
+        }
+
+        return NULL;
+}
+
+/**
+ * Video decoder - libavcodec uses its own (frame) threads so this stage just
+ * feeds it and collects decoded frames.
+ */
+static void *vidcap_file_decoder(void *state) {
+        set_thread_name(__func__);
+        struct vidcap_state_lavf_decoder *s = (struct vidcap_state_lavf_decoder *) state;
+        unsigned generation = 0;
+        AVFrame *frame = NULL;
+        while (true) {
+                pthread_mutex_lock(&s->lock);
+                while (!s->should_exit && s->packets.count == 0) {
+                        pthread_cond_wait(&s->state_changed, &s->lock);
+                }
+                if (s->should_exit) {
+                        pthread_mutex_unlock(&s->lock);
+                        break;
+                }
+                unsigned pkt_generation;
+                AVPacket *pkt = queue_pop(&s->packets, &pkt_generation, NULL);
+                pthread_mutex_unlock(&s->lock);
+                pthread_cond_broadcast(&s->state_changed);
 
-                                if (ret < 0 || !got_frame) {
-                                        if (ret < 0) {
-                                                fprintf(stderr, "Error decoding video frame (%s)\n", av_err2str(ret));
-                                        }
-                                        av_frame_free(&frame);
-                                        continue;
+                if (pkt_generation != generation) { // seek
+                        avcodec_flush_buffers(s->vid_ctx);
+                        generation = pkt_generation;
+                }
+                bool drain = pkt == NULL;
+                int ret = avcodec_send_packet(s->vid_ctx, pkt);
+                av_packet_free(&pkt);
+                if (ret < 0) {
+                        print_decoder_error(MOD_NAME, ret);
+                }
+                while (ret >= 0) {
+                        if (!frame) {
+                                frame = av_frame_alloc();
+                        }
+                        ret = avcodec_receive_frame(s->vid_ctx, frame);
+                        if (ret < 0) {
+                                if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+                                        print_decoder_error(MOD_NAME, ret);
                                 }
-                                out = vf_alloc_desc_data(s->video_desc);
-
-                                /* copy decoded frame to destination buffer:
-                                 * this is required since rawvideo expects non aligned data */
-                                int video_dst_linesize[4] = { vc_get_linesize(out->tiles[0].width, out->color_spec) };
-                                uint8_t *dst[4] = { (uint8_t *) out->tiles[0].data };
-                                sws_scale(s->sws_ctx, (const uint8_t * const *) frame->data, frame->linesize, 0,
-                                                frame->height, dst, video_dst_linesize);
-                                av_frame_free(&frame);
-                                out->callbacks.dispose = vf_free;
+                                break;
                         }
                         pthread_mutex_lock(&s->lock);
-                        while (!s->should_exit && s->video_frame != NULL) {
-                                pthread_cond_wait(&s->frame_consumed, &s->lock);
+                        while (!s->should_exit && queue_full(&s->decoded)) {
+                                pthread_cond_wait(&s->state_changed, &s->lock);
                         }
                         if (s->should_exit) {
-                                VIDEO_FRAME_DISPOSE(out);
                                 pthread_mutex_unlock(&s->lock);
-                                av_packet_unref(&pkt);
-                                return NULL;
+                                break;
                         }
-                        s->video_frame = out;
+                        queue_push(&s->decoded, frame, generation, AV_NOPTS_VALUE);
+                        frame = NULL;
                         pthread_mutex_unlock(&s->lock);
-                        pthread_cond_signal(&s->new_frame_ready);
+                        pthread_cond_broadcast(&s->state_changed);
+                }
+                if (drain) { // make the decoder accept packets again (loop)
+                        avcodec_flush_buffers(s->vid_ctx);
                 }
-                av_packet_unref(&pkt);
         }
+        av_frame_free(&frame);
+
+        return NULL;
+}
 
+static void *vidcap_file_convert_stripe(void *arg) {
+        struct conv_stripe *c = (struct conv_stripe *) arg;
+        const uint8_t *src[4];
+        for (int i = 0; i < 4; ++i) {
+                src[i] = c->in->data[i];
+                if (i < c->planes && src[i] != NULL) {
+                        int shift = i == 1 || i == 2 ? c->log2_chroma_h : 0;
+                        src[i] += (c->y >> shift) * c->in->linesize[i];
+                }
+        }
+        uint8_t *dst[4] = { (uint8_t *) c->out + c->y * c->out_linesize };
+        int dst_linesize[4] = { c->out_linesize };
+        sws_scale(c->sws_ctx, (const uint8_t * const *) src, c->in->linesize, 0, c->height, dst, dst_linesize);
         return NULL;
 }
 
+/**
+ * Converts decoded frames to UG pixel format in parallel stripes.
+ */
+static void *vidcap_file_converter(void *state) {
+        set_thread_name(__func__);
+        struct vidcap_state_lavf_decoder *s = (struct vidcap_state_lavf_decoder *) state;
+        while (true) {
+                pthread_mutex_lock(&s->lock);
+                while (!s->should_exit && s->decoded.count == 0) {
+                        pthread_cond_wait(&s->state_changed, &s->lock);
+                }
+                if (s->should_exit) {
+                        pthread_mutex_unlock(&s->lock);
+                        break;
+                }
+                unsigned generation;
+                AVFrame *frame = queue_pop(&s->decoded, &generation, NULL);
+                bool stale = generation != s->generation;
+                pthread_mutex_unlock(&s->lock);
+                pthread_cond_broadcast(&s->state_changed);
+
+                if (stale) {
+                        av_frame_free(&frame);
+                        continue;
+                }
+                if (frame->width != (int) s->video_desc.width || frame->height != (int) s->video_desc.height ||
+                                frame->format != s->conv_src_fmt) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Stream format change is not supported, dropping frame.\n");
+                        av_frame_free(&frame);
+                        continue;
+                }
+
+                /* copy decoded frame to destination buffer:
+                 * this is required since rawvideo expects non aligned data */
+                struct video_frame *out = frame_pool_get(s->pool);
+                for (int i = 0; i < s->conv_threads; ++i) {
+                        s->conv[i].in = frame;
+                        s->conv[i].out = out->tiles[0].data;
+                }
+                if (s->conv_threads == 1) {
+                        vidcap_file_convert_stripe(&s->conv[0]);
+                } else {
+                        task_run_parallel(vidcap_file_convert_stripe, s->conv_threads, s->conv, sizeof s->conv[0], NULL);
+                }
+                int64_t pts = frame->best_effort_timestamp;
+                av_frame_free(&frame);
+
+                pthread_mutex_lock(&s->lock);
+                while (!s->should_exit && queue_full(&s->frames)) {
+                        pthread_cond_wait(&s->state_changed, &s->lock);
+                }
+                if (s->should_exit || generation != s->generation) {
+                        pthread_mutex_unlock(&s->lock);
+                        VIDEO_FRAME_DISPOSE(out);
+                        continue;
+                }
+                queue_push(&s->frames, out, generation, pts);
+                pthread_mutex_unlock(&s->lock);
+                pthread_cond_broadcast(&s->state_changed);
+        }
+
+        return NULL;
+}
+
+static bool vidcap_file_init_conversion(struct vidcap_state_lavf_decoder *s, int threads) {
+        const AVPixFmtDescriptor *fmt_desc = av_pix_fmt_desc_get(s->vid_ctx->pix_fmt);
+        if (fmt_desc == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown decoded pixel format!\n");
+                return false;
+        }
+        int height = s->video_desc.height;
+        threads = MAX(MIN(threads, height / CONV_STRIPE_ALIGN), 1);
+
+        s->conv_src_fmt = s->vid_ctx->pix_fmt;
+        for (int i = 0; i < threads; ++i) {
+                struct conv_stripe *c = &s->conv[i];
+                int y_end = i == threads - 1 ? height :
+                        height * (i + 1) / threads / CONV_STRIPE_ALIGN * CONV_STRIPE_ALIGN;
+                c->y = height * i / threads / CONV_STRIPE_ALIGN * CONV_STRIPE_ALIGN;
+                c->height = y_end - c->y;
+                c->planes = av_pix_fmt_count_planes(s->conv_src_fmt);
+                c->log2_chroma_h = fmt_desc->log2_chroma_h;
+                c->out_linesize = vc_get_linesize(s->video_desc.width, s->video_desc.color_spec);
+                c->sws_ctx = sws_getContext(s->video_desc.width, c->height, s->conv_src_fmt,
+                                s->video_desc.width, c->height, get_ug_to_av_pixfmt(s->video_desc.color_spec),
+                                0, NULL, NULL, NULL);
+                if (c->sws_ctx == NULL) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to initialize conversion from %s!\n",
+                                        av_get_pix_fmt_name(s->conv_src_fmt));
+                        return false;
+                }
+        }
+        s->conv_threads = threads;
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Converting from %s in %d threads.\n",
+                        av_get_pix_fmt_name(s->conv_src_fmt), threads);
+        return true;
+}
+
 static bool vidcap_file_parse_fmt(struct vidcap_state_lavf_decoder *s, const char *fmt,
-                bool *opportunistic_audio) {
+                bool *opportunistic_audio, int *conv_threads) {
         s->src_filename = strdup(fmt);
         assert(s->src_filename != NULL);
         char *tmp = s->src_filename, *item, *saveptr;
@@ -357,11 +793,26 @@ static bool vidcap_file_parse_fmt(struct vidcap_state_lavf_decoder *s, const cha
                         s->no_decode = true;
                 } else if (strcmp(item, "opportunistic_audio") == 0) {
                         *opportunistic_audio = true;
+                } else if (strncmp(item, "readahead=", strlen("readahead=")) == 0) {
+                        s->packets.max_len = atoi(item + strlen("readahead="));
+                } else if (strncmp(item, "queue=", strlen("queue=")) == 0) {
+                        s->decoded.max_len = s->frames.max_len = atoi(item + strlen("queue="));
+                } else if (strncmp(item, "threads=", strlen("threads=")) == 0) {
+                        *conv_threads = atoi(item + strlen("threads="));
+                        if (*conv_threads < 1 || *conv_threads > CONV_THREADS_MAX) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Thread count must be 1-%d!\n", CONV_THREADS_MAX);
+                                return false;
+                        }
                 } else {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
                         return false;
                 }
         }
+        if (s->packets.max_len < 1 || s->packets.max_len >= QUEUE_MAX ||
+                        s->frames.max_len < 1 || s->frames.max_len >= QUEUE_MAX) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Queue lengths must be 1-%d!\n", QUEUE_MAX - 1);
+                return false;
+        }
         return true;
 }
 
@@ -376,6 +827,9 @@ static AVCodecContext *vidcap_file_open_dec_ctx(AVCodec *dec, AVStream *st) {
                 avcodec_free_context(&dec_ctx);
                 return NULL;
         }
+        // let libavcodec choose the thread count (frame threading adds latency but we read ahead anyways)
+        dec_ctx->thread_count = 0;
+        dec_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
         /* Init the decoders, with or without reference counting */
         AVDictionary *opts = NULL;
         av_dict_set(&opts, "refcounted_frames", "0", 0);
@@ -392,7 +846,7 @@ static void vidcap_file_new_message(struct module *mod) {
         pthread_mutex_lock(&s->lock);
         s->new_msg = true;
         pthread_mutex_unlock(&s->lock);
-        pthread_cond_signal(&s->paused_cv);
+        pthread_cond_broadcast(&s->state_changed);
 }
 
 static void vidcap_file_should_exit(void *state) {
@@ -400,14 +854,13 @@ static void vidcap_file_should_exit(void *state) {
         pthread_mutex_lock(&s->lock);
         s->should_exit = true;
         pthread_mutex_unlock(&s->lock);
-        pthread_cond_signal(&s->new_frame_ready);
-        pthread_cond_signal(&s->frame_consumed);
-        pthread_cond_signal(&s->paused_cv);
+        pthread_cond_broadcast(&s->state_changed);
 }
 
 #define CHECK(call) { int ret = call; if (ret != 0) abort(); }
 static int vidcap_file_init(struct vidcap_params *params, void **state) {
         bool opportunistic_audio = false; // do not fail if audio requested but not found
+        int conv_threads = MIN(av_cpu_count(), CONV_THREADS_MAX);
         if (strlen(vidcap_params_get_fmt(params)) == 0 ||
                         strcmp(vidcap_params_get_fmt(params), "help") == 0) {
                 vidcap_file_show_help();
@@ -417,11 +870,12 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
         struct vidcap_state_lavf_decoder *s = calloc(1, sizeof (struct vidcap_state_lavf_decoder));
         s->audio_stream_idx = -1;
         s->video_stream_idx = -1;
+        s->packets.max_len = DEFAULT_READAHEAD;
+        s->decoded.max_len = s->frames.max_len = DEFAULT_QUEUE_LEN;
+        s->audio_chunks_tail = &s->audio_chunks;
         CHECK(pthread_mutex_init(&s->audio_frame_lock, NULL));
         CHECK(pthread_mutex_init(&s->lock, NULL));
-        CHECK(pthread_cond_init(&s->frame_consumed, NULL));
-        CHECK(pthread_cond_init(&s->new_frame_ready, NULL));
-        CHECK(pthread_cond_init(&s->paused_cv, NULL));
+        CHECK(pthread_cond_init(&s->state_changed, NULL));
         module_init_default(&s->mod);
         s->mod.priv_magic = MAGIC;
         s->mod.cls = MODULE_CLASS_DATA;
@@ -429,7 +883,7 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
         s->mod.new_message = vidcap_file_new_message;
         module_register(&s->mod, vidcap_params_get_parent(params));
 
-        if (!vidcap_file_parse_fmt(s, vidcap_params_get_fmt(params), &opportunistic_audio)) {
+        if (!vidcap_file_parse_fmt(s, vidcap_params_get_fmt(params), &opportunistic_audio, &conv_threads)) {
                 vidcap_file_common_cleanup(s);
                 return VIDCAP_INIT_FAIL;
         }
@@ -468,8 +922,8 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
                         s->audio_frame.bps = av_get_bytes_per_sample(s->aud_ctx->sample_fmt);
                         s->audio_frame.sample_rate = s->aud_ctx->sample_rate;
                         s->audio_frame.ch_count = s->aud_ctx->channels;
-                        s->audio_frame.max_size = s->audio_frame.bps * s->audio_frame.ch_count * s->audio_frame.sample_rate;
-                        s->audio_frame.data = malloc(s->audio_frame.max_size);
+                        s->audio_frame.max_size = s->audio_frame.bps * s->audio_frame.ch_count * s->audio_frame.sample_rate
+                                * AUDIO_PENDING_MAX_SEC;
                         s->use_audio = true;
                 }
         }
@@ -485,6 +939,7 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
                 s->video_desc.height = st->codecpar->height;
                 s->video_desc.fps = (double) st->r_frame_rate.num / st->r_frame_rate.den;
                 s->video_desc.tile_count = 1;
+                s->vid_frame_duration = MAX(av_rescale_q(1, av_inv_q(st->r_frame_rate), st->time_base), 1);
 
                 if (s->no_decode) {
                         s->video_desc.color_spec =
@@ -502,12 +957,15 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
                                 vidcap_file_common_cleanup(s);
                                 return VIDCAP_INIT_FAIL;
                         }
-
-                        s->sws_ctx = sws_getContext(s->video_desc.width, s->video_desc.height, s->vid_ctx->pix_fmt,
-                                        s->video_desc.width, s->video_desc.height, get_ug_to_av_pixfmt(s->video_desc.color_spec),
-                                        0, NULL, NULL, NULL);
                 }
                 s->video_desc.interlacing = PROGRESSIVE; /// @todo other modes
+                if (!s->no_decode) {
+                        if (!vidcap_file_init_conversion(s, conv_threads)) {
+                                vidcap_file_common_cleanup(s);
+                                return VIDCAP_INIT_FAIL;
+                        }
+                        s->pool = frame_pool_create(s->video_desc);
+                }
         }
 
         s->last_vid_pts = s->fmt_ctx->streams[s->video_stream_idx]->start_time;
@@ -516,6 +974,10 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
         register_should_exit_callback(&s->mod, vidcap_file_should_exit, s);
 
         pthread_create(&s->thread_id, NULL, vidcap_file_worker, s);
+        if (!s->no_decode) {
+                pthread_create(&s->dec_thread_id, NULL, vidcap_file_decoder, s);
+                pthread_create(&s->conv_thread_id, NULL, vidcap_file_converter, s);
+        }
 
         *state = s;
         return VIDCAP_INIT_OK;
@@ -528,6 +990,10 @@ static void vidcap_file_done(void *state) {
         vidcap_file_should_exit(s);
 
         pthread_join(s->thread_id, NULL);
+        if (!s->no_decode) {
+                pthread_join(s->dec_thread_id, NULL);
+                pthread_join(s->conv_thread_id, NULL);
+        }
 
         vidcap_file_common_cleanup(s);
 }
@@ -545,28 +1011,32 @@ static struct video_frame *vidcap_file_grab(void *state, struct audio_frame **au
         assert(s->mod.priv_magic == MAGIC);
         *audio = NULL;
         pthread_mutex_lock(&s->lock);
-        while (s->video_frame == NULL && !s->failed && !s->should_exit) {
-                pthread_cond_wait(&s->new_frame_ready, &s->lock);
+        while ((s->frames.count == 0 || s->paused) && !s->failed && !s->should_exit) {
+                pthread_cond_wait(&s->state_changed, &s->lock);
         }
         if (s->failed || s->should_exit) {
                 pthread_mutex_unlock(&s->lock);
                 return NULL;
         }
-        out = s->video_frame;
-        s->video_frame = NULL;
+        int64_t pts;
+        out = queue_pop(&s->frames, NULL, &pts);
         pthread_mutex_unlock(&s->lock);
-        pthread_cond_signal(&s->frame_consumed);
+        pthread_cond_broadcast(&s->state_changed);
 
-        pthread_mutex_lock(&s->audio_frame_lock);
-        *audio = audio_frame_copy(&s->audio_frame, false);
-        (*audio)->dispose = vidcap_file_dispose_audio;
-        s->audio_frame.data_len = 0;
-        pthread_mutex_unlock(&s->audio_frame_lock);
+        if (s->use_audio) {
+                *audio = vidcap_file_get_audio(s, pts);
+                if (*audio) {
+                        (*audio)->dispose = vidcap_file_dispose_audio;
+                }
+        }
 
         struct timeval t;
-        do {
+        gettimeofday(&t, NULL);
+        double remaining = 1 / s->video_desc.fps - tv_diff(t, s->last_frame);
+        if (remaining > 0) {
+                usleep(remaining * 1000 * 1000);
                 gettimeofday(&t, NULL);
-        } while (tv_diff(t, s->last_frame) < 1 / s->video_desc.fps);
+        }
         s->last_frame = t;
 
         return out;
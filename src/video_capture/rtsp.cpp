@@ -200,6 +200,7 @@ struct video_rtsp_state {
 
     unsigned int h264_offset_len;
     unsigned char *h264_offset_buffer;
+    struct rtpdec_h264_state *h264_state;
 };
 
 struct audio_rtsp_state {
@@ -341,6 +342,7 @@ vidcap_rtsp_thread(void *arg) {
                             struct decode_data_h264 d;
                             d.frame = s->vrtsp_state->frame;
                             d.offset_len = s->vrtsp_state->h264_offset_len;
+                            d.state = s->vrtsp_state->h264_state;
                             if (pbuf_decode(s->vrtsp_state->cp->playout_buffer, curr_time_hr,
                                 decode_frame_by_pt, &d))
                             {
@@ -575,7 +577,8 @@ vidcap_rtsp_init(struct vidcap_params *params, void **state) {
     s->vrtsp_state->fps = 30;
     s->vrtsp_state->frame->interlacing = PROGRESSIVE;
 
-    s->vrtsp_state->frame->tiles[0].data = (char *) calloc(1, s->vrtsp_state->tile->width * s->vrtsp_state->tile->height);
+    s->vrtsp_state->h264_state = rtpdec_h264_init(s->vrtsp_state->tile->width * s->vrtsp_state->tile->height);
+    s->vrtsp_state->frame->tiles[0].data = NULL;
 
     s->should_exit = FALSE;
 
@@ -901,6 +904,7 @@ init_decompressor(void *state) {
             vc_get_linesize(sr->des.width, UYVY), UYVY);
     } else
         return 0;
+    free(sr->out_frame);
     sr->out_frame = (char *) malloc(sr->tile->width * sr->tile->height * 4);
     return 1;
 }
@@ -1097,7 +1101,8 @@ vidcap_rtsp_done(void *state) {
 
     rtp_done(s->vrtsp_state->device);
 
-    free(s->vrtsp_state->tile->data);
+    rtpdec_h264_destroy(s->vrtsp_state->h264_state);
+    free(s->vrtsp_state->out_frame);
     if(s->vrtsp_state->h264_offset_buffer!=NULL) free(s->vrtsp_state->h264_offset_buffer);
     if(s->vrtsp_state->frame!=NULL) free(s->vrtsp_state->frame);
     free(s->vrtsp_state);
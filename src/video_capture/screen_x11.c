@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2012-2013 CESNET, z.s.p.o.
+ * Copyright (c) 2012-2026 CESNET, z.s.p.o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -51,18 +51,33 @@
 
 #include "audio/audio.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#include <unistd.h>
 
 #include <X11/Xlib.h>
 #ifdef HAVE_XFIXES
 #include <X11/extensions/Xfixes.h>
 #endif // HAVE_XFIXES
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif // HAVE_XSHM
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif // HAVE_XDAMAGE
 #include <X11/Xutil.h>
 #include "x11_common.h"
 
+#define MOD_NAME "[screen capture] "
+
 #define QUEUE_SIZE_MAX 3
+/// queued images + one being grabbed + one being converted
+#define SHM_POOL_SIZE (QUEUE_SIZE_MAX + 3)
 
 /* prototypes of functions defined in this module */
 static void show_help(void);
@@ -72,20 +87,28 @@ static void show_help()
 {
         printf("Screen capture\n");
         printf("Usage\n");
-        printf("\t-t screen[:fps=<fps>]\n");
+        printf("\t-t screen[:fps=<fps>][:damage][:noshm]\n");
         printf("\t\t<fps> - preferred grabbing fps (otherwise unlimited)\n");
+        printf("\t\tdamage - grab only regions changed since last frame (XDamage)\n");
+        printf("\t\tnoshm - do not use MIT-SHM, transfer images through X connection\n");
 }
 
 struct grabbed_data;
 
+/**
+ * Grabbed rectangle of the screen. If data is NULL, nothing has changed since
+ * the previous item.
+ */
 struct grabbed_data {
         XImage *data;
+        int x, y;    ///< position of the image on the screen
+        int shm_idx; ///< index to shared memory pool, -1 if not used
         struct grabbed_data *next;
 };
 
 struct vidcap_screen_x11_state {
-        struct video_frame       *frame; 
-        struct tile       *tile; 
+        struct video_frame       *frame;
+        struct tile       *tile;
         int frames;
         struct       timeval t, t0;
         Display *dpy;
@@ -108,9 +131,154 @@ struct vidcap_screen_x11_state {
 
         double fps;
 
+        bool use_shm;
+#ifdef HAVE_XSHM
+        XShmSegmentInfo shm_info[SHM_POOL_SIZE];
+        XImage *shm_image[SHM_POOL_SIZE];
+        bool shm_busy[SHM_POOL_SIZE]; ///< protected by lock
+#endif // HAVE_XSHM
+
+        bool use_damage;
+#ifdef HAVE_XDAMAGE
+        Damage damage;
+        XserverRegion damage_region;
+        int damage_event_base;
+        bool damage_full;               ///< next grab must be whole screen
+        XRectangle cursor_rect;         ///< cursor drawn to the last grabbed image
+        unsigned long cursor_serial;
+#endif // HAVE_XDAMAGE
+
         bool initialized;
 };
 
+#ifdef HAVE_XSHM
+static void shm_pool_destroy(struct vidcap_screen_x11_state *s)
+{
+        for (int i = 0; i < SHM_POOL_SIZE; ++i) {
+                if (!s->shm_image[i]) {
+                        continue;
+                }
+                XShmDetach(s->dpy, &s->shm_info[i]);
+                XDestroyImage(s->shm_image[i]);
+                shmdt(s->shm_info[i].shmaddr);
+                s->shm_image[i] = NULL;
+        }
+        XSync(s->dpy, False);
+}
+
+static bool shm_pool_init(struct vidcap_screen_x11_state *s)
+{
+        if (!XShmQueryExtension(s->dpy)) {
+                return false;
+        }
+
+        int screen = DefaultScreen(s->dpy);
+        for (int i = 0; i < SHM_POOL_SIZE; ++i) {
+                XShmSegmentInfo *info = &s->shm_info[i];
+                XImage *img = XShmCreateImage(s->dpy, DefaultVisual(s->dpy, screen),
+                                DefaultDepth(s->dpy, screen), ZPixmap, NULL, info,
+                                s->tile->width, s->tile->height);
+                if (!img) {
+                        goto error;
+                }
+                info->shmid = shmget(IPC_PRIVATE, img->bytes_per_line * img->height, IPC_CREAT | 0600);
+                if (info->shmid == -1) {
+                        XDestroyImage(img);
+                        goto error;
+                }
+                info->shmaddr = img->data = shmat(info->shmid, NULL, 0);
+                if (info->shmaddr == (void *) -1) {
+                        shmctl(info->shmid, IPC_RMID, NULL);
+                        XDestroyImage(img);
+                        goto error;
+                }
+                info->readOnly = False;
+                if (!XShmAttach(s->dpy, info)) {
+                        shmdt(info->shmaddr);
+                        shmctl(info->shmid, IPC_RMID, NULL);
+                        XDestroyImage(img);
+                        goto error;
+                }
+                s->shm_image[i] = img;
+        }
+        XSync(s->dpy, False);
+        // segments are freed when both we and X server detach
+        for (int i = 0; i < SHM_POOL_SIZE; ++i) {
+                shmctl(s->shm_info[i].shmid, IPC_RMID, NULL);
+        }
+        return true;
+error:
+        XSync(s->dpy, False);
+        for (int i = 0; i < SHM_POOL_SIZE; ++i) {
+                if (s->shm_image[i]) {
+                        shmctl(s->shm_info[i].shmid, IPC_RMID, NULL);
+                }
+        }
+        shm_pool_destroy(s);
+        return false;
+}
+
+/**
+ * Waits for a free segment.
+ * @returns segment index or -1 if the worker should exit
+ */
+static int shm_pool_acquire(struct vidcap_screen_x11_state *s)
+{
+        int ret = -1;
+        pthread_mutex_lock(&s->lock);
+        while (!s->should_exit_worker) {
+                for (int i = 0; i < SHM_POOL_SIZE; ++i) {
+                        if (!s->shm_busy[i]) {
+                                s->shm_busy[i] = true;
+                                ret = i;
+                                break;
+                        }
+                }
+                if (ret != -1) {
+                        break;
+                }
+                s->worker_waiting = true;
+                pthread_cond_wait(&s->worker_cv, &s->lock);
+                s->worker_waiting = false;
+        }
+        pthread_mutex_unlock(&s->lock);
+        return ret;
+}
+#endif // HAVE_XSHM
+
+/**
+ * Releases grabbed image (and its shared memory segment)
+ */
+static void grabbed_data_release(struct vidcap_screen_x11_state *s, struct grabbed_data *item, bool locked)
+{
+#ifdef HAVE_XSHM
+        if (item->shm_idx != -1) {
+                // headers created for partial (damage) grabs don't own the data
+                if (item->data && item->data != s->shm_image[item->shm_idx]) {
+                        XDestroyImage(item->data);
+                }
+                if (!locked) {
+                        pthread_mutex_lock(&s->lock);
+                }
+                s->shm_busy[item->shm_idx] = false;
+                if (s->worker_waiting) {
+                        pthread_cond_signal(&s->worker_cv);
+                }
+                if (!locked) {
+                        pthread_mutex_unlock(&s->lock);
+                }
+                free(item);
+                return;
+        }
+#else
+        UNUSED(s), UNUSED(locked);
+#endif // HAVE_XSHM
+        if (item->data) {
+                XDestroyImage(item->data);
+        }
+        free(item);
+}
+
 static bool initialize(struct vidcap_screen_x11_state *s) {
         s->frame = vf_alloc(1);
         s->tile = vf_get_tile(s->frame, 0);
@@ -147,6 +315,35 @@ static bool initialize(struct vidcap_screen_x11_state *s) {
 
         s->should_exit_worker = false;
 
+#ifdef HAVE_XSHM
+        if (s->use_shm && !shm_pool_init(s)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "MIT-SHM not available, falling back to XGetImage.\n");
+                s->use_shm = false;
+        }
+#else
+        s->use_shm = false;
+#endif // HAVE_XSHM
+
+        if (s->use_damage) {
+#ifdef HAVE_XDAMAGE
+                int error_base;
+                if (!s->use_shm) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Damage tracking requires MIT-SHM, disabling.\n");
+                        s->use_damage = false;
+                } else if (!XDamageQueryExtension(s->dpy, &s->damage_event_base, &error_base)) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "XDamage extension not available, disabling damage tracking.\n");
+                        s->use_damage = false;
+                } else {
+                        s->damage = XDamageCreate(s->dpy, s->root, XDamageReportNonEmpty);
+                        s->damage_region = XFixesCreateRegion(s->dpy, NULL, 0);
+                        s->damage_full = true;
+                }
+#else
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Compiled without XDamage, damage tracking disabled.\n");
+                s->use_damage = false;
+#endif // HAVE_XDAMAGE
+        }
+
         s->frame->color_spec = RGB;
         if(s->fps > 0.0) {
                 s->frame->fps = s->fps;
@@ -163,49 +360,172 @@ static bool initialize(struct vidcap_screen_x11_state *s) {
         return true;
 }
 
+#ifdef HAVE_XFIXES
+/**
+ * Blends cursor into image placed at (img_x, img_y) of the screen.
+ */
+static void draw_cursor(XImage *img, int img_x, int img_y, XFixesCursorImage *cursor)
+{
+        uint32_t *image_data = (uint32_t *)(void *) img->data;
+        int stride = img->bytes_per_line / 4;
+        int cur_x = cursor->x - cursor->xhot - img_x;
+        int cur_y = cursor->y - cursor->yhot - img_y;
+        for(int x = 0; x < cursor->width; ++x) {
+                for(int y = 0; y < cursor->height; ++y) {
+                        if(cur_x + x < 0 || cur_x + x >= img->width ||
+                                        cur_y + y < 0 || cur_y + y >= img->height)
+                                continue;
+                        uint_fast32_t cursor_pix = cursor->pixels[x + y * cursor->width];
+                        int alpha = cursor_pix >> 24 & 0xff;
+                        int r1 = cursor_pix >> 16 & 0xff,
+                            g1 = cursor_pix >> 8 & 0xff,
+                            b1 = cursor_pix >> 0 & 0xff;
+                        uint_fast32_t image_pix = image_data[cur_x + x + (cur_y + y) * stride];
+                        int r2 = image_pix >> 16 & 0xff,
+                            g2 = image_pix >> 8 & 0xff,
+                            b2 = image_pix >> 0 & 0xff;
+                        float scale_image = (float) (255 - alpha)/ 255;
+                        float scale_cursor = (float) alpha / 255;
+
+                        image_data[cur_x + x + (cur_y + y) * stride] =
+                                ((int) (r1 * scale_cursor + r2 * scale_image) & 0xff) << 16 |
+                                ((int) (g1 * scale_cursor + g2 * scale_image) & 0xff) << 8 |
+                                ((int) (b1 * scale_cursor + b2 * scale_image) & 0xff) << 0;
+                }
+        }
+}
+#endif // HAVE_XFIXES
+
+#ifdef HAVE_XDAMAGE
+static void rect_union(int *x1, int *y1, int *x2, int *y2, int x, int y, int w, int h)
+{
+        if (w <= 0 || h <= 0) {
+                return;
+        }
+        *x1 = x < *x1 ? x : *x1;
+        *y1 = y < *y1 ? y : *y1;
+        *x2 = x + w > *x2 ? x + w : *x2;
+        *y2 = y + h > *y2 ? y + h : *y2;
+}
+
+/**
+ * Grabs bounding box of the screen area damaged since the last call (plus
+ * previous and current cursor position if the cursor has changed).
+ *
+ * @returns false if nothing has changed
+ */
+static bool grab_damaged(struct vidcap_screen_x11_state *s, struct grabbed_data *item,
+                XFixesCursorImage *cursor)
+{
+        XEvent ev;
+        while (XCheckTypedEvent(s->dpy, s->damage_event_base + XDamageNotify, &ev)) {
+        }
+        XDamageSubtract(s->dpy, s->damage, None, s->damage_region);
+
+        int x1 = INT_MAX, y1 = INT_MAX, x2 = INT_MIN, y2 = INT_MIN;
+        if (s->damage_full) {
+                rect_union(&x1, &y1, &x2, &y2, 0, 0, s->tile->width, s->tile->height);
+                s->damage_full = false;
+        } else {
+                int count = 0;
+                XRectangle *rects = XFixesFetchRegion(s->dpy, s->damage_region, &count);
+                for (int i = 0; i < count; ++i) {
+                        rect_union(&x1, &y1, &x2, &y2, rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+                }
+                if (rects) {
+                        XFree(rects);
+                }
+        }
+
+        XRectangle cursor_rect = { 0, 0, 0, 0 };
+        unsigned long cursor_serial = 0;
+        if (cursor) {
+                cursor_rect.x = cursor->x - cursor->xhot;
+                cursor_rect.y = cursor->y - cursor->yhot;
+                cursor_rect.width = cursor->width;
+                cursor_rect.height = cursor->height;
+                cursor_serial = cursor->cursor_serial;
+        }
+        bool cursor_changed = cursor_serial != s->cursor_serial ||
+                memcmp(&cursor_rect, &s->cursor_rect, sizeof cursor_rect) != 0;
+        // area below the old cursor contains the cursor in our copy of screen so it needs to be redrawn
+        if (cursor_changed) {
+                rect_union(&x1, &y1, &x2, &y2, s->cursor_rect.x, s->cursor_rect.y, s->cursor_rect.width, s->cursor_rect.height);
+                rect_union(&x1, &y1, &x2, &y2, cursor_rect.x, cursor_rect.y, cursor_rect.width, cursor_rect.height);
+        }
+        s->cursor_rect = cursor_rect;
+        s->cursor_serial = cursor_serial;
+
+        x1 = x1 < 0 ? 0 : x1;
+        y1 = y1 < 0 ? 0 : y1;
+        x2 = x2 > (int) s->tile->width ? (int) s->tile->width : x2;
+        y2 = y2 > (int) s->tile->height ? (int) s->tile->height : y2;
+        if (x1 >= x2 || y1 >= y2) {
+                return false;
+        }
+
+        int screen = DefaultScreen(s->dpy);
+        XImage *img = XShmCreateImage(s->dpy, DefaultVisual(s->dpy, screen),
+                        DefaultDepth(s->dpy, screen), ZPixmap, s->shm_info[item->shm_idx].shmaddr,
+                        &s->shm_info[item->shm_idx], x2 - x1, y2 - y1);
+        if (!img) {
+                s->damage_full = true;
+                return false;
+        }
+        XShmGetImage(s->dpy, s->root, img, x1, y1, AllPlanes);
+        item->data = img;
+        item->x = x1;
+        item->y = y1;
+        return true;
+}
+#endif // HAVE_XDAMAGE
 
 static void *grab_thread(void *args)
 {
         struct vidcap_screen_x11_state *s = args;
 
         while(!s->should_exit_worker) {
-                struct grabbed_data *new_item = malloc(sizeof(struct grabbed_data));
+                struct grabbed_data *new_item = calloc(1, sizeof(struct grabbed_data));
+                new_item->shm_idx = -1;
+
+#ifdef HAVE_XSHM
+                if (s->use_shm) {
+                        new_item->shm_idx = shm_pool_acquire(s);
+                        if (new_item->shm_idx == -1) {
+                                free(new_item);
+                                break;
+                        }
+                }
+#endif // HAVE_XSHM
 
 #ifdef HAVE_XFIXES
                 XFixesCursorImage *cursor =
                         XFixesGetCursorImage (s->dpy);
 #endif // HAVE_XFIXES
-                new_item->data = XGetImage(s->dpy,s->root, 0,0, s->tile->width, s->tile->height, AllPlanes, ZPixmap);
+                if (s->use_damage) {
+#ifdef HAVE_XDAMAGE
+                        if (!grab_damaged(s, new_item, cursor)) {
+                                // nothing changed - return the segment and pass an empty item
+                                grabbed_data_release(s, new_item, false);
+                                new_item = calloc(1, sizeof(struct grabbed_data));
+                                new_item->shm_idx = -1;
+                                usleep(1000000 / s->frame->fps);
+                        }
+#endif // HAVE_XDAMAGE
+                } else if (s->use_shm) {
+#ifdef HAVE_XSHM
+                        new_item->data = s->shm_image[new_item->shm_idx];
+                        XShmGetImage(s->dpy, s->root, new_item->data, 0, 0, AllPlanes);
+#endif // HAVE_XSHM
+                } else {
+                        new_item->data = XGetImage(s->dpy,s->root, 0,0, s->tile->width, s->tile->height, AllPlanes, ZPixmap);
+                }
 
 #ifdef HAVE_XFIXES
                 if (cursor) {
-                        uint32_t *image_data = (uint32_t *)(void *) new_item->data->data;
-                        for(int x = 0; x < cursor->width; ++x) {
-                                for(int y = 0; y < cursor->height; ++y) {
-                                        if(cursor->x + x >= (int) s->tile->width ||
-                                                        cursor->y + y >= (int) s->tile->height)
-                                                continue;
-                                        //image_data[x + y * s->tile->width] = cursor->pixels[x + y * cursor->width];
-                                        uint_fast32_t cursor_pix = cursor->pixels[x + y * cursor->width];
-                                        ///fprintf(stderr, "%d %d\n", cursor->x + x, cursor->y + y);
-                                        int alpha = cursor_pix >> 24 & 0xff;
-                                        int r1 = cursor_pix >> 16 & 0xff,
-                                            g1 = cursor_pix >> 8 & 0xff,
-                                            b1 = cursor_pix >> 0 & 0xff;
-                                        uint_fast32_t image_pix = image_data[cursor->x + x + (cursor->y + y) * s->tile->width];
-                                        int r2 = image_pix >> 16 & 0xff,
-                                            g2 = image_pix >> 8 & 0xff,
-                                            b2 = image_pix >> 0 & 0xff;
-                                        float scale_image = (float) (255 - alpha)/ 255;
-                                        float scale_cursor = (float) alpha / 255;
-
-                                        image_data[cursor->x + x + (cursor->y + y) * s->tile->width] =
-                                                ((int) (r1 * scale_cursor + r2 * scale_image) & 0xff) << 16 |
-                                                ((int) (g1 * scale_cursor + g2 * scale_image) & 0xff) << 8 |
-                                                ((int) (b1 * scale_cursor + b2 * scale_image) & 0xff) << 0;
-                                }
+                        if (new_item->data) {
+                                draw_cursor(new_item->data, new_item->x, new_item->y, cursor);
                         }
-
                         XFree(cursor);
                 }
 #endif // HAVE_XFIXES
@@ -292,7 +612,7 @@ static int vidcap_screen_x11_init(struct vidcap_params *params, void **state)
                 return VIDCAP_INIT_AUDIO_NOT_SUPPOTED;
         }
 
-        s = (struct vidcap_screen_x11_state *) malloc(sizeof(struct vidcap_screen_x11_state));
+        s = (struct vidcap_screen_x11_state *) calloc(1, sizeof(struct vidcap_screen_x11_state));
         if(s == NULL) {
                 printf("Unable to allocate screen capture state\n");
                 return VIDCAP_INIT_FAIL;
@@ -302,6 +622,7 @@ static int vidcap_screen_x11_init(struct vidcap_params *params, void **state)
         gettimeofday(&s->t0, NULL);
 
         s->fps = 0.0;
+        s->use_shm = true;
 
         s->frame = NULL;
         s->tile = NULL;
@@ -311,7 +632,7 @@ static int vidcap_screen_x11_init(struct vidcap_params *params, void **state)
         fprintf(stderr, "[Screen capture] Compiled without XFixes library, cursor won't be shown!\n");
 #endif // ! HAVE_XFIXES
 
-        s->prev_time.tv_sec = 
+        s->prev_time.tv_sec =
                 s->prev_time.tv_usec = 0;
 
         s->frames = 0;
@@ -321,9 +642,28 @@ static int vidcap_screen_x11_init(struct vidcap_params *params, void **state)
                         show_help();
                         free(s);
                         return VIDCAP_INIT_NOERR;
-                } else if (strncasecmp(vidcap_params_get_fmt(params), "fps=", strlen("fps=")) == 0) {
-                        s->fps = atoi(vidcap_params_get_fmt(params) + strlen("fps="));
                 }
+                char *fmt = strdup(vidcap_params_get_fmt(params));
+                char *save_ptr = NULL;
+                char *item = NULL;
+                char *tmp = fmt;
+                while ((item = strtok_r(tmp, ":", &save_ptr))) {
+                        tmp = NULL;
+                        if (strncasecmp(item, "fps=", strlen("fps=")) == 0) {
+                                s->fps = atoi(item + strlen("fps="));
+                        } else if (strcasecmp(item, "damage") == 0) {
+                                s->use_damage = true;
+                        } else if (strcasecmp(item, "noshm") == 0) {
+                                s->use_shm = false;
+                        } else {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                                show_help();
+                                free(fmt);
+                                free(s);
+                                return VIDCAP_INIT_FAIL;
+                        }
+                }
+                free(fmt);
         }
 
         *state = s;
@@ -365,13 +705,24 @@ static void vidcap_screen_x11_done(void *state)
                 while(s->queue_len > 0) {
                         struct grabbed_data *item = s->head;
                         s->head = s->head->next;
-                        XDestroyImage(item->data);
-                        free(item);
+                        grabbed_data_release(s, item, true);
                         s->queue_len -= 1;
                 }
         }
         pthread_mutex_unlock(&s->lock);
 
+#ifdef HAVE_XDAMAGE
+        if (s->initialized && s->use_damage) {
+                XDamageDestroy(s->dpy, s->damage);
+                XFixesDestroyRegion(s->dpy, s->damage_region);
+        }
+#endif // HAVE_XDAMAGE
+#ifdef HAVE_XSHM
+        if (s->initialized && s->use_shm) {
+                shm_pool_destroy(s);
+        }
+#endif // HAVE_XSHM
+
         if(s->tile)
                 free(s->tile->data);
 
@@ -419,24 +770,37 @@ static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_fra
          * some configurations, but seems to work currently. To be corrected if there is an
          * opposite case.
          */
-        vc_copylineABGRtoRGB((unsigned char *) s->tile->data,
-                        (unsigned char *) &item->data->data[0], s->tile->data_len, 0, 8, 16);
+        if (item->data) {
+                XImage *img = item->data;
+                int linesize = vc_get_linesize(s->tile->width, s->frame->color_spec);
+                if (item->x == 0 && img->width == (int) s->tile->width &&
+                                img->bytes_per_line == img->width * 4) {
+                        vc_copylineABGRtoRGB((unsigned char *) s->tile->data + item->y * linesize,
+                                        (unsigned char *) img->data, img->height * linesize, 0, 8, 16);
+                } else {
+                        for (int y = 0; y < img->height; ++y) {
+                                vc_copylineABGRtoRGB((unsigned char *) s->tile->data + (item->y + y) * linesize + item->x * 3,
+                                                (unsigned char *) img->data + y * img->bytes_per_line, img->width * 3, 0, 8, 16);
+                        }
+                }
+        } // else unchanged - s->tile->data already contains current screen
 
-        XDestroyImage(item->data);
-        free(item);
+        grabbed_data_release(s, item, false);
 
         if(s->fps > 0.0) {
                 struct timeval cur_time;
 
                 gettimeofday(&cur_time, NULL);
-                while(tv_diff_usec(cur_time, s->prev_time) < 1000000.0 / s->frame->fps) {
+                long long remaining = 1000000.0 / s->frame->fps - tv_diff_usec(cur_time, s->prev_time);
+                if (remaining > 0) {
+                        usleep(remaining);
                         gettimeofday(&cur_time, NULL);
                 }
                 s->prev_time = cur_time;
         }
 
         gettimeofday(&s->t, NULL);
-        double seconds = tv_diff(s->t, s->t0);        
+        double seconds = tv_diff(s->t, s->t0);
         if (seconds >= 5) {
                 float fps  = s->frames / seconds;
                 log_msg(LOG_LEVEL_INFO, "[screen capture] %d frames in %g seconds = %g FPS\n", s->frames, seconds, fps);
@@ -458,4 +822,3 @@ static const struct video_capture_info vidcap_screen_x11_info = {
 };
 
 REGISTER_MODULE(screen, &vidcap_screen_x11_info, LIBRARY_CLASS_VIDEO_CAPTURE, VIDEO_CAPTURE_ABI_VERSION);
-
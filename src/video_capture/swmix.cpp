@@ -36,11 +36,12 @@
  *
  * @brief SW video mix is a virtual video mixer.
  *
- * @todo
- * Reenable configuration file position matching.
+ * Slave frames are composed either with OpenGL or, when there is no GL
+ * context available (or if requested), by the CPU compositor that uses the
+ * resize capture filter scaler.
  *
  * @todo
- * Refactor to use also different scalers than OpenGL (eg. libswscale)
+ * Reenable configuration file position matching.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -49,21 +50,30 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include "capture_filter/resize_utils.h"
 #include "debug.h"
+#ifdef HAVE_SWMIX_GL
 #include "gl_context.h"
+#endif
 #include "host.h"
 #include "lib_common.h"
 #include "utils/config_file.h"
 #include "video.h"
 #include "video_capture.h"
+#include "video_codec.h"
 
 #include "tv.h"
+#include "utils/worker.h"
 
 #include "audio/audio.h"
 
+#include <algorithm>
+#include <cmath>
 #include <queue>
 #include <stdio.h>
 #include <stdlib.h>
+#include <thread>
+#include <vector>
 
 #define MAX_AUDIO_LEN (1024*1024)
 
@@ -74,6 +84,13 @@ typedef enum {
         BILINEAR
 } interpolation_t;
 
+enum swmix_backend {
+        SWMIX_BACKEND_AUTO, ///< OpenGL if available, CPU otherwise
+        SWMIX_BACKEND_GL,
+        SWMIX_BACKEND_CPU
+};
+
+#ifdef HAVE_SWMIX_GL
 /*
  * Bicubic interpolation taken from:
  * http://www.codeproject.com/Articles/236394/Bi-Cubic-and-Bi-Linear-Interpolation-with-GLSL
@@ -166,6 +183,7 @@ void main()
     }
     gl_FragColor = nSum / nDenom;
 });
+#endif // defined HAVE_SWMIX_GL
 
 /* prototypes of functions defined in this module */
 static void show_help(void);
@@ -173,7 +191,7 @@ static void *master_worker(void *arg);
 static void *slave_worker(void *arg);
 static char *get_config_name(void);
 static bool get_slave_param_from_file(FILE* config, const char *slave_name, int *x, int *y,
-                                        int *width, int *height);
+                                        int *width, int *height, double *opacity, bool *use_alpha);
 static bool get_device_config_from_file(FILE* config_file, char *slave_name,
                 char *device_name_config) __attribute__((unused));
 
@@ -194,7 +212,7 @@ static void show_help()
 {
         printf("SW Mix capture\n");
         printf("Usage\n");
-        printf("\t-t swmix:<width>:<height>:<fps>[:<codec>[:interpolation=<i_type>[,<algo>]][:layout=<X>x<Y>]] "
+        printf("\t-t swmix:<width>:<height>:<fps>[:<codec>[:interpolation=<i_type>[,<algo>]][:layout=<X>x<Y>][:backend=<b>]] "
                         "-t <dev1_config> -t <dev2_config>\n");
         printf("\tor\n");
         printf("\t-t swmix:file -t <dev1_config> -t <dev2_config> ...\n");
@@ -207,10 +225,13 @@ static void show_help()
                         "RGB or UYVY (optional, default RGBA)\n");
         printf("\t\t<i_type> can be one of 'bilinear' or 'bicubic' (default)\n");
         printf("\t\t\t<algo> bicubic interpolation algorithm: CatMullRom, BSpline (default) or Triangular\n");
+        printf("\t\t<b> compositing backend - 'gl' or 'cpu' (default is OpenGL if available, CPU otherwise)\n");
         printf("\n");
         printf("\t\tIn first variant, individual inputs are arranged automatically.\n");
         printf("\t\tWith the second variant, you provide overall layout and layout for \n"
                         "\t\tindividual inputs in SW mix config file (%s).\n", get_config_name());
+        printf("\t\tInput line in the file may be followed by 'opacity=<0.0-1.0>' and 'alpha'\n"
+                        "\t\t(blend by alpha channel of RGBA input to RGBA output), CPU backend only.\n");
 }
 
 struct state_slave {
@@ -229,12 +250,15 @@ struct state_slave {
 struct vidcap_swmix_state {
         struct state_slave *slaves;
         int                 devices_cnt;
+        enum swmix_backend  backend;
+#ifdef HAVE_SWMIX_GL
         struct gl_context   gl_context;
 
         GLuint              tex_output;
         GLuint              tex_output_uyvy;
         GLuint              fbo;
         GLuint              fbo_uyvy;
+#endif
 
         struct video_frame *frame;
         char               *network_buffer;
@@ -261,8 +285,11 @@ struct vidcap_swmix_state {
         bool                use_config_file;
 
         char               *bicubic_algo;
+#ifdef HAVE_SWMIX_GL
         GLuint              bicubic_program;
+#endif
         interpolation_t     interpolation;
+        enum resize_filter  cpu_filter;
         int                 grid_x, grid_y;
 };
 
@@ -285,15 +312,26 @@ vidcap_swmix_probe(bool verbose, void (**deleter)(void *))
 struct slave_data {
         struct video_frame *current_frame;
         struct video_desc   saved_desc;
+#ifdef HAVE_SWMIX_GL
         float               posX[4];
         float               posY[4];
         GLuint              texture[2]; // RGB(A), (UYVY)
         GLuint              fbo; // RGB(A)
+#endif
         double              x, y, width, height; // in 1x1 unit space
         double              fb_aspect;
+        double              opacity;   ///< 0.0-1.0, layer is blended over lower ones if < 1.0
+        bool                use_alpha; ///< blend also by alpha channel of RGBA input
 
         decoder_t           decoder;
         codec_t             decoder_from, decoder_to;
+
+        // CPU backend
+        unsigned int        dst_x, dst_y, dst_w, dst_h; ///< placement in output pixels
+        char               *converted; ///< frame converted to output codec (if needed)
+        size_t              converted_len;
+        char               *layer; ///< scaled frame to be blended to the output
+        size_t              layer_len;
 };
 
 static struct slave_data *init_slave_data(vidcap_swmix_state *s, FILE *config) {
@@ -314,19 +352,24 @@ static struct slave_data *init_slave_data(vidcap_swmix_state *s, FILE *config) {
         }
 
         for(int i = 0; i < s->devices_cnt; ++i) {
-                glGenTextures(2, slaves_data[i].texture);
-                for(int j = 0; j < 2; ++j) {
-                        glBindTexture(GL_TEXTURE_2D, slaves_data[i].texture[j]);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-                }
+#ifdef HAVE_SWMIX_GL
+                if (s->backend == SWMIX_BACKEND_GL) {
+                        glGenTextures(2, slaves_data[i].texture);
+                        for(int j = 0; j < 2; ++j) {
+                                glBindTexture(GL_TEXTURE_2D, slaves_data[i].texture[j]);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                        }
 
-                glGenFramebuffers(1, &slaves_data[i].fbo);
+                        glGenFramebuffers(1, &slaves_data[i].fbo);
+                }
+#endif
 
                 slaves_data[i].fb_aspect = (double) s->frame->tiles[0].width /
                         s->frame->tiles[0].height;
+                slaves_data[i].opacity = 1.0;
 
                 if(!s->use_config_file) {
                         slaves_data[i].width = 1.0 / (int) m;
@@ -337,7 +380,8 @@ static struct slave_data *init_slave_data(vidcap_swmix_state *s, FILE *config) {
                         int x, y, width, height;
                         if(!get_slave_param_from_file(config,
                                                 vidcap_params_get_name(s->slaves[i].device_params),
-                                        &x, &y, &width, &height)) {
+                                        &x, &y, &width, &height, &slaves_data[i].opacity,
+                                        &slaves_data[i].use_alpha)) {
                                 fprintf(stderr, "Cannot find config for device \"%s\"\n",
                                                 vidcap_params_get_name(s->slaves[i].device_params));
                                 free(slaves_data);
@@ -351,20 +395,96 @@ static struct slave_data *init_slave_data(vidcap_swmix_state *s, FILE *config) {
                                 s->frame->tiles[0].width;
                         slaves_data[i].y = (double) y /
                                 s->frame->tiles[0].height;
+                        if (s->backend != SWMIX_BACKEND_CPU &&
+                                        (slaves_data[i].opacity < 1.0 || slaves_data[i].use_alpha)) {
+                                log_msg(LOG_LEVEL_WARNING, "[swmix] Opacity and alpha are supported only "
+                                                "by the CPU backend, ignoring.\n");
+                        }
                 }
         }
 
         return slaves_data;
 }
 
-static void destroy_slave_data(struct slave_data *data, int count) {
+static void destroy_slave_data(struct slave_data *data, int count, enum swmix_backend backend) {
         for(int i = 0; i < count; ++i) {
-                glDeleteTextures(2, data[i].texture);
-                glDeleteFramebuffers(1, &data[i].fbo);
+#ifdef HAVE_SWMIX_GL
+                if (backend == SWMIX_BACKEND_GL) {
+                        glDeleteTextures(2, data[i].texture);
+                        glDeleteFramebuffers(1, &data[i].fbo);
+                }
+#else
+                UNUSED(backend);
+#endif
+                free(data[i].converted);
+                free(data[i].layer);
         }
         free(data);
 }
 
+/**
+ * Computes placement of the slave video within its area (in 1x1 unit space)
+ * preserving the video aspect ratio.
+ */
+static void get_slave_placement(struct slave_data *s, struct video_desc desc,
+                double *x, double *y, double *width, double *height)
+{
+        double video_aspect = (double) desc.width / desc.height;
+        double fb_aspect = (double) s->fb_aspect * s->width / s->height;
+        *width = s->width;
+        *height = s->height;
+        *x = s->x;
+        *y = s->y;
+
+        if(video_aspect > fb_aspect) {
+                *height = *width / video_aspect * s->fb_aspect;
+                *y += (s->height - *height) / 2;
+        } else {
+                *width = *height * video_aspect / s->fb_aspect;
+                *x += (s->width - *width) / 2;
+        }
+}
+
+/**
+ * Prepares conversion of the slave frames to the output codec and computes
+ * the target rectangle in output pixels. Parts of the area lying outside the
+ * output are clipped (the video is squeezed into the visible part).
+ */
+static void reconfigure_slave_rendering_cpu(struct slave_data *s, struct video_desc desc,
+                const struct video_frame *out)
+{
+        s->decoder = NULL;
+        if (desc.color_spec != out->color_spec) {
+                s->decoder = get_decoder_from_to(desc.color_spec, out->color_spec, true);
+                if (!s->decoder) {
+                        log_msg(LOG_LEVEL_ERROR, "[swmix] Unable to convert %s to %s, "
+                                        "the input won't be displayed.\n",
+                                        get_codec_name(desc.color_spec),
+                                        get_codec_name(out->color_spec));
+                }
+                s->decoder_from = desc.color_spec;
+                s->decoder_to = out->color_spec;
+        }
+
+        double x, y, width, height;
+        get_slave_placement(s, desc, &x, &y, &width, &height);
+        long out_w = out->tiles[0].width;
+        long out_h = out->tiles[0].height;
+        long x0 = min(max(lround(x * out_w), 0L), out_w);
+        long y0 = min(max(lround(y * out_h), 0L), out_h);
+        long x1 = min(max(lround((x + width) * out_w), 0L), out_w);
+        long y1 = min(max(lround((y + height) * out_h), 0L), out_h);
+        // whole pixel blocks (eg. 2 pixels of UYVY) only
+        long block = max(lround(get_pf_block_size(out->color_spec) / get_bpp(out->color_spec)), 1L);
+        x0 = x0 / block * block;
+        x1 = x1 / block * block;
+        s->dst_x = x0;
+        s->dst_y = y0;
+        s->dst_w = x1 - x0;
+        s->dst_h = y1 - y0;
+}
+
+#ifdef HAVE_SWMIX_GL
 static void reconfigure_slave_rendering(struct slave_data *s, struct video_desc desc)
 {
         glBindTexture(GL_TEXTURE_2D, s->texture[0]);
@@ -394,20 +514,8 @@ static void reconfigure_slave_rendering(struct slave_data *s, struct video_desc
         }
         glBindTexture(GL_TEXTURE_2D, 0);
 
-        double video_aspect = (double) desc.width / desc.height;
-        double fb_aspect = (double) s->fb_aspect * s->width / s->height;
-        double width = s->width;
-        double height = s->height;
-        double x = s->x;
-        double y = s->y;
-
-        if(video_aspect > fb_aspect) {
-                height = width / video_aspect * s->fb_aspect;
-                y += (s->height - height) / 2;
-        } else {
-                width = height * video_aspect / s->fb_aspect;
-                x += (s->width - width) / 2;
-        }
+        double x, y, width, height;
+        get_slave_placement(s, desc, &x, &y, &width, &height);
 
         // left top
         s->posX[0] = -1.0 + 2.0 * x;
@@ -478,12 +586,20 @@ void main() {
         gl_TexCoord[0] = gl_MultiTexCoord0;
         gl_Position = ftransform();
 });
+#endif // defined HAVE_SWMIX_GL
 
-static void check_for_slave_format_change(struct slave_data *s)
+static void check_for_slave_format_change(struct slave_data *s, const struct video_frame *out,
+                enum swmix_backend backend)
 {
         struct video_desc desc = video_desc_from_frame(s->current_frame);
 
         if(!video_desc_eq(desc, s->saved_desc)) {
+                if (backend == SWMIX_BACKEND_CPU) {
+                        reconfigure_slave_rendering_cpu(s, desc, out);
+                        s->saved_desc = desc;
+                        return;
+                }
+#ifdef HAVE_SWMIX_GL
                 codec_t in_codec = s->current_frame->color_spec;
                 codec_t out_codec = in_codec;
                 codec_t natively_supported[] = { RGB, BGR, RGBA, UYVY, VIDEO_CODEC_NONE };
@@ -504,9 +620,14 @@ static void check_for_slave_format_change(struct slave_data *s)
                 reconfigure_slave_rendering(s, desc);
                 desc.color_spec = s->decoder_from;
                 s->saved_desc = desc;
+#else
+                UNUSED(out);
+#endif
         }
 }
 
+#ifdef HAVE_SWMIX_GL
+
 static void load_texture(struct slave_data *s, GLuint from_uyvy)
 {
         glBindTexture(GL_TEXTURE_2D, s->texture[0]);
@@ -610,26 +731,294 @@ static void render_slave(struct slave_data *s, interpolation_t interpolation, GL
         glEnd();
 }
 
+static void compose_gl(struct vidcap_swmix_state *s, GLuint to_uyvy, char *read_buf)
+{
+        // draw
+        glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
+                        GL_TEXTURE_2D, s->tex_output, 0);
+        glClearColor(0, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glViewport(0, 0, s->frame->tiles[0].width, s->frame->tiles[0].height);
+
+        if(s->interpolation == BICUBIC) {
+                glUseProgram(s->bicubic_program);
+                glUniform1i(glGetUniformLocation(s->bicubic_program, "image"), 0);
+        }
+
+        for(int i = 0; i < s->devices_cnt; ++i) {
+                if(s->slaves_data[i].current_frame) {
+                        render_slave(&s->slaves_data[i], s->interpolation, s->bicubic_program);
+                }
+        }
+        glUseProgram(0);
+
+        // read back
+        glBindTexture(GL_TEXTURE_2D, s->tex_output);
+        int width = s->frame->tiles[0].width;
+        GLenum format = GL_RGBA;
+        if(s->frame->color_spec == UYVY) {
+                glBindFramebuffer(GL_FRAMEBUFFER, s->fbo_uyvy);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
+                                GL_TEXTURE_2D, s->tex_output_uyvy, 0);
+                glViewport(0, 0, s->frame->tiles[0].width / 2, s->frame->tiles[0].height);
+                glUseProgram(to_uyvy);
+                glBegin(GL_QUADS);
+                glTexCoord2f(0.0, 0.0); glVertex2f(-1.0, -1.0);
+                glTexCoord2f(1.0, 0.0); glVertex2f(1.0, -1.0);
+                glTexCoord2f(1.0, 1.0); glVertex2f(1.0, 1.0);
+                glTexCoord2f(0.0, 1.0); glVertex2f(-1.0, 1.0);
+                glEnd();
+                glUseProgram(0);
+                width /= 2;
+                glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
+        } else if (s->frame->color_spec == RGB) {
+                format = GL_RGB;
+        }
+
+        glReadPixels(0, 0, width,
+                        s->frame->tiles[0].height,
+                        format, GL_UNSIGNED_BYTE,
+                        read_buf);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+}
+#endif // defined HAVE_SWMIX_GL
+
+static void fill_black(char *data, codec_t codec, int width, int height)
+{
+        size_t len = (size_t) vc_get_linesize(width, codec) * height;
+        uint32_t pattern;
+        switch (codec) {
+        case RGBA:
+                pattern = 0xFF000000u;
+                break;
+        case UYVY:
+                pattern = 0x10801080u;
+                break;
+        default:
+                memset(data, 0, len);
+                return;
+        }
+        uint32_t *out = (uint32_t *) data;
+        for (size_t i = 0; i < len / sizeof pattern; ++i) {
+                out[i] = pattern;
+        }
+}
+
+struct convert_task {
+        decoder_t decoder;
+        const char *in;
+        char *out;
+        int in_pitch;
+        int out_pitch;
+        int out_linesize; ///< bytes to convert
+        int y_start;
+        int y_end;
+};
+
+static void *convert_worker(void *arg)
+{
+        struct convert_task *t = (struct convert_task *) arg;
+        for (int y = t->y_start; y < t->y_end; ++y) {
+                t->decoder((unsigned char *) t->out + (size_t) y * t->out_pitch,
+                                (const unsigned char *) t->in + (size_t) y * t->in_pitch,
+                                t->out_linesize, 0, 8, 16);
+        }
+        return NULL;
+}
+
+static void convert_lines(decoder_t decoder, const char *in, int in_pitch,
+                char *out, int out_pitch, int out_linesize, int height)
+{
+        int workers = max<int>(min<int>(thread::hardware_concurrency(), height / 64), 1);
+        vector<struct convert_task> tasks(workers);
+        for (int i = 0; i < workers; ++i) {
+                tasks[i] = { decoder, in, out, in_pitch, out_pitch, out_linesize,
+                        height * i / workers, height * (i + 1) / workers };
+        }
+        task_run_parallel(convert_worker, workers, tasks.data(), sizeof tasks[0], NULL);
+}
+
+static char *get_slave_buffer(char **buf, size_t *buf_len, size_t len)
+{
+        if (len > *buf_len) {
+                free(*buf);
+                *buf = (char *) malloc(len);
+                *buf_len = len;
+        }
+        return *buf;
+}
+
+/**
+ * Scales (and converts) the slave frame to the rectangle x, y, sd->dst_w,
+ * sd->dst_h of the out buffer of out_width x out_height pixels. Slaves in other
+ * codec than the output are converted before scaling when upscaling and after
+ * it when downscaling so that the conversion runs on the smaller picture.
+ */
+static void render_slave_cpu(struct slave_data *sd, codec_t out_codec, char *out,
+                unsigned int out_width, unsigned int out_height, unsigned int x, unsigned int y,
+                enum resize_filter filter)
+{
+        const struct tile *t = &sd->current_frame->tiles[0];
+        codec_t in_codec = sd->current_frame->color_spec;
+        int out_pitch = vc_get_linesize(out_width, out_codec);
+
+        if (in_codec == out_codec) {
+                resize_frame_to_rect(t->data, out_codec, t->width, t->height, out,
+                                out_width, out_height, x, y, sd->dst_w, sd->dst_h, filter);
+                return;
+        }
+
+        if ((size_t) sd->dst_w * sd->dst_h < (size_t) t->width * t->height
+                        && resize_supports_codec(in_codec)) {
+                int scaled_pitch = vc_get_linesize(sd->dst_w, in_codec);
+                char *scaled = get_slave_buffer(&sd->converted, &sd->converted_len, (size_t) scaled_pitch * sd->dst_h);
+                resize_frame_to_rect(t->data, in_codec, t->width, t->height, scaled,
+                                sd->dst_w, sd->dst_h, 0, 0, sd->dst_w, sd->dst_h, filter);
+                convert_lines(sd->decoder, scaled, scaled_pitch,
+                                out + (size_t) y * out_pitch + vc_get_linesize(x, out_codec),
+                                out_pitch, vc_get_linesize(sd->dst_w, out_codec), sd->dst_h);
+        } else {
+                int in_pitch = vc_get_linesize(t->width, in_codec);
+                int conv_pitch = vc_get_linesize(t->width, out_codec);
+                char *converted = get_slave_buffer(&sd->converted, &sd->converted_len, (size_t) conv_pitch * t->height);
+                convert_lines(sd->decoder, t->data, in_pitch, converted, conv_pitch,
+                                conv_pitch, t->height);
+                resize_frame_to_rect(converted, out_codec, t->width, t->height, out,
+                                out_width, out_height, x, y, sd->dst_w, sd->dst_h, filter);
+        }
+}
+
+struct blend_task {
+        const unsigned char *in;
+        unsigned char *out;
+        int in_pitch;
+        int out_pitch;
+        int linesize;
+        codec_t codec;
+        int opacity;    ///< 0-256
+        bool use_alpha; ///< multiply opacity with the alpha channel of RGBA layer
+        int y_start;
+        int y_end;
+};
+
+/**
+ * Blends the layer over the output. Blending the bytes linearly is correct
+ * for all supported output codecs (RGB, RGBA and UYVY), alpha channel of RGBA
+ * is composed as "over" so that the output stays opaque.
+ */
+static void *blend_worker(void *arg)
+{
+        struct blend_task *t = (struct blend_task *) arg;
+        for (int y = t->y_start; y < t->y_end; ++y) {
+                const unsigned char *in = t->in + (size_t) y * t->in_pitch;
+                unsigned char *out = t->out + (size_t) y * t->out_pitch;
+                if (t->codec == RGBA) {
+                        for (int x = 0; x < t->linesize; x += 4) {
+                                int a = t->use_alpha ? (in[x + 3] * t->opacity + 127) / 255 : t->opacity;
+                                out[x] = (in[x] * a + out[x] * (256 - a)) >> 8;
+                                out[x + 1] = (in[x + 1] * a + out[x + 1] * (256 - a)) >> 8;
+                                out[x + 2] = (in[x + 2] * a + out[x + 2] * (256 - a)) >> 8;
+                                out[x + 3] = (255 * a + out[x + 3] * (256 - a)) >> 8;
+                        }
+                } else {
+                        for (int x = 0; x < t->linesize; ++x) {
+                                out[x] = (in[x] * t->opacity + out[x] * (256 - t->opacity)) >> 8;
+                        }
+                }
+        }
+        return NULL;
+}
+
+static void blend_lines(const char *in, int in_pitch, char *out, int out_pitch, int linesize,
+                int height, codec_t codec, int opacity, bool use_alpha)
+{
+        int workers = max<int>(min<int>(thread::hardware_concurrency(), height / 64), 1);
+        vector<struct blend_task> tasks(workers);
+        for (int i = 0; i < workers; ++i) {
+                tasks[i] = { (const unsigned char *) in, (unsigned char *) out, in_pitch, out_pitch,
+                        linesize, codec, opacity, use_alpha, height * i / workers, height * (i + 1) / workers };
+        }
+        task_run_parallel(blend_worker, workers, tasks.data(), sizeof tasks[0], NULL);
+}
+
+/**
+ * Draws the slave to its area of the output. Opaque slaves are rendered
+ * directly to the output, translucent ones to a layer buffer that is then
+ * blended over what was drawn before.
+ */
+static void draw_slave_cpu(struct slave_data *sd, struct video_frame *f, char *out,
+                enum resize_filter filter)
+{
+        codec_t out_codec = f->color_spec;
+        if (sd->current_frame->color_spec != out_codec && !sd->decoder) {
+                return;
+        }
+        // alpha channel is kept only if both input and output are RGBA
+        bool use_alpha = sd->use_alpha && out_codec == RGBA && sd->current_frame->color_spec == RGBA;
+        int opacity = lround(sd->opacity * 256);
+        if (opacity == 0) {
+                return;
+        }
+        if (opacity == 256 && !use_alpha) {
+                render_slave_cpu(sd, out_codec, out, f->tiles[0].width, f->tiles[0].height,
+                                sd->dst_x, sd->dst_y, filter);
+                return;
+        }
+
+        int layer_pitch = vc_get_linesize(sd->dst_w, out_codec);
+        int out_pitch = vc_get_linesize(f->tiles[0].width, out_codec);
+        char *layer = get_slave_buffer(&sd->layer, &sd->layer_len, (size_t) layer_pitch * sd->dst_h);
+        render_slave_cpu(sd, out_codec, layer, sd->dst_w, sd->dst_h, 0, 0, filter);
+        blend_lines(layer, layer_pitch, out + (size_t) sd->dst_y * out_pitch + vc_get_linesize(sd->dst_x, out_codec),
+                        out_pitch, layer_pitch, sd->dst_h, out_codec, opacity, use_alpha);
+}
+
+/**
+ * CPU compositor - slaves are drawn in order (later over earlier, blended
+ * if translucent) to the black background. Each slave is scaled (and
+ * converted) in parallel in horizontal stripes of its output area.
+ */
+static void compose_cpu(struct vidcap_swmix_state *s, char *out)
+{
+        struct video_frame *f = s->frame;
+        fill_black(out, f->color_spec, f->tiles[0].width, f->tiles[0].height);
+
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct slave_data *sd = &s->slaves_data[i];
+                if (!sd->current_frame || sd->dst_w == 0 || sd->dst_h == 0) {
+                        continue;
+                }
+                draw_slave_cpu(sd, f, out, s->cpu_filter);
+        }
+}
+
 static void *master_worker(void *arg)
 {
         struct vidcap_swmix_state *s = (struct vidcap_swmix_state *) arg;
         struct timeval t0;
-        GLuint from_uyvy, to_uyvy;
 
         gettimeofday(&t0, NULL);
 
-        gl_context_make_current(&s->gl_context);
-        glEnable(GL_TEXTURE_2D);
-        from_uyvy = glsl_compile_link(vprogram, fprogram_from_uyvy);
-        to_uyvy = glsl_compile_link(vprogram, fprogram_to_uyvy);
-        assert(from_uyvy != 0);
-        assert(to_uyvy != 0);
-
-        glUseProgram(to_uyvy);
-        glUniform1i(glGetUniformLocation(to_uyvy, "image"), 0);
-        glUniform1f(glGetUniformLocation(to_uyvy, "imageWidth"),
-                        (GLfloat) s->frame->tiles[0].width);
-        glUseProgram(0);
+#ifdef HAVE_SWMIX_GL
+        GLuint from_uyvy = 0, to_uyvy = 0;
+        if (s->backend == SWMIX_BACKEND_GL) {
+                gl_context_make_current(&s->gl_context);
+                glEnable(GL_TEXTURE_2D);
+                from_uyvy = glsl_compile_link(vprogram, fprogram_from_uyvy);
+                to_uyvy = glsl_compile_link(vprogram, fprogram_to_uyvy);
+                assert(from_uyvy != 0);
+                assert(to_uyvy != 0);
+
+                glUseProgram(to_uyvy);
+                glUniform1i(glGetUniformLocation(to_uyvy, "image"), 0);
+                glUniform1f(glGetUniformLocation(to_uyvy, "imageWidth"),
+                                (GLfloat) s->frame->tiles[0].width);
+                glUseProgram(0);
+        }
+#endif
 
         int field = 0;
         char *tmp_buffer = (char *) malloc(s->frame->tiles[0].data_len);
@@ -676,7 +1065,7 @@ static void *master_worker(void *arg)
                 // check for mode change
                 for(int i = 0; i < s->devices_cnt; ++i) {
                         if(s->slaves_data[i].current_frame) {
-                                check_for_slave_format_change(&s->slaves_data[i]);
+                                check_for_slave_format_change(&s->slaves_data[i], s->frame, s->backend);
                         }
                 }
 
@@ -706,67 +1095,29 @@ static void *master_worker(void *arg)
                                         }
                                 }
 
-                                load_texture(&s->slaves_data[i], from_uyvy);
+#ifdef HAVE_SWMIX_GL
+                                if (s->backend == SWMIX_BACKEND_GL) {
+                                        load_texture(&s->slaves_data[i], from_uyvy);
+                                }
+#endif
 
                         }
                 }
 
-                // draw
-                glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
-                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
-                                GL_TEXTURE_2D, s->tex_output, 0);
-                glClearColor(0, 0, 0, 1);
-                glClear(GL_COLOR_BUFFER_BIT);
-
-                glViewport(0, 0, s->frame->tiles[0].width, s->frame->tiles[0].height);
-
-                if(s->interpolation == BICUBIC) {
-                        glUseProgram(s->bicubic_program);
-                        glUniform1i(glGetUniformLocation(s->bicubic_program, "image"), 0);
-                }
-
-                for(int i = 0; i < s->devices_cnt; ++i) {
-                        if(s->slaves_data[i].current_frame) {
-                                render_slave(&s->slaves_data[i], s->interpolation, s->bicubic_program);
-                        }
-                }
-                glUseProgram(0);
-
-                // read back
-                glBindTexture(GL_TEXTURE_2D, s->tex_output);
-                int width = s->frame->tiles[0].width;
-                GLenum format = GL_RGBA;
-                if(s->frame->color_spec == UYVY) {
-                        glBindFramebuffer(GL_FRAMEBUFFER, s->fbo_uyvy);
-                        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT,
-                                        GL_TEXTURE_2D, s->tex_output_uyvy, 0);
-                        glViewport(0, 0, s->frame->tiles[0].width / 2, s->frame->tiles[0].height);
-                        glUseProgram(to_uyvy);
-                        glBegin(GL_QUADS);
-                        glTexCoord2f(0.0, 0.0); glVertex2f(-1.0, -1.0);
-                        glTexCoord2f(1.0, 0.0); glVertex2f(1.0, -1.0);
-                        glTexCoord2f(1.0, 1.0); glVertex2f(1.0, 1.0);
-                        glTexCoord2f(0.0, 1.0); glVertex2f(-1.0, 1.0);
-                        glEnd();
-                        glUseProgram(0);
-                        width /= 2;
-                        glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
-                } else if (s->frame->color_spec == RGB) {
-                        format = GL_RGB;
-                }
-
                 char *read_buf;
                 if(s->frame->interlacing == PROGRESSIVE) {
                         read_buf = current_buffer;
                 } else {
                         read_buf = tmp_buffer;
                 }
-                glReadPixels(0, 0, width,
-                                s->frame->tiles[0].height,
-                                format, GL_UNSIGNED_BYTE,
-                                read_buf);
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
-                glBindTexture(GL_TEXTURE_2D, 0);
+                if (s->backend == SWMIX_BACKEND_CPU) {
+                        compose_cpu(s, read_buf);
+                }
+#ifdef HAVE_SWMIX_GL
+                else {
+                        compose_gl(s, to_uyvy, read_buf);
+                }
+#endif
 
                 if(s->frame->interlacing == INTERLACED_MERGED) {
                         int linesize =
@@ -805,10 +1156,14 @@ static void *master_worker(void *arg)
 
         free(tmp_buffer);
 
-        glDeleteProgram(from_uyvy);
-        glDeleteProgram(to_uyvy);
-        glDisable(GL_TEXTURE_2D);
-        gl_context_make_current(NULL);
+#ifdef HAVE_SWMIX_GL
+        if (s->backend == SWMIX_BACKEND_GL) {
+                glDeleteProgram(from_uyvy);
+                glDeleteProgram(to_uyvy);
+                glDisable(GL_TEXTURE_2D);
+                gl_context_make_current(NULL);
+        }
+#endif
 
         return NULL;
 }
@@ -875,8 +1230,11 @@ static void *slave_worker(void *arg)
         return NULL;
 }
 
+/**
+ * Line format is "<name> <x> <y> <width> <height> [<dev_config>] [opacity=<o>] [alpha]".
+ */
 static bool get_slave_param_from_file(FILE* config_file, const char *slave_name, int *x, int *y,
-                                        int *width, int *height)
+                                        int *width, int *height, double *opacity, bool *use_alpha)
 {
         char *ret;
         char line[1024];
@@ -886,13 +1244,25 @@ static bool get_slave_param_from_file(FILE* config_file, const char *slave_name,
         while (fgets(line, sizeof(line), config_file)) {
                 char name[128];
                 int x_, y_, width_, height_;
-                if(sscanf(line, "%128s %d %d %d %d", name, &x_, &y_, &width_, &height_) != 5)
+                int len = 0;
+                if(sscanf(line, "%128s %d %d %d %d%n", name, &x_, &y_, &width_, &height_, &len) != 5)
                         continue;
                 if(strcasecmp(name, slave_name) == 0) {
                         *x = x_;
                         *y = y_;
                         *width = width_;
                         *height = height_;
+                        char *save_ptr = NULL;
+                        char *item;
+                        char *options = line + len;
+                        while ((item = strtok_r(options, " \t\r\n", &save_ptr)) != NULL) {
+                                options = NULL;
+                                if (strncasecmp(item, "opacity=", strlen("opacity=")) == 0) {
+                                        *opacity = min(max(atof(item + strlen("opacity=")), 0.0), 1.0);
+                                } else if (strcasecmp(item, "alpha") == 0) {
+                                        *use_alpha = true;
+                                }
+                        }
                         return true;
                 }
         }
@@ -926,7 +1296,8 @@ static bool get_device_config_from_file(FILE* config_file, char *slave_name,
 #define PARSE_FILE 2
 static int parse_config_string(const char *fmt, unsigned int *width,
                 unsigned int *height, double *fps,
-        codec_t *color_spec, interpolation_t *interpolation, char **bicubic_algo, interlacing_t *interl, int *grid_x, int *grid_y)
+        codec_t *color_spec, interpolation_t *interpolation, char **bicubic_algo, interlacing_t *interl, int *grid_x, int *grid_y,
+        enum swmix_backend *backend)
 {
         char *save_ptr = NULL;
         char *item;
@@ -990,6 +1361,16 @@ static int parse_config_string(const char *fmt, unsigned int *width,
                                                 log_msg(LOG_LEVEL_ERROR, "Error parsing layout!\n");
                                                 return PARSE_ERROR;
                                         }
+                                } else if (strncasecmp(item, "backend=", strlen("backend=")) == 0) {
+                                        const char *b = item + strlen("backend=");
+                                        if (strcasecmp(b, "gl") == 0) {
+                                                *backend = SWMIX_BACKEND_GL;
+                                        } else if (strcasecmp(b, "cpu") == 0) {
+                                                *backend = SWMIX_BACKEND_CPU;
+                                        } else {
+                                                log_msg(LOG_LEVEL_ERROR, "Unknown backend: %s\n", b);
+                                                return PARSE_ERROR;
+                                        }
                                 } else {
                                         log_msg(LOG_LEVEL_ERROR, "Unknown option: %s\n", item);
                                         return PARSE_ERROR;
@@ -1013,7 +1394,8 @@ static bool parse(struct vidcap_swmix_state *s, struct video_desc *desc, char *f
         int ret;
 
         ret = parse_config_string(fmt, &desc->width, &desc->height, &desc->fps, &desc->color_spec,
-                        interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y);
+                        interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y,
+                        &s->backend);
         if(ret == PARSE_ERROR) {
                 show_help();
                 return false;
@@ -1035,7 +1417,8 @@ static bool parse(struct vidcap_swmix_state *s, struct video_desc *desc, char *f
                 }
                 while(isspace(line[strlen(line) - 1])) line[strlen(line) - 1] = '\0'; // trim trailing spaces
                 ret = parse_config_string(line, &desc->width, &desc->height, &desc->fps, &desc->color_spec,
-                                interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y);
+                                interpolation, &s->bicubic_algo, &desc->interlacing, &s->grid_x, &s->grid_y,
+                                &s->backend);
                 if(ret != PARSE_OK) {
                         fprintf(stderr, "Malformed input file! First line should contain config "
                                         "string same as for cmdline use (between first ':' and '#' "
@@ -1085,12 +1468,116 @@ static bool parse(struct vidcap_swmix_state *s, struct video_desc *desc, char *f
         return true;
 }
 
+#ifdef HAVE_SWMIX_GL
+static bool init_gl(struct vidcap_swmix_state *s)
+{
+        if(!init_gl_context(&s->gl_context, GL_CONTEXT_LEGACY)) {
+                fprintf(stderr, "[swmix] Unable to initialize OpenGL context.\n");
+                return false;
+        }
+
+        if (s->gl_context.gl_major < 2) {
+                fprintf(stderr, "[swmix] Unsufficient OpenGL version to run SWMix.\n");
+                destroy_gl_context(&s->gl_context);
+                return false;
+        }
+
+        gl_context_make_current(&s->gl_context);
+
+        {
+                char *bicubic = strdup(bicubic_template);
+                char *algo_pos;
+                while((algo_pos = strstr(bicubic, "INTERP_ALGORITHM_PLACEHOLDER"))) {
+                        memset(algo_pos, ' ', strlen("INTERP_ALGORITHM_PLACEHOLDER"));
+                        memcpy(algo_pos, s->bicubic_algo, strlen(s->bicubic_algo));
+                }
+                printf("Using bicubic algorithm: %s\n", s->bicubic_algo);
+                s->bicubic_program = glsl_compile_link(vprogram, bicubic);
+                free(bicubic);
+        }
+
+        return true;
+}
+
+static void init_gl_output(struct vidcap_swmix_state *s, struct video_desc desc)
+{
+        GLenum format = GL_RGBA;
+        if(desc.color_spec == RGB) {
+                format = GL_RGB;
+        }
+        glGenTextures(1, &s->tex_output);
+        glBindTexture(GL_TEXTURE_2D, s->tex_output);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, desc.width, desc.height,
+                        0, format, GL_UNSIGNED_BYTE, NULL);
+
+        glGenTextures(1, &s->tex_output_uyvy);
+        glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, desc.width / 2, desc.height,
+                        0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+        glGenFramebuffers(1, &s->fbo);
+        glGenFramebuffers(1, &s->fbo_uyvy);
+
+        gl_context_make_current(NULL);
+}
+#endif // defined HAVE_SWMIX_GL
+
+/**
+ * Selects the compositing backend - OpenGL (with GL context made current)
+ * if requested or available, CPU otherwise.
+ */
+static bool init_backend(struct vidcap_swmix_state *s)
+{
+#ifdef HAVE_SWMIX_GL
+        if (s->backend != SWMIX_BACKEND_CPU) {
+                if (init_gl(s)) {
+                        s->backend = SWMIX_BACKEND_GL;
+                        return true;
+                }
+                if (s->backend == SWMIX_BACKEND_GL) {
+                        return false;
+                }
+                log_msg(LOG_LEVEL_NOTICE, "[swmix] Falling back to CPU compositing.\n");
+        }
+#else
+        if (s->backend == SWMIX_BACKEND_GL) {
+                log_msg(LOG_LEVEL_ERROR, "[swmix] OpenGL backend not compiled in.\n");
+                return false;
+        }
+#endif
+        s->backend = SWMIX_BACKEND_CPU;
+
+        if (s->interpolation == BILINEAR) {
+                s->cpu_filter = RESIZE_BILINEAR;
+        } else if (strcasecmp(s->bicubic_algo, "CatMullRom") == 0) {
+                s->cpu_filter = RESIZE_CATMULL_ROM;
+        } else if (strcasecmp(s->bicubic_algo, "BSpline") == 0) {
+                s->cpu_filter = RESIZE_BSPLINE;
+        } else if (strcasecmp(s->bicubic_algo, "Triangular") == 0) {
+                s->cpu_filter = RESIZE_TRIANGULAR;
+        } else {
+                log_msg(LOG_LEVEL_ERROR, "[swmix] Unknown bicubic algorithm: %s\n", s->bicubic_algo);
+                return false;
+        }
+        log_msg(LOG_LEVEL_INFO, "[swmix] Using CPU compositing (%s).\n",
+                        s->interpolation == BILINEAR ? "bilinear" : s->bicubic_algo);
+
+        return true;
+}
+
 static int
 vidcap_swmix_init(struct vidcap_params *params, void **state)
 {
 	struct vidcap_swmix_state *s;
         struct video_desc desc;
-        GLenum format;
 
 	printf("vidcap_swmix_init\n");
 
@@ -1140,30 +1627,10 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
         pthread_cond_init(&s->frame_sent_cv, NULL);
         pthread_cond_init(&s->free_buffer_queue_not_empty_cv, NULL);
 
-        if(!init_gl_context(&s->gl_context, GL_CONTEXT_LEGACY)) {
-                fprintf(stderr, "[swmix] Unable to initialize OpenGL context.\n");
+        if (!init_backend(s)) {
                 goto error;
         }
 
-        if (s->gl_context.gl_major < 2) {
-                fprintf(stderr, "[swmix] Unsufficient OpenGL version to run SWMix.\n");
-                goto error;
-        }
-
-        gl_context_make_current(&s->gl_context);
-
-        {
-                char *bicubic = strdup(bicubic_template);
-                char *algo_pos;
-                while((algo_pos = strstr(bicubic, "INTERP_ALGORITHM_PLACEHOLDER"))) {
-                        memset(algo_pos, ' ', strlen("INTERP_ALGORITHM_PLACEHOLDER"));
-                        memcpy(algo_pos, s->bicubic_algo, strlen(s->bicubic_algo));
-                }
-                printf("Using bicubic algorithm: %s\n", s->bicubic_algo);
-                s->bicubic_program = glsl_compile_link(vprogram, bicubic);
-                free(bicubic);
-        }
-
         s->slaves_data = init_slave_data(s, config_file);
         if(!s->slaves_data) {
                 free(config_file);
@@ -1176,32 +1643,11 @@ vidcap_swmix_init(struct vidcap_params *params, void **state)
                 config_file = nullptr;
         }
 
-        format = GL_RGBA;
-        if(desc.color_spec == RGB) {
-                format = GL_RGB;
+#ifdef HAVE_SWMIX_GL
+        if (s->backend == SWMIX_BACKEND_GL) {
+                init_gl_output(s, desc);
         }
-        glGenTextures(1, &s->tex_output);
-        glBindTexture(GL_TEXTURE_2D, s->tex_output);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, desc.width, desc.height,
-                        0, format, GL_UNSIGNED_BYTE, NULL);
-
-        glGenTextures(1, &s->tex_output_uyvy);
-        glBindTexture(GL_TEXTURE_2D, s->tex_output_uyvy);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, desc.width / 2, desc.height,
-                        0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-        glGenFramebuffers(1, &s->fbo);
-        glGenFramebuffers(1, &s->fbo_uyvy);
-
-        gl_context_make_current(NULL);
+#endif
 
         for(int i = 0; i < s->devices_cnt; ++i) {
                 pthread_mutex_init(&(s->slaves[i].lock), NULL);
@@ -1283,17 +1729,25 @@ vidcap_swmix_done(void *state)
 
         vf_free(s->frame);
 
-        gl_context_make_current(&s->gl_context);
+#ifdef HAVE_SWMIX_GL
+        if (s->backend == SWMIX_BACKEND_GL) {
+                gl_context_make_current(&s->gl_context);
+        }
+#endif
 
-        destroy_slave_data(s->slaves_data, s->devices_cnt);
+        destroy_slave_data(s->slaves_data, s->devices_cnt, s->backend);
 
-        glDeleteTextures(1, &s->tex_output);
-        glDeleteTextures(1, &s->tex_output_uyvy);
-        glDeleteFramebuffers(1, &s->fbo);
-        glDeleteFramebuffers(1, &s->fbo_uyvy);
+#ifdef HAVE_SWMIX_GL
+        if (s->backend == SWMIX_BACKEND_GL) {
+                glDeleteTextures(1, &s->tex_output);
+                glDeleteTextures(1, &s->tex_output_uyvy);
+                glDeleteFramebuffers(1, &s->fbo);
+                glDeleteFramebuffers(1, &s->fbo_uyvy);
 
-        gl_context_make_current(NULL);
-        destroy_gl_context(&s->gl_context);
+                gl_context_make_current(NULL);
+                destroy_gl_context(&s->gl_context);
+        }
+#endif
 
         pthread_mutex_destroy(&s->lock);
         pthread_cond_destroy(&s->frame_ready_cv);
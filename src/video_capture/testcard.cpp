@@ -67,6 +67,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <chrono>
+#include <thread>
+#include <vector>
 #ifdef HAVE_LIBSDL_MIXER
 #include <SDL/SDL.h>
 #include <SDL/SDL_mixer.h>
@@ -100,7 +102,8 @@ enum class image_pattern : int {
 #define DEFAULT_BLANK_COLOR 0xff000000
 
 struct testcard_state {
-        std::chrono::steady_clock::time_point last_frame_time;
+        std::chrono::steady_clock::time_point next_frame_time;
+        std::chrono::steady_clock::duration frame_duration;
         int size;
         int pan;
         struct testcard_pixmap pixmap;
@@ -120,6 +123,9 @@ struct testcard_state {
         unsigned int grab_audio:1;
 
         unsigned int still_image;
+        std::vector<char *> ring; ///< precomputed frames (ring=<n>), empty if not used
+        unsigned int ring_idx;
+        uint32_t ring_frame_count {0}; ///< stamped to the ring frames
         enum image_pattern pattern {image_pattern::BARS};
         uint32_t blank_color = DEFAULT_BLANK_COLOR;
 };
@@ -288,6 +294,43 @@ static int configure_tiling(struct testcard_state *s, const char *fmt)
         return 0;
 }
 
+/**
+ * Writes binary frame counter (32 blocks of 0x00/0xff bytes) to the top lines
+ * of the frame.
+ */
+static void testcard_stamp_frame(struct testcard_state *s, char *f, uint32_t counter)
+{
+        const int stamp_lines = max((int) vf_get_tile(s->frame, 0)->height / 32, 1);
+        const int block = s->frame_linesize / 32;
+
+        for (int y = 0; y < stamp_lines && block > 0; ++y) {
+                for (int b = 0; b < 32; ++b) {
+                        memset(f + y * s->frame_linesize + b * block,
+                                        (counter >> (31 - b)) & 1 ? 0xff : 0x00, block);
+                }
+        }
+}
+
+/**
+ * Precomputes ring_len frames so that grabbing is just a pointer swap (and
+ * stamping the frame counter, see testcard_stamp_frame()). Frame k is the
+ * (doubled) pattern shifted by k * height / ring_len lines.
+ */
+static void testcard_fill_ring(struct testcard_state *s, int ring_len)
+{
+        const struct tile *tile = vf_get_tile(s->frame, 0);
+        const int height = tile->height;
+        const int step = s->still_image ? 0 : max(height / ring_len, 1);
+
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Precomputing %d frames (%.1f MiB).\n", ring_len,
+                        (double) ring_len * s->size / (1 << 20));
+        for (int k = 0; k < ring_len; ++k) {
+                char *f = (char *) malloc(s->size);
+                memcpy(f, s->data + (size_t) (k * step % height) * s->frame_linesize, s->size);
+                s->ring.push_back(f);
+        }
+}
+
 static const codec_t codecs_8b[] = {I420, RGBA, RGB, UYVY, YUYV, VIDEO_CODEC_NONE};
 static const codec_t codecs_10b[] = {R10k, v210, VIDEO_CODEC_NONE};
 static const codec_t codecs_12b[] = {R12L, VIDEO_CODEC_NONE};
@@ -303,19 +346,21 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
         codec_t codec = RGBA;
         int aligned_x;
         char *save_ptr = NULL;
+        int ring_len = 0;
         struct video_desc desc{};
         desc.tile_count = 1;
         desc.interlacing = PROGRESSIVE;
 
         if (vidcap_params_get_fmt(params) == NULL || strcmp(vidcap_params_get_fmt(params), "help") == 0) {
                 printf("testcard options:\n");
-                printf("\t-t testcard:<width>:<height>:<fps>:<codec>[:filename=<filename>][:p][:s=<X>x<Y>][:i|:sf][:still][:pattern=bars|blank|noise|0x<AAGGBBRR>]\n");
+                printf("\t-t testcard:<width>:<height>:<fps>:<codec>[:filename=<filename>][:p][:s=<X>x<Y>][:i|:sf][:still][:pattern=bars|blank|noise|0x<AAGGBBRR>][:ring=<n>]\n");
                 printf("\t<filename> - use file named filename instead of default bars\n");
                 printf("\tp - pan with frame\n");
                 printf("\ts - split the frames into XxY separate tiles\n");
                 printf("\ti|sf - send as interlaced or segmented frame (if none of those is set, progressive is assumed)\n");
                 printf("\tstill - send still image\n");
                 printf("\tpattern - pattern to use\n");
+                printf("\tring - precompute <n> distinct frames (moving pattern with frame counter), eg. for load testing\n");
                 show_codec_help("testcard", codecs_8b, codecs_10b, codecs_12b);
                 return VIDCAP_INIT_NOERR;
         }
@@ -464,6 +509,12 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
                         log_msg(LOG_LEVEL_WARNING, "[testcard] Deprecated 'sf' option. Use format testcard:1920:1080:25sf:UYVY instead!\n");
                 } else if (strcmp(tmp, "still") == 0) {
                         s->still_image = TRUE;
+                } else if (strncmp(tmp, "ring=", strlen("ring=")) == 0) {
+                        ring_len = atoi(tmp + strlen("ring="));
+                        if (ring_len <= 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong ring length!\n");
+                                goto error;
+                        }
                 } else if (strncmp(tmp, "pattern=", strlen("pattern=")) == 0) {
                         const char *pattern = tmp + strlen("pattern=");
                         if (strcmp(pattern, "bars") == 0) {
@@ -609,7 +660,17 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
                 s->still_image = true;
         }
 
-        s->last_frame_time = std::chrono::steady_clock::now();
+        if (ring_len > 0) {
+                if (strip_fmt != NULL) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Ring cannot be combined with tiling!\n");
+                        goto error;
+                }
+                testcard_fill_ring(s, ring_len);
+        }
+
+        s->frame_duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(1.0 / s->frame->fps));
+        s->next_frame_time = std::chrono::steady_clock::now();
 
         printf("Testcard capture set to %dx%d, bpp %f\n", vf_get_tile(s->frame, 0)->width,
                         vf_get_tile(s->frame, 0)->height, bpp);
@@ -639,6 +700,9 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
 error:
         free(fmt);
         free(s->data);
+        for (char *f : s->ring) {
+                free(f);
+        }
         vf_free(s->frame);
         if (in)
                 fclose(in);
@@ -650,6 +714,9 @@ static void vidcap_testcard_done(void *state)
 {
         struct testcard_state *s = (struct testcard_state *) state;
         free(s->data);
+        for (char *f : s->ring) {
+                free(f);
+        }
         if (s->tiled) {
                 int i;
                 for (i = 0; i < s->tiles_cnt_horizontal; ++i) {
@@ -669,15 +736,16 @@ static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **
         struct testcard_state *state;
         state = (struct testcard_state *)arg;
 
+        // wait for an absolute deadline so that the frame rate doesn't drift
         std::chrono::steady_clock::time_point curr_time =
                 std::chrono::steady_clock::now();
-
-        if (std::chrono::duration_cast<std::chrono::duration<double>>(curr_time - state->last_frame_time).count() <
-            1.0 / (double)state->frame->fps) {
-                return NULL;
+        if (curr_time < state->next_frame_time) {
+                std::this_thread::sleep_until(state->next_frame_time);
+        } else if (curr_time - state->next_frame_time > state->frame_duration) {
+                // we are late more than one frame, do not try to catch up with a burst
+                state->next_frame_time = curr_time;
         }
-
-        state->last_frame_time = curr_time;
+        state->next_frame_time += state->frame_duration;
 
         if (state->grab_audio) {
 #ifdef HAVE_LIBSDL_MIXER
@@ -701,6 +769,13 @@ static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **
                 *audio = NULL;
         }
 
+        if (!state->ring.empty()) {
+                vf_get_tile(state->frame, 0)->data = state->ring[state->ring_idx];
+                testcard_stamp_frame(state, state->ring[state->ring_idx], state->ring_frame_count++);
+                state->ring_idx = (state->ring_idx + 1) % state->ring.size();
+                return state->frame;
+        }
+
         if(!state->still_image) {
                 vf_get_tile(state->frame, 0)->data += state->frame_linesize;
         }
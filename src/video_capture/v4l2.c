@@ -69,50 +69,44 @@ static void show_help(void);
 static void print_fps(int fd, struct v4l2_frmivalenum *param);
 
 #define DEFAULT_DEVICE "/dev/video0"
+#define MOD_NAME "[V4L2 capture] "
 
 #define DEFAULT_BUF_COUNT 2
 #define MAX_BUF_COUNT 30
 
+struct vidcap_v4l2_state;
+
+struct v4l2_capture_buffer {
+        struct vidcap_v4l2_state *s;
+        void *start;
+        size_t length;
+        struct v4l2_buffer buf; ///< as dequeued, valid while lent out in a frame
+};
+
 struct vidcap_v4l2_state {
         struct video_desc desc;
 
         int fd;
-        struct {
-                void *start;
-                size_t length;
-        } buffers[MAX_BUF_COUNT];
+        enum v4l2_memory memory;
+        struct v4l2_capture_buffer buffers[MAX_BUF_COUNT];
 
-        bool conversion_needed;
         struct v4lconvert_data *convert;
         struct v4l2_format src_fmt, dst_fmt;
+        /// native format with padded lines - lines are repacked instead of converting
+        int src_linesize;
+        struct simple_linked_list *conv_buffers; ///< recycled buffers for converted frames
+        int conv_frames;                         ///< converted frames lent out
 
         struct timeval t0;
         int frames;
 
         int buffer_count;
 
-        struct simple_linked_list *buffers_to_enqueue;
         int dequeued_buffers;
         pthread_mutex_t lock;
         pthread_cond_t cv;
 };
 
-struct v4l2_dispose_deq_buffer_data {
-        struct vidcap_v4l2_state *s;
-        struct v4l2_buffer buf;
-};
-
-static void enqueue_all_finished_frames(struct vidcap_v4l2_state *s) {
-        struct v4l2_dispose_deq_buffer_data *dequeue_data;
-        while ((dequeue_data = simple_linked_list_pop(s->buffers_to_enqueue)) != NULL) {
-                s->dequeued_buffers -= 1;
-                if (ioctl(s->fd, VIDIOC_QBUF, &dequeue_data->buf) != 0) {
-                        perror("Unable to enqueue buffer");
-                }
-                free(dequeue_data);
-        }
-}
-
 static void vidcap_v4l2_common_cleanup(struct vidcap_v4l2_state *s) {
         if (!s) {
                 return;
@@ -124,20 +118,33 @@ static void vidcap_v4l2_common_cleanup(struct vidcap_v4l2_state *s) {
         };
 
         pthread_mutex_lock(&s->lock);
-        enqueue_all_finished_frames(s);
-        while (s->dequeued_buffers != 0) {
+        while (s->dequeued_buffers != 0 || s->conv_frames != 0) {
                 pthread_cond_wait(&s->cv, &s->lock);
-                enqueue_all_finished_frames(s);
         }
         pthread_mutex_unlock(&s->lock);
 
         pthread_cond_destroy(&s->cv);
         pthread_mutex_destroy(&s->lock);
-        simple_linked_list_destroy(s->buffers_to_enqueue);
+        void *conv_buffer;
+        while ((conv_buffer = simple_linked_list_pop(s->conv_buffers)) != NULL) {
+                free(conv_buffer);
+        }
+        simple_linked_list_destroy(s->conv_buffers);
 
         if (s->fd != -1)
                 close(s->fd);
 
+        for (int i = 0; i < MAX_BUF_COUNT; ++i) {
+                if (s->buffers[i].start == NULL) {
+                        continue;
+                }
+                if (s->memory == V4L2_MEMORY_MMAP) {
+                        munmap(s->buffers[i].start, s->buffers[i].length);
+                } else {
+                        free(s->buffers[i].start);
+                }
+        }
+
         if (s->convert) {
                 v4lconvert_destroy(s->convert);
         }
@@ -189,12 +196,13 @@ static void show_help()
 {
         printf("V4L2 capture\n");
         printf("Usage\n");
-        printf("\t-t v4l2[:device=<dev>][:codec=<pixel_fmt>][:size=<width>x<height>][:tpf=<tpf>|:fps=<fps>][:buffers=<bufcnt>][:RGB]\n");
+        printf("\t-t v4l2[:device=<dev>][:codec=<pixel_fmt>][:size=<width>x<height>][:tpf=<tpf>|:fps=<fps>][:buffers=<bufcnt>][:RGB][:userptr]\n");
         printf("\t\tuse device <dev> for grab (default: %s)\n", DEFAULT_DEVICE);
         printf("\t\t<tpf> - time per frame in format <numerator>/<denominator>\n");
         printf("\t\t<bufcnt> - number of capture buffers to be used (default: %d)\n", DEFAULT_BUF_COUNT);
         printf("\t\t<tpf> or <fps> should be given as a single integer or a fraction\n");
         printf("\t\tRGB - forces conversion to RGB (may be useful eg. to convert captured MJPG from USB 2.0 webcam to HEVC)\n");
+        printf("\t\tuserptr - let the driver capture to buffers allocated by UltraGrid instead of mapped driver buffers\n");
         printf("\n");
 
         for (int i = 0; i < 64; ++i) {
@@ -442,6 +450,7 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                  denominator = 0;
         bool conversion_needed = false;
         bool force_convert = false;
+        bool use_userptr = false;
 
         printf("vidcap_v4l2_init\n");
 
@@ -462,7 +471,7 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
         }
         s->buffer_count = DEFAULT_BUF_COUNT;
         s->fd = -1;
-        s->buffers_to_enqueue = simple_linked_list_init();
+        s->conv_buffers = simple_linked_list_init();
         pthread_mutex_init(&s->lock, NULL);
         pthread_cond_init(&s->cv, NULL);
 
@@ -516,6 +525,8 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                                 assert (s->buffer_count <= MAX_BUF_COUNT);
                         } else if (strcasecmp(item, "RGB") == 0) {
                                 force_convert = true;
+                        } else if (strcmp(item, "userptr") == 0) {
+                                use_userptr = true;
                         } else {
                                 fprintf(stderr, "[V4L2] Invalid configuration argument: %s\n",
                                                 item);
@@ -631,6 +642,9 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                 case V4L2_PIX_FMT_RGB24:
                         s->desc.color_spec = RGB;
                         break;
+                case V4L2_PIX_FMT_BGR24:
+                        s->desc.color_spec = BGR;
+                        break;
                 case V4L2_PIX_FMT_RGB32:
                         s->desc.color_spec = RGBA;
                         break;
@@ -640,6 +654,28 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                 case V4L2_PIX_FMT_H264:
                         s->desc.color_spec = H264;
                         break;
+#ifdef V4L2_PIX_FMT_HEVC
+                case V4L2_PIX_FMT_HEVC:
+                        s->desc.color_spec = H265;
+                        break;
+#endif
+                case V4L2_PIX_FMT_YUV420:
+                        if (fmt.fmt.pix.bytesperline == fmt.fmt.pix.width) {
+                                s->desc.color_spec = I420;
+                                break;
+                        }
+                        // padded planes - convert
+                        conversion_needed = true;
+                        s->dst_fmt.fmt.pix.pixelformat =  V4L2_PIX_FMT_RGB24;
+                        s->desc.color_spec = RGB;
+                        break;
+                case V4L2_PIX_FMT_NV12:
+                case V4L2_PIX_FMT_YVU420:
+                        // keep 4:2:0 instead of expanding to RGB
+                        conversion_needed = true;
+                        s->dst_fmt.fmt.pix.pixelformat =  V4L2_PIX_FMT_YUV420;
+                        s->desc.color_spec = I420;
+                        break;
                 default:
                         conversion_needed = true;
                         s->dst_fmt.fmt.pix.pixelformat =  V4L2_PIX_FMT_RGB24;
@@ -682,18 +718,33 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
 
         if (conversion_needed) {
                 s->convert = v4lconvert_create(s->fd);
+                s->dst_fmt.fmt.pix.bytesperline = s->desc.color_spec == I420 ? (int) s->desc.width :
+                        vc_get_linesize(s->desc.width, s->desc.color_spec);
+                s->dst_fmt.fmt.pix.sizeimage = vc_get_datalen(s->desc.width, s->desc.height, s->desc.color_spec);
         } else {
                 s->convert = NULL;
+                if (!is_codec_opaque(s->desc.color_spec) && !codec_is_planar(s->desc.color_spec) &&
+                                (int) fmt.fmt.pix.bytesperline > vc_get_linesize(s->desc.width, s->desc.color_spec)) {
+                        s->src_linesize = fmt.fmt.pix.bytesperline;
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Lines are padded to %d B, repacking.\n", s->src_linesize);
+                }
         }
 
         struct v4l2_requestbuffers reqbuf;
 
         memset(&reqbuf, 0, sizeof(reqbuf));
         reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        reqbuf.memory = V4L2_MEMORY_MMAP;
+        reqbuf.memory = s->memory = use_userptr ? V4L2_MEMORY_USERPTR : V4L2_MEMORY_MMAP;
         reqbuf.count = s->buffer_count;
 
-        if (ioctl (s->fd, VIDIOC_REQBUFS, &reqbuf) != 0) {
+        int ret = ioctl (s->fd, VIDIOC_REQBUFS, &reqbuf);
+        if (ret != 0 && errno == EINVAL && s->memory == V4L2_MEMORY_USERPTR) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "User pointer streaming is not supported, using mmap.\n");
+                reqbuf.memory = s->memory = V4L2_MEMORY_MMAP;
+                reqbuf.count = s->buffer_count;
+                ret = ioctl (s->fd, VIDIOC_REQBUFS, &reqbuf);
+        }
+        if (ret != 0) {
                 if (errno == EINVAL)
                         printf("Video capturing or mmap-streaming is not supported\n");
                 else
@@ -707,31 +758,49 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                 printf("Not enough buffer memory\n");
                 goto error;
         }
+        if (reqbuf.count > MAX_BUF_COUNT) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Driver allocated %u buffers, max %d supported!\n", reqbuf.count, MAX_BUF_COUNT);
+                goto error;
+        }
+        s->buffer_count = reqbuf.count;
 
+        long page_size = sysconf(_SC_PAGESIZE);
         for (unsigned int i = 0; i < reqbuf.count; i++) {
                 struct v4l2_buffer buf;
                 memset(&buf, 0, sizeof(buf));
                 buf.type = reqbuf.type;
-                buf.memory = V4L2_MEMORY_MMAP;
+                buf.memory = s->memory;
                 buf.index = i;
+                s->buffers[i].s = s;
 
-                if (-1 == ioctl (s->fd, VIDIOC_QUERYBUF, &buf)) {
-                        perror("VIDIOC_QUERYBUF");
-                        goto error;
-                }
+                if (s->memory == V4L2_MEMORY_USERPTR) {
+                        size_t length = (fmt.fmt.pix.sizeimage + page_size - 1) / page_size * page_size;
+                        if (posix_memalign(&s->buffers[i].start, page_size, length) != 0) {
+                                s->buffers[i].start = NULL;
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to allocate buffer!\n");
+                                goto error;
+                        }
+                        s->buffers[i].length = length;
+                        buf.m.userptr = (unsigned long) s->buffers[i].start;
+                        buf.length = length;
+                } else {
+                        if (-1 == ioctl (s->fd, VIDIOC_QUERYBUF, &buf)) {
+                                perror("VIDIOC_QUERYBUF");
+                                goto error;
+                        }
 
-                s->buffers[i].length = buf.length; /* remember for munmap() */
+                        s->buffers[i].length = buf.length; /* remember for munmap() */
 
-                s->buffers[i].start = mmap(NULL, buf.length,
-                                PROT_READ | PROT_WRITE, /* recommended */
-                                MAP_SHARED,             /* recommended */
-                                s->fd, buf.m.offset);
+                        s->buffers[i].start = mmap(NULL, buf.length,
+                                        PROT_READ | PROT_WRITE, /* recommended */
+                                        MAP_SHARED,             /* recommended */
+                                        s->fd, buf.m.offset);
 
-                if (MAP_FAILED == s->buffers[i].start) {
-                        /* If you do not exit here you should unmap() and free()
-                           the buffers mapped so far. */
-                        perror("mmap");
-                        goto error;
+                        if (MAP_FAILED == s->buffers[i].start) {
+                                s->buffers[i].start = NULL;
+                                perror("mmap");
+                                goto error;
+                        }
                 }
 
                 buf.flags = 0;
@@ -772,18 +841,30 @@ static void vidcap_v4l2_done(void *state)
         vidcap_v4l2_common_cleanup(s);
 }
 
+/// returns the driver buffer back to the capture queue
 static void vidcap_v4l2_dispose_video_frame(struct video_frame *frame) {
-        struct v4l2_dispose_deq_buffer_data *data =
-                (struct v4l2_dispose_deq_buffer_data *) frame->callbacks.dispose_udata;
-
-        if (data) {
-                pthread_mutex_lock(&data->s->lock);
-                simple_linked_list_append(data->s->buffers_to_enqueue, data);
-                pthread_mutex_unlock(&data->s->lock);
-                pthread_cond_signal(&data->s->cv);
-        } else {
-                free(frame->tiles[0].data);
+        struct v4l2_capture_buffer *b = frame->callbacks.dispose_udata;
+        struct vidcap_v4l2_state *s = b->s;
+
+        pthread_mutex_lock(&s->lock);
+        if (ioctl(s->fd, VIDIOC_QBUF, &b->buf) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to enqueue buffer: %s\n", strerror(errno));
         }
+        s->dequeued_buffers -= 1;
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->cv);
+
+        vf_free(frame);
+}
+
+static void vidcap_v4l2_dispose_converted_frame(struct video_frame *frame) {
+        struct vidcap_v4l2_state *s = frame->callbacks.dispose_udata;
+
+        pthread_mutex_lock(&s->lock);
+        simple_linked_list_append(s->conv_buffers, frame->tiles[0].data);
+        s->conv_frames -= 1;
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->cv);
 
         vf_free(frame);
 }
@@ -794,10 +875,8 @@ static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **a
         struct video_frame *out;
 
         pthread_mutex_lock(&s->lock);
-        enqueue_all_finished_frames(s);
         while (s->dequeued_buffers == s->buffer_count) { // we cannot dequeue any buffer
                 pthread_cond_wait(&s->cv, &s->lock);
-                enqueue_all_finished_frames(s);
         }
         pthread_mutex_unlock(&s->lock);
 
@@ -806,43 +885,61 @@ static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **a
         struct v4l2_buffer buf;
         memset(&buf, 0, sizeof(buf));
         buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
+        buf.memory = s->memory;
 
         if(ioctl(s->fd, VIDIOC_DQBUF, &buf) != 0) {
                 perror("Unable to dequeue buffer");
                 return NULL;
         };
 
+        pthread_mutex_lock(&s->lock);
         s->dequeued_buffers += 1;
+        pthread_mutex_unlock(&s->lock);
 
+        struct v4l2_capture_buffer *b = &s->buffers[buf.index];
         out = vf_alloc_desc(s->desc);
-        out->callbacks.dispose = vidcap_v4l2_dispose_video_frame;
-
-        if (!s->convert) {
-                struct v4l2_dispose_deq_buffer_data *frame_data =
-                        malloc(sizeof(struct v4l2_dispose_deq_buffer_data));
-                frame_data->s = s;
-                memcpy(&frame_data->buf, &buf, sizeof(buf));
-                out->tiles[0].data = s->buffers[frame_data->buf.index].start;
-                out->tiles[0].data_len = frame_data->buf.bytesused;
-                out->callbacks.dispose_udata = frame_data;
+
+        if (!s->convert && s->src_linesize == 0) { // zero-copy
+                b->buf = buf;
+                out->tiles[0].data = b->start;
+                out->tiles[0].data_len = buf.bytesused;
+                out->callbacks.dispose = vidcap_v4l2_dispose_video_frame;
+                out->callbacks.dispose_udata = b;
         } else {
-                out->callbacks.dispose_udata = NULL;
-                out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
-                int ret = v4lconvert_convert(s->convert,
-                                &s->src_fmt,  /*  in */
-                                &s->dst_fmt, /*  in */
-                                s->buffers[buf.index].start,
-                                buf.bytesused,
-                                (unsigned char *) out->tiles[0].data,
-                                out->tiles[0].data_len);
+                pthread_mutex_lock(&s->lock);
+                out->tiles[0].data = simple_linked_list_pop(s->conv_buffers);
+                s->conv_frames += 1;
+                pthread_mutex_unlock(&s->lock);
+                if (out->tiles[0].data == NULL) {
+                        out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
+                }
+                out->callbacks.dispose = vidcap_v4l2_dispose_converted_frame;
+                out->callbacks.dispose_udata = s;
+
+                int ret = out->tiles[0].data_len;
+                if (s->convert) {
+                        ret = v4lconvert_convert(s->convert,
+                                        &s->src_fmt,  /*  in */
+                                        &s->dst_fmt, /*  in */
+                                        b->start,
+                                        buf.bytesused,
+                                        (unsigned char *) out->tiles[0].data,
+                                        out->tiles[0].data_len);
+                } else { // strip line padding
+                        int linesize = vc_get_linesize(s->desc.width, s->desc.color_spec);
+                        for (unsigned int y = 0; y < s->desc.height; ++y) {
+                                memcpy(out->tiles[0].data + y * linesize,
+                                                (char *) b->start + y * s->src_linesize, linesize);
+                        }
+                }
 
                 // we do not need the driver buffer any more
+                pthread_mutex_lock(&s->lock);
                 if (ioctl(s->fd, VIDIOC_QBUF, &buf) != 0) {
-                        log_msg(LOG_LEVEL_ERROR, "[V4L2 capture] Unable to enqueue buffer: %s\n", strerror(errno));
-                } else {
-                        s->dequeued_buffers -= 1;
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to enqueue buffer: %s\n", strerror(errno));
                 }
+                s->dequeued_buffers -= 1;
+                pthread_mutex_unlock(&s->lock);
 
                 if(ret == -1) {
                         fprintf(stderr, "Error converting video.\n");
@@ -860,7 +957,7 @@ static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **a
         double seconds = tv_diff(t, s->t0);
         if (seconds >= 5) {
                 float fps  = s->frames / seconds;
-                log_msg(LOG_LEVEL_INFO, "[V4L2 capture] %d frames in %g seconds = %g FPS\n", s->frames, seconds, fps);
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "%d frames in %g seconds = %g FPS\n", s->frames, seconds, fps);
                 s->t0 = t;
                 s->frames = 0;
         }
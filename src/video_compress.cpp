@@ -43,6 +43,7 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <atomic>
 #include <cinttypes>
 #include <memory>
 #include <stdio.h>
@@ -54,6 +55,7 @@
 #include "compat/platform_time.h"
 #include "messaging.h"
 #include "module.h"
+#include "utils/metrics.h"
 #include "utils/synchronized_queue.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
@@ -103,6 +105,10 @@ struct compress_state {
         struct module mod;               ///< compress module data
         struct compress_state_real *ptr; ///< pointer to real compress state
         synchronized_queue<shared_ptr<video_frame>, 1> queue;
+
+        struct metric *compressed_frames = nullptr;
+        struct metric *compressed_bytes = nullptr;
+        struct metric *compress_time = nullptr;
 };
 
 /**
@@ -216,6 +222,12 @@ int compress_init(struct module *parent, const char *config_string, struct compr
 
         module_register(&proxy->mod, parent);
 
+        static atomic<int> compress_idx{0};
+        string labels = "compress=\"" + to_string(compress_idx++) + "\"";
+        proxy->compressed_frames = metric_register_counter("ug_video_compress_frames_total", "Compressed video frames", labels.c_str());
+        proxy->compressed_bytes = metric_register_counter("ug_video_compress_bytes_total", "Compressed video data size", labels.c_str());
+        proxy->compress_time = metric_register_histogram("ug_video_compress_seconds", "Video frame compression latency (millisecond precision)", labels.c_str(), nullptr, 0);
+
         *state = proxy;
         return 0;
 }
@@ -495,6 +507,9 @@ static void compress_done(struct module *mod)
         struct compress_state_real *s = proxy->ptr;
         delete s;
 
+        metric_unregister(proxy->compressed_frames);
+        metric_unregister(proxy->compressed_bytes);
+        metric_unregister(proxy->compress_time);
         delete proxy;
 }
 
@@ -566,6 +581,9 @@ void compress_state_real::async_consumer(struct compress_state *s)
         set_thread_name(__func__);
         while (true) {
                 auto frame = funcs->compress_frame_async_pop_func(state[0]);
+                if (frame) {
+                        frame->compress_end = time_since_epoch_in_ms();
+                }
                 if (!discard_frames) {
                         s->queue.push(frame);
 
@@ -588,6 +606,11 @@ shared_ptr<video_frame> compress_pop(struct compress_state *proxy)
         auto f = proxy->queue.pop();
         if (f) {
                 log_msg(LOG_LEVEL_DEBUG, "Compressed frame size: %8u; duration: %3" PRIu64 " ms\n", vf_get_data_len(f.get()), f->compress_end - f->compress_start);
+                metric_inc(proxy->compressed_frames);
+                metric_add(proxy->compressed_bytes, vf_get_data_len(f.get()));
+                if (f->compress_end >= f->compress_start) {
+                        metric_observe(proxy->compress_time, (f->compress_end - f->compress_start) / 1000.0);
+                }
         }
         return f;
 }
@@ -254,6 +254,8 @@ struct video_frame *display_get_frame(struct display *d)
  *
  * @param d        display to be putted frame to
  * @param frame    frame that has been obtained from display_get_frame() and has not yet been put.
+ *                 If display_accepts_external_frames() returns true, it can
+ *                 also be any other frame with video_frame::callbacks::dispose set.
  *                 Should not be NULL unless we want to quit display mainloop.
  * @param flags specifies blocking behavior (@ref display_put_frame_flags)
  * @retval      0  if displayed succesfully
@@ -426,6 +428,9 @@ int display_get_property(struct display *d, int property, void *val, size_t *len
                                 }
                         }
 			break;
+                case DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES:
+                        // postprocessor writes to its own buffers
+                        return FALSE;
                 default:
                         return d->funcs->get_property(d->state, property, val, len);
                 }
@@ -434,6 +439,22 @@ int display_get_property(struct display *d, int property, void *val, size_t *len
         }
 }
 
+/**
+ * @brief Checks whether display can take frames not allocated by its getf.
+ *
+ * Such displays can be passed shared read-only frames (see vf_share()) instead
+ * of copying the data into the display buffer.
+ */
+bool display_accepts_external_frames(struct display *d)
+{
+        bool val = false;
+        size_t len = sizeof val;
+        if (!display_get_property(d, DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES, &val, &len)) {
+                return false;
+        }
+        return val;
+}
+
 /**
  * @brief Puts audio data.
  * @param d     video display
@@ -125,6 +125,8 @@ enum display_property {
         DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES = 5, ///< whether display supports receiving data from - returns (struct multi_sources_supp_info *)
                                                      ///< multiple network sources concurrently
         DISPLAY_PROPERTY_AUDIO_FORMAT = 6, ///< @see audio_display_info::query_format - in/out parameter is struct audio_desc
+        DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES = 7, ///< whether display accepts frames not obtained with its getf - bool
+                                                      ///< (the frame is then disposed with video_frame::callbacks::dispose)
 };
 
 #define PITCH_DEFAULT -1 ///< default pitch, i. e. respective linesize
@@ -178,6 +180,7 @@ enum display_put_frame_flags {
 int 		         display_put_frame(struct display *d, struct video_frame *frame, int flags);
 int                      display_reconfigure(struct display *d, struct video_desc desc, enum video_mode mode);
 int                      display_get_property(struct display *d, int property, void *val, size_t *len);
+bool                     display_accepts_external_frames(struct display *d);
 /**
  * @defgroup display_audio Audio
  * Audio related functions (embedded audio).
@@ -44,6 +44,7 @@
 #include "video.h"
 #include "video_display.h"
 #include "video_codec.h"
+#include "utils/video_frame_pool.h"
 
 #include <cinttypes>
 #include <condition_variable>
@@ -371,9 +372,12 @@ struct state_conference_common {
         struct module *parent = NULL;
 };
 
+typedef video_frame_pool<aligned_data_allocator<>> conference_frame_pool;
+
 struct state_conference {
         shared_ptr<struct state_conference_common> common;
         struct video_desc desc;
+        shared_ptr<conference_frame_pool> pool{make_shared<conference_frame_pool>()};
 };
 
 static struct display *display_conference_fork(void *state)
@@ -593,7 +597,7 @@ static void display_conference_run(void *state)
                 }
                 s->output->updateTile(frame->ssrc);
 
-                vf_free(frame);
+                VIDEO_FRAME_DISPOSE(frame);
 
                 now = chrono::system_clock::now();
 
@@ -628,7 +632,7 @@ static struct video_frame *display_conference_getf(void *state)
 {
         struct state_conference *s = (struct state_conference *)state;
 
-        return vf_alloc_desc_data(s->desc);
+        return video_frame_pool_get_disposable_frame(s->pool);
 }
 
 static int display_conference_putf(void *state, struct video_frame *frame, int flags)
@@ -636,7 +640,7 @@ static int display_conference_putf(void *state, struct video_frame *frame, int f
         shared_ptr<struct state_conference_common> s = ((struct state_conference *)state)->common;
 
         if (flags == PUTF_DISCARD) {
-                vf_free(frame);
+                VIDEO_FRAME_DISPOSE(frame);
         } else {
                 unique_lock<mutex> lg(s->lock);
                 if (s->incoming_queue.size() >= IN_QUEUE_MAX_BUFFER_LEN) {
@@ -644,7 +648,7 @@ static int display_conference_putf(void *state, struct video_frame *frame, int f
                         //vf_free(frame);
                 }
                 if (flags == PUTF_NONBLOCK && s->incoming_queue.size() >= IN_QUEUE_MAX_BUFFER_LEN) {
-                        vf_free(frame);
+                        VIDEO_FRAME_DISPOSE(frame);
                         return 1;
                 }
                 s->in_queue_decremented_cv.wait(lg, [s]{return s->incoming_queue.size() < IN_QUEUE_MAX_BUFFER_LEN;});
@@ -676,6 +680,7 @@ static int display_conference_reconfigure(void *state, struct video_desc desc)
         struct state_conference *s = (struct state_conference *) state;
 
         s->desc = desc;
+        s->pool->reconfigure(desc, vc_get_datalen(desc.width, desc.height, desc.color_spec));
 
         return 1;
 }
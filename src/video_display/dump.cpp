@@ -117,6 +117,9 @@ static int display_dump_putf(void *state, struct video_frame *frame, int)
 
         if (frame) {
                 export_video(s->e, frame);
+                if (frame != s->f) { // shared frame passed from multiplier or proxy
+                        VIDEO_FRAME_DISPOSE(frame);
+                }
         }
 
         return 0;
@@ -143,6 +146,13 @@ static int display_dump_get_property(void *, int property, void *val, size_t *le
                         *(int *) val = DISPLAY_PROPERTY_VIDEO_SEPARATE_TILES;
                         *len = sizeof(int);
                         break;
+                case DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES:
+                        if (sizeof(bool) > *len) {
+                                return FALSE;
+                        }
+                        *(bool *) val = true;
+                        *len = sizeof(bool);
+                        break;
                 default:
                         return FALSE;
         }
@@ -41,6 +41,7 @@
 #include "config_win32.h"
 #include "debug.h"
 #include "lib_common.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_display.h"
 
@@ -166,6 +167,27 @@ static void check_reconf(struct state_multiplier_common *s, struct video_desc de
         }
 }
 
+struct multiplier_copy_data {
+        struct display *real_display;
+        struct video_frame *frame;
+};
+
+/**
+ * Fallback for displays that need the frame in their own buffer, these are
+ * run in parallel for all such displays.
+ */
+static void *display_multiplier_copy_and_put(void *arg)
+{
+        auto data = (struct multiplier_copy_data *) arg;
+        struct video_frame *real_display_frame = display_get_frame(data->real_display);
+        for (unsigned int i = 0; i < data->frame->tile_count; ++i) {
+                memcpy(real_display_frame->tiles[i].data, data->frame->tiles[i].data,
+                                data->frame->tiles[i].data_len);
+        }
+        display_put_frame(data->real_display, real_display_frame, PUTF_BLOCKING);
+        return NULL;
+}
+
 static void display_multiplier_worker(void *state)
 {
         shared_ptr<struct state_multiplier_common> s = ((struct state_multiplier *)state)->common;
@@ -196,13 +218,28 @@ static void display_multiplier_worker(void *state)
 
                 check_reconf(s.get(), video_desc_from_frame(frame));
 
+                vector<struct display *> sharing;
+                vector<struct multiplier_copy_data> copying;
                 for (auto& disp : s->displays) {
-                        struct video_frame *real_display_frame = display_get_frame(disp.real_display);
-                        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
-                        display_put_frame(disp.real_display, real_display_frame, PUTF_BLOCKING);
+                        if (display_accepts_external_frames(disp.real_display)) {
+                                sharing.push_back(disp.real_display);
+                        } else {
+                                copying.push_back({disp.real_display, frame});
+                        }
                 }
 
-                vf_free(frame);
+                // the last reference is held by us until the copies are done
+                vector<struct video_frame *> refs(sharing.size() + 1);
+                vf_share(frame, refs.size(), refs.data());
+                for (unsigned int i = 0; i < sharing.size(); ++i) {
+                        display_put_frame(sharing[i], refs[i], PUTF_BLOCKING);
+                }
+                if (copying.size() > 0) {
+                        task_run_parallel(display_multiplier_copy_and_put, copying.size(),
+                                        copying.data(), sizeof copying[0], NULL);
+                }
+
+                vf_free(refs.back());
         }
 }
 
@@ -287,6 +324,9 @@ static int display_multiplier_get_property(void *state, int property, void *val,
                 return FALSE;
 
         }
+        if (property == DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES) {
+                return FALSE;
+        }
         //TODO Find common properties, for now just return properties of the first display
         return display_get_property(s->displays[0].real_display, property, val, len);
 }
@@ -42,13 +42,19 @@
 #include "debug.h"
 #include "video.h"
 #include "video_display.h"
+#include "utils/video_frame_pool.h"
 
 #include "hd-rum-translator/hd-rum-decompress.h"
 
+#include <memory>
+
+typedef video_frame_pool<aligned_data_allocator<>> pipe_frame_pool;
+
 struct state_pipe {
         struct module *parent;
         frame_recv_delegate *delegate;
         struct video_desc desc;
+        std::shared_ptr<pipe_frame_pool> pool;
 };
 
 static struct display *display_pipe_fork(void *state)
@@ -75,7 +81,7 @@ static void *display_pipe_init(struct module *parent, const char *fmt, unsigned
 
         sscanf(fmt, "%p", &delegate);
 
-        struct state_pipe *s = new state_pipe{parent, delegate, video_desc()};
+        struct state_pipe *s = new state_pipe{parent, delegate, video_desc(), std::make_shared<pipe_frame_pool>()};
 
         return s;
 }
@@ -90,11 +96,9 @@ static struct video_frame *display_pipe_getf(void *state)
 {
         struct state_pipe *s = (struct state_pipe *)state;
 
-        struct video_frame *out = vf_alloc_desc_data(s->desc);
         // explicit dispose is needed because we do not process the frame
         // by ourselves but it is passed to further processing
-        out->callbacks.dispose = vf_free;
-        return out;
+        return video_frame_pool_get_disposable_frame(s->pool);
 }
 
 static int display_pipe_putf(void *state, struct video_frame *frame, int flags)
@@ -103,6 +107,8 @@ static int display_pipe_putf(void *state, struct video_frame *frame, int flags)
 
         if (flags != PUTF_DISCARD) {
                 s->delegate->frame_arrived(frame);
+        } else {
+                VIDEO_FRAME_DISPOSE(frame);
         }
 
         return TRUE;
@@ -159,6 +165,14 @@ static int display_pipe_get_property(void *state, int property, void *val, size_
                         ((struct multi_sources_supp_info *) val)->state = state;
                         *len = sizeof(struct multi_sources_supp_info);
                         break;
+                case DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES:
+                        // frames are passed further and disposed by the receiver
+                        if (sizeof(bool) > *len) {
+                                return FALSE;
+                        }
+                        *(bool *) val = true;
+                        *len = sizeof(bool);
+                        break;
                 default:
                         return FALSE;
         }
@@ -170,6 +184,7 @@ static int display_pipe_reconfigure(void *state, struct video_desc desc)
         struct state_pipe *s = (struct state_pipe *) state;
 
         s->desc = desc;
+        s->pool->reconfigure(desc, vc_get_datalen(desc.width, desc.height, desc.color_spec));
 
         return 1;
 }
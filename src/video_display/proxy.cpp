@@ -72,7 +72,7 @@ struct state_proxy_common {
 
                 for (auto && ssrc_map : frames) {
                         for (auto && frame : ssrc_map.second) {
-                                vf_free(frame);
+                                VIDEO_FRAME_DISPOSE(frame);
                         }
                 }
         }
@@ -169,6 +169,26 @@ static void check_reconf(struct state_proxy_common *s, struct video_desc desc)
         }
 }
 
+/**
+ * Passes the frame to the real display, either directly if it can take
+ * external frames or by copying to its buffer. Frame (either from
+ * display_proxy_getf() or an external one) is consumed.
+ */
+static void display_proxy_put_frame(struct state_proxy_common *s, struct video_frame *frame)
+{
+        if (display_accepts_external_frames(s->real_display)) {
+                frame->ssrc = s->current_ssrc;
+                display_put_frame(s->real_display, frame, PUTF_BLOCKING);
+                return;
+        }
+
+        struct video_frame *real_display_frame = display_get_frame(s->real_display);
+        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
+        VIDEO_FRAME_DISPOSE(frame);
+        real_display_frame->ssrc = s->current_ssrc;
+        display_put_frame(s->real_display, real_display_frame, PUTF_BLOCKING);
+}
+
 static void display_proxy_run(void *state)
 {
         shared_ptr<struct state_proxy_common> s = ((struct state_proxy *)state)->common;
@@ -194,7 +214,7 @@ static void display_proxy_run(void *state)
                 auto it = s->disabled_ssrc.find(frame->ssrc);
                 if (it != s->disabled_ssrc.end()) {
                         it->second = now;
-                        vf_free(frame);
+                        VIDEO_FRAME_DISPOSE(frame);
                         continue;
                 }
 
@@ -216,6 +236,7 @@ static void display_proxy_run(void *state)
                                 skipped = 0;
                         } else {
                                 skipped++;
+                                VIDEO_FRAME_DISPOSE(frame);
                                 continue;
                         }
                 }
@@ -242,12 +263,7 @@ static void display_proxy_run(void *state)
                                         ssrc_list.pop_front();
 
                                         check_reconf(s.get(), video_desc_from_frame(frame));
-
-                                        struct video_frame *real_display_frame = display_get_frame(s->real_display);
-                                        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
-                                        vf_free(frame);
-                                        real_display_frame->ssrc = s->current_ssrc;
-                                        display_put_frame(s->real_display, real_display_frame, PUTF_BLOCKING);
+                                        display_proxy_put_frame(s.get(), frame);
                                 }
                         } else {
                                 auto & old_list = s->frames[s->old_ssrc];
@@ -286,8 +302,8 @@ static void display_proxy_run(void *state)
                                                 fprintf(stderr, "SMOLIK4!\n");
                                                 memcpy(real_display_frame->tiles[0].data, new_frame->tiles[0].data, new_frame->tiles[0].data_len);
                                         }
-                                        vf_free(old_frame);
-                                        vf_free(new_frame);
+                                        VIDEO_FRAME_DISPOSE(old_frame);
+                                        VIDEO_FRAME_DISPOSE(new_frame);
                                         real_display_frame->ssrc = s->current_ssrc;
                                         display_put_frame(s->real_display, real_display_frame, PUTF_BLOCKING);
                                 }
@@ -302,19 +318,14 @@ static void display_proxy_run(void *state)
                                         s->frames[s->current_ssrc].pop_front();
 
                                         check_reconf(s.get(), video_desc_from_frame(frame));
-
-                                        struct video_frame *real_display_frame = display_get_frame(s->real_display);
-                                        memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
-                                        vf_free(frame);
-                                        real_display_frame->ssrc = s->current_ssrc;
-                                        display_put_frame(s->real_display, real_display_frame, PUTF_BLOCKING);
+                                        display_proxy_put_frame(s.get(), frame);
                                 }
                         }
                 }
 
                 if (s->old_ssrc != 0 && s->transition >= TRANSITION_COUNT) {
                         for (auto && frame : s->frames[s->old_ssrc]) {
-                                vf_free(frame);
+                                VIDEO_FRAME_DISPOSE(frame);
                         }
 
                         s->frames.erase(s->old_ssrc);
@@ -338,7 +349,10 @@ static struct video_frame *display_proxy_getf(void *state)
 {
         struct state_proxy *s = (struct state_proxy *)state;
 
-        return vf_alloc_desc_data(s->desc);
+        struct video_frame *out = vf_alloc_desc_data(s->desc);
+        // the frame may be passed directly to the real display
+        out->callbacks.dispose = vf_free;
+        return out;
 }
 
 static int display_proxy_putf(void *state, struct video_frame *frame, int flags)
@@ -346,14 +360,14 @@ static int display_proxy_putf(void *state, struct video_frame *frame, int flags)
         shared_ptr<struct state_proxy_common> s = ((struct state_proxy *)state)->common;
 
         if (flags == PUTF_DISCARD) {
-                vf_free(frame);
+                VIDEO_FRAME_DISPOSE(frame);
         } else {
                 unique_lock<mutex> lg(s->lock);
                 if (s->incoming_queue.size() >= IN_QUEUE_MAX_BUFFER_LEN) {
                         fprintf(stderr, "Proxy: queue full!\n");
                 }
                 if (flags == PUTF_NONBLOCK && s->incoming_queue.size() >= IN_QUEUE_MAX_BUFFER_LEN) {
-                        vf_free(frame);
+                        VIDEO_FRAME_DISPOSE(frame);
                         return 1;
                 }
                 s->in_queue_decremented_cv.wait(lg, [s]{return s->incoming_queue.size() < IN_QUEUE_MAX_BUFFER_LEN;});
@@ -375,6 +389,14 @@ static int display_proxy_get_property(void *state, int property, void *val, size
                 *len = sizeof(struct multi_sources_supp_info);
                 return TRUE;
 
+        } else if (property == DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES) {
+                // frames are held until they are displayed or mixed and then disposed
+                if (sizeof(bool) > *len) {
+                        return FALSE;
+                }
+                *(bool *) val = true;
+                *len = sizeof(bool);
+                return TRUE;
         } else {
                 return display_get_property(s->real_display, property, val, len);
         }
@@ -378,6 +378,43 @@ struct video_frame *vf_get_copy(struct video_frame *original) {
         return frame_copy;
 }
 
+struct vf_shared_data {
+        struct video_frame *orig;
+        int refcount; ///< accessed atomically
+};
+
+static void vf_shared_data_deleter(struct video_frame *ref)
+{
+        struct vf_shared_data *shared = (struct vf_shared_data *) ref->callbacks.dispose_udata;
+        if (__atomic_sub_fetch(&shared->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+                vf_free(shared->orig);
+                free(shared);
+        }
+}
+
+void vf_share(struct video_frame *frame, int count, struct video_frame **refs)
+{
+        assert(count > 0);
+        struct vf_shared_data *shared = (struct vf_shared_data *) malloc(sizeof *shared);
+        shared->orig = frame;
+        shared->refcount = count;
+
+        for (int i = 0; i < count; ++i) {
+                struct video_frame *ref = vf_alloc_desc(video_desc_from_frame(frame));
+                for (unsigned int j = 0; j < frame->tile_count; ++j) {
+                        ref->tiles[j].data = frame->tiles[j].data;
+                        ref->tiles[j].data_len = frame->tiles[j].data_len;
+                }
+                memcpy((char *) ref + offsetof(struct video_frame, VF_METADATA_START),
+                                (char *) frame + offsetof(struct video_frame, VF_METADATA_START),
+                                VF_METADATA_SIZE);
+                ref->callbacks.data_deleter = vf_shared_data_deleter;
+                ref->callbacks.dispose = vf_free;
+                ref->callbacks.dispose_udata = shared;
+                refs[i] = ref;
+        }
+}
+
 bool save_video_frame_as_pnm(struct video_frame *frame, const char *name)
 {
         unsigned char *data = NULL, *tmp_data = NULL;
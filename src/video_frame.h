@@ -134,6 +134,24 @@ struct tile * vf_get_tile(struct video_frame *buf, int pos);
  * Copied data are automatically freeed by vf_free()
  */
 struct video_frame * vf_get_copy(struct video_frame *frame);
+/**
+ * @brief Creates references to video frame sharing its data
+ *
+ * Each of the returned frames holds the description of the original frame and
+ * points to the same tile data. The data are not copied, so the references
+ * must be treated as read-only. The original frame is passed by the caller
+ * and is freed with vf_free() once the last of the references is freed (in
+ * any thread).
+ *
+ * The references have video_frame::callbacks::dispose set to vf_free() so
+ * that they can be passed to displays accepting external frames
+ * (@ref DISPLAY_PROPERTY_ACCEPTS_EXTERNAL_FRAMES).
+ *
+ * @param frame frame to be shared, ownership is passed to the references
+ * @param count number of references to be created (must be positive)
+ * @param[out] refs array of count created references
+ */
+void vf_share(struct video_frame *frame, int count, struct video_frame **refs);
 /**
  * @brief Compares two video descriptions.
  *
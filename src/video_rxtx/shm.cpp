@@ -0,0 +1,748 @@
+/**
+ * @file   video_rxtx/shm.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @todo
+ * * add also audio
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include "video_rxtx/shm.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/futex.h>
+#include <new>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "utils/thread.h"
+#include "video.h"
+#include "video_codec.h"
+#include "video_decompress.h"
+#include "video_display.h"
+#include "video_frame.h"
+
+using std::atomic;
+using std::atomic_thread_fence;
+using std::chrono::milliseconds;
+using std::cout;
+using std::map;
+using std::memory_order_acquire;
+using std::memory_order_relaxed;
+using std::memory_order_release;
+using std::shared_ptr;
+using std::string;
+using std::this_thread::sleep_for;
+using std::vector;
+
+static const char *MODULE_NAME = "[shm] ";
+
+#define SHM_RING_MAGIC 0x48534755u // "UGSH"
+#define SHM_RING_VERSION 1
+#define SHM_MAX_SLOTS 16
+#define SHM_MAX_TILES 16
+#define SHM_PAGE 4096
+
+struct shm_slot {
+        atomic<uint32_t> seq; ///< seqlock, odd while the sender writes the slot
+        uint32_t width;
+        uint32_t height;
+        uint32_t color_spec;
+        uint32_t interlacing;
+        uint32_t tile_count;
+        double fps;
+        uint32_t data_len[SHM_MAX_TILES];
+};
+
+/**
+ * Header of the shared memory, followed by slot data (slot_count * slot_size
+ * bytes) starting at SHM_DATA_OFFSET.
+ */
+struct shm_ring {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slot_count;
+        atomic<uint32_t> layout;    ///< seqlock over slot_size, odd while resizing
+        atomic<uint64_t> slot_size; ///< data bytes per slot
+        atomic<uint32_t> published; ///< count of published frames (futex word)
+        atomic<uint32_t> waiters;   ///< receivers sleeping on published
+        struct shm_slot slots[SHM_MAX_SLOTS];
+};
+
+static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t) && ATOMIC_INT_LOCK_FREE == 2,
+                "futex requires plain lock-free 32-bit atomics");
+
+static const size_t SHM_DATA_OFFSET = (sizeof(struct shm_ring) + SHM_PAGE - 1) / SHM_PAGE * SHM_PAGE;
+
+static char *slot_data(struct shm_ring *ring, unsigned int idx, size_t slot_size)
+{
+        return reinterpret_cast<char *>(ring) + SHM_DATA_OFFSET + idx * slot_size;
+}
+
+/**
+ * Fills address in abstract UNIX socket namespace (no filesystem entry,
+ * released automatically with the sender).
+ */
+static socklen_t get_socket_addr(struct sockaddr_un *addr, string const &name)
+{
+        memset(addr, 0, sizeof *addr);
+        addr->sun_family = AF_UNIX;
+        string path = "ultragrid-shm-" + name;
+        size_t len = std::min(path.size(), sizeof addr->sun_path - 1);
+        memcpy(addr->sun_path + 1, path.data(), len);
+        return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+static void show_help()
+{
+        cout << "Usage:\n\tuv --video-protocol shm[:name=<name>][:slots=<n>]\n";
+        cout << "\t\t<name>  - channel name shared by the sender and receivers (default \"ultragrid\")\n";
+        cout << "\t\t<n>     - number of frames in the ring, sender only (2-" << SHM_MAX_SLOTS << ", default 4)\n";
+        cout << "\nExample:\n\tuv -t testcard --video-protocol shm:name=cam1\n\tuv -d gl --video-protocol shm:name=cam1\n";
+}
+
+shm_video_rxtx::shm_video_rxtx(map<string, param_u> const &params)
+        : video_rxtx(params), m_name("ultragrid")
+{
+        m_display_device = static_cast<struct display *>(params.at("display_device").ptr);
+
+        char *tmp = strdup(params.at("opts").str);
+        char *save_ptr = nullptr;
+        char *item = nullptr;
+        char *opts = tmp;
+        bool ok = true;
+        while ((item = strtok_r(opts, ":", &save_ptr)) != nullptr) {
+                opts = nullptr;
+                if (strcmp(item, "help") == 0) {
+                        show_help();
+                        free(tmp);
+                        throw 0;
+                } else if (strncmp(item, "name=", strlen("name=")) == 0) {
+                        m_name = item + strlen("name=");
+                } else if (strncmp(item, "slots=", strlen("slots=")) == 0) {
+                        m_slot_count = atoi(item + strlen("slots="));
+                        if (m_slot_count < 2 || m_slot_count > SHM_MAX_SLOTS) {
+                                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "Slot count must be in range 2-" << SHM_MAX_SLOTS << "\n";
+                                ok = false;
+                        }
+                } else {
+                        LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "Unknown option: " << item << "\n";
+                        ok = false;
+                }
+        }
+        free(tmp);
+        if (!ok) {
+                throw string("Wrong shm options");
+        }
+
+        if ((m_rxtx_mode & MODE_SENDER) != 0 && !init_sender()) {
+                cleanup_sender();
+                throw string("Unable to initialize shared memory sender");
+        }
+}
+
+shm_video_rxtx::~shm_video_rxtx()
+{
+        cleanup_sender();
+        disconnect_sender();
+        cleanup_decoder();
+}
+
+bool shm_video_rxtx::init_sender()
+{
+        m_memfd = memfd_create(("ultragrid-shm-" + m_name).c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (m_memfd == -1) {
+                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "memfd_create: " << strerror(errno) << "\n";
+                return false;
+        }
+        // receivers' mappings must stay valid
+        if (ftruncate(m_memfd, SHM_DATA_OFFSET) == -1 || fcntl(m_memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) == -1) {
+                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "Cannot set up memfd: " << strerror(errno) << "\n";
+                return false;
+        }
+        void *addr = mmap(nullptr, SHM_DATA_OFFSET, PROT_READ | PROT_WRITE, MAP_SHARED, m_memfd, 0);
+        if (addr == MAP_FAILED) {
+                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "mmap: " << strerror(errno) << "\n";
+                return false;
+        }
+        m_map_len = SHM_DATA_OFFSET;
+        m_slot_size = 0;
+        m_ring = new (addr) shm_ring;
+        m_ring->magic = SHM_RING_MAGIC;
+        m_ring->version = SHM_RING_VERSION;
+        m_ring->slot_count = m_slot_count;
+        m_ring->layout.store(0);
+        m_ring->slot_size.store(0);
+        m_ring->published.store(0);
+        m_ring->waiters.store(0);
+        for (auto &slot : m_ring->slots) {
+                slot.seq.store(0);
+        }
+
+        m_listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        struct sockaddr_un sun;
+        socklen_t sun_len = get_socket_addr(&sun, m_name);
+        if (m_listen_fd == -1 || bind(m_listen_fd, reinterpret_cast<struct sockaddr *>(&sun), sun_len) == -1 ||
+                        listen(m_listen_fd, 8) == -1) {
+                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "Cannot listen on \"" << m_name << "\": " << strerror(errno) <<
+                        (errno == EADDRINUSE ? " (another sender with the same name running?)" : "") << "\n";
+                return false;
+        }
+        m_listener = std::thread(&shm_video_rxtx::listener_loop, this);
+
+        LOG(LOG_LEVEL_NOTICE) << MODULE_NAME << "Publishing frames as \"" << m_name << "\".\n";
+        return true;
+}
+
+void shm_video_rxtx::cleanup_sender()
+{
+        m_exit_listener = true;
+        if (m_listener.joinable()) {
+                m_listener.join();
+        }
+        for (int fd : m_clients) {
+                close(fd);
+        }
+        m_clients.clear();
+        if (m_listen_fd != -1) {
+                close(m_listen_fd);
+                m_listen_fd = -1;
+        }
+        if (m_ring) {
+                munmap(m_ring, m_map_len);
+                m_ring = nullptr;
+        }
+        if (m_memfd != -1) {
+                close(m_memfd);
+                m_memfd = -1;
+        }
+}
+
+/**
+ * Passes the memfd to connecting receivers.
+ */
+void shm_video_rxtx::listener_loop()
+{
+        set_thread_name("shm_listener");
+        while (!m_exit_listener) {
+                struct pollfd pfd = { m_listen_fd, POLLIN, 0 };
+                if (poll(&pfd, 1, 100) <= 0) {
+                        continue;
+                }
+                int fd = accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd == -1) {
+                        continue;
+                }
+                // abstract socket has no permissions, receivers get writable memory
+                struct ucred cred{};
+                socklen_t cred_len = sizeof cred;
+                if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1 || cred.uid != geteuid()) {
+                        LOG(LOG_LEVEL_WARNING) << MODULE_NAME << "Rejecting receiver of other user (PID " << cred.pid << ").\n";
+                        close(fd);
+                        continue;
+                }
+
+                // drop receivers that have already gone
+                m_clients.erase(std::remove_if(m_clients.begin(), m_clients.end(), [](int client) {
+                                        struct pollfd pfd = { client, POLLIN, 0 };
+                                        if (poll(&pfd, 1, 0) == 0) {
+                                                return false;
+                                        }
+                                        close(client);
+                                        return true;
+                                        }), m_clients.end());
+
+                char c = 0;
+                struct iovec iov = { &c, 1 };
+                char ctrl[CMSG_SPACE(sizeof(int))];
+                memset(ctrl, 0, sizeof ctrl);
+                struct msghdr msg{};
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+                msg.msg_control = ctrl;
+                msg.msg_controllen = sizeof ctrl;
+                struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_RIGHTS;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+                memcpy(CMSG_DATA(cmsg), &m_memfd, sizeof(int));
+                if (sendmsg(fd, &msg, MSG_NOSIGNAL) == -1) {
+                        LOG(LOG_LEVEL_WARNING) << MODULE_NAME << "Cannot pass memory to receiver: " << strerror(errno) << "\n";
+                        close(fd);
+                        continue;
+                }
+                LOG(LOG_LEVEL_INFO) << MODULE_NAME << "Receiver connected.\n";
+                m_clients.push_back(fd);
+        }
+}
+
+/**
+ * Grows slots to hold data_len bytes. Receivers keep their (smaller) mapping
+ * valid because the memfd is never shrunk, they detect the change by layout.
+ */
+bool shm_video_rxtx::ensure_capacity(size_t data_len)
+{
+        if (data_len <= m_slot_size) {
+                return true;
+        }
+        // some headroom for compressed streams
+        size_t slot_size = (data_len + data_len / 4 + SHM_PAGE - 1) / SHM_PAGE * SHM_PAGE;
+        size_t map_len = SHM_DATA_OFFSET + m_slot_count * slot_size;
+
+        m_ring->layout.fetch_add(1);
+        if (ftruncate(m_memfd, map_len) == -1) {
+                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "ftruncate: " << strerror(errno) << "\n";
+                m_ring->layout.fetch_add(1);
+                return false;
+        }
+        void *addr = mremap(m_ring, m_map_len, map_len, MREMAP_MAYMOVE);
+        if (addr == MAP_FAILED) {
+                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "mremap: " << strerror(errno) << "\n";
+                m_ring->layout.fetch_add(1);
+                return false;
+        }
+        m_ring = static_cast<struct shm_ring *>(addr);
+        m_map_len = map_len;
+        m_slot_size = slot_size;
+        m_ring->slot_size.store(slot_size);
+        m_ring->layout.fetch_add(1);
+        LOG(LOG_LEVEL_VERBOSE) << MODULE_NAME << "Slot size set to " << slot_size << " B.\n";
+        return true;
+}
+
+void shm_video_rxtx::send_frame(shared_ptr<video_frame> f)
+{
+        if (!m_ring) {
+                return;
+        }
+        if (f->tile_count > SHM_MAX_TILES) {
+                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "Max " << SHM_MAX_TILES << " tiles supported!\n";
+                return;
+        }
+        size_t data_len = 0;
+        for (unsigned int i = 0; i < f->tile_count; ++i) {
+                data_len += f->tiles[i].data_len;
+        }
+        if (!ensure_capacity(data_len)) {
+                return;
+        }
+
+        uint32_t frame_idx = m_ring->published.load(memory_order_relaxed);
+        unsigned int idx = frame_idx % m_slot_count;
+        struct shm_slot *slot = &m_ring->slots[idx];
+        uint32_t seq = slot->seq.load(memory_order_relaxed);
+        slot->seq.store(seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+
+        slot->width = f->tiles[0].width;
+        slot->height = f->tiles[0].height;
+        slot->color_spec = f->color_spec;
+        slot->interlacing = f->interlacing;
+        slot->tile_count = f->tile_count;
+        slot->fps = f->fps;
+        char *dst = slot_data(m_ring, idx, m_slot_size);
+        for (unsigned int i = 0; i < f->tile_count; ++i) {
+                slot->data_len[i] = f->tiles[i].data_len;
+                memcpy(dst, f->tiles[i].data, f->tiles[i].data_len);
+                dst += f->tiles[i].data_len;
+        }
+
+        slot->seq.store(seq + 2, memory_order_release);
+        // sequentially consistent so that waiters is not read before the store
+        m_ring->published.store(frame_idx + 1);
+        if (m_ring->waiters.load() > 0) {
+                syscall(SYS_futex, &m_ring->published, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        }
+}
+
+bool shm_video_rxtx::connect_sender()
+{
+        int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (sock == -1) {
+                return false;
+        }
+        struct sockaddr_un sun;
+        socklen_t sun_len = get_socket_addr(&sun, m_name);
+        if (connect(sock, reinterpret_cast<struct sockaddr *>(&sun), sun_len) == -1) {
+                close(sock);
+                return false;
+        }
+
+        char c;
+        struct iovec iov = { &c, 1 };
+        char ctrl[CMSG_SPACE(sizeof(int))];
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof ctrl;
+        struct cmsghdr *cmsg = nullptr;
+        if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) <= 0 || (cmsg = CMSG_FIRSTHDR(&msg)) == nullptr ||
+                        cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                close(sock);
+                return false;
+        }
+        int memfd;
+        memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+
+        // mremap() is used later to follow growing slots so the fd itself is not needed
+        // writable because of the waiters counter
+        void *addr = mmap(nullptr, SHM_DATA_OFFSET, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        close(memfd);
+        if (addr == MAP_FAILED) {
+                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "mmap: " << strerror(errno) << "\n";
+                close(sock);
+                return false;
+        }
+        auto ring = static_cast<struct shm_ring *>(addr);
+        if (ring->magic != SHM_RING_MAGIC || ring->version != SHM_RING_VERSION ||
+                        ring->slot_count < 2 || ring->slot_count > SHM_MAX_SLOTS) {
+                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "Incompatible sender!\n";
+                munmap(addr, SHM_DATA_OFFSET);
+                close(sock);
+                return false;
+        }
+        m_rx_ring = ring;
+        m_rx_map_len = SHM_DATA_OFFSET;
+        m_rx_sock = sock;
+        LOG(LOG_LEVEL_NOTICE) << MODULE_NAME << "Connected to \"" << m_name << "\".\n";
+        return true;
+}
+
+void shm_video_rxtx::disconnect_sender()
+{
+        if (m_rx_ring) {
+                munmap(m_rx_ring, m_rx_map_len);
+                m_rx_ring = nullptr;
+        }
+        if (m_rx_sock != -1) {
+                close(m_rx_sock);
+                m_rx_sock = -1;
+        }
+}
+
+/**
+ * Sleeps until a frame after last is published or a timeout elapses.
+ * @returns false if the sender has exited
+ */
+bool shm_video_rxtx::wait_for_frame(uint32_t last)
+{
+        struct timespec timeout = { 0, 100 * 1000 * 1000 };
+        m_rx_ring->waiters.fetch_add(1);
+        syscall(SYS_futex, &m_rx_ring->published, FUTEX_WAIT, last, &timeout, nullptr, 0);
+        m_rx_ring->waiters.fetch_sub(1);
+
+        struct pollfd pfd = { m_rx_sock, POLLIN, 0 };
+        return poll(&pfd, 1, 0) == 0;
+}
+
+void shm_video_rxtx::receive_frame(uint32_t frame_idx)
+{
+        uint32_t layout = m_rx_ring->layout.load(memory_order_acquire);
+        if (layout % 2 == 1) {
+                return;
+        }
+        size_t slot_size = m_rx_ring->slot_size.load(memory_order_relaxed);
+        size_t map_len = SHM_DATA_OFFSET + m_rx_ring->slot_count * slot_size;
+        if (map_len > m_rx_map_len) {
+                void *addr = mremap(m_rx_ring, m_rx_map_len, map_len, MREMAP_MAYMOVE);
+                if (addr == MAP_FAILED) {
+                        LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "mremap: " << strerror(errno) << "\n";
+                        return;
+                }
+                m_rx_ring = static_cast<struct shm_ring *>(addr);
+                m_rx_map_len = map_len;
+        }
+
+        unsigned int idx = frame_idx % m_rx_ring->slot_count;
+        struct shm_slot *slot = &m_rx_ring->slots[idx];
+        uint32_t seq = slot->seq.load(memory_order_acquire);
+        if (seq % 2 == 1) {
+                return;
+        }
+        struct video_desc desc{};
+        desc.width = slot->width;
+        desc.height = slot->height;
+        desc.color_spec = static_cast<codec_t>(slot->color_spec);
+        desc.interlacing = static_cast<interlacing_t>(slot->interlacing);
+        desc.tile_count = slot->tile_count;
+        desc.fps = slot->fps;
+        uint32_t data_len[SHM_MAX_TILES];
+        memcpy(data_len, slot->data_len, sizeof data_len);
+        atomic_thread_fence(memory_order_acquire);
+        if (slot->seq.load(memory_order_relaxed) != seq || desc.tile_count == 0 || desc.tile_count > SHM_MAX_TILES) {
+                return;
+        }
+        size_t total_len = 0;
+        for (unsigned int i = 0; i < desc.tile_count; ++i) {
+                total_len += data_len[i];
+        }
+        if (total_len > slot_size) {
+                return;
+        }
+
+        if (m_configure_desc != desc) {
+                // failure is reported once, not for every frame of the stream
+                m_configure_desc = desc;
+                m_decoder_ok = reconfigure_decoder(desc);
+        }
+        if (!m_decoder_ok) {
+                return;
+        }
+        if (!is_codec_opaque(desc.color_spec) && m_decompress.empty()) {
+                size_t tile_len = vc_get_datalen(desc.width, desc.height, desc.color_spec);
+                for (unsigned int i = 0; i < desc.tile_count; ++i) {
+                        if (data_len[i] < tile_len) {
+                                LOG(LOG_LEVEL_WARNING) << MODULE_NAME << "Short frame received, dropped.\n";
+                                return;
+                        }
+                }
+        }
+
+        auto display_f = display_get_frame(m_display_device);
+        const char *src = slot_data(m_rx_ring, idx, slot_size);
+        bool ok = true;
+        for (unsigned int i = 0; i < desc.tile_count && ok; ++i) {
+                ok = decode_tile(&display_f->tiles[i], src, data_len[i], i, frame_idx, &display_f->callbacks);
+                src += data_len[i];
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (slot->seq.load(memory_order_relaxed) != seq || m_rx_ring->layout.load(memory_order_relaxed) != layout) {
+                LOG(LOG_LEVEL_DEBUG) << MODULE_NAME << "Frame overwritten while reading, dropped.\n";
+                ok = false;
+        }
+        display_put_frame(m_display_device, display_f, ok ? PUTF_BLOCKING : PUTF_DISCARD);
+}
+
+void shm_video_rxtx::cleanup_decoder()
+{
+        for (auto state : m_decompress) {
+                decompress_done(state);
+        }
+        m_decompress.clear();
+        m_decode_line = nullptr;
+}
+
+/**
+ * Selects display codec for the received stream the same way as the video
+ * decoder does - a native codec first, then a line decoder to one of display
+ * codecs and finally a decompressor.
+ */
+bool shm_video_rxtx::reconfigure_decoder(struct video_desc desc)
+{
+        cleanup_decoder();
+
+        codec_t native_codecs[VIDEO_CODEC_COUNT];
+        size_t len = sizeof native_codecs;
+        if (!display_get_property(m_display_device, DISPLAY_PROPERTY_CODECS, native_codecs, &len)) {
+                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "Failed to query codecs from video display.\n";
+                return false;
+        }
+        size_t native_count = len / sizeof(codec_t);
+
+        codec_t out_codec = VIDEO_CODEC_NONE;
+        for (bool slow : { false, true }) {
+                for (size_t i = 0; i < native_count && out_codec == VIDEO_CODEC_NONE; ++i) {
+                        // opaque and planar codecs cannot be line-decoded, only passed as they are
+                        if ((is_codec_opaque(desc.color_spec) || codec_is_planar(desc.color_spec) ||
+                                                codec_is_planar(native_codecs[i])) && native_codecs[i] != desc.color_spec) {
+                                continue;
+                        }
+                        if ((m_decode_line = get_decoder_from_to(desc.color_spec, native_codecs[i], slow)) != nullptr) {
+                                out_codec = native_codecs[i];
+                        }
+                }
+        }
+        if (out_codec == VIDEO_CODEC_NONE) {
+                m_decompress.resize(desc.tile_count);
+                for (size_t i = 0; i < native_count && out_codec == VIDEO_CODEC_NONE; ++i) {
+                        if (decompress_init_multi(desc.color_spec, VIDEO_CODEC_NONE, native_codecs[i],
+                                                m_decompress.data(), m_decompress.size())) {
+                                out_codec = native_codecs[i];
+                        }
+                }
+                if (out_codec == VIDEO_CODEC_NONE) {
+                        m_decompress.clear();
+                        LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "Unable to find decoder for input codec " <<
+                                get_codec_name(desc.color_spec) << "!\n";
+                        return false;
+                }
+        }
+
+        m_out_codec = out_codec;
+        struct video_desc display_desc = desc;
+        display_desc.color_spec = out_codec;
+        if (display_reconfigure(m_display_device, display_desc, VIDEO_NORMAL) == FALSE) {
+                LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "Unable to reconfigure display!\n";
+                cleanup_decoder();
+                return false;
+        }
+        len = sizeof m_display_pitch;
+        m_display_pitch = PITCH_DEFAULT;
+        display_get_property(m_display_device, DISPLAY_PROPERTY_BUF_PITCH, &m_display_pitch, &len);
+        if (m_display_pitch == PITCH_DEFAULT) {
+                m_display_pitch = vc_get_linesize(desc.width, out_codec);
+        }
+
+        struct video_desc tile_desc = desc;
+        tile_desc.tile_count = 1;
+        for (auto state : m_decompress) {
+                if (decompress_reconfigure(state, tile_desc, 0, 8, 16, m_display_pitch, out_codec) == 0) {
+                        LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "Unable to reconfigure decompress!\n";
+                        cleanup_decoder();
+                        return false;
+                }
+        }
+        LOG(LOG_LEVEL_NOTICE) << MODULE_NAME << "Receiving " << desc << (desc.color_spec != out_codec ?
+                        string(", displaying as ") + get_codec_name(out_codec) : string()) << ".\n";
+        return true;
+}
+
+/**
+ * Writes one received tile to display tile honoring display pitch.
+ */
+bool shm_video_rxtx::decode_tile(struct tile *dst, const char *src, size_t src_len, unsigned int tile_idx,
+                uint32_t frame_idx, struct video_frame_callbacks *callbacks)
+{
+        auto in = reinterpret_cast<unsigned char *>(const_cast<char *>(src));
+        auto out = reinterpret_cast<unsigned char *>(dst->data);
+        if (!m_decompress.empty()) {
+                codec_t internal_codec = VIDEO_CODEC_NONE;
+                return decompress_frame(m_decompress[tile_idx], out, in, src_len, frame_idx, callbacks,
+                                &internal_codec) == DECODER_GOT_FRAME;
+        }
+        if (is_codec_opaque(m_configure_desc.color_spec)) {
+                if (src_len > dst->data_len) {
+                        return false;
+                }
+                memcpy(out, in, src_len);
+                dst->data_len = src_len;
+                return true;
+        }
+
+        int src_linesize = vc_get_linesize(m_configure_desc.width, m_configure_desc.color_spec);
+        int dst_linesize = vc_get_linesize(m_configure_desc.width, m_out_codec);
+        if (m_decode_line == vc_memcpy && (m_display_pitch == src_linesize || codec_is_planar(m_configure_desc.color_spec))) {
+                memcpy(out, in, vc_get_datalen(m_configure_desc.width, m_configure_desc.height, m_configure_desc.color_spec));
+                return true;
+        }
+        for (unsigned int y = 0; y < m_configure_desc.height; ++y) {
+                m_decode_line(out, in, dst_linesize, 0, 8, 16);
+                out += m_display_pitch;
+                in += src_linesize;
+        }
+        return true;
+}
+
+void *shm_video_rxtx::receiver_thread(void *arg)
+{
+        auto s = static_cast<shm_video_rxtx *>(arg);
+        return s->receiver_loop();
+}
+
+void *shm_video_rxtx::receiver_loop()
+{
+        set_thread_name(__func__);
+        uint32_t last = 0;
+        bool waiting_reported = false;
+        while (!should_exit) {
+                if (!m_rx_ring) {
+                        if (!connect_sender()) {
+                                if (!waiting_reported) {
+                                        LOG(LOG_LEVEL_INFO) << MODULE_NAME << "Waiting for sender \"" << m_name << "\"...\n";
+                                        waiting_reported = true;
+                                }
+                                sleep_for(milliseconds(100));
+                                continue;
+                        }
+                        waiting_reported = false;
+                        last = m_rx_ring->published.load(memory_order_acquire);
+                }
+
+                uint32_t published = m_rx_ring->published.load(memory_order_acquire);
+                if (published == last) {
+                        if (!wait_for_frame(last)) {
+                                LOG(LOG_LEVEL_NOTICE) << MODULE_NAME << "Sender disconnected.\n";
+                                disconnect_sender();
+                        }
+                        continue;
+                }
+                if (published - last > 1) {
+                        LOG(LOG_LEVEL_DEBUG) << MODULE_NAME << "Skipped " << published - last - 1 << " frames.\n";
+                }
+                last = published;
+                // always the newest frame - older ones may be already overwritten
+                receive_frame(published - 1);
+        }
+        disconnect_sender();
+        display_put_frame(m_display_device, nullptr, PUTF_BLOCKING);
+        return nullptr;
+}
+
+void *(*shm_video_rxtx::get_receiver_thread())(void *arg)
+{
+        return (m_rxtx_mode & MODE_RECEIVER) != 0 ? receiver_thread : nullptr;
+}
+
+static video_rxtx *create_video_rxtx_shm(std::map<std::string, param_u> const &params)
+{
+        return new shm_video_rxtx(params);
+}
+
+static const struct video_rxtx_info shm_video_rxtx_info = {
+        "shared memory (same host)",
+        create_video_rxtx_shm
+};
+
+REGISTER_MODULE(shm, &shm_video_rxtx_info, LIBRARY_CLASS_VIDEO_RXTX, VIDEO_RXTX_ABI_VERSION);
@@ -0,0 +1,115 @@
+/**
+ * @file   video_rxtx/shm.h
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VIDEO_RXTX_SHM_H
+#define VIDEO_RXTX_SHM_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+#include "video_codec.h"
+#include "video_rxtx.h"
+
+struct display;
+struct shm_ring;
+struct state_decompress;
+struct tile;
+struct video_frame_callbacks;
+
+/**
+ * Video transport between processes on the same host. Sender publishes
+ * frames into a ring of slots in a memfd-backed shared memory, receivers
+ * obtain the memfd over an abstract UNIX socket, map it and decode frames
+ * to the display codec and pitch. Slots are protected by a seqlock so that any
+ * number of receivers may read without blocking the sender.
+ */
+class shm_video_rxtx : public video_rxtx {
+public:
+        shm_video_rxtx(std::map<std::string, param_u> const &);
+        virtual ~shm_video_rxtx();
+
+private:
+        static void *receiver_thread(void *arg);
+        virtual void send_frame(std::shared_ptr<video_frame>) override;
+        void *receiver_loop();
+        virtual void *(*get_receiver_thread())(void *arg) override;
+
+        // sender
+        bool init_sender();
+        void cleanup_sender();
+        void listener_loop();
+        bool ensure_capacity(size_t data_len);
+
+        // receiver
+        bool connect_sender();
+        void disconnect_sender();
+        bool wait_for_frame(uint32_t last);
+        void receive_frame(uint32_t frame_idx);
+        bool reconfigure_decoder(struct video_desc desc);
+        void cleanup_decoder();
+        bool decode_tile(struct tile *dst, const char *src, size_t src_len, unsigned int tile_idx,
+                        uint32_t frame_idx, struct video_frame_callbacks *callbacks);
+
+        std::string m_name;
+        unsigned int m_slot_count = 4;
+
+        int m_listen_fd = -1;
+        int m_memfd = -1;
+        struct shm_ring *m_ring = nullptr;
+        size_t m_map_len = 0;
+        size_t m_slot_size = 0; ///< never read back from the ring, receivers can write there
+        std::thread m_listener;
+        std::atomic<bool> m_exit_listener{false};
+        std::vector<int> m_clients; ///< kept open so that receivers can detect our exit
+
+        struct display *m_display_device;
+        struct video_desc m_configure_desc{}; ///< received stream format
+        codec_t m_out_codec = VIDEO_CODEC_NONE; ///< display codec
+        bool m_decoder_ok = false;
+        int m_display_pitch = 0;
+        decoder_t m_decode_line = nullptr;
+        std::vector<struct state_decompress *> m_decompress; ///< one per tile, used for compressed streams
+        int m_rx_sock = -1;
+        struct shm_ring *m_rx_ring = nullptr;
+        size_t m_rx_map_len = 0;
+};
+
+#endif // VIDEO_RXTX_SHM_H
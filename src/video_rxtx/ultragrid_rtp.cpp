@@ -433,6 +433,7 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                         break;
                                 }
 #endif // SHARED_DECODER
+                                video_decoder_attach_playout_buffer(cp->playout_buffer, cp->decoder_state);
                         }
 
                         struct vcodec_state *vdecoder_state = (struct vcodec_state *) cp->decoder_state;
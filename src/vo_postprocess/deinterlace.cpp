@@ -1,9 +1,14 @@
 /**
  * @file   vo_postprocess/deinterlace.cpp
  * @author Martin Pulec     <pulec@cesnet.cz>
+ *
+ * Deinterlaces the video either with a motion-adaptive filter (similar to
+ * yadif but without lookahead, so that no latency is added) or by blending
+ * both fields. Output is written directly to the display frame, the work is
+ * split among worker threads.
  */
 /*
- * Copyright (c) 2014 CESNET, z. s. p. o.
+ * Copyright (c) 2014-2020 CESNET, z. s. p. o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -42,30 +47,80 @@
 #endif
 #include "debug.h"
 
+#include <algorithm>
 #include <pthread.h>
 #include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define DEINTERLACE_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
 #include "lib_common.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_display.h"
 #include "vo_postprocess.h"
 
+#define MIN_LINES_PER_WORKER 32
+
+using namespace std;
+
+enum deinterlace_mode {
+        DEINTERLACE_ADAPTIVE,
+        DEINTERLACE_BLEND,
+};
+
 struct state_deinterlace {
-        struct video_frame *out;
+        enum deinterlace_mode mode;
+        struct video_frame *in;
+        char *buffers[2];
+        int last_processed; ///< index of buffer with previous frame, -1 if none
+};
+
+struct deinterlace_task {
+        const unsigned char *in;
+        const unsigned char *prev; ///< previous frame (adaptive mode only)
+        unsigned char *out;
+        long linesize;
+        long out_pitch;
+        int height;
+        int step; ///< distance of horizontally neighbouring samples of the same component
+        int y_start; ///< even
+        int y_end;
 };
 
 static void usage()
 {
         printf("Deinterlaces output video frames.\nUsage:\n");
-        printf("\t-p deinterlace\n");
+        printf("\t-p deinterlace[:blend]\n");
+        printf("\t\tblend - only blend both fields (faster, lower quality)\n");
+        printf("\n\tMotion-adaptive deinterlacing is used by default for UYVY, YUYV, RGB, BGR and RGBA,\n"
+                        "\tother pixel formats are blended.\n");
 }
 
 static void * deinterlace_init(const char *config) {
-        if(config && strcmp(config, "help") == 0) {
-                usage();
-                return NULL;
+        enum deinterlace_mode mode = DEINTERLACE_ADAPTIVE;
+        if (config) {
+                if (strcmp(config, "help") == 0) {
+                        usage();
+                        return NULL;
+                } else if (strcmp(config, "blend") == 0) {
+                        mode = DEINTERLACE_BLEND;
+                } else if (strlen(config) > 0) {
+                        log_msg(LOG_LEVEL_ERROR, "[deinterlace] Unknown config: %s\n", config);
+                        return NULL;
+                }
         }
 
         struct state_deinterlace *s = new state_deinterlace();
+        s->mode = mode;
+        s->last_processed = -1;
 
         return s;
 }
@@ -79,9 +134,16 @@ static int deinterlace_reconfigure(void *state, struct video_desc desc)
 {
         struct state_deinterlace *s = (struct state_deinterlace *) state;
 
-        vf_free(s->out);
+        vf_free(s->in);
+        free(s->buffers[0]);
+        free(s->buffers[1]);
         assert(desc.tile_count == 1);
-        s->out = vf_alloc_desc_data(desc);
+        s->in = vf_alloc_desc(desc);
+        s->in->tiles[0].data_len = vc_get_linesize(desc.width, desc.color_spec) * desc.height;
+        // previous frame is kept for the motion detection
+        s->buffers[0] = (char *) malloc(s->in->tiles[0].data_len);
+        s->buffers[1] = (char *) malloc(s->in->tiles[0].data_len);
+        s->last_processed = -1;
 
         return TRUE;
 }
@@ -90,20 +152,350 @@ static struct video_frame * deinterlace_getf(void *state)
 {
         struct state_deinterlace *s = (struct state_deinterlace *) state;
 
-        return s->out;
+        s->in->tiles[0].data = s->buffers[s->last_processed == 0 ? 1 : 0];
+
+        return s->in;
+}
+
+/// @returns sample distance for motion-adaptive filtering, 0 if not supported
+static int get_adaptive_step(codec_t codec)
+{
+        switch (codec) {
+        case UYVY:
+        case YUYV: // only macropixels are considered
+        case RGBA:
+                return 4;
+        case RGB:
+        case BGR:
+                return 3;
+        default:
+                return 0;
+        }
+}
+
+#ifdef DEINTERLACE_X86_DISPATCH
+static bool cpu_has_avx2()
+{
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+}
+
+static const bool deinterlace_avx2 = cpu_has_avx2();
+
+/// @returns number of bytes processed (multiple of 32)
+__attribute__((target("avx2")))
+static long blend_line_avx2(const unsigned char *a, const unsigned char *b, unsigned char *dst_a, unsigned char *dst_b, long len)
+{
+        long x = 0;
+        for ( ; x + 32 <= len; x += 32) {
+                __m256i val = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *) (a + x)),
+                                _mm256_loadu_si256((const __m256i *) (b + x)));
+                _mm256_storeu_si256((__m256i *) (dst_a + x), val);
+                _mm256_storeu_si256((__m256i *) (dst_b + x), val);
+        }
+        return x;
+}
+#endif
+
+/**
+ * Blends both lines of every line pair of the input, the result is written
+ * to both corresponding output lines.
+ */
+static void *blend_worker(void *arg)
+{
+        auto t = (struct deinterlace_task *) arg;
+        for (int y = t->y_start; y < t->y_end; y += 2) {
+                const unsigned char *a = t->in + y * t->linesize;
+                unsigned char *dst_a = t->out + y * t->out_pitch;
+                if (y + 1 >= t->height) {
+                        memcpy(dst_a, a, t->linesize);
+                        break;
+                }
+                const unsigned char *b = a + t->linesize;
+                unsigned char *dst_b = dst_a + t->out_pitch;
+                long x = 0;
+#ifdef DEINTERLACE_X86_DISPATCH
+                if (deinterlace_avx2) {
+                        x = blend_line_avx2(a, b, dst_a, dst_b, t->linesize);
+                }
+#endif
+#ifdef __SSE2__
+                for ( ; x + 16 <= t->linesize; x += 16) {
+                        __m128i val = _mm_avg_epu8(_mm_loadu_si128((const __m128i *) (a + x)),
+                                        _mm_loadu_si128((const __m128i *) (b + x)));
+                        _mm_storeu_si128((__m128i *) (dst_a + x), val);
+                        _mm_storeu_si128((__m128i *) (dst_b + x), val);
+                }
+#endif
+                for ( ; x < t->linesize; ++x) {
+                        dst_a[x] = dst_b[x] = (a[x] + b[x] + 1) >> 1;
+                }
+        }
+        return NULL;
+}
+
+/**
+ * Lines used to reconstruct one missing (bottom field) line. "c" and "e" are
+ * kept (top field) lines above and below, "b" and "f" are missing field lines
+ * two lines above and below. Lines prefixed with "p" are from previous frame.
+ */
+struct adaptive_lines {
+        const unsigned char *c, *e, *pc, *pe;
+        const unsigned char *cur, *prev;
+        const unsigned char *b, *pb, *f, *pf;
+};
+
+static inline int clamp_sample(const unsigned char *line, long x, long off, long len)
+{
+        return x + off >= 0 && x + off < len ? line[x + off] : line[x];
+}
+
+/**
+ * Scalar version of the motion-adaptive filter for one sample (used also at
+ * the line edges). Bottom field lines from the previous and current frame are
+ * temporally centered around the current top field so their average is the
+ * temporal prediction. Spatial prediction is edge-directed, the result is
+ * constrained by the amount of motion.
+ */
+static inline unsigned char adaptive_sample(const struct adaptive_lines &l, long x, int s, long len)
+{
+        int c = l.c[x];
+        int e = l.e[x];
+        int d = (l.prev[x] + l.cur[x]) >> 1;
+        int td0 = abs(l.prev[x] - l.cur[x]);
+        int td1 = (abs(l.pc[x] - c) + abs(l.pe[x] - e)) >> 1;
+        int diff = max(td0 >> 1, td1);
+
+        int spatial_pred = (c + e) >> 1;
+        int spatial_score = abs(clamp_sample(l.c, x, -s, len) - clamp_sample(l.e, x, -s, len)) + abs(c - e)
+                + abs(clamp_sample(l.c, x, s, len) - clamp_sample(l.e, x, s, len)) - 1;
+        for (int dir = -1; dir <= 1; dir += 2) {
+                int score = abs(clamp_sample(l.c, x, (dir - 1) * s, len) - clamp_sample(l.e, x, -(dir + 1) * s, len))
+                        + abs(clamp_sample(l.c, x, dir * s, len) - clamp_sample(l.e, x, -dir * s, len))
+                        + abs(clamp_sample(l.c, x, (dir + 1) * s, len) - clamp_sample(l.e, x, (1 - dir) * s, len));
+                if (score < spatial_score) {
+                        spatial_score = score;
+                        spatial_pred = (clamp_sample(l.c, x, dir * s, len) + clamp_sample(l.e, x, -dir * s, len)) >> 1;
+                }
+        }
+
+        int b = (l.pb[x] + l.b[x]) >> 1;
+        int f = (l.pf[x] + l.f[x]) >> 1;
+        int mx = max(max(d - e, d - c), min(b - c, f - e));
+        int mn = min(min(d - e, d - c), max(b - c, f - e));
+        diff = max(max(diff, mn), -mx);
+
+        return min(max(spatial_pred, d - diff), d + diff);
+}
+
+#ifdef __SSE2__
+static inline __m128i load8(const unsigned char *p)
+{
+        return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) p), _mm_setzero_si128());
+}
+
+static inline __m128i absdiff16(__m128i a, __m128i b)
+{
+        return _mm_sub_epi16(_mm_max_epi16(a, b), _mm_min_epi16(a, b));
+}
+
+static inline __m128i avg16(__m128i a, __m128i b)
+{
+        return _mm_srli_epi16(_mm_add_epi16(a, b), 1);
+}
+
+static inline __m128i select16(__m128i mask, __m128i a, __m128i b)
+{
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/// SSE2 version of adaptive_sample() for 8 samples, needs 2 * s samples on both sides
+static inline void adaptive_8_samples(const struct adaptive_lines &l, long x, int s, unsigned char *dst)
+{
+        __m128i c = load8(l.c + x);
+        __m128i e = load8(l.e + x);
+        __m128i prev = load8(l.prev + x);
+        __m128i cur = load8(l.cur + x);
+        __m128i d = avg16(prev, cur);
+        __m128i td0 = absdiff16(prev, cur);
+        __m128i td1 = _mm_srli_epi16(_mm_add_epi16(absdiff16(load8(l.pc + x), c), absdiff16(load8(l.pe + x), e)), 1);
+        __m128i diff = _mm_max_epi16(_mm_srli_epi16(td0, 1), td1);
+
+        __m128i spatial_pred = avg16(c, e);
+        __m128i spatial_score = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(
+                                absdiff16(load8(l.c + x - s), load8(l.e + x - s)), absdiff16(c, e)),
+                                absdiff16(load8(l.c + x + s), load8(l.e + x + s))), _mm_set1_epi16(1));
+        for (int dir = -1; dir <= 1; dir += 2) {
+                __m128i cd = load8(l.c + x + dir * s);
+                __m128i ed = load8(l.e + x - dir * s);
+                __m128i score = _mm_add_epi16(_mm_add_epi16(
+                                        absdiff16(load8(l.c + x + (dir - 1) * s), load8(l.e + x - (dir + 1) * s)),
+                                        absdiff16(cd, ed)),
+                                absdiff16(load8(l.c + x + (dir + 1) * s), load8(l.e + x + (1 - dir) * s)));
+                __m128i better = _mm_cmplt_epi16(score, spatial_score);
+                spatial_score = select16(better, score, spatial_score);
+                spatial_pred = select16(better, avg16(cd, ed), spatial_pred);
+        }
+
+        __m128i b = avg16(load8(l.pb + x), load8(l.b + x));
+        __m128i f = avg16(load8(l.pf + x), load8(l.f + x));
+        __m128i de = _mm_sub_epi16(d, e);
+        __m128i dc = _mm_sub_epi16(d, c);
+        __m128i bc = _mm_sub_epi16(b, c);
+        __m128i fe = _mm_sub_epi16(f, e);
+        __m128i mx = _mm_max_epi16(_mm_max_epi16(de, dc), _mm_min_epi16(bc, fe));
+        __m128i mn = _mm_min_epi16(_mm_min_epi16(de, dc), _mm_max_epi16(bc, fe));
+        diff = _mm_max_epi16(_mm_max_epi16(diff, mn), _mm_sub_epi16(_mm_setzero_si128(), mx));
+
+        __m128i res = _mm_min_epi16(_mm_max_epi16(spatial_pred, _mm_sub_epi16(d, diff)), _mm_add_epi16(d, diff));
+        _mm_storel_epi64((__m128i *) dst, _mm_packus_epi16(res, res));
+}
+#endif
+
+#ifdef DEINTERLACE_X86_DISPATCH
+__attribute__((target("avx2")))
+static inline __m256i load16_avx2(const unsigned char *p)
+{
+        return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) p));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i absdiff16_avx2(__m256i a, __m256i b)
+{
+        return _mm256_sub_epi16(_mm256_max_epi16(a, b), _mm256_min_epi16(a, b));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avg16_avx2(__m256i a, __m256i b)
+{
+        return _mm256_srli_epi16(_mm256_add_epi16(a, b), 1);
+}
+
+/// AVX2 version of adaptive_8_samples() for 16 samples
+__attribute__((target("avx2")))
+static inline void adaptive_16_samples(const struct adaptive_lines &l, long x, int s, unsigned char *dst)
+{
+        __m256i c = load16_avx2(l.c + x);
+        __m256i e = load16_avx2(l.e + x);
+        __m256i prev = load16_avx2(l.prev + x);
+        __m256i cur = load16_avx2(l.cur + x);
+        __m256i d = avg16_avx2(prev, cur);
+        __m256i td0 = absdiff16_avx2(prev, cur);
+        __m256i td1 = _mm256_srli_epi16(_mm256_add_epi16(absdiff16_avx2(load16_avx2(l.pc + x), c),
+                                absdiff16_avx2(load16_avx2(l.pe + x), e)), 1);
+        __m256i diff = _mm256_max_epi16(_mm256_srli_epi16(td0, 1), td1);
+
+        __m256i spatial_pred = avg16_avx2(c, e);
+        __m256i spatial_score = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(
+                                absdiff16_avx2(load16_avx2(l.c + x - s), load16_avx2(l.e + x - s)), absdiff16_avx2(c, e)),
+                                absdiff16_avx2(load16_avx2(l.c + x + s), load16_avx2(l.e + x + s))), _mm256_set1_epi16(1));
+        for (int dir = -1; dir <= 1; dir += 2) {
+                __m256i cd = load16_avx2(l.c + x + dir * s);
+                __m256i ed = load16_avx2(l.e + x - dir * s);
+                __m256i score = _mm256_add_epi16(_mm256_add_epi16(
+                                        absdiff16_avx2(load16_avx2(l.c + x + (dir - 1) * s), load16_avx2(l.e + x - (dir + 1) * s)),
+                                        absdiff16_avx2(cd, ed)),
+                                absdiff16_avx2(load16_avx2(l.c + x + (dir + 1) * s), load16_avx2(l.e + x + (1 - dir) * s)));
+                __m256i better = _mm256_cmpgt_epi16(spatial_score, score);
+                spatial_score = _mm256_blendv_epi8(spatial_score, score, better);
+                spatial_pred = _mm256_blendv_epi8(spatial_pred, avg16_avx2(cd, ed), better);
+        }
+
+        __m256i b = avg16_avx2(load16_avx2(l.pb + x), load16_avx2(l.b + x));
+        __m256i f = avg16_avx2(load16_avx2(l.pf + x), load16_avx2(l.f + x));
+        __m256i de = _mm256_sub_epi16(d, e);
+        __m256i dc = _mm256_sub_epi16(d, c);
+        __m256i bc = _mm256_sub_epi16(b, c);
+        __m256i fe = _mm256_sub_epi16(f, e);
+        __m256i mx = _mm256_max_epi16(_mm256_max_epi16(de, dc), _mm256_min_epi16(bc, fe));
+        __m256i mn = _mm256_min_epi16(_mm256_min_epi16(de, dc), _mm256_max_epi16(bc, fe));
+        diff = _mm256_max_epi16(_mm256_max_epi16(diff, mn), _mm256_sub_epi16(_mm256_setzero_si256(), mx));
+
+        __m256i res = _mm256_min_epi16(_mm256_max_epi16(spatial_pred, _mm256_sub_epi16(d, diff)), _mm256_add_epi16(d, diff));
+        _mm_storeu_si128((__m128i *) dst, _mm_packus_epi16(_mm256_castsi256_si128(res), _mm256_extracti128_si256(res, 1)));
+}
+
+/// @returns position of the first sample not processed
+__attribute__((target("avx2")))
+static long adaptive_line_avx2(const struct adaptive_lines &l, long x, int s, long len, unsigned char *dst)
+{
+        for ( ; x + 16 + 2 * s <= len; x += 16) {
+                adaptive_16_samples(l, x, s, dst + x);
+        }
+        return x;
+}
+#endif
+
+static void *adaptive_worker(void *arg)
+{
+        auto t = (struct deinterlace_task *) arg;
+        const long len = t->linesize;
+        const int s = t->step;
+        auto line = [t](const unsigned char *frame, int y) {
+                return frame + y * t->linesize;
+        };
+        for (int y = t->y_start; y < t->y_end; y += 2) {
+                // top field line is kept
+                memcpy(t->out + y * t->out_pitch, line(t->in, y), len);
+                int m = y + 1; // reconstructed line
+                if (m >= t->height) {
+                        break;
+                }
+                int e_y = m + 1 < t->height ? m + 1 : m - 1;
+                int b_y = m - 2 >= 0 ? m - 2 : m;
+                int f_y = m + 2 < t->height ? m + 2 : m;
+                struct adaptive_lines l = {
+                        line(t->in, m - 1), line(t->in, e_y), line(t->prev, m - 1), line(t->prev, e_y),
+                        line(t->in, m), line(t->prev, m),
+                        line(t->in, b_y), line(t->prev, b_y), line(t->in, f_y), line(t->prev, f_y),
+                };
+                unsigned char *dst = t->out + m * t->out_pitch;
+                long x = 0;
+#if defined __SSE2__ || defined DEINTERLACE_X86_DISPATCH
+                for ( ; x < 2 * s && x < len; ++x) {
+                        dst[x] = adaptive_sample(l, x, s, len);
+                }
+#endif
+#ifdef DEINTERLACE_X86_DISPATCH
+                if (deinterlace_avx2) {
+                        x = adaptive_line_avx2(l, x, s, len, dst);
+                }
+#endif
+#ifdef __SSE2__
+                for ( ; x + 8 + 2 * s <= len; x += 8) {
+                        adaptive_8_samples(l, x, s, dst + x);
+                }
+#endif
+                for ( ; x < len; ++x) {
+                        dst[x] = adaptive_sample(l, x, s, len);
+                }
+        }
+        return NULL;
 }
 
 static bool deinterlace_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
-        UNUSED(state);
-        assert (req_pitch == vc_get_linesize(in->tiles[0].width, in->color_spec));
+        struct state_deinterlace *s = (struct state_deinterlace *) state;
         assert (video_desc_eq(video_desc_from_frame(out), video_desc_from_frame(in)));
         assert (in->tiles[0].data_len <= vc_get_linesize(in->tiles[0].width, in->color_spec) * in->tiles[0].height);
-        assert (out->tiles[0].data_len <= vc_get_linesize(in->tiles[0].width, in->color_spec) * in->tiles[0].height);
 
-        vc_deinterlace((unsigned char *) in->tiles[0].data, vc_get_linesize(in->tiles[0].width,
-                                in->color_spec), in->tiles[0].height);
-        memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
+        int current = in->tiles[0].data == s->buffers[0] ? 0 : 1;
+        int step = get_adaptive_step(in->color_spec);
+        bool adaptive = s->mode == DEINTERLACE_ADAPTIVE && step > 0 && s->last_processed != -1
+                && s->last_processed != current;
+        int height = in->tiles[0].height;
+        int workers = min<int>(max(height / MIN_LINES_PER_WORKER, 1), max(thread::hardware_concurrency(), 1u));
+        vector<struct deinterlace_task> tasks(workers);
+        for (int i = 0; i < workers; ++i) {
+                tasks[i] = { (const unsigned char *) in->tiles[0].data,
+                        adaptive ? (const unsigned char *) s->buffers[s->last_processed] : NULL,
+                        (unsigned char *) out->tiles[0].data,
+                        vc_get_linesize(in->tiles[0].width, in->color_spec), req_pitch, height, step,
+                        height * i / workers / 2 * 2, height * (i + 1) / workers / 2 * 2 };
+        }
+        tasks[workers - 1].y_end = height;
+        task_run_parallel(adaptive ? adaptive_worker : blend_worker, workers, tasks.data(), sizeof tasks[0], NULL);
+        s->last_processed = current;
 
         return true;
 }
@@ -112,7 +504,9 @@ static void deinterlace_done(void *state)
 {
         struct state_deinterlace *s = (struct state_deinterlace *) state;
         
-        vf_free(s->out);
+        vf_free(s->in);
+        free(s->buffers[0]);
+        free(s->buffers[1]);
         delete s;
 }
 
@@ -120,7 +514,7 @@ static void deinterlace_get_out_desc(void *state, struct video_desc *out, int *i
 {
         struct state_deinterlace *s = (struct state_deinterlace *) state;
 
-        *out = video_desc_from_frame(s->out);
+        *out = video_desc_from_frame(s->in);
 
         UNUSED(in_display_mode);
         //*in_display_mode = DISPLAY_PROPERTY_VIDEO_MERGED;
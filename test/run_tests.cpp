@@ -57,12 +57,16 @@ extern "C" {
 #include "test_bitstream.h"
 #include "test_des.h"
 #include "test_md5.h"
+#include "test_metrics.h"
 #include "test_random.h"
+#include "test_resize.h"
 #include "test_tv.h"
 #include "test_net_udp.h"
+#include "test_pdb.h"
 #include "test_rtp.h"
 #include "test_video_capture.h"
 #include "test_video_display.h"
+#include "test_video_rxtx_shm.h"
 }
 
 #define TEST_AV_HW 1
@@ -102,6 +106,8 @@ int main(int argc, char **argv)
 #endif
         if (test_md5() != 0)
                 success = false;
+        if (test_metrics() != 0)
+                success = false;
         if (test_random() != 0)
                 success = false;
         if (test_tv() != 0)
@@ -110,12 +116,18 @@ int main(int argc, char **argv)
                 success = false;
         if (test_rtp() != 0)
                 success = false;
+        if (test_pdb() != 0)
+                success = false;
+        if (test_resize() != 0)
+                success = false;
 
 #ifdef TEST_AV_HW
         if (test_video_capture() != 0)
                 success = false;
         if (test_video_display() != 0)
                 success = false;
+        if (test_video_rxtx_shm() != 0)
+                success = false;
 #endif
 
 #ifdef HAVE_CPPUNIT
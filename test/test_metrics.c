@@ -0,0 +1,132 @@
+/**
+ * @file   test_metrics.c
+ * @brief  Metrics registry and Prometheus export tests
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#include "utils/metrics.h"
+#include "test_metrics.h"
+
+#define THREADS 4
+#define INCREMENTS 100000
+
+static void *test_metrics_inc(void *arg)
+{
+        struct metric *counter = arg;
+        for (int i = 0; i < INCREMENTS; ++i) {
+                metric_inc(counter);
+        }
+        return NULL;
+}
+
+static int expect_line(const char *exported, const char *line)
+{
+        if (strstr(exported, line) == NULL) {
+                printf("FAIL\n  missing \"%s\" in:\n%s\n", line, exported);
+                return 1;
+        }
+        return 0;
+}
+
+int test_metrics(void)
+{
+        int ret = 0;
+        char *exported;
+        printf
+            ("Testing metrics registry ................................................. ");
+        fflush(stdout);
+
+        struct metric *c0 = metric_register_counter("test_packets_total", "Test packets", "port=\"0\"");
+        struct metric *c1 = metric_register_counter("test_packets_total", "Test packets", "port=\"1\"");
+        struct metric *g = metric_register_gauge("test_volume", "Test gauge", NULL);
+        const double bounds[] = { 0.1, 1.0 };
+        struct metric *h = metric_register_histogram("test_latency_seconds", "Test histogram", "stream=\"a\"", bounds, 2);
+        struct metric *mismatch = metric_register_gauge("test_packets_total", "Test packets", "port=\"2\"");
+        if (mismatch != NULL) {
+                printf("FAIL\n  type mismatch not detected\n");
+                metric_unregister(mismatch);
+                ret = 1;
+                goto cleanup;
+        }
+
+        pthread_t thr[THREADS];
+        for (int i = 0; i < THREADS; ++i) {
+                pthread_create(&thr[i], NULL, test_metrics_inc, c0);
+        }
+        for (int i = 0; i < THREADS; ++i) {
+                pthread_join(thr[i], NULL);
+        }
+        metric_add(c1, 5);
+        metric_set(g, -1.5);
+        metric_observe(h, 0.05);
+        metric_observe(h, 0.5);
+        metric_observe(h, 0.5);
+        metric_observe(h, 7.0);
+        metric_inc(NULL);
+
+        exported = metrics_export();
+        char buf[128];
+        snprintf(buf, sizeof buf, "test_packets_total{port=\"0\"} %d\n", THREADS * INCREMENTS);
+        ret |= expect_line(exported, "# HELP test_packets_total Test packets\n# TYPE test_packets_total counter\n");
+        ret |= expect_line(exported, buf);
+        ret |= expect_line(exported, "test_packets_total{port=\"1\"} 5\n");
+        ret |= expect_line(exported, "# TYPE test_volume gauge\ntest_volume -1.5\n");
+        ret |= expect_line(exported, "# TYPE test_latency_seconds histogram\n"
+                        "test_latency_seconds_bucket{stream=\"a\",le=\"0.1\"} 1\n"
+                        "test_latency_seconds_bucket{stream=\"a\",le=\"1\"} 3\n"
+                        "test_latency_seconds_bucket{stream=\"a\",le=\"+Inf\"} 4\n"
+                        "test_latency_seconds_sum{stream=\"a\"} 8.05\n"
+                        "test_latency_seconds_count{stream=\"a\"} 4\n");
+        free(exported);
+
+cleanup:
+        metric_unregister(c0);
+        metric_unregister(c1);
+        metric_unregister(g);
+        metric_unregister(h);
+        exported = metrics_export();
+        if (ret == 0 && strstr(exported, "test_") != NULL) {
+                printf("FAIL\n  unregistered metrics exported:\n%s\n", exported);
+                ret = 1;
+        }
+        free(exported);
+
+        if (ret == 0) {
+                printf("Ok\n");
+        }
+        return ret;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file   test_pdb.c
+ * @brief  Participant database tests and lookup benchmark
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#include "pdb.h"
+#include "tv.h"
+#include "test_pdb.h"
+
+#define BENCH_LOOKUPS 4000000 ///< with UG_RUN_BENCHMARKS set in environment
+
+static uint32_t test_pdb_ssrc(int i)
+{
+        return (uint32_t) i * 2654435761u + 0x1234567u;
+}
+
+static int test_pdb_basic(void)
+{
+        struct pdb *db = pdb_init(NULL);
+        struct pdb_e *e;
+        pdb_iter_t it;
+        int i;
+
+        /* enough to force several rebuilds */
+        for (i = 0; i < 100; ++i) {
+                if (pdb_add(db, test_pdb_ssrc(i)) != 0) {
+                        printf("FAIL\n  pdb_add %d\n", i);
+                        return 1;
+                }
+        }
+        if (pdb_add(db, test_pdb_ssrc(42)) != 1) {
+                printf("FAIL\n  duplicate pdb_add\n");
+                return 1;
+        }
+        for (i = 0; i < 100; ++i) {
+                e = pdb_get(db, test_pdb_ssrc(i));
+                if (e == NULL || e->ssrc != test_pdb_ssrc(i)) {
+                        printf("FAIL\n  pdb_get %d\n", i);
+                        return 1;
+                }
+        }
+        if (pdb_get(db, 0xDEADBEEF) != NULL) {
+                printf("FAIL\n  pdb_get non-existent\n");
+                return 1;
+        }
+
+        /* remove odd items (including the current one) while iterating,
+         * add new ones to force the table to be rebuilt in the middle */
+        i = 0;
+        e = pdb_iter_init(db, &it);
+        while (e != NULL) {
+                struct pdb_e *item;
+                if (e->ssrc != test_pdb_ssrc(i)) {
+                        printf("FAIL\n  iteration order %d\n", i);
+                        return 1;
+                }
+                if (i % 2 == 1) {
+                        pdb_remove(db, e->ssrc, &item);
+                        pdb_destroy_item(item);
+                }
+                if (i == 50) {
+                        for (int j = 100; j < 200; ++j) {
+                                pdb_add(db, test_pdb_ssrc(j));
+                        }
+                }
+                e = pdb_iter_next(&it);
+                i++;
+        }
+        pdb_iter_done(&it);
+        if (i != 200) {
+                printf("FAIL\n  iterated %d items instead of 200\n", i);
+                return 1;
+        }
+        for (i = 0; i < 200; ++i) {
+                if ((pdb_get(db, test_pdb_ssrc(i)) == NULL) != (i % 2 == 1)) {
+                        printf("FAIL\n  pdb_get after removal %d\n", i);
+                        return 1;
+                }
+        }
+
+        pdb_destroy(&db);
+        return 0;
+}
+
+static void test_pdb_bench(int count)
+{
+        struct pdb *db = pdb_init(NULL);
+        uint32_t *ssrcs = malloc(count * sizeof(uint32_t));
+        struct timeval t0, t1;
+        uintptr_t sum = 0;
+
+        for (int i = 0; i < count; ++i) {
+                ssrcs[i] = (uint32_t) lrand48();
+                pdb_add(db, ssrcs[i]);
+        }
+
+        gettimeofday(&t0, NULL);
+        for (unsigned int i = 0; i < BENCH_LOOKUPS; ++i) {
+                struct pdb_e *e = pdb_get(db, ssrcs[(i * 7919u) % count]);
+                sum += (uintptr_t) e;
+        }
+        gettimeofday(&t1, NULL);
+
+        printf("  %4d SSRCs: %.1f M lookups/s%s\n", count,
+                        BENCH_LOOKUPS / tv_diff(t1, t0) / 1000000.0, sum == 0 ? " (?)" : "");
+
+        free(ssrcs);
+        pdb_destroy(&db);
+}
+
+int test_pdb(void)
+{
+        printf
+            ("Testing participant database ............................................. ");
+        fflush(stdout);
+
+        if (test_pdb_basic() != 0) {
+                return 1;
+        }
+
+        printf("Ok\n");
+
+        if (getenv("UG_RUN_BENCHMARKS")) {
+                test_pdb_bench(10);
+                test_pdb_bench(100);
+                test_pdb_bench(1000);
+        }
+
+        return 0;
+}
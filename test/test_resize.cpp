@@ -0,0 +1,202 @@
+/**
+ * @file   test_resize.cpp
+ * @brief  Resize capture filter (native pixel format scaler) checks
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#include "capture_filter.h"
+#include "module.h"
+#include "video.h"
+#include "video_codec.h"
+
+extern "C" {
+#include "test_resize.h"
+}
+
+using std::max;
+using std::min;
+using std::shared_ptr;
+
+#ifdef HAVE_RESIZE
+/// pattern value at (x, y) of the input, component comp
+typedef unsigned char (*pattern_t)(unsigned int x, unsigned int y, int comp);
+/**
+ * Checks output pixel (x, y) of component comp.
+ * @retval true if the value is as expected
+ */
+typedef bool (*check_t)(unsigned int x, unsigned int y, int comp, unsigned char val);
+
+/**
+ * Runs the resize filter with cfg over a pattern frame and checks the output
+ * dimensions and all output samples. Samples are addressed in pixels, for UYVY
+ * comp 0 is luma and 1, 2 are chroma (of the pixel pair).
+ */
+static int test_filter(struct module *root, const char *cfg, codec_t codec,
+                unsigned int width, unsigned int height,
+                unsigned int out_width, unsigned int out_height,
+                pattern_t pattern, check_t check)
+{
+        struct capture_filter *cf = nullptr;
+        if (capture_filter_init(root, cfg, &cf) != 0) {
+                printf("FAIL\n  cannot initialize %s\n", cfg);
+                return 1;
+        }
+
+        struct video_desc desc{};
+        desc.width = width;
+        desc.height = height;
+        desc.color_spec = codec;
+        desc.interlacing = PROGRESSIVE;
+        desc.fps = 30;
+        desc.tile_count = 1;
+        shared_ptr<video_frame> in(vf_alloc_desc_data(desc), vf_free);
+        for (unsigned int y = 0; y < height; ++y) {
+                unsigned char *line = (unsigned char *) in->tiles[0].data + y * vc_get_linesize(width, codec);
+                for (unsigned int x = 0; x < width; ++x) {
+                        if (codec == UYVY) {
+                                line[2 * x + 1] = pattern(x, y, 0);
+                                line[2 * x] = pattern(x, y, 1 + x % 2);
+                        } else {
+                                for (int c = 0; c < 3; ++c) {
+                                        line[3 * x + c] = pattern(x, y, c);
+                                }
+                        }
+                }
+        }
+
+        int ret = 0;
+        struct video_frame *out = capture_filter(cf, in.get());
+        if (out == nullptr) {
+                printf("FAIL\n  %s: no output frame\n", cfg);
+                ret = 1;
+        } else if (out->color_spec != codec || out->tiles[0].width != out_width ||
+                        out->tiles[0].height != out_height ||
+                        out->tiles[0].data_len != vc_get_datalen(out_width, out_height, codec)) {
+                printf("FAIL\n  %s: output is %s %ux%u, expected %s %ux%u\n", cfg,
+                                get_codec_name(out->color_spec), out->tiles[0].width, out->tiles[0].height,
+                                get_codec_name(codec), out_width, out_height);
+                ret = 1;
+        }
+        for (unsigned int y = 0; ret == 0 && y < out_height; ++y) {
+                const unsigned char *line = (unsigned char *) out->tiles[0].data + y * vc_get_linesize(out_width, codec);
+                for (unsigned int x = 0; ret == 0 && x < out_width; ++x) {
+                        for (int c = 0; c < 3; ++c) {
+                                unsigned char val = codec == UYVY ? (c == 0 ? line[2 * x + 1] : line[4 * (x / 2) + 2 * (c - 1)])
+                                        : line[3 * x + c];
+                                if (!check(x, y, c, val)) {
+                                        printf("FAIL\n  %s: pixel %ux%u component %d has unexpected value %d\n",
+                                                        cfg, x, y, c, val);
+                                        ret = 1;
+                                        break;
+                                }
+                        }
+                }
+        }
+        VIDEO_FRAME_DISPOSE(out);
+        capture_filter_destroy(cf);
+        return ret;
+}
+
+/// luma is a plane, so the bilinear filter reproduces it (up to rounding and edge clamping)
+static unsigned char uyvy_pattern(unsigned int x, unsigned int y, int comp)
+{
+        return comp == 0 ? 2 * x + 3 * y : comp == 1 ? 100 : 200;
+}
+
+static bool uyvy_half_check(unsigned int x, unsigned int y, int comp, unsigned char val)
+{
+        if (comp != 0) {
+                return val == (comp == 1 ? 100 : 200);
+        }
+        // output pixel center is at (2x + 0.5, 2y + 0.5) in input
+        return fabs(val - (2 * (2 * x + 0.5) + 3 * (2 * y + 0.5))) <= 1.0;
+}
+
+static unsigned char rgb_pattern(unsigned int x, unsigned int y, int comp)
+{
+        return comp == 0 ? 4 * x : comp == 1 ? 4 * y : 77;
+}
+
+static bool rgb_double_check(unsigned int x, unsigned int y, int comp, unsigned char val)
+{
+        // output pixel center is at (x / 2 - 0.25, y / 2 - 0.25) in input, edges are replicated
+        double cx = min(max(x / 2.0 - 0.25, 0.0), 31.0);
+        double cy = min(max(y / 2.0 - 0.25, 0.0), 15.0);
+        double expected = comp == 0 ? 4 * cx : comp == 1 ? 4 * cy : 77;
+        return fabs(val - expected) <= 1.0;
+}
+
+/// 32x16 to 32x32 keeping aspect - picture copied to lines 8-23, black bars around
+static bool rgb_letterbox_check(unsigned int x, unsigned int y, int comp, unsigned char val)
+{
+        if (y < 8 || y >= 24) {
+                return val == 0;
+        }
+        return val == rgb_pattern(x, y - 8, comp);
+}
+#endif // defined HAVE_RESIZE
+
+int test_resize(void)
+{
+#ifdef HAVE_RESIZE
+        printf
+            ("Testing resize capture filter ............................................ ");
+        struct module root;
+        module_init_default(&root);
+        root.cls = MODULE_CLASS_ROOT;
+
+        int ret = 0;
+        if (test_filter(&root, "resize:1/2", UYVY, 64, 32, 32, 16, uyvy_pattern, uyvy_half_check) != 0 ||
+                        test_filter(&root, "resize:2", RGB, 32, 16, 64, 32, rgb_pattern, rgb_double_check) != 0 ||
+                        test_filter(&root, "resize:32x32", RGB, 32, 16, 32, 32, rgb_pattern, rgb_letterbox_check) != 0) {
+                ret = 1;
+        }
+        module_done(&root);
+        if (ret == 0) {
+                printf("Ok\n");
+        }
+        return ret;
+#else
+        return 0;
+#endif
+}
@@ -34,14 +34,117 @@
 #include "config_win32.h"
 #include "debug.h"
 #include "rtp/rtp.h"
+#include "tv.h"
 #include "test_rtp.h"
 
+#define BENCH_PACKETS      (1 << 21) ///< with UG_RUN_BENCHMARKS set in environment
+#define BENCH_BATCH         64
+#define BENCH_SSRCS         4
+#define BENCH_RUN_LEN       16
+#define BENCH_PAYLOAD_LEN   1200
+#define BENCH_HDR_LEN       12
+#define CHECK_PACKETS      (BENCH_BATCH * BENCH_SSRCS * 4)
+
+static long received;
+
+static void test_rtp_callback(struct rtp *session, rtp_event *e)
+{
+        UNUSED(session);
+        if (e->type == RX_RTP) {
+                /* packet buffers are owned by the test (RTP_OPT_REUSE_PACKET_BUFS) */
+                received++;
+        }
+}
+
+/**
+ * Processes count packets in batches of batch_size.
+ * @returns packets per second or -1 if some packets were lost
+ */
+static double test_rtp_process(struct rtp *session, rtp_packet **packets,
+                uint8_t (*headers)[BENCH_HDR_LEN], int batch_size, int count)
+{
+        int lens[BENCH_BATCH];
+        struct timeval t0, t1;
+
+        for (int i = 0; i < BENCH_BATCH; ++i) {
+                lens[i] = BENCH_HDR_LEN + BENCH_PAYLOAD_LEN;
+        }
+
+        received = 0;
+        gettimeofday(&t0, NULL);
+        for (int sent = 0; sent < count; sent += BENCH_BATCH) {
+                /* header is converted to host byte order in place */
+                for (int i = 0; i < BENCH_BATCH; ++i) {
+                        memcpy((uint8_t *) packets[i] + RTP_PACKET_HEADER_SIZE,
+                                        headers[(sent + i) % (BENCH_BATCH * BENCH_SSRCS)], BENCH_HDR_LEN);
+                }
+                for (int i = 0; i < BENCH_BATCH; i += batch_size) {
+                        rtp_process_data_batch(session, 0, packets + i, lens + i, batch_size);
+                }
+        }
+        gettimeofday(&t1, NULL);
+
+        if (received != count) {
+                printf("FAIL\n  received %ld packets of %d\n", received, count);
+                return -1;
+        }
+        return count / tv_diff(t1, t0);
+}
+
 int test_rtp(void)
 {
+        struct rtp *session;
+        rtp_packet *packets[BENCH_BATCH];
+        uint8_t (*headers)[BENCH_HDR_LEN];
+        double pps_single, pps_batch;
+        int count = getenv("UG_RUN_BENCHMARKS") ? BENCH_PACKETS : CHECK_PACKETS;
+
         printf
             ("Testing RTP .............................................................. ");
         fflush(stdout);
 
-        printf("--\n");
+        session = rtp_init("127.0.0.1", 0, 0, 255, 0, 0, test_rtp_callback, NULL, 0, false);
+        if (session == NULL) {
+                printf("--\n");
+                return 0;
+        }
+        rtp_set_option(session, RTP_OPT_PROMISC, TRUE);
+        rtp_set_option(session, RTP_OPT_REUSE_PACKET_BUFS, TRUE);
+
+        /* runs of BENCH_RUN_LEN packets from BENCH_SSRCS interleaved senders */
+        headers = malloc(BENCH_BATCH * BENCH_SSRCS * BENCH_HDR_LEN);
+        for (int i = 0; i < BENCH_BATCH * BENCH_SSRCS; ++i) {
+                uint32_t ssrc = htonl(0x10000 + i / BENCH_RUN_LEN % BENCH_SSRCS);
+                uint16_t seq = htons(i / BENCH_RUN_LEN / BENCH_SSRCS * BENCH_RUN_LEN + i % BENCH_RUN_LEN);
+                uint32_t ts = 0;
+                headers[i][0] = 0x80;
+                headers[i][1] = 20;
+                memcpy(&headers[i][2], &seq, sizeof seq);
+                memcpy(&headers[i][4], &ts, sizeof ts);
+                memcpy(&headers[i][8], &ssrc, sizeof ssrc);
+        }
+        for (int i = 0; i < BENCH_BATCH; ++i) {
+                packets[i] = calloc(1, RTP_MAX_PACKET_LEN);
+        }
+
+        pps_single = test_rtp_process(session, packets, headers, 1, count);
+        pps_batch = test_rtp_process(session, packets, headers, BENCH_BATCH, count);
+
+        for (int i = 0; i < BENCH_BATCH; ++i) {
+                free(packets[i]);
+        }
+        free(headers);
+        rtp_done(session);
+
+        if (pps_single < 0 || pps_batch < 0) {
+                return 1;
+        }
+
+        printf("Ok\n");
+        if (count != BENCH_PACKETS) {
+                return 0;
+        }
+        printf("  per-packet: %.2f M packets/s, batch of %d: %.2f M packets/s\n",
+                        pps_single / 1000000.0, BENCH_BATCH, pps_batch / 1000000.0);
         return 0;
 }
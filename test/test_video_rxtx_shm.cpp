@@ -0,0 +1,198 @@
+/**
+ * @file   test_video_rxtx_shm.cpp
+ * @brief  Shared memory video transport sender/receiver round trip
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "host.h"
+#include "module.h"
+#include "video.h"
+#include "video_codec.h"
+#include "video_display.h"
+#include "video_rxtx.h"
+
+extern "C" {
+#include "test_video_rxtx_shm.h"
+}
+
+using std::map;
+using std::shared_ptr;
+using std::string;
+using std::to_string;
+using std::vector;
+
+#ifdef HAVE_SHM_RXTX
+#define SEND_ATTEMPTS 50
+
+static bool display_supports_codec(struct display *d, codec_t codec)
+{
+        codec_t codecs[VIDEO_CODEC_COUNT];
+        size_t len = sizeof codecs;
+        if (!display_get_property(d, DISPLAY_PROPERTY_CODECS, codecs, &len)) {
+                return false;
+        }
+        for (size_t i = 0; i < len / sizeof(codec_t); ++i) {
+                if (codecs[i] == codec) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/**
+ * Sends a frame in codec to itself over a shm channel rendering to the dummy
+ * display and checks that the displayed frame is the sent one converted to
+ * the display codec.
+ */
+static int test_round_trip(struct module *root, codec_t codec)
+{
+        struct display *d = nullptr;
+        if (initialize_video_display(root, "dummy", NULL, 0, NULL, &d) != 0) {
+                printf("FAIL\n  cannot initialize dummy display\n");
+                return 1;
+        }
+
+        struct video_desc desc{};
+        desc.width = 96;
+        desc.height = 4;
+        desc.color_spec = codec;
+        desc.interlacing = PROGRESSIVE;
+        desc.fps = 30;
+        desc.tile_count = 1;
+        shared_ptr<video_frame> f(vf_alloc_desc_data(desc), vf_free);
+        for (unsigned int i = 0; i < f->tiles[0].data_len; ++i) {
+                f->tiles[0].data[i] = i * 7 + 3;
+        }
+
+        string opts = "name=test-" + to_string(getpid()) + "-" + get_codec_name(codec);
+        map<string, param_u> params;
+        params["parent"].ptr = root;
+        params["exporter"].ptr = NULL;
+        params["compression"].str = "none";
+        params["rxtx_mode"].i = MODE_SENDER | MODE_RECEIVER;
+        params["paused"].b = false;
+        params["display_device"].ptr = d;
+        params["opts"].str = opts.c_str();
+        video_rxtx *rxtx = nullptr;
+        try {
+                rxtx = video_rxtx::create("shm", params);
+        } catch (...) {
+        }
+        if (rxtx == nullptr) {
+                printf("FAIL\n  cannot create shm transport\n");
+                display_done(d);
+                return 1;
+        }
+
+        pthread_t receiver;
+        pthread_create(&receiver, NULL, video_rxtx::receiver_thread, rxtx);
+        // receiver displays only frames published after it has connected
+        for (int i = 0; i < SEND_ATTEMPTS; ++i) {
+                rxtx->send(f);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        should_exit = true;
+        pthread_join(receiver, NULL);
+        should_exit = false;
+        rxtx->join();
+        delete rxtx;
+
+        int ret = 0;
+        struct video_frame *displayed = display_get_frame(d);
+        if (displayed == nullptr || displayed->tiles[0].width != desc.width ||
+                        displayed->tiles[0].height != desc.height) {
+                printf("FAIL\n  %s: no frame displayed\n", get_codec_name(codec));
+                ret = 1;
+        } else if (!display_supports_codec(d, displayed->color_spec)) {
+                printf("FAIL\n  %s: displayed as %s not supported by display\n", get_codec_name(codec),
+                                get_codec_name(displayed->color_spec));
+                ret = 1;
+        } else {
+                decoder_t decode = get_decoder_from_to(codec, displayed->color_spec, true);
+                int src_linesize = vc_get_linesize(desc.width, codec);
+                int dst_linesize = vc_get_linesize(desc.width, displayed->color_spec);
+                vector<unsigned char> expected(dst_linesize);
+                for (unsigned int y = 0; y < desc.height && ret == 0; ++y) {
+                        decode(expected.data(), (unsigned char *) f->tiles[0].data + y * src_linesize, dst_linesize, 0, 8, 16);
+                        if (memcmp(expected.data(), displayed->tiles[0].data + y * dst_linesize, dst_linesize) != 0) {
+                                printf("FAIL\n  %s->%s: line %u differs\n", get_codec_name(codec),
+                                                get_codec_name(displayed->color_spec), y);
+                                ret = 1;
+                        }
+                }
+        }
+        display_done(d);
+        return ret;
+}
+#endif // defined HAVE_SHM_RXTX
+
+int test_video_rxtx_shm(void)
+{
+#ifdef HAVE_SHM_RXTX
+        printf
+            ("Testing shared memory video transport .................................... ");
+        struct module root;
+        module_init_default(&root);
+        root.cls = MODULE_CLASS_ROOT;
+
+        int ret = 0;
+        // natively supported by the display and converted with a line decoder
+        for (codec_t codec : { UYVY, DPX10 }) {
+                if (test_round_trip(&root, codec) != 0) {
+                        ret = 1;
+                        break;
+                }
+        }
+        module_done(&root);
+        if (ret == 0) {
+                printf("Ok\n");
+        }
+        return ret;
+#else
+        return 0;
+#endif
+}
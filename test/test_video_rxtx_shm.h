@@ -0,0 +1 @@
+int test_video_rxtx_shm(void);
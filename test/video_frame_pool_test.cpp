@@ -0,0 +1,98 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#ifdef HAVE_CPPUNIT
+
+#include <cppunit/config/SourcePrefix.h>
+#include <chrono>
+#include <future>
+#include <memory>
+#include "video_frame_pool_test.h"
+#include "utils/video_frame_pool.h"
+
+using std::async;
+using std::future;
+using std::future_status;
+using std::launch;
+using std::shared_ptr;
+using std::chrono::milliseconds;
+
+typedef video_frame_pool<default_data_allocator> test_pool;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( video_frame_pool_test );
+
+video_frame_pool_test::video_frame_pool_test()
+{
+}
+
+video_frame_pool_test::~video_frame_pool_test()
+{
+}
+
+void
+video_frame_pool_test::setUp()
+{
+}
+
+
+void
+video_frame_pool_test::tearDown()
+{
+}
+
+void
+video_frame_pool_test::test_limit()
+{
+        test_pool pool(2);
+        struct video_desc desc{64, 64, UYVY, 30, PROGRESSIVE, 1};
+        pool.reconfigure(desc, vc_get_datalen(desc.width, desc.height, desc.color_spec));
+
+        auto f1 = pool.get_frame();
+        auto f2 = pool.get_frame();
+        char *data1 = f1->tiles[0].data;
+        future<shared_ptr<video_frame>> f3 = async(launch::async, [&pool] { return pool.get_frame(); });
+        CPPUNIT_ASSERT(f3.wait_for(milliseconds(50)) == future_status::timeout);
+
+        f1.reset();
+        CPPUNIT_ASSERT(f3.wait_for(milliseconds(5000)) == future_status::ready);
+        CPPUNIT_ASSERT(f3.get()->tiles[0].data == data1); // recycled
+}
+
+/**
+ * Frames of the old generation are freed when returned, a blocked get_frame()
+ * must allocate a new one instead.
+ */
+void
+video_frame_pool_test::test_reconfigure_with_frames_out()
+{
+        test_pool pool(2);
+        struct video_desc desc{64, 64, UYVY, 30, PROGRESSIVE, 1};
+        pool.reconfigure(desc, vc_get_datalen(desc.width, desc.height, desc.color_spec));
+
+        auto f1 = pool.get_frame();
+        auto f2 = pool.get_frame();
+
+        struct video_desc new_desc{128, 32, RGBA, 30, PROGRESSIVE, 1};
+        size_t new_len = vc_get_datalen(new_desc.width, new_desc.height, new_desc.color_spec);
+        pool.reconfigure(new_desc, new_len);
+
+        future<shared_ptr<video_frame>> f3 = async(launch::async, [&pool] { return pool.get_frame(); });
+        CPPUNIT_ASSERT(f3.wait_for(milliseconds(50)) == future_status::timeout);
+
+        f1.reset();
+        CPPUNIT_ASSERT(f3.wait_for(milliseconds(5000)) == future_status::ready);
+        auto f = f3.get();
+        CPPUNIT_ASSERT_EQUAL(new_desc.width, f->tiles[0].width);
+        CPPUNIT_ASSERT_EQUAL(new_desc.color_spec, f->color_spec);
+        CPPUNIT_ASSERT_EQUAL(new_len, (size_t) f->tiles[0].data_len);
+
+        f2.reset();
+        auto f4 = pool.get_frame(); // allocated, old one freed as well
+        CPPUNIT_ASSERT_EQUAL(new_len, (size_t) f4->tiles[0].data_len);
+}
+
+#endif // defined HAVE_CPPUNIT
@@ -0,0 +1,23 @@
+#ifndef VIDEO_FRAME_POOL_TEST_H
+#define VIDEO_FRAME_POOL_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class video_frame_pool_test : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( video_frame_pool_test );
+  CPPUNIT_TEST( test_limit );
+  CPPUNIT_TEST( test_reconfigure_with_frames_out );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  video_frame_pool_test();
+  ~video_frame_pool_test();
+  void setUp();
+  void tearDown();
+
+  void test_limit();
+  void test_reconfigure_with_frames_out();
+};
+
+#endif //  VIDEO_FRAME_POOL_TEST_H